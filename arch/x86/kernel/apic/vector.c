@@ -804,6 +804,9 @@ int __init arch_early_irq_init(void)
 					 FIRST_SYSTEM_VECTOR);
 	BUG_ON(!vector_matrix);
 
+	/* Let managed affinity spreading see where vectors are allocated */
+	irq_affinity_set_load_matrix(vector_matrix);
+
 	return arch_early_ioapic_init();
 }
 
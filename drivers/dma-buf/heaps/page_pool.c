@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * DMA BUF page pool system
+ *
+ * Based on the ION page pool code
+ * Copyright (C) 2011 Google, Inc.
+ */
+
+#include <linux/highmem.h>
+#include <linux/kobject.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/shrinker.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+#include <linux/vmstat.h>
+
+#include "page_pool.h"
+
+static LIST_HEAD(pool_list);
+static DEFINE_MUTEX(pool_list_lock);
+
+static void dmabuf_page_pool_clear(struct dmabuf_page_pool *pool,
+				   struct page *page)
+{
+	unsigned int i;
+
+	for (i = 0; i < (1 << pool->order); i++)
+		clear_highpage(page + i);
+}
+
+/* The pooled pages are accounted as reclaimable, they are in meminfo */
+static void dmabuf_page_pool_account(struct dmabuf_page_pool *pool,
+				     struct page *page, int sign)
+{
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+			    sign * (1 << pool->order));
+}
+
+static void dmabuf_page_pool_zero_work(struct work_struct *work)
+{
+	struct dmabuf_page_pool *pool;
+	struct page *page;
+
+	pool = container_of(work, struct dmabuf_page_pool, zero_work);
+	for (;;) {
+		spin_lock(&pool->lock);
+		page = list_first_entry_or_null(&pool->dirty, struct page, lru);
+		if (!page) {
+			spin_unlock(&pool->lock);
+			break;
+		}
+		list_del(&page->lru);
+		pool->dirty_count--;
+		spin_unlock(&pool->lock);
+
+		dmabuf_page_pool_clear(pool, page);
+
+		spin_lock(&pool->lock);
+		list_add_tail(&page->lru, &pool->clean);
+		pool->clean_count++;
+		spin_unlock(&pool->lock);
+
+		cond_resched();
+	}
+}
+
+/**
+ * dmabuf_page_pool_alloc - get a cleared page from the pool
+ * @pool: the pool to allocate from
+ *
+ * Prefers the pages already cleared in the background, then the pages
+ * waiting to be cleared, and only then goes to the page allocator.
+ *
+ * Returns the page, or NULL if none could be allocated.
+ */
+struct page *dmabuf_page_pool_alloc(struct dmabuf_page_pool *pool)
+{
+	struct page *page;
+	bool dirty = false;
+
+	spin_lock(&pool->lock);
+	page = list_first_entry_or_null(&pool->clean, struct page, lru);
+	if (page) {
+		pool->clean_count--;
+		pool->hits++;
+	} else {
+		page = list_first_entry_or_null(&pool->dirty, struct page, lru);
+		if (page) {
+			pool->dirty_count--;
+			pool->dirty_hits++;
+			dirty = true;
+		} else {
+			pool->misses++;
+		}
+	}
+	if (page)
+		list_del(&page->lru);
+	spin_unlock(&pool->lock);
+
+	if (!page)
+		return alloc_pages(pool->gfp_mask, pool->order);
+
+	dmabuf_page_pool_account(pool, page, -1);
+	if (dirty)
+		dmabuf_page_pool_clear(pool, page);
+	return page;
+}
+
+/**
+ * dmabuf_page_pool_free - give a page back to the pool
+ * @pool: the pool the page was allocated from
+ * @page: the page
+ *
+ * The page is kept until the shrinker gives it back to the page allocator,
+ * it is cleared in the background in the meantime.
+ */
+void dmabuf_page_pool_free(struct dmabuf_page_pool *pool, struct page *page)
+{
+	if (WARN_ON(pool->order != compound_order(page))) {
+		__free_pages(page, compound_order(page));
+		return;
+	}
+
+	spin_lock(&pool->lock);
+	list_add_tail(&page->lru, &pool->dirty);
+	pool->dirty_count++;
+	spin_unlock(&pool->lock);
+
+	dmabuf_page_pool_account(pool, page, 1);
+	queue_work(system_unbound_wq, &pool->zero_work);
+}
+
+/* Give back up to @nr_to_scan pages, the ones not cleared yet first */
+static unsigned long dmabuf_page_pool_shrink(struct dmabuf_page_pool *pool,
+					     unsigned long nr_to_scan)
+{
+	unsigned long freed = 0;
+	struct page *page;
+
+	while (freed < nr_to_scan) {
+		spin_lock(&pool->lock);
+		page = list_first_entry_or_null(&pool->dirty, struct page, lru);
+		if (page) {
+			pool->dirty_count--;
+		} else {
+			page = list_first_entry_or_null(&pool->clean,
+							struct page, lru);
+			if (!page) {
+				spin_unlock(&pool->lock);
+				break;
+			}
+			pool->clean_count--;
+		}
+		list_del(&page->lru);
+		pool->shrunk++;
+		spin_unlock(&pool->lock);
+
+		dmabuf_page_pool_account(pool, page, -1);
+		__free_pages(page, pool->order);
+		freed += 1 << pool->order;
+	}
+
+	return freed;
+}
+
+static unsigned long dmabuf_page_pool_count(struct dmabuf_page_pool *pool)
+{
+	return (READ_ONCE(pool->dirty_count) + READ_ONCE(pool->clean_count))
+		<< pool->order;
+}
+
+/**
+ * dmabuf_page_pool_create - create a pool of pages
+ * @gfp_mask: flags for the allocations from the page allocator, the pages
+ *	      must come out cleared (__GFP_ZERO)
+ * @order: order of the pages in the pool
+ *
+ * Returns the pool, or NULL on allocation failure.
+ */
+struct dmabuf_page_pool *dmabuf_page_pool_create(gfp_t gfp_mask,
+						 unsigned int order)
+{
+	struct dmabuf_page_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->dirty);
+	INIT_LIST_HEAD(&pool->clean);
+	INIT_WORK(&pool->zero_work, dmabuf_page_pool_zero_work);
+	pool->gfp_mask = gfp_mask | __GFP_COMP;
+	pool->order = order;
+
+	mutex_lock(&pool_list_lock);
+	list_add(&pool->list, &pool_list);
+	mutex_unlock(&pool_list_lock);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_create);
+
+void dmabuf_page_pool_destroy(struct dmabuf_page_pool *pool)
+{
+	mutex_lock(&pool_list_lock);
+	list_del(&pool->list);
+	mutex_unlock(&pool_list_lock);
+
+	cancel_work_sync(&pool->zero_work);
+	dmabuf_page_pool_shrink(pool, ULONG_MAX);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_destroy);
+
+static unsigned long dmabuf_page_pool_shrink_count(struct shrinker *shrinker,
+						   struct shrink_control *sc)
+{
+	struct dmabuf_page_pool *pool;
+	unsigned long count = 0;
+
+	mutex_lock(&pool_list_lock);
+	list_for_each_entry(pool, &pool_list, list)
+		count += dmabuf_page_pool_count(pool);
+	mutex_unlock(&pool_list_lock);
+
+	return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long dmabuf_page_pool_shrink_scan(struct shrinker *shrinker,
+						  struct shrink_control *sc)
+{
+	struct dmabuf_page_pool *pool;
+	unsigned long freed = 0;
+
+	mutex_lock(&pool_list_lock);
+	list_for_each_entry(pool, &pool_list, list) {
+		freed += dmabuf_page_pool_shrink(pool, sc->nr_to_scan - freed);
+		if (freed >= sc->nr_to_scan)
+			break;
+	}
+	mutex_unlock(&pool_list_lock);
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker pool_shrinker = {
+	.count_objects = dmabuf_page_pool_shrink_count,
+	.scan_objects = dmabuf_page_pool_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+	.batch = 0,
+};
+
+/*
+ * Statistics of all the pools, in pages, under /sys/kernel/dmabuf_page_pool
+ */
+#define DMABUF_PAGE_POOL_STAT(_name, _expr)				\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	struct dmabuf_page_pool *pool;					\
+	unsigned long val = 0;						\
+									\
+	mutex_lock(&pool_list_lock);					\
+	list_for_each_entry(pool, &pool_list, list)			\
+		val += (_expr) << pool->order;				\
+	mutex_unlock(&pool_list_lock);					\
+									\
+	return sysfs_emit(buf, "%lu\n", val);				\
+}									\
+static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+
+DMABUF_PAGE_POOL_STAT(pages, READ_ONCE(pool->dirty_count) +
+			     READ_ONCE(pool->clean_count));
+DMABUF_PAGE_POOL_STAT(zeroed_pages, READ_ONCE(pool->clean_count));
+DMABUF_PAGE_POOL_STAT(hits, READ_ONCE(pool->hits));
+DMABUF_PAGE_POOL_STAT(dirty_hits, READ_ONCE(pool->dirty_hits));
+DMABUF_PAGE_POOL_STAT(misses, READ_ONCE(pool->misses));
+DMABUF_PAGE_POOL_STAT(shrunk, READ_ONCE(pool->shrunk));
+
+static struct attribute *dmabuf_page_pool_attrs[] = {
+	&pages_attr.attr,
+	&zeroed_pages_attr.attr,
+	&hits_attr.attr,
+	&dirty_hits_attr.attr,
+	&misses_attr.attr,
+	&shrunk_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group dmabuf_page_pool_attr_group = {
+	.attrs = dmabuf_page_pool_attrs,
+};
+
+static int __init dmabuf_page_pool_init(void)
+{
+	struct kobject *kobj;
+	int ret;
+
+	ret = register_shrinker(&pool_shrinker);
+	if (ret)
+		return ret;
+
+	kobj = kobject_create_and_add("dmabuf_page_pool", kernel_kobj);
+	if (!kobj)
+		return 0;
+
+	if (sysfs_create_group(kobj, &dmabuf_page_pool_attr_group))
+		kobject_put(kobj);
+
+	return 0;
+}
+module_init(dmabuf_page_pool_init);
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * DMA BUF page pool system
+ *
+ * Based on the ION page pool code
+ * Copyright (C) 2011 Google, Inc.
+ */
+
+#ifndef _DMABUF_PAGE_POOL_H
+#define _DMABUF_PAGE_POOL_H
+
+#include <linux/list.h>
+#include <linux/mm_types.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+/**
+ * struct dmabuf_page_pool - pagepool struct
+ * @lock:		protects the lists and counters
+ * @dirty:		pages given back to the pool, not cleared yet
+ * @clean:		pages cleared by @zero_work, ready to be handed out
+ * @dirty_count:	number of pages on @dirty
+ * @clean_count:	number of pages on @clean
+ * @hits:		allocations served with a cleared page
+ * @dirty_hits:		allocations served with a page cleared on the spot
+ * @misses:		allocations that went to the page allocator
+ * @shrunk:		pages given back to the page allocator by the shrinker
+ * @gfp_mask:		gfp_mask to use for allocations from the page allocator
+ * @order:		order of pages in the pool
+ * @zero_work:		clears the pages on @dirty in the background
+ * @list:		list node for the list of pools
+ *
+ * Allows you to keep a pool of pages of a given order around instead of
+ * going back to the page allocator for every buffer.  The pages given back
+ * to the pool are cleared in the background, so that allocations don't
+ * have to pay for it.
+ */
+struct dmabuf_page_pool {
+	spinlock_t lock;
+	struct list_head dirty;
+	struct list_head clean;
+	unsigned long dirty_count;
+	unsigned long clean_count;
+	unsigned long hits;
+	unsigned long dirty_hits;
+	unsigned long misses;
+	unsigned long shrunk;
+	gfp_t gfp_mask;
+	unsigned int order;
+	struct work_struct zero_work;
+	struct list_head list;
+};
+
+struct dmabuf_page_pool *dmabuf_page_pool_create(gfp_t gfp_mask,
+						 unsigned int order);
+void dmabuf_page_pool_destroy(struct dmabuf_page_pool *pool);
+struct page *dmabuf_page_pool_alloc(struct dmabuf_page_pool *pool);
+void dmabuf_page_pool_free(struct dmabuf_page_pool *pool, struct page *page);
+
+#endif /* _DMABUF_PAGE_POOL_H */
@@ -69,6 +69,7 @@
 struct vring_desc_state_split {
 	void *data;			/* Data for callback. */
 	struct vring_desc *indir_desc;	/* Indirect descriptor, if any. */
+	u32 total_in_len;		/* Length of the device writable part. */
 };
 
 struct vring_desc_state_packed {
@@ -106,6 +107,9 @@ struct vring_virtqueue {
 	/* Host publishes avail event idx */
 	bool event;
 
+	/* Host uses the buffers in the order they were made available */
+	bool in_order;
+
 	/* Head of free buffer list. */
 	unsigned int free_head;
 	/* Number we've added since last sync. */
@@ -132,6 +136,23 @@ struct vring_virtqueue {
 			 */
 			u16 avail_idx_shadow;
 
+			/*
+			 * Next used ring entry to look at.  It only differs
+			 * from last_used_idx, which counts buffers, when the
+			 * device writes a single entry for a batch of in order
+			 * buffers.
+			 */
+			u16 last_used_entry;
+
+			/*
+			 * Used entry of the in order batch being drained, id
+			 * is UINT_MAX if there is none.
+			 */
+			struct {
+				u32 id;
+				u32 len;
+			} batch_last;
+
 			/* Per-descriptor state. */
 			struct vring_desc_state_split *desc_state;
 			struct vring_desc_extra *desc_extra;
@@ -169,6 +190,14 @@ struct vring_virtqueue {
 			 */
 			u16 event_flags_shadow;
 
+			/*
+			 * Head of the first buffer of a batch being added, and
+			 * the flags that will make the whole batch available.
+			 */
+			bool batch_pending;
+			u16 batch_head;
+			__le16 batch_head_flags;
+
 			/* Per-descriptor state. */
 			struct vring_desc_state_packed *desc_state;
 			struct vring_desc_extra *desc_extra;
@@ -467,6 +496,16 @@ static inline unsigned int virtqueue_add_desc_split(struct virtqueue *vq,
 	return next;
 }
 
+/* Expose the available entries added so far to the other side. */
+static inline void virtqueue_publish_avail_split(struct vring_virtqueue *vq)
+{
+	/* Descriptors and available array need to be set before we expose the
+	 * new available array entries. */
+	virtio_wmb(vq->weak_barriers);
+	vq->split.vring.avail->idx = cpu_to_virtio16(vq->vq.vdev,
+						vq->split.avail_idx_shadow);
+}
+
 static inline int virtqueue_add_split(struct virtqueue *_vq,
 				      struct scatterlist *sgs[],
 				      unsigned int total_sg,
@@ -474,12 +513,14 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 				      unsigned int in_sgs,
 				      void *data,
 				      void *ctx,
+				      bool more,
 				      gfp_t gfp)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	struct scatterlist *sg;
 	struct vring_desc *desc;
 	unsigned int i, n, avail, descs_used, prev, err_idx;
+	u32 total_in_len = 0;
 	int head;
 	bool indirect;
 
@@ -563,6 +604,7 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 						     VRING_DESC_F_NEXT |
 						     VRING_DESC_F_WRITE,
 						     indirect);
+			total_in_len += sg->length;
 		}
 	}
 	/* Last one doesn't continue. */
@@ -597,6 +639,7 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 
 	/* Store token and indirect buffer state. */
 	vq->split.desc_state[head].data = data;
+	vq->split.desc_state[head].total_in_len = total_in_len;
 	if (indirect)
 		vq->split.desc_state[head].indir_desc = desc;
 	else
@@ -607,21 +650,23 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 	avail = vq->split.avail_idx_shadow & (vq->split.vring.num - 1);
 	vq->split.vring.avail->ring[avail] = cpu_to_virtio16(_vq->vdev, head);
 
-	/* Descriptors and available array need to be set before we expose the
-	 * new available array entries. */
-	virtio_wmb(vq->weak_barriers);
 	vq->split.avail_idx_shadow++;
-	vq->split.vring.avail->idx = cpu_to_virtio16(_vq->vdev,
-						vq->split.avail_idx_shadow);
 	vq->num_added++;
 
+	/* The rest of a batch follows, avail->idx is written once for all. */
+	if (!more)
+		virtqueue_publish_avail_split(vq);
+
 	pr_debug("Added buffer head %i to %p\n", head, vq);
 	END_USE(vq);
 
 	/* This is very unlikely, but theoretically possible.  Kick
 	 * just in case. */
-	if (unlikely(vq->num_added == (1 << 16) - 1))
+	if (unlikely(vq->num_added == (1 << 16) - 1)) {
+		if (more)
+			virtqueue_publish_avail_split(vq);
 		virtqueue_kick(_vq);
+	}
 
 	return 0;
 
@@ -733,18 +778,88 @@ static void detach_buf_split(struct vring_virtqueue *vq, unsigned int head,
 
 static inline bool more_used_split(const struct vring_virtqueue *vq)
 {
-	return vq->last_used_idx != virtio16_to_cpu(vq->vq.vdev,
+	return vq->split.last_used_entry != virtio16_to_cpu(vq->vq.vdev,
 			vq->split.vring.used->idx);
 }
 
+/*
+ * Detach the buffer of the next used entry, the caller made sure there is
+ * one and ordered the reads below after the read of used->idx.
+ */
+static void *detach_used_buf_split(struct vring_virtqueue *vq,
+				   unsigned int *len, void **ctx)
+{
+	struct virtio_device *vdev = vq->vq.vdev;
+	u16 mask = vq->split.vring.num - 1;
+	u16 last_used = vq->split.last_used_entry & mask;
+	unsigned int i;
+	void *ret;
+
+	if (vq->in_order) {
+		/*
+		 * The buffers are used in the order they were made
+		 * available, but the device may write a single used entry,
+		 * for the last buffer, for a whole batch of them: the ones
+		 * before it were fully written.  Walk the avail ring up to
+		 * the buffer of the entry before moving on to the next one.
+		 */
+		if (vq->split.batch_last.id == UINT_MAX) {
+			vq->split.batch_last.id = virtio32_to_cpu(vdev,
+					vq->split.vring.used->ring[last_used].id);
+			vq->split.batch_last.len = virtio32_to_cpu(vdev,
+					vq->split.vring.used->ring[last_used].len);
+		}
+		i = virtio16_to_cpu(vdev,
+			vq->split.vring.avail->ring[vq->last_used_idx & mask]);
+		if (vq->split.batch_last.id == i) {
+			vq->split.batch_last.id = UINT_MAX;
+			vq->split.last_used_entry++;
+			*len = vq->split.batch_last.len;
+		} else {
+			*len = vq->split.desc_state[i].total_in_len;
+		}
+	} else {
+		i = virtio32_to_cpu(vdev, vq->split.vring.used->ring[last_used].id);
+		*len = virtio32_to_cpu(vdev,
+				vq->split.vring.used->ring[last_used].len);
+		vq->split.last_used_entry++;
+	}
+
+	if (unlikely(i >= vq->split.vring.num)) {
+		BAD_RING(vq, "id %u out of range\n", i);
+		return NULL;
+	}
+	if (unlikely(!vq->split.desc_state[i].data)) {
+		BAD_RING(vq, "id %u is not a head!\n", i);
+		return NULL;
+	}
+
+	/* detach_buf_split clears data, so grab it now. */
+	ret = vq->split.desc_state[i].data;
+	detach_buf_split(vq, i, ctx);
+	vq->last_used_idx++;
+
+	return ret;
+}
+
+/* If we expect an interrupt for the next entry, tell host
+ * by writing event index and flush out the write before
+ * the read in the next get_buf call. */
+static inline void virtqueue_update_used_event_split(struct vring_virtqueue *vq)
+{
+	if (!(vq->split.avail_flags_shadow & VRING_AVAIL_F_NO_INTERRUPT))
+		virtio_store_mb(vq->weak_barriers,
+				&vring_used_event(&vq->split.vring),
+				cpu_to_virtio16(vq->vq.vdev,
+						vq->split.last_used_entry));
+}
+
 static void *virtqueue_get_buf_ctx_split(struct virtqueue *_vq,
 					 unsigned int *len,
 					 void **ctx)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	void *ret;
-	unsigned int i;
-	u16 last_used;
 
 	START_USE(vq);
 
@@ -762,37 +877,59 @@ static void *virtqueue_get_buf_ctx_split(struct virtqueue *_vq,
 	/* Only get used array entries after they have been exposed by host. */
 	virtio_rmb(vq->weak_barriers);
 
-	last_used = (vq->last_used_idx & (vq->split.vring.num - 1));
-	i = virtio32_to_cpu(_vq->vdev,
-			vq->split.vring.used->ring[last_used].id);
-	*len = virtio32_to_cpu(_vq->vdev,
-			vq->split.vring.used->ring[last_used].len);
-
-	if (unlikely(i >= vq->split.vring.num)) {
-		BAD_RING(vq, "id %u out of range\n", i);
+	ret = detach_used_buf_split(vq, len, ctx);
+	if (!ret)
 		return NULL;
+
+	virtqueue_update_used_event_split(vq);
+
+	LAST_ADD_TIME_INVALID(vq);
+
+	END_USE(vq);
+	return ret;
+}
+
+static unsigned int virtqueue_get_bufs_split(struct virtqueue *_vq,
+					     void **bufs, unsigned int *lens,
+					     unsigned int num)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n;
+	u16 used_idx;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return 0;
 	}
-	if (unlikely(!vq->split.desc_state[i].data)) {
-		BAD_RING(vq, "id %u is not a head!\n", i);
-		return NULL;
+
+	/*
+	 * With VIRTIO_F_IN_ORDER a used entry may stand for several
+	 * buffers, so count entries, not buffers.
+	 */
+	used_idx = virtio16_to_cpu(_vq->vdev, vq->split.vring.used->idx);
+	if (vq->split.last_used_entry == used_idx) {
+		pr_debug("No more buffers in queue\n");
+		END_USE(vq);
+		return 0;
 	}
 
-	/* detach_buf_split clears data, so grab it now. */
-	ret = vq->split.desc_state[i].data;
-	detach_buf_split(vq, i, ctx);
-	vq->last_used_idx++;
-	/* If we expect an interrupt for the next entry, tell host
-	 * by writing event index and flush out the write before
-	 * the read in the next get_buf call. */
-	if (!(vq->split.avail_flags_shadow & VRING_AVAIL_F_NO_INTERRUPT))
-		virtio_store_mb(vq->weak_barriers,
-				&vring_used_event(&vq->split.vring),
-				cpu_to_virtio16(_vq->vdev, vq->last_used_idx));
+	/* Only get used array entries after they have been exposed by host. */
+	virtio_rmb(vq->weak_barriers);
+
+	for (n = 0; n < num && vq->split.last_used_entry != used_idx; n++) {
+		bufs[n] = detach_used_buf_split(vq, &lens[n], NULL);
+		if (!bufs[n])
+			return n;
+	}
+
+	virtqueue_update_used_event_split(vq);
 
 	LAST_ADD_TIME_INVALID(vq);
 
 	END_USE(vq);
-	return ret;
+	return n;
 }
 
 static void virtqueue_disable_cb_split(struct virtqueue *_vq)
@@ -831,7 +968,7 @@ static unsigned virtqueue_enable_cb_prepare_split(struct virtqueue *_vq)
 						vq->split.avail_flags_shadow);
 	}
 	vring_used_event(&vq->split.vring) = cpu_to_virtio16(_vq->vdev,
-			last_used_idx = vq->last_used_idx);
+			last_used_idx = vq->split.last_used_entry);
 	END_USE(vq);
 	return last_used_idx;
 }
@@ -863,15 +1000,24 @@ static bool virtqueue_enable_cb_delayed_split(struct virtqueue *_vq)
 				cpu_to_virtio16(_vq->vdev,
 						vq->split.avail_flags_shadow);
 	}
-	/* TODO: tune this threshold */
-	bufs = (u16)(vq->split.avail_idx_shadow - vq->last_used_idx) * 3 / 4;
+	/*
+	 * TODO: tune this threshold.  An in order device may write a single
+	 * used entry for all the outstanding buffers, so only the next entry
+	 * can be waited for.
+	 */
+	if (vq->in_order)
+		bufs = 0;
+	else
+		bufs = (u16)(vq->split.avail_idx_shadow -
+			     vq->last_used_idx) * 3 / 4;
 
 	virtio_store_mb(vq->weak_barriers,
 			&vring_used_event(&vq->split.vring),
-			cpu_to_virtio16(_vq->vdev, vq->last_used_idx + bufs));
+			cpu_to_virtio16(_vq->vdev,
+					vq->split.last_used_entry + bufs));
 
 	if (unlikely((u16)(virtio16_to_cpu(_vq->vdev, vq->split.vring.used->idx)
-					- vq->last_used_idx) > bufs)) {
+					- vq->split.last_used_entry) > bufs)) {
 		END_USE(vq);
 		return false;
 	}
@@ -1033,12 +1179,50 @@ static struct vring_packed_desc *alloc_indirect_packed(unsigned int total_sg,
 	return desc;
 }
 
+/*
+ * Make the buffer starting at @head available by writing its head flags.
+ *
+ * A driver MUST NOT make the first descriptor in the list available
+ * before all subsequent descriptors comprising the list are made
+ * available.  While a batch is being added, its first head is held back
+ * instead: the device can't walk past it, so the heads of the following
+ * buffers can be written without a barrier and the batch is exposed at
+ * once by virtqueue_publish_batch_packed().
+ */
+static inline void virtqueue_publish_head_packed(struct vring_virtqueue *vq,
+						 u16 head, __le16 head_flags,
+						 bool more)
+{
+	if (vq->packed.batch_pending) {
+		vq->packed.vring.desc[head].flags = head_flags;
+	} else if (more) {
+		vq->packed.batch_pending = true;
+		vq->packed.batch_head = head;
+		vq->packed.batch_head_flags = head_flags;
+	} else {
+		virtio_wmb(vq->weak_barriers);
+		vq->packed.vring.desc[head].flags = head_flags;
+	}
+}
+
+static inline void virtqueue_publish_batch_packed(struct vring_virtqueue *vq)
+{
+	if (!vq->packed.batch_pending)
+		return;
+
+	virtio_wmb(vq->weak_barriers);
+	vq->packed.vring.desc[vq->packed.batch_head].flags =
+		vq->packed.batch_head_flags;
+	vq->packed.batch_pending = false;
+}
+
 static int virtqueue_add_indirect_packed(struct vring_virtqueue *vq,
 					 struct scatterlist *sgs[],
 					 unsigned int total_sg,
 					 unsigned int out_sgs,
 					 unsigned int in_sgs,
 					 void *data,
+					 bool more,
 					 gfp_t gfp)
 {
 	struct vring_packed_desc *desc;
@@ -1098,14 +1282,10 @@ static int virtqueue_add_indirect_packed(struct vring_virtqueue *vq,
 						  vq->packed.avail_used_flags;
 	}
 
-	/*
-	 * A driver MUST NOT make the first descriptor in the list
-	 * available before all subsequent descriptors comprising
-	 * the list are made available.
-	 */
-	virtio_wmb(vq->weak_barriers);
-	vq->packed.vring.desc[head].flags = cpu_to_le16(VRING_DESC_F_INDIRECT |
-						vq->packed.avail_used_flags);
+	virtqueue_publish_head_packed(vq, head,
+				      cpu_to_le16(VRING_DESC_F_INDIRECT |
+						  vq->packed.avail_used_flags),
+				      more);
 
 	/* We're using some buffers from the free list. */
 	vq->vq.num_free -= 1;
@@ -1154,6 +1334,7 @@ static inline int virtqueue_add_packed(struct virtqueue *_vq,
 				       unsigned int in_sgs,
 				       void *data,
 				       void *ctx,
+				       bool more,
 				       gfp_t gfp)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
@@ -1180,7 +1361,7 @@ static inline int virtqueue_add_packed(struct virtqueue *_vq,
 
 	if (virtqueue_use_indirect(_vq, total_sg)) {
 		err = virtqueue_add_indirect_packed(vq, sgs, total_sg, out_sgs,
-						    in_sgs, data, gfp);
+						    in_sgs, data, more, gfp);
 		if (err != -ENOMEM) {
 			END_USE(vq);
 			return err;
@@ -1263,13 +1444,7 @@ static inline int virtqueue_add_packed(struct virtqueue *_vq,
 	vq->packed.desc_state[id].indir_desc = ctx;
 	vq->packed.desc_state[id].last = prev;
 
-	/*
-	 * A driver MUST NOT make the first descriptor in the list
-	 * available before all subsequent descriptors comprising
-	 * the list are made available.
-	 */
-	virtio_wmb(vq->weak_barriers);
-	vq->packed.vring.desc[head].flags = head_flags;
+	virtqueue_publish_head_packed(vq, head, head_flags, more);
 	vq->num_added += descs_used;
 
 	pr_debug("Added buffer head %i to %p\n", head, vq);
@@ -1412,30 +1587,16 @@ static inline bool more_used_packed(const struct vring_virtqueue *vq)
 			vq->packed.used_wrap_counter);
 }
 
-static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
-					  unsigned int *len,
-					  void **ctx)
+/*
+ * Detach the buffer of the next used descriptor, the caller made sure there
+ * is one and ordered the reads below after the read of its flags.
+ */
+static void *detach_used_buf_packed(struct vring_virtqueue *vq,
+				    unsigned int *len, void **ctx)
 {
-	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 last_used, id;
 	void *ret;
 
-	START_USE(vq);
-
-	if (unlikely(vq->broken)) {
-		END_USE(vq);
-		return NULL;
-	}
-
-	if (!more_used_packed(vq)) {
-		pr_debug("No more buffers in queue\n");
-		END_USE(vq);
-		return NULL;
-	}
-
-	/* Only get used elements after they have been exposed by host. */
-	virtio_rmb(vq->weak_barriers);
-
 	last_used = vq->last_used_idx;
 	id = le16_to_cpu(vq->packed.vring.desc[last_used].id);
 	*len = le32_to_cpu(vq->packed.vring.desc[last_used].len);
@@ -1459,17 +1620,52 @@ static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
 		vq->packed.used_wrap_counter ^= 1;
 	}
 
-	/*
-	 * If we expect an interrupt for the next entry, tell host
-	 * by writing event index and flush out the write before
-	 * the read in the next get_buf call.
-	 */
+	return ret;
+}
+
+/*
+ * If we expect an interrupt for the next entry, tell host
+ * by writing event index and flush out the write before
+ * the read in the next get_buf call.
+ */
+static inline void virtqueue_update_used_event_packed(struct vring_virtqueue *vq)
+{
 	if (vq->packed.event_flags_shadow == VRING_PACKED_EVENT_FLAG_DESC)
 		virtio_store_mb(vq->weak_barriers,
 				&vq->packed.vring.driver->off_wrap,
 				cpu_to_le16(vq->last_used_idx |
 					(vq->packed.used_wrap_counter <<
 					 VRING_PACKED_EVENT_F_WRAP_CTR)));
+}
+
+static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
+					  unsigned int *len,
+					  void **ctx)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	void *ret;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return NULL;
+	}
+
+	if (!more_used_packed(vq)) {
+		pr_debug("No more buffers in queue\n");
+		END_USE(vq);
+		return NULL;
+	}
+
+	/* Only get used elements after they have been exposed by host. */
+	virtio_rmb(vq->weak_barriers);
+
+	ret = detach_used_buf_packed(vq, len, ctx);
+	if (!ret)
+		return NULL;
+
+	virtqueue_update_used_event_packed(vq);
 
 	LAST_ADD_TIME_INVALID(vq);
 
@@ -1477,6 +1673,48 @@ static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
 	return ret;
 }
 
+static unsigned int virtqueue_get_bufs_packed(struct virtqueue *_vq,
+					      void **bufs, unsigned int *lens,
+					      unsigned int num)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return 0;
+	}
+
+	/*
+	 * Where the next used element is depends on the length of the
+	 * previous one, so each of them has to be checked in turn, but the
+	 * event index is only updated once.
+	 */
+	for (n = 0; n < num && more_used_packed(vq); n++) {
+		/* Only get used elements after they have been exposed by host. */
+		virtio_rmb(vq->weak_barriers);
+
+		bufs[n] = detach_used_buf_packed(vq, &lens[n], NULL);
+		if (!bufs[n])
+			return n;
+	}
+
+	if (!n) {
+		pr_debug("No more buffers in queue\n");
+		END_USE(vq);
+		return 0;
+	}
+
+	virtqueue_update_used_event_packed(vq);
+
+	LAST_ADD_TIME_INVALID(vq);
+
+	END_USE(vq);
+	return n;
+}
+
 static void virtqueue_disable_cb_packed(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
@@ -1704,6 +1942,7 @@ static struct virtqueue *vring_create_virtqueue_packed(
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
 		!context;
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	vq->in_order = false;
 
 	if (virtio_has_feature(vdev, VIRTIO_F_ORDER_PLATFORM))
 		vq->weak_barriers = false;
@@ -1725,6 +1964,7 @@ static struct virtqueue *vring_create_virtqueue_packed(
 	vq->packed.used_wrap_counter = 1;
 	vq->packed.event_flags_shadow = 0;
 	vq->packed.avail_used_flags = 1 << VRING_PACKED_DESC_F_AVAIL;
+	vq->packed.batch_pending = false;
 
 	vq->packed.desc_state = kmalloc_array(num,
 			sizeof(struct vring_desc_state_packed),
@@ -1785,9 +2025,9 @@ static inline int virtqueue_add(struct virtqueue *_vq,
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
 	return vq->packed_ring ? virtqueue_add_packed(_vq, sgs, total_sg,
-					out_sgs, in_sgs, data, ctx, gfp) :
+					out_sgs, in_sgs, data, ctx, false, gfp) :
 				 virtqueue_add_split(_vq, sgs, total_sg,
-					out_sgs, in_sgs, data, ctx, gfp);
+					out_sgs, in_sgs, data, ctx, false, gfp);
 }
 
 /**
@@ -1825,6 +2065,64 @@ int virtqueue_add_sgs(struct virtqueue *_vq,
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_sgs);
 
+/**
+ * virtqueue_add_sgs_batch - expose several buffers to other end at once
+ * @_vq: the struct virtqueue we're talking about.
+ * @bufs: the buffers to add, see virtqueue_add_sgs() for their fields.
+ * @num: the number of entries in @bufs.
+ * @gfp: how to do memory allocations (if necessary).
+ *
+ * Same as calling virtqueue_add_sgs() for each buffer in turn, except that
+ * the buffers are exposed to the other side with a single barrier and
+ * index (or head flags, for packed rings) update.  Buffers are added in
+ * order until one of them fails to be added.
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ *
+ * Returns the number of buffers added, or a negative error (ie. ENOSPC,
+ * ENOMEM, EIO) if the first one could not be added.
+ */
+int virtqueue_add_sgs_batch(struct virtqueue *_vq,
+			    struct virtqueue_buf *bufs,
+			    unsigned int num,
+			    gfp_t gfp)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int i, n, total_sg;
+	int err = 0;
+
+	for (n = 0; n < num; n++) {
+		struct virtqueue_buf *buf = &bufs[n];
+
+		total_sg = 0;
+		for (i = 0; i < buf->out_sgs + buf->in_sgs; i++) {
+			struct scatterlist *sg;
+
+			for (sg = buf->sgs[i]; sg; sg = sg_next(sg))
+				total_sg++;
+		}
+
+		err = vq->packed_ring ?
+			virtqueue_add_packed(_vq, buf->sgs, total_sg,
+					     buf->out_sgs, buf->in_sgs,
+					     buf->data, NULL, true, gfp) :
+			virtqueue_add_split(_vq, buf->sgs, total_sg,
+					    buf->out_sgs, buf->in_sgs,
+					    buf->data, NULL, true, gfp);
+		if (err)
+			break;
+	}
+
+	if (vq->packed_ring)
+		virtqueue_publish_batch_packed(vq);
+	else if (n)
+		virtqueue_publish_avail_split(vq);
+
+	return n ? n : err;
+}
+EXPORT_SYMBOL_GPL(virtqueue_add_sgs_batch);
+
 /**
  * virtqueue_add_outbuf - expose output buffers to other end
  * @vq: the struct virtqueue we're talking about.
@@ -1984,6 +2282,33 @@ void *virtqueue_get_buf_ctx(struct virtqueue *_vq, unsigned int *len,
 }
 EXPORT_SYMBOL_GPL(virtqueue_get_buf_ctx);
 
+/**
+ * virtqueue_get_bufs - get several used buffers at once
+ * @_vq: the struct virtqueue we're talking about.
+ * @bufs: where to store the "data" tokens of the used buffers.
+ * @lens: where to store the lengths written into the used buffers.
+ * @num: the size of @bufs and @lens.
+ *
+ * Same as calling virtqueue_get_buf() until it returns NULL or @num
+ * buffers were returned, except that the event index telling the other
+ * side when to interrupt us is only updated once.
+ *
+ * Caller must ensure we don't call this with other virtqueue
+ * operations at the same time (except where noted).
+ *
+ * Returns the number of used buffers stored in @bufs.
+ */
+unsigned int virtqueue_get_bufs(struct virtqueue *_vq, void **bufs,
+				unsigned int *lens, unsigned int num)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	return vq->packed_ring ?
+		virtqueue_get_bufs_packed(_vq, bufs, lens, num) :
+		virtqueue_get_bufs_split(_vq, bufs, lens, num);
+}
+EXPORT_SYMBOL_GPL(virtqueue_get_bufs);
+
 void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 {
 	return virtqueue_get_buf_ctx(_vq, len, NULL);
@@ -2192,6 +2517,7 @@ struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
 		!context;
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	vq->in_order = virtio_has_feature(vdev, VIRTIO_F_IN_ORDER);
 
 	if (virtio_has_feature(vdev, VIRTIO_F_ORDER_PLATFORM))
 		vq->weak_barriers = false;
@@ -2202,6 +2528,8 @@ struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->split.vring = vring;
 	vq->split.avail_flags_shadow = 0;
 	vq->split.avail_idx_shadow = 0;
+	vq->split.last_used_entry = 0;
+	vq->split.batch_last.id = UINT_MAX;
 
 	/* No callback?  Tell other side not to bother us. */
 	if (!callback) {
@@ -2346,6 +2674,11 @@ void vring_transport_features(struct virtio_device *vdev)
 			break;
 		case VIRTIO_F_ORDER_PLATFORM:
 			break;
+		case VIRTIO_F_IN_ORDER:
+			/* Only the split ring knows about it for now. */
+			if (virtio_has_feature(vdev, VIRTIO_F_RING_PACKED))
+				__virtio_clear_bit(vdev, i);
+			break;
 		default:
 			/* We don't understand this bit. */
 			__virtio_clear_bit(vdev, i);
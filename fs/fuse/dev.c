@@ -21,6 +21,9 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/sched.h>
+#include <linux/sched/clock.h>
+#include <linux/bvec.h>
+#include <linux/vmalloc.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -204,13 +207,44 @@ static unsigned int fuse_req_hash(u64 unique)
 	return hash_long(unique & ~FUSE_INT_REQ_BIT, FUSE_PQ_HASH_BITS);
 }
 
+/*
+ * Kick a thread sleeping on the empty queue of its device, so that it
+ * takes over work queued where all threads are busy.  Starts looking on
+ * the CPU next to this one, not to always pick the same victim.
+ */
+static void fuse_wake_idle(struct fuse_conn *fc)
+{
+	unsigned int start = raw_smp_processor_id();
+	unsigned int i;
+	struct fuse_dev *fud;
+
+	rcu_read_lock();
+	for (i = 1; i <= nr_cpu_ids; i++) {
+		fud = rcu_dereference(fc->cpu_devs[(start + i) % nr_cpu_ids]);
+		if (fud && wq_has_sleeper(&fud->q.waitq)) {
+			WRITE_ONCE(fud->q.kick, true);
+			wake_up(&fud->q.waitq);
+			break;
+		}
+	}
+	rcu_read_unlock();
+}
+
 /**
  * A new request is available, wake fiq->waitq
+ *
+ * Threads of devices bound to a CPU don't sleep on fiq->waitq, one of
+ * them is kicked if nobody else is there to serve the request.
  */
 static void fuse_dev_wake_and_unlock(struct fuse_iqueue *fiq)
 __releases(fiq->lock)
 {
-	wake_up(&fiq->waitq);
+	struct fuse_conn *fc = container_of(fiq, struct fuse_conn, iq);
+
+	if (fc->per_cpu_queues && !wq_has_sleeper(&fiq->waitq))
+		fuse_wake_idle(fc);
+	else
+		wake_up(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 	spin_unlock(&fiq->lock);
 }
@@ -233,6 +267,53 @@ __releases(fiq->lock)
 	fiq->ops->wake_pending_and_unlock(fiq);
 }
 
+/*
+ * Queue the request on the device bound to the current CPU, if any.
+ * Doesn't touch the fiq, so that the threads serving different CPUs
+ * don't contend on fiq->lock.
+ *
+ * Returns false if the request has to go through the fiq instead.
+ */
+static bool fuse_queue_request_cpu(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_dev_queue *q;
+	struct fuse_dev *fud;
+	bool queued = false;
+
+	if (!fc->per_cpu_queues)
+		return false;
+
+	rcu_read_lock();
+	fud = rcu_dereference(fc->cpu_devs[raw_smp_processor_id()]);
+	if (fud) {
+		q = &fud->q;
+		spin_lock(&q->lock);
+		if (q->connected) {
+			q->reqctr += FUSE_REQ_ID_STEP;
+			req->in.h.unique = ((u64)(q->cpu + 1) <<
+					    FUSE_DEV_QUEUE_ID_SHIFT) | q->reqctr;
+			req->in.h.len = sizeof(struct fuse_in_header) +
+				fuse_len_args(req->args->in_numargs,
+					      (struct fuse_arg *) req->args->in_args);
+			req->fdq = q;
+			list_add_tail(&req->list, &q->pending);
+			queued = true;
+		}
+		spin_unlock(&q->lock);
+
+		if (queued) {
+			/* if the thread is busy, let an idle one steal it */
+			if (wq_has_sleeper(&q->waitq))
+				wake_up(&q->waitq);
+			else
+				fuse_wake_idle(fc);
+		}
+	}
+	rcu_read_unlock();
+
+	return queued;
+}
+
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
@@ -263,6 +344,8 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_first_entry(&fc->bg_queue, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
+		if (fuse_queue_request_cpu(fc, req))
+			continue;
 		spin_lock(&fiq->lock);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request_and_unlock(fiq, req);
@@ -361,6 +444,42 @@ static int queue_interrupt(struct fuse_req *req)
 	return 0;
 }
 
+/*
+ * Take the request off the queue it is pending on, if it is still pending.
+ * A request only ever moves from a per-CPU queue to the fiq, and the
+ * devices are freed after an RCU grace period once their queue is empty.
+ */
+static bool fuse_remove_pending(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_dev_queue *fdq;
+	bool removed = false;
+
+	rcu_read_lock();
+	fdq = READ_ONCE(req->fdq);
+	if (fdq) {
+		spin_lock(&fdq->lock);
+		if (req->fdq == fdq && test_bit(FR_PENDING, &req->flags)) {
+			list_del(&req->list);
+			req->fdq = NULL;
+			removed = true;
+		}
+		spin_unlock(&fdq->lock);
+	}
+	rcu_read_unlock();
+	if (removed)
+		return true;
+
+	spin_lock(&fiq->lock);
+	if (!req->fdq && test_bit(FR_PENDING, &req->flags)) {
+		list_del(&req->list);
+		removed = true;
+	}
+	spin_unlock(&fiq->lock);
+
+	return removed;
+}
+
 static void request_wait_answer(struct fuse_req *req)
 {
 	struct fuse_conn *fc = req->fm->fc;
@@ -388,16 +507,12 @@ static void request_wait_answer(struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->lock);
 		/* Request is not yet in userspace, bail out */
-		if (test_bit(FR_PENDING, &req->flags)) {
-			list_del(&req->list);
-			spin_unlock(&fiq->lock);
+		if (fuse_remove_pending(fc, req)) {
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
-		spin_unlock(&fiq->lock);
 	}
 
 	/*
@@ -409,24 +524,28 @@ static void request_wait_answer(struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &req->fm->fc->iq;
+	struct fuse_conn *fc = req->fm->fc;
+	struct fuse_iqueue *fiq = &fc->iq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->lock);
-	if (!fiq->connected) {
-		spin_unlock(&fiq->lock);
-		req->out.h.error = -ENOTCONN;
-	} else {
+	/* acquire extra reference, since request is still needed
+	   after fuse_request_end() */
+	__fuse_get_request(req);
+	if (!fuse_queue_request_cpu(fc, req)) {
+		spin_lock(&fiq->lock);
+		if (!fiq->connected) {
+			spin_unlock(&fiq->lock);
+			__fuse_put_request(req);
+			req->out.h.error = -ENOTCONN;
+			return;
+		}
 		req->in.h.unique = fuse_get_unique(fiq);
-		/* acquire extra reference, since request is still needed
-		   after fuse_request_end() */
-		__fuse_get_request(req);
 		queue_request_and_unlock(fiq, req);
-
-		request_wait_answer(req);
-		/* Pairs with smp_wmb() in fuse_request_end() */
-		smp_rmb();
 	}
+
+	request_wait_answer(req);
+	/* Pairs with smp_wmb() in fuse_request_end() */
+	smp_rmb();
 }
 
 static void fuse_adjust_compat(struct fuse_conn *fc, struct fuse_args *args)
@@ -651,6 +770,7 @@ struct fuse_copy_state {
 	unsigned len;
 	unsigned offset;
 	unsigned move_pages:1;
+	unsigned ring:1;
 };
 
 static void fuse_copy_init(struct fuse_copy_state *cs, int write,
@@ -1035,6 +1155,61 @@ static int request_pending(struct fuse_iqueue *fiq)
 		forget_pending(fiq);
 }
 
+/* Forgets, interrupts or requests on the fiq, or the fiq got aborted */
+static bool fuse_fiq_work(struct fuse_iqueue *fiq)
+{
+	return !READ_ONCE(fiq->connected) || request_pending(fiq);
+}
+
+static bool fuse_dev_queue_ready(struct fuse_dev *fud)
+{
+	return !list_empty_careful(&fud->q.pending) || READ_ONCE(fud->q.kick) ||
+		fuse_fiq_work(&fud->fc->iq);
+}
+
+static struct fuse_req *fuse_dev_queue_pop(struct fuse_dev_queue *q)
+{
+	struct fuse_req *req = NULL;
+
+	spin_lock(&q->lock);
+	if (!list_empty(&q->pending)) {
+		req = list_first_entry(&q->pending, struct fuse_req, list);
+		clear_bit(FR_PENDING, &req->flags);
+		list_del_init(&req->list);
+		req->fdq = NULL;
+	}
+	spin_unlock(&q->lock);
+
+	return req;
+}
+
+/*
+ * Get a request off the queue of the device, or else steal one from the
+ * queue of a device whose thread is busy.
+ */
+static struct fuse_req *fuse_dev_dequeue(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_dev *victim;
+	struct fuse_req *req;
+	unsigned int i;
+
+	req = fuse_dev_queue_pop(&fud->q);
+	if (req)
+		return req;
+
+	rcu_read_lock();
+	for (i = 1; i < nr_cpu_ids && !req; i++) {
+		victim = rcu_dereference(fc->cpu_devs[(fud->q.cpu + i) %
+						      nr_cpu_ids]);
+		if (victim && !list_empty_careful(&victim->q.pending))
+			req = fuse_dev_queue_pop(&victim->q);
+	}
+	rcu_read_unlock();
+
+	return req;
+}
+
 /*
  * Transfer an interrupt request to userspace
  *
@@ -1198,13 +1373,14 @@ __releases(fiq->lock)
  * fuse_request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, bool nonblock,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
 	struct fuse_iqueue *fiq = &fc->iq;
 	struct fuse_pqueue *fpq = &fud->pq;
+	struct fuse_ring *ring = READ_ONCE(fud->ring);
 	struct fuse_req *req;
 	struct fuse_args *args;
 	unsigned reqsize;
@@ -1221,21 +1397,53 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	 *
 	 * which is the absolute minimum any sane filesystem should be using
 	 * for header room.
+	 *
+	 * The slots of a ring may be smaller, the requests that don't fit are
+	 * left for read() or splice().
 	 */
-	if (nbytes < max_t(size_t, FUSE_MIN_READ_BUFFER,
-			   sizeof(struct fuse_in_header) +
-			   sizeof(struct fuse_write_in) +
-			   fc->max_write))
+	if (!cs->ring && nbytes < max_t(size_t, FUSE_MIN_READ_BUFFER,
+					sizeof(struct fuse_in_header) +
+					sizeof(struct fuse_write_in) +
+					fc->max_write))
 		return -EINVAL;
 
+	if (ring && !cs->ring) {
+		spin_lock(&fpq->lock);
+		req = list_first_entry_or_null(&ring->overflow, struct fuse_req,
+					       list);
+		if (req)
+			list_del_init(&req->list);
+		spin_unlock(&fpq->lock);
+		if (req)
+			goto found;
+	}
+
  restart:
 	for (;;) {
+		/* the fiq goes first, it carries the forgets and interrupts */
+		if (fud->q.cpu >= 0 && !fuse_fiq_work(fiq)) {
+			WRITE_ONCE(fud->q.kick, false);
+			req = fuse_dev_dequeue(fud);
+			if (req)
+				goto found;
+
+			if (nonblock)
+				return -EAGAIN;
+			err = wait_event_interruptible_exclusive(fud->q.waitq,
+					fuse_dev_queue_ready(fud));
+			if (err)
+				return err;
+			continue;
+		}
+
 		spin_lock(&fiq->lock);
 		if (!fiq->connected || request_pending(fiq))
 			break;
 		spin_unlock(&fiq->lock);
 
-		if (file->f_flags & O_NONBLOCK)
+		if (fud->q.cpu >= 0)
+			continue;
+		if (nonblock)
 			return -EAGAIN;
 		err = wait_event_interruptible_exclusive(fiq->waitq,
 				!fiq->connected || request_pending(fiq));
@@ -1267,9 +1475,24 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	list_del_init(&req->list);
 	spin_unlock(&fiq->lock);
 
+ found:
 	args = req->args;
 	reqsize = req->in.h.len;
 
+	/* Only the header goes in the slot, the server reads the rest */
+	if (nbytes < reqsize && cs->ring) {
+		fuse_copy_one(cs, &req->in.h, sizeof(req->in.h));
+		fuse_copy_finish(cs);
+		spin_lock(&fpq->lock);
+		if (!fpq->connected) {
+			req->out.h.error = err = -ECONNABORTED;
+			goto out_end;
+		}
+		list_add_tail(&req->list, &ring->overflow);
+		spin_unlock(&fpq->lock);
+		return sizeof(req->in.h);
+	}
+
 	/* If request is too large, reply with an error and restart the read */
 	if (nbytes < reqsize) {
 		req->out.h.error = -EIO;
@@ -1361,7 +1584,8 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, struct iov_iter *to)
 
 	fuse_copy_init(&cs, 1, to);
 
-	return fuse_dev_do_read(fud, file, &cs, iov_iter_count(to));
+	return fuse_dev_do_read(fud, file->f_flags & O_NONBLOCK, &cs,
+				iov_iter_count(to));
 }
 
 static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
@@ -1385,7 +1609,7 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	fuse_copy_init(&cs, 1, NULL);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fud, in, &cs, len);
+	ret = fuse_dev_do_read(fud, in->f_flags & O_NONBLOCK, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -2062,11 +2286,13 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 
 	fiq = &fud->fc->iq;
 	poll_wait(file, &fiq->waitq, wait);
+	if (fud->q.cpu >= 0)
+		poll_wait(file, &fud->q.waitq, wait);
 
 	spin_lock(&fiq->lock);
 	if (!fiq->connected)
 		mask = EPOLLERR;
-	else if (request_pending(fiq))
+	else if (request_pending(fiq) || !list_empty_careful(&fud->q.pending))
 		mask |= EPOLLIN | EPOLLRDNORM;
 	spin_unlock(&fiq->lock);
 
@@ -2155,6 +2381,9 @@ void fuse_abort_conn(struct fuse_conn *fc)
 			for (i = 0; i < FUSE_PQ_HASH_SIZE; i++)
 				list_splice_tail_init(&fpq->processing[i],
 						      &to_end);
+			if (fud->ring)
+				list_splice_tail_init(&fud->ring->overflow,
+						      &to_end);
 			spin_unlock(&fpq->lock);
 		}
 		spin_lock(&fc->bg_lock);
@@ -2172,6 +2401,20 @@ void fuse_abort_conn(struct fuse_conn *fc)
 			kfree(fuse_dequeue_forget(fiq, 1, NULL));
 		wake_up_all(&fiq->waitq);
 		spin_unlock(&fiq->lock);
+
+		list_for_each_entry(fud, &fc->devices, entry) {
+			struct fuse_dev_queue *q = &fud->q;
+
+			spin_lock(&q->lock);
+			q->connected = 0;
+			list_for_each_entry(req, &q->pending, list) {
+				clear_bit(FR_PENDING, &req->flags);
+				req->fdq = NULL;
+			}
+			list_splice_tail_init(&q->pending, &to_end);
+			spin_unlock(&q->lock);
+			wake_up_all(&q->waitq);
+		}
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
@@ -2191,6 +2434,48 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+/*
+ * Hand the requests still queued on the device over to the fiq.  The
+ * device stays around until nobody can be looking at it under RCU.
+ */
+static void fuse_dev_unbind(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_dev_queue *q = &fud->q;
+	struct fuse_req *req;
+
+	spin_lock(&fc->lock);
+	RCU_INIT_POINTER(fc->cpu_devs[q->cpu], NULL);
+	spin_unlock(&fc->lock);
+
+	spin_lock(&q->lock);
+	q->connected = 0;
+	spin_lock(&fiq->lock);
+	/* if the fiq is aborted, fuse_abort_conn() takes care of them */
+	if (fiq->connected && !list_empty(&q->pending)) {
+		list_for_each_entry(req, &q->pending, list)
+			req->fdq = NULL;
+		list_splice_tail_init(&q->pending, &fiq->pending);
+		fiq->ops->wake_pending_and_unlock(fiq);
+	} else {
+		spin_unlock(&fiq->lock);
+	}
+	spin_unlock(&q->lock);
+
+	synchronize_rcu();
+}
+
+static void fuse_ring_free(struct fuse_ring *ring)
+{
+	if (ring) {
+		bitmap_free(ring->busy);
+		kvfree(ring->bvecs);
+		vfree(ring->buf);
+		kfree(ring);
+	}
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2198,6 +2483,7 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 	if (fud) {
 		struct fuse_conn *fc = fud->fc;
 		struct fuse_pqueue *fpq = &fud->pq;
+		struct fuse_ring *ring = fud->ring;
 		LIST_HEAD(to_end);
 		unsigned int i;
 
@@ -2205,16 +2491,23 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 		WARN_ON(!list_empty(&fpq->io));
 		for (i = 0; i < FUSE_PQ_HASH_SIZE; i++)
 			list_splice_init(&fpq->processing[i], &to_end);
+		if (ring)
+			list_splice_init(&ring->overflow, &to_end);
 		spin_unlock(&fpq->lock);
 
 		end_requests(&to_end);
 
+		if (fud->q.cpu >= 0)
+			fuse_dev_unbind(fud);
+
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
 			fuse_abort_conn(fc);
 		}
+		/* fuse_abort_conn() looks at the overflow list until then */
 		fuse_dev_free(fud);
+		fuse_ring_free(ring);
 	}
 	return 0;
 }
@@ -2248,11 +2541,219 @@ static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 	return 0;
 }
 
+static int fuse_dev_bind_cpu(struct fuse_dev *fud, u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	int res = 0;
+
+	if (!fc->per_cpu_queues || cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	if (!fc->connected) {
+		res = -ENOTCONN;
+	} else if (fud->q.cpu >= 0 ||
+		   rcu_access_pointer(fc->cpu_devs[cpu])) {
+		res = -EBUSY;
+	} else {
+		fud->q.cpu = cpu;
+		rcu_assign_pointer(fc->cpu_devs[cpu], fud);
+	}
+	spin_unlock(&fc->lock);
+
+	return res;
+}
+
+#define FUSE_RING_MAX_ENTRIES	4096
+#define FUSE_RING_MAX_SIZE	(64 << 20)
+
+static int fuse_ring_setup(struct fuse_dev *fud,
+			   struct fuse_ring_setup __user *uarg)
+{
+	struct fuse_ring_setup arg;
+	struct fuse_ring *ring;
+	size_t ctrl_size, size;
+	unsigned int i;
+
+	if (copy_from_user(&arg, uarg, sizeof(arg)))
+		return -EFAULT;
+
+	/* interrupts and forgets always fit in a slot */
+	if (arg.flags || !is_power_of_2(arg.entries) ||
+	    arg.entries > FUSE_RING_MAX_ENTRIES ||
+	    arg.entry_size < FUSE_MIN_READ_BUFFER ||
+	    !PAGE_ALIGNED(arg.entry_size))
+		return -EINVAL;
+
+	ctrl_size = PAGE_ALIGN(sizeof(struct fuse_ring_ctrl) + 2 * arg.entries *
+			       sizeof(struct fuse_ring_entry));
+	size = ctrl_size + (size_t)arg.entries * arg.entry_size;
+	if (size > FUSE_RING_MAX_SIZE)
+		return -EINVAL;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	mutex_init(&ring->lock);
+	INIT_LIST_HEAD(&ring->overflow);
+	ring->entries = arg.entries;
+	ring->entry_size = arg.entry_size;
+	ring->busy_poll_us = arg.busy_poll_us;
+	ring->buf = vmalloc_user(size);
+	ring->bvecs = kvmalloc_array((size - ctrl_size) >> PAGE_SHIFT,
+				     sizeof(*ring->bvecs), GFP_KERNEL);
+	ring->busy = bitmap_zalloc(arg.entries, GFP_KERNEL);
+	if (!ring->buf || !ring->bvecs || !ring->busy) {
+		fuse_ring_free(ring);
+		return -ENOMEM;
+	}
+
+	ring->ctrl = ring->buf;
+	ring->sq = ring->buf + sizeof(struct fuse_ring_ctrl);
+	ring->cq = ring->sq + arg.entries;
+	for (i = 0; i < (size - ctrl_size) >> PAGE_SHIFT; i++) {
+		ring->bvecs[i].bv_page =
+			vmalloc_to_page(ring->buf + ctrl_size + i * PAGE_SIZE);
+		ring->bvecs[i].bv_len = PAGE_SIZE;
+		ring->bvecs[i].bv_offset = 0;
+	}
+
+	if (cmpxchg(&fud->ring, NULL, ring)) {
+		fuse_ring_free(ring);
+		return -EBUSY;
+	}
+
+	arg.mmap_size = size;
+	arg.sq_off = (void *)ring->sq - ring->buf;
+	arg.cq_off = (void *)ring->cq - ring->buf;
+	arg.slots_off = ctrl_size;
+	if (copy_to_user(uarg, &arg, sizeof(arg)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static void fuse_ring_slot_iter(struct fuse_ring *ring, struct iov_iter *iter,
+				unsigned int dir, u32 slot, size_t len)
+{
+	unsigned int nr_pages = ring->entry_size >> PAGE_SHIFT;
+
+	iov_iter_bvec(iter, dir, ring->bvecs + slot * nr_pages, nr_pages, len);
+}
+
+/*
+ * Hand the replies in the completed slots over to fuse_dev_do_write(), and
+ * report the result in the status of each completion entry
+ */
+static void fuse_ring_complete(struct fuse_dev *fud, struct fuse_ring *ring)
+{
+	u32 tail = smp_load_acquire(&ring->ctrl->cq_tail);
+	struct fuse_copy_state cs;
+	struct fuse_ring_entry *cqe;
+	struct iov_iter iter;
+	unsigned int n;
+	u32 slot, len;
+	ssize_t ret;
+
+	/* the server may have scribbled over the tail */
+	for (n = 0; ring->cq_head != tail && n < ring->entries; n++) {
+		cqe = &ring->cq[ring->cq_head++ & (ring->entries - 1)];
+		slot = READ_ONCE(cqe->slot);
+		len = READ_ONCE(cqe->len);
+
+		if (slot >= ring->entries || !test_and_clear_bit(slot, ring->busy)) {
+			ret = -EINVAL;
+		} else if (!len) {
+			ret = 0;
+		} else if (len > ring->entry_size) {
+			ret = -EINVAL;
+		} else {
+			fuse_ring_slot_iter(ring, &iter, WRITE, slot, len);
+			fuse_copy_init(&cs, 0, &iter);
+			ret = fuse_dev_do_write(fud, &cs, len);
+		}
+		WRITE_ONCE(cqe->status, ret < 0 ? ret : 0);
+	}
+	/* pairs with the server reading the status after cq_head */
+	smp_store_release(&ring->ctrl->cq_head, ring->cq_head);
+}
+
+/* Copy the pending requests into the free slots */
+static long fuse_ring_submit(struct fuse_dev *fud, struct fuse_ring *ring,
+			     bool wait)
+{
+	u64 poll_end = local_clock() + ring->busy_poll_us * NSEC_PER_USEC;
+	struct fuse_copy_state cs;
+	struct fuse_ring_entry *sqe;
+	struct iov_iter iter;
+	unsigned int nr = 0;
+	bool nonblock;
+	ssize_t ret;
+	u32 slot;
+
+	for (;;) {
+		slot = find_first_zero_bit(ring->busy, ring->entries);
+		if (slot >= ring->entries)
+			return nr;
+
+		nonblock = nr || !wait || local_clock() < poll_end;
+		fuse_ring_slot_iter(ring, &iter, READ, slot, ring->entry_size);
+		fuse_copy_init(&cs, 1, &iter);
+		cs.ring = 1;
+		ret = fuse_dev_do_read(fud, nonblock, &cs, ring->entry_size);
+		if (ret == -EAGAIN && !nr && wait) {
+			if (signal_pending(current))
+				return -ERESTARTSYS;
+			cond_resched();
+			continue;
+		}
+		if (ret < 0)
+			return nr ? nr : ret;
+
+		set_bit(slot, ring->busy);
+		sqe = &ring->sq[ring->sq_tail++ & (ring->entries - 1)];
+		WRITE_ONCE(sqe->slot, slot);
+		WRITE_ONCE(sqe->len, ret);
+		smp_store_release(&ring->ctrl->sq_tail, ring->sq_tail);
+		nr++;
+	}
+}
+
+static long fuse_ring_enter(struct fuse_dev *fud, u32 flags)
+{
+	struct fuse_ring *ring = READ_ONCE(fud->ring);
+	long ret;
+
+	if (!ring || flags & ~FUSE_RING_ENTER_WAIT)
+		return -EINVAL;
+
+	mutex_lock(&ring->lock);
+	fuse_ring_complete(fud, ring);
+	ret = fuse_ring_submit(fud, ring, flags & FUSE_RING_ENTER_WAIT);
+	mutex_unlock(&ring->lock);
+
+	return ret;
+}
+
+static int fuse_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_ring *ring = fud ? READ_ONCE(fud->ring) : NULL;
+
+	if (!ring)
+		return -ENODEV;
+
+	return remap_vmalloc_range(vma, ring->buf, vma->vm_pgoff);
+}
+
 static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
 	int res;
 	int oldfd;
+	u32 cpu, flags, backing_id;
+	struct fuse_backing_map map;
 	struct fuse_dev *fud = NULL;
 
 	switch (cmd) {
@@ -2280,6 +2781,42 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			}
 		}
 		break;
+	case FUSE_DEV_IOC_BIND_CPU:
+		res = -EFAULT;
+		if (!get_user(cpu, (__u32 __user *)arg)) {
+			fud = fuse_get_dev(file);
+			res = fud ? fuse_dev_bind_cpu(fud, cpu) : -EINVAL;
+		}
+		break;
+	case FUSE_DEV_IOC_RING_SETUP:
+		fud = fuse_get_dev(file);
+		res = fud ? fuse_ring_setup(fud, (void __user *)arg) : -EINVAL;
+		break;
+	case FUSE_DEV_IOC_RING_ENTER:
+		res = -EFAULT;
+		if (!get_user(flags, (__u32 __user *)arg)) {
+			fud = fuse_get_dev(file);
+			res = fud ? fuse_ring_enter(fud, flags) : -EINVAL;
+		}
+		break;
+	case FUSE_DEV_IOC_BACKING_OPEN:
+		res = -EFAULT;
+		if (!copy_from_user(&map, (void __user *)arg, sizeof(map))) {
+			fud = fuse_get_dev(file);
+			res = -EINVAL;
+			if (fud && IS_ENABLED(CONFIG_FUSE_PASSTHROUGH))
+				res = fuse_backing_open(fud->fc, &map);
+		}
+		break;
+	case FUSE_DEV_IOC_BACKING_CLOSE:
+		res = -EFAULT;
+		if (!get_user(backing_id, (__u32 __user *)arg)) {
+			fud = fuse_get_dev(file);
+			res = -EINVAL;
+			if (fud && IS_ENABLED(CONFIG_FUSE_PASSTHROUGH))
+				res = fuse_backing_close(fud->fc, backing_id);
+		}
+		break;
 	default:
 		res = -ENOTTY;
 		break;
@@ -2300,6 +2837,7 @@ const struct file_operations fuse_dev_operations = {
 	.fasync		= fuse_dev_fasync,
 	.unlocked_ioctl = fuse_dev_ioctl,
 	.compat_ioctl   = compat_ptr_ioctl,
+	.mmap		= fuse_dev_mmap,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
@@ -603,6 +603,16 @@ static int fuse_create_open(struct inode *dir, struct dentry *entry,
 	ff->fh = outopen.fh;
 	ff->nodeid = outentry.nodeid;
 	ff->open_flags = outopen.open_flags;
+	if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH) &&
+	    (ff->open_flags & FOPEN_PASSTHROUGH)) {
+		err = fuse_passthrough_open(ff, flags, outopen.backing_id);
+		if (err) {
+			flags &= ~(O_CREAT | O_EXCL | O_TRUNC);
+			fuse_sync_release(NULL, ff, flags);
+			fuse_queue_forget(fm->fc, forget, outentry.nodeid, 1);
+			goto out_err;
+		}
+	}
 	inode = fuse_iget(dir->i_sb, outentry.nodeid, outentry.generation,
 			  &outentry.attr, entry_attr_timeout(&outentry), 0);
 	if (!inode) {
@@ -31,6 +31,7 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 #include <linux/user_namespace.h>
+#include <linux/idr.h>
 
 /** Default max number of pages that can be used in a single read request */
 #define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
@@ -224,6 +225,9 @@ struct fuse_file {
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
 
+	/** Backing file of a FOPEN_PASSTHROUGH open */
+	struct file *passthrough;
+
 	/** Has flock been performed on this file? */
 	bool flock:1;
 };
@@ -374,6 +378,9 @@ struct fuse_req {
 
 	/** fuse_mount this request belongs to */
 	struct fuse_mount *fm;
+
+	/** Per-CPU queue the request is pending on, NULL if on fiq->pending */
+	struct fuse_dev_queue *fdq;
 };
 
 struct fuse_iqueue;
@@ -467,6 +474,80 @@ struct fuse_pqueue {
 	struct list_head io;
 };
 
+/* Bits above this one of the unique ID hold the CPU of a per-CPU queue */
+#define FUSE_DEV_QUEUE_ID_SHIFT 48
+
+/**
+ * Per-CPU input queue of a device bound to a CPU
+ *
+ * With FUSE_PER_CPU_QUEUES negotiated, the requests submitted on a CPU
+ * are queued on the device bound to it, if any, instead of fiq->pending.
+ * Forgets and interrupts still go through the fiq.
+ */
+struct fuse_dev_queue {
+	/** Lock protecting accesses to members of this structure */
+	spinlock_t lock;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** Wait queue of the thread reading the device */
+	wait_queue_head_t waitq;
+
+	/** The next unique request id */
+	u64 reqctr;
+
+	/** CPU the device is bound to, -1 if not bound */
+	int cpu;
+
+	/** Requests may be queued */
+	unsigned connected;
+
+	/** Woken up to steal from another queue or to serve the fiq */
+	bool kick;
+};
+
+/**
+ * Shared memory ring of a device
+ *
+ * Set up with FUSE_DEV_IOC_RING_SETUP and mapped by the server: a struct
+ * fuse_ring_ctrl, the submission and completion entries and the slots.
+ * FUSE_DEV_IOC_RING_ENTER reaps the replies the server put in the slots
+ * it completed, and copies requests into the free slots.
+ */
+struct fuse_ring {
+	/** Serializes FUSE_DEV_IOC_RING_ENTER */
+	struct mutex lock;
+
+	/** The area mapped by the server */
+	void *buf;
+	struct fuse_ring_ctrl *ctrl;
+	struct fuse_ring_entry *sq;
+	struct fuse_ring_entry *cq;
+
+	/** Pages of the slots, to copy through a bvec iterator */
+	struct bio_vec *bvecs;
+
+	/** Number of slots, and of entries of each queue */
+	unsigned int entries;
+
+	/** Size of a slot */
+	unsigned int entry_size;
+
+	/** Busy poll before sleeping in FUSE_DEV_IOC_RING_ENTER */
+	unsigned int busy_poll_us;
+
+	/** Private copies of the indices the kernel advances */
+	u32 sq_tail;
+	u32 cq_head;
+
+	/** Slots handed over to the server */
+	unsigned long *busy;
+
+	/** Requests too large for a slot, protected by fpq->lock */
+	struct list_head overflow;
+};
+
 /**
  * Fuse device instance
  */
@@ -477,6 +558,12 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Per-CPU input queue */
+	struct fuse_dev_queue q;
+
+	/** Shared memory ring, if set up */
+	struct fuse_ring *ring;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
 };
@@ -784,6 +871,12 @@ struct fuse_conn {
 	/* Does the filesystem support per inode DAX? */
 	unsigned int inode_dax:1;
 
+	/* Queue requests on the device bound to the submitting CPU */
+	unsigned int per_cpu_queues:1;
+
+	/* Can open replies pass I/O through to a backing file? */
+	unsigned int passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -820,6 +913,12 @@ struct fuse_conn {
 	/** List of device instances belonging to this connection */
 	struct list_head devices;
 
+	/** Devices bound to each CPU, if per_cpu_queues */
+	struct fuse_dev __rcu **cpu_devs;
+
+	/** Backing files registered for passthrough, protected by lock */
+	struct idr backing_files;
+
 #ifdef CONFIG_FUSE_DAX
 	/* Dax mode */
 	enum fuse_dax_mode dax_mode;
@@ -1301,6 +1400,23 @@ void fuse_dax_dontcache(struct inode *inode, unsigned int flags);
 bool fuse_dax_check_alignment(struct fuse_conn *fc, unsigned int map_alignment);
 void fuse_dax_cancel_work(struct fuse_conn *fc);
 
+/* passthrough.c */
+
+static inline struct file *fuse_file_passthrough(struct fuse_file *ff)
+{
+	return IS_ENABLED(CONFIG_FUSE_PASSTHROUGH) ? ff->passthrough : NULL;
+}
+
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map);
+int fuse_backing_close(struct fuse_conn *fc, int backing_id);
+void fuse_backing_files_free(struct fuse_conn *fc);
+int fuse_passthrough_open(struct fuse_file *ff, unsigned int open_flags,
+			  int backing_id);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 /* ioctl.c */
 long fuse_file_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 long fuse_file_compat_ioctl(struct file *file, unsigned int cmd,
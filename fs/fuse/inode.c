@@ -821,6 +821,7 @@ void fuse_conn_init(struct fuse_conn *fc, struct fuse_mount *fm,
 	INIT_LIST_HEAD(&fc->bg_queue);
 	INIT_LIST_HEAD(&fc->entry);
 	INIT_LIST_HEAD(&fc->devices);
+	idr_init(&fc->backing_files);
 	atomic_set(&fc->num_waiting, 0);
 	fc->max_background = FUSE_DEFAULT_MAX_BACKGROUND;
 	fc->congestion_threshold = FUSE_DEFAULT_CONGESTION_THRESHOLD;
@@ -859,6 +860,9 @@ void fuse_conn_put(struct fuse_conn *fc)
 			WARN_ON(atomic_read(&bucket->count) != 1);
 			kfree(bucket);
 		}
+		kfree(fc->cpu_devs);
+		if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH))
+			fuse_backing_files_free(fc);
 		fc->release(fc);
 	}
 }
@@ -1189,6 +1193,19 @@ static void process_init_reply(struct fuse_mount *fm, struct fuse_args *args,
 				fc->setxattr_ext = 1;
 			if (flags & FUSE_SECURITY_CTX)
 				fc->init_security = 1;
+			if (flags & FUSE_PER_CPU_QUEUES) {
+				fc->cpu_devs = kcalloc(nr_cpu_ids,
+						       sizeof(*fc->cpu_devs),
+						       GFP_KERNEL);
+				if (fc->cpu_devs)
+					fc->per_cpu_queues = 1;
+			}
+			if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH) &&
+			    (flags & FUSE_PASSTHROUGH)) {
+				fc->passthrough = 1;
+				/* backing files must not be stacked */
+				fm->sb->s_stack_depth = 1;
+			}
 		} else {
 			ra_pages = fc->max_read / PAGE_SIZE;
 			fc->no_lock = 1;
@@ -1234,7 +1251,9 @@ void fuse_send_init(struct fuse_mount *fm)
 		FUSE_ABORT_ERROR | FUSE_MAX_PAGES | FUSE_CACHE_SYMLINKS |
 		FUSE_NO_OPENDIR_SUPPORT | FUSE_EXPLICIT_INVAL_DATA |
 		FUSE_HANDLE_KILLPRIV_V2 | FUSE_SETXATTR_EXT | FUSE_INIT_EXT |
-		FUSE_SECURITY_CTX;
+		FUSE_SECURITY_CTX | FUSE_PER_CPU_QUEUES;
+	if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH))
+		flags |= FUSE_PASSTHROUGH;
 #ifdef CONFIG_FUSE_DAX
 	if (fm->fc->dax)
 		flags |= FUSE_MAP_ALIGNMENT;
@@ -1332,6 +1351,12 @@ struct fuse_dev *fuse_dev_alloc(void)
 	fud->pq.processing = pq;
 	fuse_pqueue_init(&fud->pq);
 
+	spin_lock_init(&fud->q.lock);
+	INIT_LIST_HEAD(&fud->q.pending);
+	init_waitqueue_head(&fud->q.waitq);
+	fud->q.cpu = -1;
+	fud->q.connected = 1;
+
 	return fud;
 }
 EXPORT_SYMBOL_GPL(fuse_dev_alloc);
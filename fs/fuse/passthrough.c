@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * FUSE passthrough: file I/O straight to a backing file of the server
+ */
+
+#include "fuse_i.h"
+
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/uio.h>
+
+/*
+ * Backing files are registered by the server on the fuse device and picked
+ * by id in the open reply.  The data of the backing file is accessed with
+ * the credentials it was opened with, so only a server with CAP_SYS_ADMIN
+ * may register files: it could otherwise hand out access to the files it
+ * can open to the users of the filesystem.  The files are not visible in
+ * the file tables of the processes using them either, another reason to
+ * keep this to privileged servers.
+ *
+ * The fuse superblock is one level deeper than the backing files when
+ * passthrough is negotiated, so a backing file may not itself be stacked,
+ * which also keeps a server from passing a fuse file through to itself.
+ */
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map)
+{
+	struct file *file;
+	struct inode *inode;
+	int res;
+
+	if (!fc->passthrough)
+		return -EOPNOTSUPP;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (map->flags || map->padding)
+		return -EINVAL;
+
+	file = fget(map->fd);
+	if (!file)
+		return -EBADF;
+
+	inode = file_inode(file);
+	res = -EINVAL;
+	if (!S_ISREG(inode->i_mode) || !file->f_op->read_iter ||
+	    !file->f_op->write_iter)
+		goto out_fput;
+
+	res = -ELOOP;
+	if (inode->i_sb->s_stack_depth)
+		goto out_fput;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	res = idr_alloc_cyclic(&fc->backing_files, file, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+	if (res > 0)
+		return res;
+
+out_fput:
+	fput(file);
+	return res;
+}
+
+int fuse_backing_close(struct fuse_conn *fc, int backing_id)
+{
+	struct file *file;
+
+	if (!fc->passthrough)
+		return -EOPNOTSUPP;
+
+	if (backing_id <= 0)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	file = idr_remove(&fc->backing_files, backing_id);
+	spin_unlock(&fc->lock);
+	if (!file)
+		return -ENOENT;
+
+	fput(file);
+	return 0;
+}
+
+void fuse_backing_files_free(struct fuse_conn *fc)
+{
+	struct file *file;
+	int id;
+
+	idr_for_each_entry(&fc->backing_files, file, id)
+		fput(file);
+	idr_destroy(&fc->backing_files);
+}
+
+/**
+ * fuse_passthrough_open - set up the backing file of a passthrough open
+ * @ff: the file being opened
+ * @open_flags: the flags of the open
+ * @backing_id: the id from the open reply
+ *
+ * The backing file must have been opened for what the open asks for, the
+ * server cannot upgrade a read-only backing file to a writable one.
+ *
+ * Returns 0, or -EIO if the open reply doesn't name a usable backing file.
+ */
+int fuse_passthrough_open(struct fuse_file *ff, unsigned int open_flags,
+			  int backing_id)
+{
+	struct fuse_conn *fc = ff->fm->fc;
+	unsigned int accmode = open_flags & O_ACCMODE;
+	struct file *file = NULL;
+
+	if (!fc->passthrough || backing_id <= 0)
+		return -EIO;
+
+	spin_lock(&fc->lock);
+	file = idr_find(&fc->backing_files, backing_id);
+	if (file)
+		get_file(file);
+	spin_unlock(&fc->lock);
+	if (!file)
+		return -EIO;
+
+	if ((accmode != O_WRONLY && !(file->f_mode & FMODE_READ)) ||
+	    (accmode != O_RDONLY && !(file->f_mode & FMODE_WRITE))) {
+		fput(file);
+		return -EIO;
+	}
+
+	ff->passthrough = file;
+	return 0;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough) {
+		fput(ff->passthrough);
+		ff->passthrough = NULL;
+	}
+}
+
+static rwf_t fuse_iocb_to_rwf(int ifl)
+{
+	rwf_t flags = 0;
+
+	if (ifl & IOCB_NOWAIT)
+		flags |= RWF_NOWAIT;
+	if (ifl & IOCB_HIPRI)
+		flags |= RWF_HIPRI;
+	if (ifl & IOCB_DSYNC)
+		flags |= RWF_DSYNC;
+	if (ifl & IOCB_SYNC)
+		flags |= RWF_SYNC;
+	if (ifl & IOCB_APPEND)
+		flags |= RWF_APPEND;
+
+	return flags;
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct file *backing = fuse_file_passthrough(file->private_data);
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(to))
+		return 0;
+
+	old_cred = override_creds(backing->f_cred);
+	ret = vfs_iter_read(backing, to, &iocb->ki_pos,
+			    fuse_iocb_to_rwf(iocb->ki_flags));
+	revert_creds(old_cred);
+
+	fuse_invalidate_atime(file_inode(file));
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct file *backing = fuse_file_passthrough(file->private_data);
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(from))
+		return 0;
+
+	inode_lock(inode);
+	old_cred = override_creds(backing->f_cred);
+	file_start_write(backing);
+	ret = vfs_iter_write(backing, from, &iocb->ki_pos,
+			     fuse_iocb_to_rwf(iocb->ki_flags));
+	file_end_write(backing);
+	revert_creds(old_cred);
+
+	/* The cached size and times of the fuse inode are stale now */
+	fuse_write_update_attr(inode, iocb->ki_pos, ret);
+	inode_unlock(inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct file *backing = fuse_file_passthrough(file->private_data);
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma_set_file(vma, backing);
+
+	old_cred = override_creds(backing->f_cred);
+	ret = call_mmap(vma->vm_file, vma);
+	revert_creds(old_cred);
+
+	fuse_invalidate_atime(file_inode(file));
+	return ret;
+}
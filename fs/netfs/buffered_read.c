@@ -27,7 +27,14 @@ void netfs_rreq_unlock_folios(struct netfs_io_request *rreq)
 	if (test_bit(NETFS_RREQ_FAILED, &rreq->flags)) {
 		__clear_bit(NETFS_RREQ_COPY_TO_CACHE, &rreq->flags);
 		list_for_each_entry(subreq, &rreq->subrequests, rreq_link) {
-			__clear_bit(NETFS_SREQ_COPY_TO_CACHE, &subreq->flags);
+			/* Folios unlocked early are already marked for the
+			 * copy and hold good data, so still write those.
+			 */
+			if (test_bit(NETFS_SREQ_FOLIOS_UNLOCKED, &subreq->flags) &&
+			    test_bit(NETFS_SREQ_COPY_TO_CACHE, &subreq->flags))
+				__set_bit(NETFS_RREQ_COPY_TO_CACHE, &rreq->flags);
+			else
+				__clear_bit(NETFS_SREQ_COPY_TO_CACHE, &subreq->flags);
 		}
 	}
 
@@ -46,10 +53,35 @@ void netfs_rreq_unlock_folios(struct netfs_io_request *rreq)
 
 	rcu_read_lock();
 	xas_for_each(&xas, folio, last_page) {
-		unsigned int pgpos = (folio_index(folio) - start_page) * PAGE_SIZE;
-		unsigned int pgend = pgpos + folio_size(folio);
+		unsigned int pgpos, pgend;
 		bool pg_failed = false;
 
+		/* A folio starting before the request isn't one of ours */
+		if (folio_index(folio) < start_page)
+			continue;
+		pgpos = (folio_index(folio) - start_page) * PAGE_SIZE;
+		pgend = pgpos + folio_size(folio);
+
+		/* Skip subrequests whose folios were all unlocked when they
+		 * completed: those folios may be gone from the page cache by
+		 * now, or even replaced by someone else's locked folios, so
+		 * anything within them must be left alone.
+		 */
+		while (subreq && iopos + subreq->len <= pgpos) {
+			account += subreq->transferred;
+			iopos += subreq->len;
+			if (!list_is_last(&subreq->rreq_link, &rreq->subrequests)) {
+				subreq = list_next_entry(subreq, rreq_link);
+				subreq_failed = (subreq->error < 0);
+			} else {
+				subreq = NULL;
+				subreq_failed = false;
+			}
+		}
+		if (subreq && pgend <= iopos + subreq->len &&
+		    test_bit(NETFS_SREQ_FOLIOS_UNLOCKED, &subreq->flags))
+			continue;
+
 		for (;;) {
 			if (!subreq) {
 				pg_failed = true;
@@ -89,11 +121,61 @@ void netfs_rreq_unlock_folios(struct netfs_io_request *rreq)
 	}
 	rcu_read_unlock();
 
+	/* Account the trailing subrequests whose folios were all skipped */
+	for (; subreq; subreq = list_is_last(&subreq->rreq_link, &rreq->subrequests) ?
+		     NULL : list_next_entry(subreq, rreq_link))
+		account += subreq->transferred;
+
 	task_io_account_read(account);
 	if (rreq->netfs_ops->done)
 		rreq->netfs_ops->done(rreq);
 }
 
+/*
+ * Unlock the folios lying entirely within a readahead subrequest as soon as
+ * it has all its data, rather than when the whole request is done, so that
+ * readers of the extents that came in first don't wait on the slowest one.
+ * Folios straddling subrequests are left to netfs_rreq_unlock_folios(), as
+ * are the folios of synchronous reads, which hand their folio back locked.
+ *
+ * May be called in softirq mode.
+ */
+void netfs_subreq_unlock_folios(struct netfs_io_subrequest *subreq)
+{
+	struct netfs_io_request *rreq = subreq->rreq;
+	struct folio *folio;
+	loff_t end = subreq->start + subreq->len;
+
+	XA_STATE(xas, &rreq->mapping->i_pages, subreq->start / PAGE_SIZE);
+
+	if (rreq->origin != NETFS_READAHEAD ||
+	    test_bit(NETFS_RREQ_DONT_UNLOCK_FOLIOS, &rreq->flags))
+		return;
+
+	/* Data from the cache may yet be found to be stale */
+	if (subreq->source == NETFS_READ_FROM_CACHE &&
+	    rreq->netfs_ops->is_still_valid)
+		return;
+
+	rcu_read_lock();
+	xas_for_each(&xas, folio, (end - 1) / PAGE_SIZE) {
+		if (xas_retry(&xas, folio))
+			continue;
+		if (folio_pos(folio) < subreq->start ||
+		    folio_pos(folio) + folio_size(folio) > end)
+			continue;
+
+		if (test_bit(NETFS_SREQ_COPY_TO_CACHE, &subreq->flags))
+			folio_start_fscache(folio);
+		flush_dcache_folio(folio);
+		folio_mark_uptodate(folio);
+		folio_unlock(folio);
+	}
+	rcu_read_unlock();
+
+	set_bit(NETFS_SREQ_FOLIOS_UNLOCKED, &subreq->flags);
+}
+
 static void netfs_cache_expand_readahead(struct netfs_io_request *rreq,
 					 loff_t *_start, size_t *_len, loff_t i_size)
 {
@@ -19,6 +19,7 @@
  * buffered_read.c
  */
 void netfs_rreq_unlock_folios(struct netfs_io_request *rreq);
+void netfs_subreq_unlock_folios(struct netfs_io_subrequest *subreq);
 
 /*
  * io.c
@@ -433,6 +433,7 @@ void netfs_subreq_terminated(struct netfs_io_subrequest *subreq,
 	__clear_bit(NETFS_SREQ_NO_PROGRESS, &subreq->flags);
 	if (test_bit(NETFS_SREQ_COPY_TO_CACHE, &subreq->flags))
 		set_bit(NETFS_RREQ_COPY_TO_CACHE, &rreq->flags);
+	netfs_subreq_unlock_folios(subreq);
 
 out:
 	trace_netfs_sreq(subreq, netfs_sreq_trace_terminated);
@@ -535,10 +536,11 @@ netfs_rreq_prepare_read(struct netfs_io_request *rreq,
 }
 
 /*
- * Slice off a piece of a read request and submit an I/O request for it.
+ * Slice off a piece of a read request and work out where it's to be read from.
+ * The I/O is issued separately, once all of the slices are known.
  */
-static bool netfs_rreq_submit_slice(struct netfs_io_request *rreq,
-				    unsigned int *_debug_index)
+static bool netfs_rreq_prepare_slice(struct netfs_io_request *rreq,
+				     unsigned int *_debug_index)
 {
 	struct netfs_io_subrequest *subreq;
 	enum netfs_io_source source;
@@ -569,30 +571,80 @@ static bool netfs_rreq_submit_slice(struct netfs_io_request *rreq,
 	atomic_inc(&rreq->nr_outstanding);
 
 	rreq->submitted += subreq->len;
-
-	trace_netfs_sreq(subreq, netfs_sreq_trace_submit);
-	switch (source) {
-	case NETFS_FILL_WITH_ZEROES:
-		netfs_fill_with_zeroes(rreq, subreq);
-		break;
-	case NETFS_DOWNLOAD_FROM_SERVER:
-		netfs_read_from_server(rreq, subreq);
-		break;
-	case NETFS_READ_FROM_CACHE:
-		netfs_read_from_cache(rreq, subreq, NETFS_READ_HOLE_IGNORE);
-		break;
-	default:
-		BUG();
-	}
-
 	return true;
 
 subreq_failed:
 	rreq->error = subreq->error;
+	list_del_init(&subreq->rreq_link);
+	netfs_put_subrequest(subreq, false, netfs_sreq_trace_put_failed);
 	netfs_put_subrequest(subreq, false, netfs_sreq_trace_put_failed);
 	return false;
 }
 
+static void netfs_read_from_server_work(struct work_struct *work)
+{
+	struct netfs_io_subrequest *subreq =
+		container_of(work, struct netfs_io_subrequest, work);
+	unsigned int nofs_flags;
+
+	/* Keep to the allocation constraints of the readahead we came from */
+	nofs_flags = memalloc_nofs_save();
+	netfs_read_from_server(subreq->rreq, subreq);
+	memalloc_nofs_restore(nofs_flags);
+}
+
+/*
+ * Issue the I/O for all the slices of a read request.  The reads from the
+ * cache and the zero fills are issued first, as they don't depend on the
+ * server.  The downloads are then issued in parallel: all but the last one are
+ * handed to a workqueue, so that a netfs that does its ->issue_read()
+ * synchronously still has them all in flight at once rather than one after
+ * the other.
+ */
+static void netfs_rreq_issue_slices(struct netfs_io_request *rreq)
+{
+	struct netfs_io_subrequest *subreq, *last_download = NULL;
+
+	/* The slices can't go away whilst we hold nr_outstanding: they stay on
+	 * the list until the request is assessed.
+	 */
+	list_for_each_entry(subreq, &rreq->subrequests, rreq_link) {
+		if (subreq->source == NETFS_DOWNLOAD_FROM_SERVER) {
+			last_download = subreq;
+			continue;
+		}
+
+		trace_netfs_sreq(subreq, netfs_sreq_trace_submit);
+		switch (subreq->source) {
+		case NETFS_FILL_WITH_ZEROES:
+			netfs_fill_with_zeroes(rreq, subreq);
+			break;
+		case NETFS_READ_FROM_CACHE:
+			netfs_read_from_cache(rreq, subreq, NETFS_READ_HOLE_IGNORE);
+			break;
+		default:
+			BUG();
+		}
+	}
+
+	if (!last_download)
+		return;
+
+	list_for_each_entry(subreq, &rreq->subrequests, rreq_link) {
+		if (subreq->source != NETFS_DOWNLOAD_FROM_SERVER)
+			continue;
+
+		trace_netfs_sreq(subreq, netfs_sreq_trace_submit);
+		if (subreq == last_download) {
+			netfs_read_from_server(rreq, subreq);
+			break;
+		}
+
+		INIT_WORK(&subreq->work, netfs_read_from_server_work);
+		queue_work(system_unbound_wq, &subreq->work);
+	}
+}
+
 /*
  * Begin the process of reading in a chunk of data, where that data may be
  * stitched together from multiple sources, including multiple servers and the
@@ -618,15 +670,18 @@ int netfs_begin_read(struct netfs_io_request *rreq, bool sync)
 		netfs_get_request(rreq, netfs_rreq_trace_get_hold);
 
 	/* Chop the read into slices according to what the cache and the netfs
-	 * want and submit each one.
+	 * want, then submit them all.  Whatever got sliced is still read if we
+	 * fail to slice the rest, leaving the request short.
 	 */
 	atomic_set(&rreq->nr_outstanding, 1);
 	do {
-		if (!netfs_rreq_submit_slice(rreq, &debug_index))
+		if (!netfs_rreq_prepare_slice(rreq, &debug_index))
 			break;
 
 	} while (rreq->submitted < rreq->len);
 
+	netfs_rreq_issue_slices(rreq);
+
 	if (sync) {
 		/* Keep nr_outstanding incremented so that the ref always belongs to
 		 * us, and the service code isn't punted off to a random thread pool to
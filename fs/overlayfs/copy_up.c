@@ -19,6 +19,7 @@
 #include <linux/fdtable.h>
 #include <linux/ratelimit.h>
 #include <linux/exportfs.h>
+#include <linux/workqueue.h>
 #include "overlayfs.h"
 
 #define OVL_COPY_UP_CHUNK_SIZE (1 << 20)
@@ -193,36 +194,25 @@ static int ovl_copy_fileattr(struct inode *inode, struct path *old,
 	return ovl_real_fileattr_set(new, &newfa);
 }
 
-static int ovl_copy_up_data(struct ovl_fs *ofs, struct path *old,
-			    struct path *new, loff_t len)
+/*
+ * Copy [pos, pos + len) of old_file to the same offsets of new_file, by
+ * cloning if the filesystem can do that and skipping holes of old_file.
+ */
+static int ovl_copy_up_file_range(struct file *old_file, struct file *new_file,
+				  loff_t pos, loff_t len)
 {
-	struct file *old_file;
-	struct file *new_file;
-	loff_t old_pos = 0;
-	loff_t new_pos = 0;
+	loff_t old_pos = pos;
+	loff_t new_pos = pos;
 	loff_t cloned;
 	loff_t data_pos = -1;
 	loff_t hole_len;
 	bool skip_hole = false;
 	int error = 0;
 
-	if (len == 0)
-		return 0;
-
-	old_file = ovl_path_open(old, O_LARGEFILE | O_RDONLY);
-	if (IS_ERR(old_file))
-		return PTR_ERR(old_file);
-
-	new_file = ovl_path_open(new, O_LARGEFILE | O_WRONLY);
-	if (IS_ERR(new_file)) {
-		error = PTR_ERR(new_file);
-		goto out_fput;
-	}
-
 	/* Try to use clone_file_range to clone up within the same fs */
-	cloned = do_clone_file_range(old_file, 0, new_file, 0, len, 0);
+	cloned = do_clone_file_range(old_file, pos, new_file, pos, len, 0);
 	if (cloned == len)
-		goto out;
+		return 0;
 	/* Couldn't clone, so now we try to copy the data */
 
 	/* Check if lower fs supports seek operation */
@@ -262,6 +252,8 @@ static int ovl_copy_up_data(struct ovl_fs *ofs, struct path *old,
 			data_pos = vfs_llseek(old_file, old_pos, SEEK_DATA);
 			if (data_pos > old_pos) {
 				hole_len = data_pos - old_pos;
+				if (hole_len >= len)
+					break;
 				len -= hole_len;
 				old_pos = new_pos = data_pos;
 				continue;
@@ -283,7 +275,30 @@ static int ovl_copy_up_data(struct ovl_fs *ofs, struct path *old,
 
 		len -= bytes;
 	}
-out:
+	return error;
+}
+
+static int ovl_copy_up_data(struct ovl_fs *ofs, struct path *old,
+			    struct path *new, loff_t len)
+{
+	struct file *old_file;
+	struct file *new_file;
+	int error;
+
+	if (len == 0)
+		return 0;
+
+	old_file = ovl_path_open(old, O_LARGEFILE | O_RDONLY);
+	if (IS_ERR(old_file))
+		return PTR_ERR(old_file);
+
+	new_file = ovl_path_open(new, O_LARGEFILE | O_WRONLY);
+	if (IS_ERR(new_file)) {
+		error = PTR_ERR(new_file);
+		goto out_fput;
+	}
+
+	error = ovl_copy_up_file_range(old_file, new_file, 0, len);
 	if (!error && ovl_should_sync(ofs))
 		error = vfs_fsync(new_file, 0);
 	fput(new_file);
@@ -848,6 +863,17 @@ static int ovl_do_copy_up(struct ovl_copy_up_ctx *c)
 	return err;
 }
 
+/*
+ * A file in the middle of a lazy copy up can't be mapped shared writable, see
+ * ovl_lazy_mmap_file(), so only opens that can't map the file at all start
+ * one.  Truncate and the other users of ovl_copy_up_with_data() pass
+ * O_WRONLY.
+ */
+static bool ovl_open_lazy_copy_up(struct ovl_fs *ofs, int flags)
+{
+	return ofs->config.lazy_copyup && (flags & O_ACCMODE) == O_WRONLY;
+}
+
 static bool ovl_need_meta_copy_up(struct dentry *dentry, umode_t mode,
 				  int flags)
 {
@@ -859,7 +885,12 @@ static bool ovl_need_meta_copy_up(struct dentry *dentry, umode_t mode,
 	if (!S_ISREG(mode))
 		return false;
 
-	if (flags && ((OPEN_FMODE(flags) & FMODE_WRITE) || (flags & O_TRUNC)))
+	if (flags & O_TRUNC)
+		return false;
+
+	/* Data is copied up lazily after the metadata copy up */
+	if (flags && (OPEN_FMODE(flags) & FMODE_WRITE) &&
+	    !ovl_open_lazy_copy_up(ofs, flags))
 		return false;
 
 	return true;
@@ -888,8 +919,705 @@ static ssize_t ovl_getxattr(struct dentry *dentry, char *name, char **value)
 	return res;
 }
 
+/*
+ * Lazy data copy up.
+ *
+ * With lazy_copyup=on, the data of a large file is not copied up when it is
+ * first opened for write.  The file is copied up metadata only, and its data
+ * is split into chunks that are copied up by a background work.  A chunk
+ * that is about to be written to is copied up right away.  Until all
+ * chunks are copied up, reads of the chunks that are not copied up yet are
+ * served from the lower data file.
+ *
+ * The chunks copied up so far are recorded in the "lazy" xattr on the upper
+ * file, next to the "metacopy" xattr, so the copy up resumes after the inode
+ * is evicted or the overlay is mounted again.  The upper file also gets an
+ * empty "redirect" xattr.  Kernels that don't know about lazy copy up reject
+ * it and fail the lookup, instead of copying up the data of the metacopy
+ * file again from the lower file, over the chunks that were modified.  The
+ * xattrs are removed when the last chunk is copied up.
+ */
+#define OVL_LAZY_MIN_SIZE	(16 << 20)
+#define OVL_LAZY_MIN_SHIFT	20
+/* OVL_LAZY_MAX_CHUNKS << OVL_LAZY_MAX_SHIFT fits in loff_t */
+#define OVL_LAZY_MAX_SHIFT	48
+#define OVL_LAZY_MAX_CHUNKS	(1 << 14)
+#define OVL_LAZY_VERSION	1
+/* Data or size of the file changed since the copy up started */
+#define OVL_LAZY_MODIFIED	0x1
+
+/* On-disk format of the lazy xattr */
+struct ovl_lazy_map {
+	u8 version;
+	u8 chunk_shift;
+	__le16 flags;
+	__le32 nr_chunks;
+	__le32 map[];	/* bit set for every chunk that is copied up */
+} __packed;
+
+struct ovl_lazy {
+	struct inode *inode;
+	struct file *upper;
+	struct file *lower;
+	/* serializes copy up of chunks and updates of the map */
+	struct mutex lock;
+	struct work_struct work;
+	unsigned int chunk_shift;
+	unsigned int nr_chunks;
+	unsigned int nr_left;
+	bool modified;
+	struct ovl_lazy_map *map;
+	unsigned long copied[];
+};
+
+static size_t ovl_lazy_map_size(unsigned int nr_chunks)
+{
+	return sizeof(struct ovl_lazy_map) +
+	       DIV_ROUND_UP(nr_chunks, 32) * sizeof(__le32);
+}
+
+/* Only valid once OVL_LAZYDATA was seen set, the struct stays until evict */
+static struct ovl_lazy *ovl_lazy(struct inode *inode)
+{
+	/* Pairs with smp_wmb() in ovl_lazy_install() */
+	smp_rmb();
+	return OVL_I(inode)->lazy;
+}
+
+static void ovl_lazy_work(struct work_struct *work);
+
+static struct ovl_lazy *ovl_lazy_alloc(struct dentry *dentry,
+				       unsigned int chunk_shift,
+				       unsigned int nr_chunks)
+{
+	int flags = sb_rdonly(dentry->d_sb) ? O_RDONLY : O_RDWR;
+	struct path upperpath, datapath;
+	struct ovl_lazy *lazy;
+	int err;
+
+	ovl_path_upper(dentry, &upperpath);
+	if (WARN_ON(upperpath.dentry == NULL))
+		return ERR_PTR(-EIO);
+
+	ovl_path_lowerdata(dentry, &datapath);
+	if (WARN_ON(datapath.dentry == NULL))
+		return ERR_PTR(-EIO);
+
+	lazy = kzalloc(struct_size(lazy, copied, BITS_TO_LONGS(nr_chunks)),
+		       GFP_KERNEL);
+	if (!lazy)
+		return ERR_PTR(-ENOMEM);
+
+	err = -ENOMEM;
+	lazy->map = kzalloc(ovl_lazy_map_size(nr_chunks), GFP_KERNEL);
+	if (!lazy->map)
+		goto out_free;
+
+	lazy->upper = ovl_path_open(&upperpath, O_LARGEFILE | flags);
+	if (IS_ERR(lazy->upper)) {
+		err = PTR_ERR(lazy->upper);
+		goto out_free;
+	}
+
+	lazy->lower = ovl_path_open(&datapath, O_LARGEFILE | O_RDONLY);
+	if (IS_ERR(lazy->lower)) {
+		err = PTR_ERR(lazy->lower);
+		goto out_fput;
+	}
+
+	lazy->inode = d_inode(dentry);
+	mutex_init(&lazy->lock);
+	INIT_WORK(&lazy->work, ovl_lazy_work);
+	lazy->chunk_shift = chunk_shift;
+	lazy->nr_chunks = nr_chunks;
+	lazy->nr_left = nr_chunks;
+
+	return lazy;
+
+out_fput:
+	fput(lazy->upper);
+out_free:
+	kfree(lazy->map);
+	kfree(lazy);
+	return ERR_PTR(err);
+}
+
+static void ovl_lazy_destroy(struct ovl_lazy *lazy)
+{
+	fput(lazy->lower);
+	fput(lazy->upper);
+	mutex_destroy(&lazy->lock);
+	kfree(lazy->map);
+	kfree(lazy);
+}
+
+static void ovl_lazy_install(struct ovl_lazy *lazy)
+{
+	struct inode *inode = lazy->inode;
+
+	OVL_I(inode)->lazy = lazy;
+	/* Pairs with smp_rmb() in ovl_lazy() */
+	smp_wmb();
+	ovl_set_flag(OVL_LAZYDATA, inode);
+
+	if (lazy->upper->f_mode & FMODE_WRITE)
+		queue_work(system_unbound_wq, &lazy->work);
+}
+
+/*
+ * Chunks from @end on are written as copied up, whether they are or not.
+ * Caller should hold lazy->lock.
+ */
+static int __ovl_lazy_write_map(struct ovl_lazy *lazy, unsigned int end)
+{
+	struct ovl_fs *ofs = OVL_FS(lazy->inode->i_sb);
+	struct ovl_lazy_map *map = lazy->map;
+	size_t size = ovl_lazy_map_size(lazy->nr_chunks);
+	unsigned int i;
+
+	memset(map, 0, size);
+	map->version = OVL_LAZY_VERSION;
+	map->chunk_shift = lazy->chunk_shift;
+	if (lazy->modified)
+		map->flags |= cpu_to_le16(OVL_LAZY_MODIFIED);
+	map->nr_chunks = cpu_to_le32(lazy->nr_chunks);
+	for (i = 0; i < lazy->nr_chunks; i++)
+		if (i >= end || test_bit(i, lazy->copied))
+			map->map[i / 32] |= cpu_to_le32(BIT(i % 32));
+
+	return ovl_do_setxattr(ofs, lazy->upper->f_path.dentry, OVL_XATTR_LAZY,
+			       map, size);
+}
+
+/* Caller should hold lazy->lock */
+static int ovl_lazy_write_map(struct ovl_lazy *lazy)
+{
+	return __ovl_lazy_write_map(lazy, lazy->nr_chunks);
+}
+
+/* Caller should hold lazy->lock and freeze protection of upper fs */
+static int ovl_lazy_copy_chunk(struct ovl_lazy *lazy, unsigned int idx)
+{
+	struct ovl_fs *ofs = OVL_FS(lazy->inode->i_sb);
+	struct dentry *upper = lazy->upper->f_path.dentry;
+	loff_t pos = (loff_t)idx << lazy->chunk_shift;
+	loff_t len = 1LL << lazy->chunk_shift;
+	loff_t size;
+	char *capability = NULL;
+	ssize_t cap_size;
+	int err;
+
+	/* Don't extend an upper file that was truncated meanwhile */
+	size = min(i_size_read(file_inode(lazy->lower)),
+		   i_size_read(file_inode(lazy->upper)));
+	len = min(len, size - pos);
+	if (len > 0) {
+		err = cap_size = ovl_getxattr(upper, XATTR_NAME_CAPS,
+					      &capability);
+		if (cap_size < 0)
+			return err;
+
+		err = ovl_copy_up_file_range(lazy->lower, lazy->upper, pos,
+					     len);
+		if (!err && ovl_should_sync(ofs))
+			err = vfs_fsync_range(lazy->upper, pos, pos + len - 1,
+					      1);
+		/* Writing to upper file will clear security.capability xattr */
+		if (!err && capability)
+			err = vfs_setxattr(&init_user_ns, upper,
+					   XATTR_NAME_CAPS, capability,
+					   cap_size, 0);
+		kfree(capability);
+		if (err)
+			return err;
+	}
+
+	/* Pairs with smp_rmb() in ovl_lazy_real_file() */
+	smp_mb__before_atomic();
+	set_bit(idx, lazy->copied);
+	lazy->nr_left--;
+
+	err = ovl_lazy_write_map(lazy);
+	if (err) {
+		clear_bit(idx, lazy->copied);
+		lazy->nr_left++;
+	}
+	return err;
+}
+
+static int ovl_lazy_finish(struct ovl_lazy *lazy)
+{
+	struct inode *inode = lazy->inode;
+	struct ovl_fs *ofs = OVL_FS(inode->i_sb);
+	struct dentry *upper = lazy->upper->f_path.dentry;
+	int err = 0;
+
+	ovl_inode_lock(inode);
+	if (!ovl_is_lazy(inode))
+		goto out;
+
+	/*
+	 * A lazy map is only looked at on a metacopy upper, so drop that
+	 * first, the empty redirect is only valid next to a lazy map.
+	 */
+	err = ovl_do_removexattr(ofs, upper, OVL_XATTR_METACOPY);
+	if (!err || err == -ENODATA)
+		err = ovl_do_removexattr(ofs, upper, OVL_XATTR_REDIRECT);
+	if (!err || err == -ENODATA)
+		err = ovl_do_removexattr(ofs, upper, OVL_XATTR_LAZY);
+	if (err == -ENODATA)
+		err = 0;
+	if (!err) {
+		ovl_set_upperdata(inode);
+		ovl_clear_flag(OVL_LAZYDATA, inode);
+	}
+out:
+	ovl_inode_unlock(inode);
+	return err;
+}
+
+/* Copies up one chunk per run, so writers get a chance to take the lock */
+static void ovl_lazy_work(struct work_struct *work)
+{
+	struct ovl_lazy *lazy = container_of(work, struct ovl_lazy, work);
+	const struct cred *old_cred;
+	unsigned int idx;
+	bool done;
+	int err = 0;
+
+	old_cred = ovl_override_creds(lazy->inode->i_sb);
+	file_start_write(lazy->upper);
+
+	mutex_lock(&lazy->lock);
+	idx = find_first_zero_bit(lazy->copied, lazy->nr_chunks);
+	if (idx < lazy->nr_chunks)
+		err = ovl_lazy_copy_chunk(lazy, idx);
+	done = !lazy->nr_left;
+	/* Not while a truncate holds the lock with the chunks past EOF marked */
+	if (!err && done)
+		err = ovl_lazy_finish(lazy);
+	mutex_unlock(&lazy->lock);
+
+	file_end_write(lazy->upper);
+	revert_creds(old_cred);
+
+	if (err)
+		pr_warn_ratelimited("lazy copy up of %pd2 failed (%i)\n",
+				    lazy->upper->f_path.dentry, err);
+	else if (!done)
+		queue_work(system_unbound_wq, &lazy->work);
+}
+
+static int ovl_lazy_copy_up_start(struct dentry *dentry, loff_t size)
+{
+	struct ovl_fs *ofs = OVL_FS(dentry->d_sb);
+	unsigned int chunk_shift = OVL_LAZY_MIN_SHIFT;
+	struct dentry *upper;
+	struct ovl_lazy *lazy;
+	int err;
+
+	/* The empty redirect would replace the one of a renamed file */
+	if (ovl_dentry_get_redirect(dentry))
+		return -EXDEV;
+
+	while (size > ((loff_t)OVL_LAZY_MAX_CHUNKS << chunk_shift))
+		chunk_shift++;
+
+	lazy = ovl_lazy_alloc(dentry, chunk_shift,
+			      DIV_ROUND_UP_ULL(size, 1ULL << chunk_shift));
+	if (IS_ERR(lazy))
+		return PTR_ERR(lazy);
+
+	/* Without the redirect, the map is ignored, see ovl_lazy_load() */
+	upper = lazy->upper->f_path.dentry;
+	err = ovl_lazy_write_map(lazy);
+	if (!err)
+		err = ovl_do_setxattr(ofs, upper, OVL_XATTR_REDIRECT, "", 0);
+	if (err) {
+		ovl_do_removexattr(ofs, upper, OVL_XATTR_LAZY);
+		ovl_lazy_destroy(lazy);
+		return err;
+	}
+
+	ovl_lazy_install(lazy);
+	return 0;
+}
+
+/*
+ * Pick up a lazy copy up that was started before the inode was evicted.
+ * Caller should hold ovl_inode->lock.
+ */
+int ovl_lazy_load(struct dentry *dentry)
+{
+	struct ovl_fs *ofs = OVL_FS(dentry->d_sb);
+	struct inode *inode = d_inode(dentry);
+	struct dentry *upper = ovl_dentry_upper(dentry);
+	struct ovl_lazy_map *map;
+	struct ovl_lazy *lazy;
+	unsigned int i, nr_chunks;
+	ssize_t res;
+	int err;
+
+	if (!upper || !d_is_reg(dentry) || ovl_is_lazy(inode) ||
+	    ovl_has_upperdata(inode))
+		return 0;
+
+	/*
+	 * A lazy copy up that didn't get its empty redirect never started,
+	 * the metacopy file is left as is.
+	 */
+	res = ovl_do_getxattr(ofs, upper, OVL_XATTR_REDIRECT, NULL, 0);
+	if (res == -ENODATA || res == -EOPNOTSUPP || res > 0)
+		return 0;
+	if (res < 0)
+		return res;
+
+	res = ovl_do_getxattr(ofs, upper, OVL_XATTR_LAZY, NULL, 0);
+	if (res == -ENODATA || res == -EOPNOTSUPP)
+		return 0;
+	if (res < 0)
+		return res;
+
+	map = kzalloc(res, GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+
+	res = ovl_do_getxattr(ofs, upper, OVL_XATTR_LAZY, map, res);
+	if (res < 0) {
+		err = res;
+		goto out;
+	}
+
+	err = -EIO;
+	if (res < sizeof(*map))
+		goto invalid;
+
+	nr_chunks = le32_to_cpu(map->nr_chunks);
+	if (map->version != OVL_LAZY_VERSION ||
+	    map->chunk_shift < OVL_LAZY_MIN_SHIFT ||
+	    map->chunk_shift > OVL_LAZY_MAX_SHIFT ||
+	    !nr_chunks || nr_chunks > OVL_LAZY_MAX_CHUNKS ||
+	    res != ovl_lazy_map_size(nr_chunks))
+		goto invalid;
+
+	lazy = ovl_lazy_alloc(dentry, map->chunk_shift, nr_chunks);
+	if (IS_ERR(lazy)) {
+		err = PTR_ERR(lazy);
+		goto out;
+	}
+
+	lazy->modified = le16_to_cpu(map->flags) & OVL_LAZY_MODIFIED;
+	for (i = 0; i < nr_chunks; i++) {
+		if (le32_to_cpu(map->map[i / 32]) & BIT(i % 32)) {
+			__set_bit(i, lazy->copied);
+			lazy->nr_left--;
+		}
+	}
+	/* With nr_left == 0 the work just has to clean up the xattrs */
+	ovl_lazy_install(lazy);
+	err = 0;
+out:
+	kfree(map);
+	return err;
+
+invalid:
+	pr_warn_ratelimited("invalid lazy copy up map (%pd2)\n", upper);
+	goto out;
+}
+
+/**
+ * ovl_lazy_real_file - pick the real file to read data of a lazy inode from
+ * @inode: overlay inode with OVL_LAZYDATA seen set
+ * @pos: position of the read
+ * @len: length of the read, trimmed to what is read from the returned file
+ *
+ * Returns the lower data file for chunks not copied up yet, otherwise the
+ * upper file.  Data past the end of the lower file, from writes or truncate
+ * that extended the file, is only in the upper file.
+ */
+struct file *ovl_lazy_real_file(struct inode *inode, loff_t pos, size_t *len)
+{
+	struct ovl_lazy *lazy = ovl_lazy(inode);
+	loff_t size = i_size_read(file_inode(lazy->upper));
+	loff_t lower_size = i_size_read(file_inode(lazy->lower));
+	loff_t idx = pos >> lazy->chunk_shift;
+	loff_t end = (idx + 1) << lazy->chunk_shift;
+	bool copied;
+
+	if (pos >= size || pos >= lower_size || idx >= lazy->nr_chunks)
+		return lazy->upper;
+
+	copied = test_bit(idx, lazy->copied);
+	/* Pairs with smp_mb__before_atomic() in ovl_lazy_copy_chunk() */
+	smp_rmb();
+
+	end = min(end, size);
+	if (!copied)
+		end = min(end, lower_size);
+	if (*len > end - pos)
+		*len = end - pos;
+
+	return copied ? lazy->upper : lazy->lower;
+}
+
+/* Caller should hold lazy->lock */
+static int ovl_lazy_set_modified(struct ovl_lazy *lazy)
+{
+	int err;
+
+	if (lazy->modified)
+		return 0;
+
+	lazy->modified = true;
+	err = ovl_lazy_write_map(lazy);
+	if (err)
+		lazy->modified = false;
+	return err;
+}
+
+static int ovl_lazy_copy_range(struct inode *inode, loff_t pos, loff_t len,
+			       bool modify)
+{
+	struct ovl_lazy *lazy;
+	const struct cred *old_cred;
+	unsigned long idx, end;
+	int err;
+
+	if (!ovl_is_lazy(inode) || len <= 0)
+		return 0;
+
+	lazy = ovl_lazy(inode);
+	if (!(lazy->upper->f_mode & FMODE_WRITE))
+		return -EROFS;
+
+	idx = min_t(loff_t, lazy->nr_chunks, pos >> lazy->chunk_shift);
+	if (len > LLONG_MAX - pos)
+		len = LLONG_MAX - pos;
+	end = min_t(loff_t, lazy->nr_chunks,
+		    ((pos + len - 1) >> lazy->chunk_shift) + 1);
+
+	old_cred = ovl_override_creds(inode->i_sb);
+	err = mutex_lock_killable(&lazy->lock);
+	if (!err) {
+		for_each_clear_bit_from(idx, lazy->copied, end) {
+			err = -EINTR;
+			if (fatal_signal_pending(current))
+				break;
+			err = ovl_lazy_copy_chunk(lazy, idx);
+			if (err)
+				break;
+		}
+		if (!err && modify)
+			err = ovl_lazy_set_modified(lazy);
+		mutex_unlock(&lazy->lock);
+	}
+	revert_creds(old_cred);
+
+	return err;
+}
+
+/*
+ * Copy up the chunks in [pos, pos + len) before they get read from the upper
+ * file, or modified if @modify is set.
+ * Caller should hold freeze protection of upper fs.
+ */
+int ovl_lazy_copy_up_range(struct inode *inode, loff_t pos, loff_t len,
+			   bool modify)
+{
+	return ovl_lazy_copy_range(inode, pos, len, modify);
+}
+
+/* Caller should hold freeze protection of upper fs */
+static int __ovl_lazy_complete(struct inode *inode)
+{
+	struct ovl_lazy *lazy;
+	const struct cred *old_cred;
+	int err;
+
+	if (!ovl_is_lazy(inode))
+		return 0;
+
+	err = ovl_lazy_copy_range(inode, 0, LLONG_MAX, false);
+	if (err)
+		return err;
+
+	lazy = ovl_lazy(inode);
+	old_cred = ovl_override_creds(inode->i_sb);
+	err = mutex_lock_killable(&lazy->lock);
+	if (!err) {
+		if (!lazy->nr_left)
+			err = ovl_lazy_finish(lazy);
+		mutex_unlock(&lazy->lock);
+	}
+	revert_creds(old_cred);
+
+	return err;
+}
+
+/*
+ * Complete the copy up now, for operations that need all of the data in the
+ * upper file of an open file.
+ */
+int ovl_lazy_copy_up_all(struct inode *inode)
+{
+	struct ovl_lazy *lazy;
+	int err;
+
+	if (!ovl_is_lazy(inode))
+		return 0;
+
+	lazy = ovl_lazy(inode);
+	file_start_write(lazy->upper);
+	err = __ovl_lazy_complete(inode);
+	file_end_write(lazy->upper);
+
+	return err;
+}
+
+/*
+ * Complete the copy up of a file that may not have been opened since it was
+ * looked up, for operations that give it a redirect, which would replace the
+ * empty one of the lazy copy up.
+ * Caller should hold freeze protection of upper fs.
+ */
+int ovl_lazy_complete(struct dentry *dentry)
+{
+	struct inode *inode = d_inode(dentry);
+	const struct cred *old_cred;
+	int err;
+
+	if (ovl_inode_upper(inode) && !ovl_has_upperdata(inode) &&
+	    !ovl_is_lazy(inode)) {
+		old_cred = ovl_override_creds(dentry->d_sb);
+		ovl_inode_lock(inode);
+		err = ovl_lazy_load(dentry);
+		ovl_inode_unlock(inode);
+		revert_creds(old_cred);
+		if (err)
+			return err;
+	}
+
+	return __ovl_lazy_complete(inode);
+}
+
+/**
+ * ovl_lazy_mmap_file - pick the real file to map for a lazy inode
+ * @inode: overlay inode with OVL_LAZYDATA seen set
+ * @vma: the new mapping
+ *
+ * Pages of a mapping are not copied up chunk by chunk before they are
+ * written to, and ->mmap() runs under mmap_lock, so it can't wait for the
+ * copy up to complete.  Opens that allow a shared writable mapping complete
+ * the copy up instead, see ovl_open().  Other mappings map the lower data,
+ * as long as nothing modified the file since the copy up started.  Like the
+ * mapping of a lower file that is copied up later, they don't see changes to
+ * the file.
+ *
+ * Returns NULL if the mapping has to be served from the page cache of the
+ * overlay inode, see ovl_readpage().
+ */
+struct file *ovl_lazy_mmap_file(struct inode *inode, struct vm_area_struct *vma)
+{
+	struct ovl_lazy *lazy = ovl_lazy(inode);
+	bool shared_write = (vma->vm_flags & (VM_SHARED | VM_MAYWRITE)) ==
+			    (VM_SHARED | VM_MAYWRITE);
+
+	if (!shared_write && !READ_ONCE(lazy->modified))
+		return lazy->lower;
+
+	return NULL;
+}
+
+/**
+ * ovl_lazy_truncate_begin - prepare a lazy inode for truncate
+ * @inode: overlay inode
+ * @size: the new size
+ * @locked: set when the copy up is locked until ovl_lazy_truncate_end()
+ *
+ * Copies up the chunk that contains the new size and marks the chunks past
+ * it as copied up, so the lower data past the new size is never copied up
+ * after the upper file was truncated.  Copy up stays locked until the upper
+ * file is truncated.  Caller should hold freeze protection of upper fs.
+ */
+int ovl_lazy_truncate_begin(struct inode *inode, loff_t size, bool *locked)
+{
+	struct ovl_lazy *lazy;
+	const struct cred *old_cred;
+	unsigned long idx, end;
+	bool modified;
+	int err;
+
+	*locked = false;
+	if (!ovl_is_lazy(inode))
+		return 0;
+
+	lazy = ovl_lazy(inode);
+	if (!(lazy->upper->f_mode & FMODE_WRITE))
+		return -EROFS;
+
+	old_cred = ovl_override_creds(inode->i_sb);
+	err = mutex_lock_killable(&lazy->lock);
+	if (err)
+		goto out;
+
+	idx = size >> lazy->chunk_shift;
+	if ((size & ((1LL << lazy->chunk_shift) - 1)) &&
+	    idx < lazy->nr_chunks && !test_bit(idx, lazy->copied))
+		err = ovl_lazy_copy_chunk(lazy, idx);
+	if (err)
+		goto out_unlock;
+
+	/* Mark the chunks on disk first, in case the upper file is truncated */
+	end = min_t(loff_t, lazy->nr_chunks,
+		    DIV_ROUND_UP_ULL(size, 1ULL << lazy->chunk_shift));
+	modified = lazy->modified;
+	lazy->modified = true;
+	err = __ovl_lazy_write_map(lazy, end);
+	if (err) {
+		lazy->modified = modified;
+		goto out_unlock;
+	}
+	for (idx = end; idx < lazy->nr_chunks; idx++) {
+		if (!test_and_set_bit(idx, lazy->copied))
+			lazy->nr_left--;
+	}
+
+	*locked = true;
+	revert_creds(old_cred);
+	return 0;
+
+out_unlock:
+	mutex_unlock(&lazy->lock);
+out:
+	revert_creds(old_cred);
+	return err;
+}
+
+void ovl_lazy_truncate_end(struct inode *inode, bool locked)
+{
+	struct ovl_lazy *lazy;
+
+	if (!locked)
+		return;
+
+	lazy = ovl_lazy(inode);
+	mutex_unlock(&lazy->lock);
+}
+
+void ovl_lazy_free(struct inode *inode)
+{
+	struct ovl_lazy *lazy = OVL_I(inode)->lazy;
+
+	if (!lazy)
+		return;
+
+	cancel_work_sync(&lazy->work);
+	ovl_lazy_destroy(lazy);
+	OVL_I(inode)->lazy = NULL;
+}
+
 /* Copy up data of an inode which was copied up metadata only in the past. */
-static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
+static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c, int flags)
 {
 	struct ovl_fs *ofs = OVL_FS(c->dentry->d_sb);
 	struct path upperpath, datapath;
@@ -897,6 +1625,16 @@ static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
 	char *capability = NULL;
 	ssize_t cap_size;
 
+	err = ovl_lazy_load(c->dentry);
+	if (err || ovl_is_lazy(d_inode(c->dentry)))
+		return err;
+
+	/* Fall back to copying up all the data if lazy copy up can't start */
+	if (ovl_open_lazy_copy_up(ofs, flags) &&
+	    c->stat.size >= OVL_LAZY_MIN_SIZE &&
+	    !ovl_lazy_copy_up_start(c->dentry, c->stat.size))
+		return 0;
+
 	ovl_path_upper(c->dentry, &upperpath);
 	if (WARN_ON(upperpath.dentry == NULL))
 		return -EIO;
@@ -995,7 +1733,7 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 		if (!err && parent && !ovl_dentry_has_upper_alias(dentry))
 			err = ovl_link_up(&ctx);
 		if (!err && ovl_dentry_needs_data_copy_up_locked(dentry, flags))
-			err = ovl_copy_up_meta_inode_data(&ctx);
+			err = ovl_copy_up_meta_inode_data(&ctx, flags);
 		ovl_copy_up_end(dentry);
 	}
 	do_delayed_call(&done);
@@ -712,6 +712,11 @@ static int ovl_link(struct dentry *old, struct inode *newdir,
 	if (err)
 		goto out_drop_write;
 
+	/* A lazy copy up has an empty redirect that can't be replaced */
+	err = ovl_lazy_complete(old);
+	if (err)
+		goto out_drop_write;
+
 	if (ovl_is_metacopy_dentry(old)) {
 		err = ovl_set_link_redirect(old);
 		if (err)
@@ -1139,11 +1144,18 @@ static int ovl_rename(struct user_namespace *mnt_userns, struct inode *olddir,
 	if (err)
 		goto out_drop_write;
 
+	/* A lazy copy up has an empty redirect that can't be replaced */
+	err = ovl_lazy_complete(old);
+	if (err)
+		goto out_drop_write;
+
 	err = ovl_copy_up(new->d_parent);
 	if (err)
 		goto out_drop_write;
 	if (!overwrite) {
 		err = ovl_copy_up(new);
+		if (!err)
+			err = ovl_lazy_complete(new);
 		if (err)
 			goto out_drop_write;
 	} else if (d_inode(new)) {
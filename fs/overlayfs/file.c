@@ -13,6 +13,8 @@
 #include <linux/security.h>
 #include <linux/mm.h>
 #include <linux/fs.h>
+#include <linux/falloc.h>
+#include <linux/pagemap.h>
 #include "overlayfs.h"
 
 struct ovl_aio_req {
@@ -145,12 +147,36 @@ static int ovl_real_fdget(const struct file *file, struct fd *real)
 static int ovl_open(struct inode *inode, struct file *file)
 {
 	struct file *realfile;
+	const struct cred *old_cred;
 	int err;
 
 	err = ovl_maybe_copy_up(file_dentry(file), file->f_flags);
 	if (err)
 		return err;
 
+	/* Data of a metacopy upper may be in the middle of a lazy copy up */
+	if (ovl_inode_upper(inode) && !ovl_has_upperdata(inode) &&
+	    !ovl_is_lazy(inode)) {
+		old_cred = ovl_override_creds(inode->i_sb);
+		ovl_inode_lock(inode);
+		err = ovl_lazy_load(file_dentry(file));
+		ovl_inode_unlock(inode);
+		revert_creds(old_cred);
+		if (err)
+			return err;
+	}
+
+	/*
+	 * A shared writable mapping needs all of the data in the upper file,
+	 * and ->mmap() can't wait for it, see ovl_lazy_mmap_file().
+	 */
+	if ((file->f_mode & (FMODE_READ | FMODE_WRITE)) ==
+	    (FMODE_READ | FMODE_WRITE)) {
+		err = ovl_lazy_copy_up_all(inode);
+		if (err)
+			return err;
+	}
+
 	/* No longer need these flags, so don't pass them on to underlying fs */
 	file->f_flags &= ~(O_CREAT | O_EXCL | O_NOCTTY | O_TRUNC);
 
@@ -189,6 +215,13 @@ static loff_t ovl_llseek(struct file *file, loff_t offset, int whence)
 			return vfs_setpos(file, 0, 0);
 	}
 
+	/* Holes of the upper file are not holes of a lazy copy up */
+	if (whence == SEEK_DATA || whence == SEEK_HOLE) {
+		ret = ovl_lazy_copy_up_all(inode);
+		if (ret)
+			return ret;
+	}
+
 	ret = ovl_real_fdget(file, &real);
 	if (ret)
 		return ret;
@@ -290,6 +323,43 @@ static void ovl_aio_rw_complete(struct kiocb *iocb, long res)
 	orig_iocb->ki_complete(orig_iocb, res);
 }
 
+/*
+ * Until a lazy copy up completes, read chunk by chunk from the lower or the
+ * upper file, depending on whether the chunk was copied up yet.
+ */
+static ssize_t ovl_lazy_read_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct file *realfile;
+	const struct cred *old_cred;
+	size_t count, len;
+	ssize_t ret = 0, res;
+
+	old_cred = ovl_override_creds(inode->i_sb);
+	while ((count = iov_iter_count(iter))) {
+		len = count;
+		realfile = ovl_lazy_real_file(inode, iocb->ki_pos, &len);
+
+		iov_iter_truncate(iter, len);
+		res = vfs_iter_read(realfile, iter, &iocb->ki_pos,
+				    ovl_iocb_to_rwf(iocb->ki_flags));
+		iov_iter_reexpand(iter, count - max_t(ssize_t, res, 0));
+		if (res <= 0) {
+			if (!ret)
+				ret = res;
+			break;
+		}
+		ret += res;
+		if (res < len)
+			break;
+	}
+	revert_creds(old_cred);
+	ovl_file_accessed(file);
+
+	return ret;
+}
+
 static ssize_t ovl_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 {
 	struct file *file = iocb->ki_filp;
@@ -300,6 +370,9 @@ static ssize_t ovl_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 	if (!iov_iter_count(iter))
 		return 0;
 
+	if (ovl_is_lazy(file_inode(file)))
+		return ovl_lazy_read_iter(iocb, iter);
+
 	ret = ovl_real_fdget(file, &real);
 	if (ret)
 		return ret;
@@ -342,6 +415,41 @@ static ssize_t ovl_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 	return ret;
 }
 
+/*
+ * Copy up the chunks of a lazy copy up that are about to be modified, or
+ * read from the upper file by a copy to another file.
+ */
+static int ovl_lazy_prepare_write(struct inode *inode, struct file *realfile,
+				  loff_t pos, loff_t len, bool modify)
+{
+	int err;
+
+	if (!ovl_is_lazy(inode))
+		return 0;
+
+	file_start_write(realfile);
+	err = ovl_lazy_copy_up_range(inode, pos, len, modify);
+	file_end_write(realfile);
+
+	return err;
+}
+
+/*
+ * The overlay inode only caches pages for mappings made in the middle of a
+ * lazy copy up, see ovl_lazy_mmap_file().  Drop the ones a write changed.
+ */
+static void ovl_invalidate_range(struct inode *inode, loff_t pos, loff_t len)
+{
+	pgoff_t end = -1;
+
+	if (!inode->i_mapping->nrpages || len <= 0)
+		return;
+
+	if (len <= LLONG_MAX - pos)
+		end = (pos + len - 1) >> PAGE_SHIFT;
+	invalidate_inode_pages2_range(inode->i_mapping, pos >> PAGE_SHIFT, end);
+}
+
 static ssize_t ovl_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 {
 	struct file *file = iocb->ki_filp;
@@ -371,6 +479,13 @@ static ssize_t ovl_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 	     !real.file->f_mapping->a_ops->direct_IO))
 		goto out_fdput;
 
+	ret = ovl_lazy_prepare_write(inode, real.file,
+				     (ifl & IOCB_APPEND) ?
+				     i_size_read(file_inode(real.file)) :
+				     iocb->ki_pos, iov_iter_count(iter), true);
+	if (ret)
+		goto out_fdput;
+
 	if (!ovl_should_sync(OVL_FS(inode->i_sb)))
 		ifl &= ~(IOCB_DSYNC | IOCB_SYNC);
 
@@ -382,9 +497,16 @@ static ssize_t ovl_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 		file_end_write(real.file);
 		/* Update size */
 		ovl_copyattr(ovl_inode_real(inode), inode);
+		if (ret > 0)
+			ovl_invalidate_range(inode, iocb->ki_pos - ret, ret);
 	} else {
 		struct ovl_aio_req *aio_req;
 
+		/* Can't be done on completion, which may be in irq context */
+		ovl_invalidate_range(inode, (ifl & IOCB_APPEND) ?
+				     i_size_read(file_inode(real.file)) :
+				     iocb->ki_pos, iov_iter_count(iter));
+
 		ret = -ENOMEM;
 		aio_req = kmem_cache_zalloc(ovl_aio_request_cachep, GFP_KERNEL);
 		if (!aio_req)
@@ -445,6 +567,12 @@ static ssize_t ovl_splice_write(struct pipe_inode_info *pipe, struct file *out,
 	if (ret)
 		goto out_unlock;
 
+	ret = ovl_lazy_prepare_write(inode, real.file, *ppos, len, true);
+	if (ret) {
+		fdput(real);
+		goto out_unlock;
+	}
+
 	old_cred = ovl_override_creds(inode->i_sb);
 	file_start_write(real.file);
 
@@ -453,6 +581,8 @@ static ssize_t ovl_splice_write(struct pipe_inode_info *pipe, struct file *out,
 	file_end_write(real.file);
 	/* Update size */
 	ovl_copyattr(realinode, inode);
+	if (ret > 0)
+		ovl_invalidate_range(inode, *ppos - ret, ret);
 	revert_creds(old_cred);
 	fdput(real);
 
@@ -500,6 +630,13 @@ static int ovl_mmap(struct file *file, struct vm_area_struct *vma)
 	if (WARN_ON(file != vma->vm_file))
 		return -EIO;
 
+	/* Pages of a mapping can't be copied up chunk by chunk */
+	if (ovl_is_lazy(file_inode(file))) {
+		realfile = ovl_lazy_mmap_file(file_inode(file), vma);
+		if (!realfile)
+			return generic_file_readonly_mmap(file, vma);
+	}
+
 	vma_set_file(vma, realfile);
 
 	old_cred = ovl_override_creds(file_inode(file)->i_sb);
@@ -510,6 +647,75 @@ static int ovl_mmap(struct file *file, struct vm_area_struct *vma)
 	return ret;
 }
 
+/*
+ * Fill a page of the overlay inode, for the mappings made in the middle of a
+ * lazy copy up that can't map the lower file, see ovl_lazy_mmap_file().  The
+ * data is copied from the page cache of the real file it is in, as reading
+ * it with the real fs ->read_iter() could take locks the faulting task
+ * already holds.
+ */
+int ovl_readpage(struct file *file, struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	loff_t pos = page_offset(page);
+	size_t len = PAGE_SIZE;
+	const struct cred *old_cred;
+	struct file *realfile;
+	struct page *realpage;
+	struct fd real;
+	int err;
+
+	if (WARN_ON_ONCE(!file)) {
+		err = -EIO;
+		goto out;
+	}
+
+	err = ovl_real_fdget(file, &real);
+	if (err)
+		goto out;
+
+	realfile = real.file;
+	if (ovl_is_lazy(inode))
+		realfile = ovl_lazy_real_file(inode, pos, &len);
+	if (pos >= i_size_read(file_inode(realfile)))
+		len = 0;
+
+	old_cred = ovl_override_creds(inode->i_sb);
+	if (!len) {
+		/* Past EOF */
+	} else if (realfile->f_mapping->a_ops->readpage) {
+		realpage = read_mapping_page(realfile->f_mapping, page->index,
+					     realfile);
+		if (IS_ERR(realpage)) {
+			err = PTR_ERR(realpage);
+		} else {
+			memcpy_page(page, 0, realpage, 0, len);
+			put_page(realpage);
+		}
+	} else {
+		void *kaddr = kmap(page);
+		ssize_t ret = kernel_read(realfile, kaddr, len, &pos);
+
+		kunmap(page);
+		if (ret < 0)
+			err = ret;
+		else
+			len = ret;
+	}
+	revert_creds(old_cred);
+	fdput(real);
+
+	if (!err) {
+		zero_user_segment(page, len, PAGE_SIZE);
+		SetPageUptodate(page);
+	}
+out:
+	if (err)
+		SetPageError(page);
+	unlock_page(page);
+	return err;
+}
+
 static long ovl_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
 {
 	struct inode *inode = file_inode(file);
@@ -521,13 +727,27 @@ static long ovl_fallocate(struct file *file, int mode, loff_t offset, loff_t len
 	if (ret)
 		return ret;
 
+	if (mode & (FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE))
+		ret = ovl_lazy_prepare_write(inode, real.file, 0, LLONG_MAX,
+					     true);
+	else
+		ret = ovl_lazy_prepare_write(inode, real.file, offset, len,
+					     true);
+	if (ret)
+		goto out_fdput;
+
 	old_cred = ovl_override_creds(file_inode(file)->i_sb);
 	ret = vfs_fallocate(real.file, mode, offset, len);
 	revert_creds(old_cred);
 
 	/* Update size */
 	ovl_copyattr(ovl_inode_real(inode), inode);
+	if (mode & (FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE))
+		ovl_invalidate_range(inode, 0, LLONG_MAX);
+	else
+		ovl_invalidate_range(inode, offset, len);
 
+out_fdput:
 	fdput(real);
 
 	return ret;
@@ -577,6 +797,15 @@ static loff_t ovl_copyfile(struct file *file_in, loff_t pos_in,
 		return ret;
 	}
 
+	/* len == 0 means up to EOF for clone and dedupe */
+	ret = ovl_lazy_prepare_write(file_inode(file_in), real_in.file, pos_in,
+				     len ?: LLONG_MAX, false);
+	if (!ret)
+		ret = ovl_lazy_prepare_write(inode_out, real_out.file, pos_out,
+					     len ?: LLONG_MAX, true);
+	if (ret)
+		goto out_fdput;
+
 	old_cred = ovl_override_creds(file_inode(file_out)->i_sb);
 	switch (op) {
 	case OVL_COPY:
@@ -599,7 +828,10 @@ static loff_t ovl_copyfile(struct file *file_in, loff_t pos_in,
 
 	/* Update size */
 	ovl_copyattr(ovl_inode_real(inode_out), inode_out);
+	if (ret >= 0)
+		ovl_invalidate_range(inode_out, pos_out, len ?: LLONG_MAX);
 
+out_fdput:
 	fdput(real_in);
 	fdput(real_out);
 
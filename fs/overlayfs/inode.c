@@ -22,6 +22,7 @@ int ovl_setattr(struct user_namespace *mnt_userns, struct dentry *dentry,
 {
 	int err;
 	bool full_copy_up = false;
+	bool lazy_locked = false;
 	struct dentry *upperdentry;
 	const struct cred *old_cred;
 
@@ -52,6 +53,12 @@ int ovl_setattr(struct user_namespace *mnt_userns, struct dentry *dentry,
 			err = get_write_access(winode);
 			if (err)
 				goto out_drop_write;
+			/* Lower data past the new EOF must not be copied up */
+			err = ovl_lazy_truncate_begin(d_inode(dentry),
+						      attr->ia_size,
+						      &lazy_locked);
+			if (err)
+				goto out_put_write;
 		}
 
 		if (attr->ia_valid & (ATTR_KILL_SUID|ATTR_KILL_SGID))
@@ -83,6 +90,12 @@ int ovl_setattr(struct user_namespace *mnt_userns, struct dentry *dentry,
 			ovl_copyattr(upperdentry->d_inode, dentry->d_inode);
 		inode_unlock(upperdentry->d_inode);
 
+		ovl_lazy_truncate_end(d_inode(dentry), lazy_locked);
+		/* Pages cached for the mappings of a lazy copy up */
+		if (!err && (attr->ia_valid & ATTR_SIZE) &&
+		    d_inode(dentry)->i_mapping->nrpages)
+			truncate_pagecache(d_inode(dentry), attr->ia_size);
+out_put_write:
 		if (winode)
 			put_write_access(winode);
 	}
@@ -493,6 +506,10 @@ static int ovl_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 	if (!realinode->i_op->fiemap)
 		return -EOPNOTSUPP;
 
+	err = ovl_lazy_copy_up_all(inode);
+	if (err)
+		return err;
+
 	old_cred = ovl_override_creds(inode->i_sb);
 	err = realinode->i_op->fiemap(realinode, fieinfo, start, len);
 	revert_creds(old_cred);
@@ -663,6 +680,8 @@ static const struct inode_operations ovl_special_inode_operations = {
 };
 
 static const struct address_space_operations ovl_aops = {
+	/* For mappings in the middle of a lazy copy up */
+	.readpage		= ovl_readpage,
 	/* For O_DIRECT dentry_open() checks f_mapping->a_ops->direct_IO */
 	.direct_IO		= noop_direct_IO,
 };
@@ -35,6 +35,7 @@ enum ovl_xattr {
 	OVL_XATTR_UPPER,
 	OVL_XATTR_METACOPY,
 	OVL_XATTR_PROTATTR,
+	OVL_XATTR_LAZY,
 };
 
 enum ovl_inode_flag {
@@ -46,6 +47,8 @@ enum ovl_inode_flag {
 	OVL_UPPERDATA,
 	/* Inode number will remain constant over copy up. */
 	OVL_CONST_INO,
+	/* Data copy up in progress, see ovl_lazy_copy_up_start() */
+	OVL_LAZYDATA,
 };
 
 enum ovl_entry_flag {
@@ -365,6 +368,11 @@ static inline bool ovl_test_flag(unsigned long flag, struct inode *inode)
 	return test_bit(flag, &OVL_I(inode)->flags);
 }
 
+static inline bool ovl_is_lazy(struct inode *inode)
+{
+	return ovl_test_flag(OVL_LAZYDATA, inode);
+}
+
 static inline bool ovl_is_impuredir(struct super_block *sb,
 				    struct dentry *dentry)
 {
@@ -464,6 +472,8 @@ int ovl_check_empty_dir(struct dentry *dentry, struct list_head *list);
 void ovl_cleanup_whiteouts(struct dentry *upper, struct list_head *list);
 void ovl_cache_free(struct list_head *list);
 void ovl_dir_cache_free(struct inode *inode);
+void __init ovl_dir_cache_debugfs_init(void);
+void ovl_dir_cache_debugfs_exit(void);
 int ovl_check_d_type_supported(struct path *realpath);
 int ovl_workdir_cleanup(struct inode *dir, struct vfsmount *mnt,
 			struct dentry *dentry, int level);
@@ -586,6 +596,7 @@ int ovl_real_fileattr_set(struct path *realpath, struct fileattr *fa);
 int ovl_fileattr_get(struct dentry *dentry, struct fileattr *fa);
 int ovl_fileattr_set(struct user_namespace *mnt_userns,
 		     struct dentry *dentry, struct fileattr *fa);
+int ovl_readpage(struct file *file, struct page *page);
 
 /* copy_up.c */
 int ovl_copy_up(struct dentry *dentry);
@@ -598,6 +609,16 @@ struct ovl_fh *ovl_encode_real_fh(struct ovl_fs *ofs, struct dentry *real,
 				  bool is_upper);
 int ovl_set_origin(struct ovl_fs *ofs, struct dentry *lower,
 		   struct dentry *upper);
+int ovl_lazy_load(struct dentry *dentry);
+struct file *ovl_lazy_real_file(struct inode *inode, loff_t pos, size_t *len);
+int ovl_lazy_copy_up_range(struct inode *inode, loff_t pos, loff_t len,
+			   bool modify);
+int ovl_lazy_complete(struct dentry *dentry);
+int ovl_lazy_copy_up_all(struct inode *inode);
+struct file *ovl_lazy_mmap_file(struct inode *inode, struct vm_area_struct *vma);
+int ovl_lazy_truncate_begin(struct inode *inode, loff_t size, bool *locked);
+void ovl_lazy_truncate_end(struct inode *inode, bool locked);
+void ovl_lazy_free(struct inode *inode);
 
 /* export.c */
 extern const struct export_operations ovl_export_operations;
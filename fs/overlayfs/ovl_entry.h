@@ -18,6 +18,7 @@ struct ovl_config {
 	bool nfs_export;
 	int xino;
 	bool metacopy;
+	bool lazy_copyup;
 	bool userxattr;
 	bool ovl_volatile;
 };
@@ -130,6 +131,7 @@ struct ovl_inode {
 	struct inode vfs_inode;
 	struct dentry *__upperdentry;
 	struct inode *lower;
+	struct ovl_lazy *lazy;
 
 	/* synchronize copy up and more */
 	struct mutex lock;
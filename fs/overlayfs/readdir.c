@@ -13,6 +13,8 @@
 #include <linux/security.h>
 #include <linux/cred.h>
 #include <linux/ratelimit.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "overlayfs.h"
 
 struct ovl_cache_entry {
@@ -33,8 +35,34 @@ struct ovl_dir_cache {
 	u64 version;
 	struct list_head entries;
 	struct rb_root root;
+	/* merged dir caches with no opener are kept on ovl_dir_cache_lru */
+	struct list_head lru;
+	struct inode *inode;
+	size_t size;
 };
 
+/*
+ * The merged listing of a directory stays attached to the inode after the
+ * last opener closes it, so that the next opener doesn't have to merge the
+ * layers again as long as the upper dir did not change.  Memory of these
+ * idle caches is bounded by readdir_cache_kb, the least recently used ones
+ * are freed to stay below that.
+ */
+static unsigned int ovl_readdir_cache_kb = 32768;
+module_param_named(readdir_cache_kb, ovl_readdir_cache_kb, uint, 0644);
+MODULE_PARM_DESC(readdir_cache_kb,
+		 "Maximum size of merged dir listings kept with no opener");
+
+static DEFINE_SPINLOCK(ovl_dir_cache_lock);
+static LIST_HEAD(ovl_dir_cache_lru);
+static size_t ovl_dir_cache_lru_size;
+static unsigned long ovl_dir_cache_lru_count;
+
+static atomic_long_t ovl_dir_cache_hits;
+static atomic_long_t ovl_dir_cache_misses;
+static atomic_long_t ovl_dir_cache_stale;
+static atomic_long_t ovl_dir_cache_evictions;
+
 struct ovl_readdir_data {
 	struct dir_context ctx;
 	struct dentry *dentry;
@@ -225,9 +253,81 @@ void ovl_cache_free(struct list_head *list)
 	INIT_LIST_HEAD(list);
 }
 
+/* Caller should hold ovl_dir_cache_lock */
+static void ovl_cache_lru_del(struct ovl_dir_cache *cache)
+{
+	if (!list_empty(&cache->lru)) {
+		list_del_init(&cache->lru);
+		ovl_dir_cache_lru_size -= cache->size;
+		ovl_dir_cache_lru_count--;
+	}
+}
+
+static void ovl_cache_dispose(struct list_head *dispose)
+{
+	struct ovl_dir_cache *cache, *n;
+
+	list_for_each_entry_safe(cache, n, dispose, lru) {
+		ovl_cache_free(&cache->entries);
+		kfree(cache);
+	}
+}
+
+/*
+ * Free the least recently used idle caches until their total size is below
+ * @max.  Caller should hold ovl_dir_cache_lock.  The dir inode lock is what
+ * serializes ovl_cache_get() and ovl_cache_put(), so caches of dirs that are
+ * busy are skipped.
+ */
+static void ovl_cache_shrink(size_t max, struct list_head *dispose)
+{
+	struct ovl_dir_cache *cache, *n;
+
+	list_for_each_entry_safe(cache, n, &ovl_dir_cache_lru, lru) {
+		if (ovl_dir_cache_lru_size <= max)
+			break;
+		if (!inode_trylock(cache->inode))
+			continue;
+
+		ovl_cache_lru_del(cache);
+		ovl_set_dir_cache(cache->inode, NULL);
+		inode_unlock(cache->inode);
+		list_add(&cache->lru, dispose);
+		atomic_long_inc(&ovl_dir_cache_evictions);
+	}
+}
+
+/* Returns true if @cache was kept for the next opener of the dir */
+static bool ovl_cache_keep(struct ovl_dir_cache *cache)
+{
+	size_t max = (size_t)READ_ONCE(ovl_readdir_cache_kb) << 10;
+	LIST_HEAD(dispose);
+
+	if (cache->size > max)
+		return false;
+
+	spin_lock(&ovl_dir_cache_lock);
+	list_add_tail(&cache->lru, &ovl_dir_cache_lru);
+	ovl_dir_cache_lru_size += cache->size;
+	ovl_dir_cache_lru_count++;
+	ovl_cache_shrink(max, &dispose);
+	spin_unlock(&ovl_dir_cache_lock);
+
+	ovl_cache_dispose(&dispose);
+
+	return true;
+}
+
 void ovl_dir_cache_free(struct inode *inode)
 {
-	struct ovl_dir_cache *cache = ovl_dir_cache(inode);
+	struct ovl_dir_cache *cache;
+
+	/* Could be on the lru, where ovl_cache_shrink() may free it */
+	spin_lock(&ovl_dir_cache_lock);
+	cache = ovl_dir_cache(inode);
+	if (cache)
+		ovl_cache_lru_del(cache);
+	spin_unlock(&ovl_dir_cache_lock);
 
 	if (cache) {
 		ovl_cache_free(&cache->entries);
@@ -238,12 +338,18 @@ void ovl_dir_cache_free(struct inode *inode)
 static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
 {
 	struct ovl_dir_cache *cache = od->cache;
+	struct inode *inode = d_inode(dentry);
 
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
 	if (!cache->refcount) {
-		if (ovl_dir_cache(d_inode(dentry)) == cache)
-			ovl_set_dir_cache(d_inode(dentry), NULL);
+		if (ovl_dir_cache(inode) == cache) {
+			if (ovl_dentry_version_get(dentry) == cache->version &&
+			    ovl_cache_keep(cache))
+				return;
+
+			ovl_set_dir_cache(inode, NULL);
+		}
 
 		ovl_cache_free(&cache->entries);
 		kfree(cache);
@@ -394,14 +500,27 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 {
 	int res;
 	struct ovl_dir_cache *cache;
+	struct ovl_cache_entry *p;
 
 	cache = ovl_dir_cache(d_inode(dentry));
 	if (cache && ovl_dentry_version_get(dentry) == cache->version) {
-		WARN_ON(!cache->refcount);
+		if (!cache->refcount) {
+			spin_lock(&ovl_dir_cache_lock);
+			ovl_cache_lru_del(cache);
+			spin_unlock(&ovl_dir_cache_lock);
+		}
 		cache->refcount++;
+		atomic_long_inc(&ovl_dir_cache_hits);
 		return cache;
 	}
+	if (cache) {
+		atomic_long_inc(&ovl_dir_cache_stale);
+		/* Nobody else has a reference to an idle cache */
+		if (!cache->refcount)
+			ovl_dir_cache_free(d_inode(dentry));
+	}
 	ovl_set_dir_cache(d_inode(dentry), NULL);
+	atomic_long_inc(&ovl_dir_cache_misses);
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
 	if (!cache)
@@ -410,6 +529,8 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 	cache->refcount = 1;
 	INIT_LIST_HEAD(&cache->entries);
 	cache->root = RB_ROOT;
+	INIT_LIST_HEAD(&cache->lru);
+	cache->inode = d_inode(dentry);
 
 	res = ovl_dir_read_merged(dentry, &cache->entries, &cache->root);
 	if (res) {
@@ -418,6 +539,10 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 		return ERR_PTR(res);
 	}
 
+	cache->size = sizeof(*cache);
+	list_for_each_entry(p, &cache->entries, l_node)
+		cache->size += offsetof(struct ovl_cache_entry, name[p->len + 1]);
+
 	cache->version = ovl_dentry_version_get(dentry);
 	ovl_set_dir_cache(d_inode(dentry), cache);
 
@@ -611,6 +736,9 @@ static struct ovl_dir_cache *ovl_cache_get_impure(struct path *path)
 	if (!cache)
 		return ERR_PTR(-ENOMEM);
 
+	INIT_LIST_HEAD(&cache->lru);
+	cache->inode = d_inode(dentry);
+
 	res = ovl_dir_read_impure(path, &cache->entries, &cache->root);
 	if (res) {
 		ovl_cache_free(&cache->entries);
@@ -958,6 +1086,43 @@ const struct file_operations ovl_dir_operations = {
 	.release	= ovl_dir_release,
 };
 
+static int ovl_dir_cache_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long count;
+	size_t size;
+
+	spin_lock(&ovl_dir_cache_lock);
+	count = ovl_dir_cache_lru_count;
+	size = ovl_dir_cache_lru_size;
+	spin_unlock(&ovl_dir_cache_lock);
+
+	seq_printf(m, "hits:       %ld\n", atomic_long_read(&ovl_dir_cache_hits));
+	seq_printf(m, "misses:     %ld\n",
+		   atomic_long_read(&ovl_dir_cache_misses));
+	seq_printf(m, "stale:      %ld\n", atomic_long_read(&ovl_dir_cache_stale));
+	seq_printf(m, "evictions:  %ld\n",
+		   atomic_long_read(&ovl_dir_cache_evictions));
+	seq_printf(m, "idle:       %lu\n", count);
+	seq_printf(m, "idle_bytes: %zu\n", size);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ovl_dir_cache_stats);
+
+static struct dentry *ovl_debugfs_root;
+
+void __init ovl_dir_cache_debugfs_init(void)
+{
+	ovl_debugfs_root = debugfs_create_dir("overlay", NULL);
+	debugfs_create_file("readdir_cache", 0444, ovl_debugfs_root, NULL,
+			    &ovl_dir_cache_stats_fops);
+}
+
+void ovl_dir_cache_debugfs_exit(void)
+{
+	debugfs_remove_recursive(ovl_debugfs_root);
+}
+
 int ovl_check_empty_dir(struct dentry *dentry, struct list_head *list)
 {
 	int err;
@@ -66,6 +66,11 @@ module_param_named(metacopy, ovl_metacopy_def, bool, 0644);
 MODULE_PARM_DESC(metacopy,
 		 "Default to on or off for the metadata only copy up feature");
 
+static bool ovl_lazy_copyup_def = IS_ENABLED(CONFIG_OVERLAY_FS_LAZY_COPYUP);
+module_param_named(lazy_copyup, ovl_lazy_copyup_def, bool, 0644);
+MODULE_PARM_DESC(lazy_copyup,
+		 "Default to on or off for the lazy data copy up feature");
+
 static void ovl_dentry_release(struct dentry *dentry)
 {
 	struct ovl_entry *oe = dentry->d_fsdata;
@@ -186,6 +191,7 @@ static struct inode *ovl_alloc_inode(struct super_block *sb)
 	oi->__upperdentry = NULL;
 	oi->lower = NULL;
 	oi->lowerdata = NULL;
+	oi->lazy = NULL;
 	mutex_init(&oi->lock);
 
 	return &oi->vfs_inode;
@@ -206,10 +212,12 @@ static void ovl_destroy_inode(struct inode *inode)
 
 	dput(oi->__upperdentry);
 	iput(oi->lower);
-	if (S_ISDIR(inode->i_mode))
+	if (S_ISDIR(inode->i_mode)) {
 		ovl_dir_cache_free(inode);
-	else
+	} else {
+		ovl_lazy_free(inode);
 		iput(oi->lowerdata);
+	}
 }
 
 static void ovl_free_fs(struct ovl_fs *ofs)
@@ -378,6 +386,9 @@ static int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 	if (ofs->config.metacopy != ovl_metacopy_def)
 		seq_printf(m, ",metacopy=%s",
 			   ofs->config.metacopy ? "on" : "off");
+	if (ofs->config.lazy_copyup != ovl_lazy_copyup_def)
+		seq_printf(m, ",lazy_copyup=%s",
+			   ofs->config.lazy_copyup ? "on" : "off");
 	if (ofs->config.ovl_volatile)
 		seq_puts(m, ",volatile");
 	if (ofs->config.userxattr)
@@ -436,6 +447,8 @@ enum {
 	OPT_XINO_AUTO,
 	OPT_METACOPY_ON,
 	OPT_METACOPY_OFF,
+	OPT_LAZY_COPYUP_ON,
+	OPT_LAZY_COPYUP_OFF,
 	OPT_VOLATILE,
 	OPT_ERR,
 };
@@ -458,6 +471,8 @@ static const match_table_t ovl_tokens = {
 	{OPT_XINO_AUTO,			"xino=auto"},
 	{OPT_METACOPY_ON,		"metacopy=on"},
 	{OPT_METACOPY_OFF,		"metacopy=off"},
+	{OPT_LAZY_COPYUP_ON,		"lazy_copyup=on"},
+	{OPT_LAZY_COPYUP_OFF,		"lazy_copyup=off"},
 	{OPT_VOLATILE,			"volatile"},
 	{OPT_ERR,			NULL}
 };
@@ -514,6 +529,7 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 	int err;
 	bool metacopy_opt = false, redirect_opt = false;
 	bool nfs_export_opt = false, index_opt = false;
+	bool lazy_copyup_opt = false;
 
 	config->redirect_mode = kstrdup(ovl_redirect_mode_def(), GFP_KERNEL);
 	if (!config->redirect_mode)
@@ -611,6 +627,16 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 			metacopy_opt = true;
 			break;
 
+		case OPT_LAZY_COPYUP_ON:
+			config->lazy_copyup = true;
+			lazy_copyup_opt = true;
+			break;
+
+		case OPT_LAZY_COPYUP_OFF:
+			config->lazy_copyup = false;
+			lazy_copyup_opt = true;
+			break;
+
 		case OPT_VOLATILE:
 			config->ovl_volatile = true;
 			break;
@@ -744,6 +770,16 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 		config->metacopy = false;
 	}
 
+	/* Resolve lazy_copyup -> metacopy dependency */
+	if (config->lazy_copyup && !config->metacopy) {
+		if (lazy_copyup_opt) {
+			pr_err("conflicting options: lazy_copyup=on,metacopy=off\n");
+			return -EINVAL;
+		}
+		/* Silently disable default setting of lazy_copyup */
+		config->lazy_copyup = false;
+	}
+
 	return 0;
 }
 
@@ -1417,6 +1453,7 @@ static int ovl_make_workdir(struct super_block *sb, struct ovl_fs *ofs,
 		if (ofs->config.index || ofs->config.metacopy) {
 			ofs->config.index = false;
 			ofs->config.metacopy = false;
+			ofs->config.lazy_copyup = false;
 			pr_warn("upper fs does not support xattr, falling back to index=off,metacopy=off.\n");
 		}
 		/*
@@ -1997,6 +2034,7 @@ static int ovl_fill_super(struct super_block *sb, void *data, int silent)
 	ofs->config.nfs_export = ovl_nfs_export_def;
 	ofs->config.xino = ovl_xino_def();
 	ofs->config.metacopy = ovl_metacopy_def;
+	ofs->config.lazy_copyup = ovl_lazy_copyup_def;
 	err = ovl_parse_opt((char *) data, &ofs->config);
 	if (err)
 		goto out_err;
@@ -2193,8 +2231,10 @@ static int __init ovl_init(void)
 	err = ovl_aio_request_cache_init();
 	if (!err) {
 		err = register_filesystem(&ovl_fs_type);
-		if (!err)
+		if (!err) {
+			ovl_dir_cache_debugfs_init();
 			return 0;
+		}
 
 		ovl_aio_request_cache_destroy();
 	}
@@ -2205,6 +2245,7 @@ static int __init ovl_init(void)
 
 static void __exit ovl_exit(void)
 {
+	ovl_dir_cache_debugfs_exit();
 	unregister_filesystem(&ovl_fs_type);
 
 	/*
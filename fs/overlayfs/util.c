@@ -268,7 +268,7 @@ struct inode *ovl_inode_realdata(struct inode *inode)
 	struct inode *upperinode;
 
 	upperinode = ovl_inode_upper(inode);
-	if (upperinode && ovl_has_upperdata(inode))
+	if (upperinode && (ovl_has_upperdata(inode) || ovl_is_lazy(inode)))
 		return upperinode;
 
 	return ovl_inode_lowerdata(inode);
@@ -375,7 +375,8 @@ bool ovl_dentry_needs_data_copy_up_locked(struct dentry *dentry, int flags)
 	if (!ovl_open_flags_need_copy_up(flags))
 		return false;
 
-	return !ovl_test_flag(OVL_UPPERDATA, d_inode(dentry));
+	return !ovl_test_flag(OVL_UPPERDATA, d_inode(dentry)) &&
+	       !ovl_is_lazy(d_inode(dentry));
 }
 
 bool ovl_dentry_needs_data_copy_up(struct dentry *dentry, int flags)
@@ -383,7 +384,8 @@ bool ovl_dentry_needs_data_copy_up(struct dentry *dentry, int flags)
 	if (!ovl_open_flags_need_copy_up(flags))
 		return false;
 
-	return !ovl_has_upperdata(d_inode(dentry));
+	return !ovl_has_upperdata(d_inode(dentry)) &&
+	       !ovl_is_lazy(d_inode(dentry));
 }
 
 bool ovl_redirect_dir(struct super_block *sb)
@@ -478,6 +480,9 @@ struct file *ovl_path_open(struct path *path, int flags)
 	case O_WRONLY:
 		acc_mode = MAY_WRITE;
 		break;
+	case O_RDWR:
+		acc_mode = MAY_READ | MAY_WRITE;
+		break;
 	default:
 		BUG();
 	}
@@ -587,6 +592,7 @@ bool ovl_check_dir_xattr(struct super_block *sb, struct dentry *dentry,
 #define OVL_XATTR_UPPER_POSTFIX		"upper"
 #define OVL_XATTR_METACOPY_POSTFIX	"metacopy"
 #define OVL_XATTR_PROTATTR_POSTFIX	"protattr"
+#define OVL_XATTR_LAZY_POSTFIX		"lazy"
 
 #define OVL_XATTR_TAB_ENTRY(x) \
 	[x] = { [false] = OVL_XATTR_TRUSTED_PREFIX x ## _POSTFIX, \
@@ -601,6 +607,7 @@ const char *const ovl_xattr_table[][2] = {
 	OVL_XATTR_TAB_ENTRY(OVL_XATTR_UPPER),
 	OVL_XATTR_TAB_ENTRY(OVL_XATTR_METACOPY),
 	OVL_XATTR_TAB_ENTRY(OVL_XATTR_PROTATTR),
+	OVL_XATTR_TAB_ENTRY(OVL_XATTR_LAZY),
 };
 
 int ovl_check_setxattr(struct ovl_fs *ofs, struct dentry *upperdentry,
@@ -998,6 +1005,10 @@ char *ovl_get_redirect_xattr(struct ovl_fs *ofs, struct dentry *dentry,
 		return NULL;
 	if (res < 0)
 		goto fail;
+	/* Empty redirect of a lazy copy up, see ovl_lazy_copy_up_start() */
+	if (res == 0 && d_is_reg(dentry) &&
+	    ovl_do_getxattr(ofs, dentry, OVL_XATTR_LAZY, NULL, 0) > 0)
+		return NULL;
 	if (res == 0)
 		goto invalid;
 
@@ -20,12 +20,189 @@
 #include <linux/shmem_fs.h>
 #include <linux/uaccess.h>
 #include <linux/pkeys.h>
+#include <linux/buildid.h>
+#include <linux/ctype.h>
 
 #include <asm/elf.h>
 #include <asm/tlb.h>
 #include <asm/tlbflush.h>
 #include "internal.h"
 
+/*
+ * smaps_rollup walks the page tables of every VMA on every read.  For
+ * monitoring that rereads it often, an open smaps_rollup file can be
+ * switched to a cheaper mode by writing to it:
+ *
+ *   "full"		the default, walk all VMAs
+ *   "rss"		only Rss, Anonymous and Swap, from the mm RSS counters,
+ *			without taking the mmap_lock or walking anything
+ *   "cached [ms]"	reuse the stats of a VMA from the previous read of the
+ *			same file while the VMA is unchanged and the stats are
+ *			younger than ms milliseconds (1000 by default)
+ *
+ * The page tables of a VMA change without the VMA itself changing, so the
+ * cached mode trades up to the max age of staleness for not walking VMAs
+ * that were walked recently.
+ */
+enum smaps_rollup_mode {
+	SMAPS_ROLLUP_FULL,
+	SMAPS_ROLLUP_RSS,
+	SMAPS_ROLLUP_CACHED,
+};
+
+#define SMAPS_ROLLUP_MAX_AGE_MS	1000
+
+struct smaps_rollup_entry {
+	unsigned long start;
+	unsigned long end;
+	unsigned long pgoff;
+	vm_flags_t flags;
+	struct file *file;		/* only compared, not a reference */
+	struct anon_vma *anon_vma;	/* ditto */
+	unsigned long stamp;		/* jiffies when walked */
+	struct mem_size_stats mss;
+};
+
+struct smaps_rollup_private {
+	struct proc_maps_private maps;	/* must be first, m->private */
+	enum smaps_rollup_mode mode;
+	unsigned long max_age;		/* in jiffies */
+	/* stats of the previous read, sorted by start */
+	struct smaps_rollup_entry *cache;
+	unsigned int nr_cache;
+	unsigned int cursor;
+	/* stats of the read in progress */
+	struct smaps_rollup_entry *next;
+	unsigned int nr_next;
+	unsigned int max_next;
+};
+
+static void smaps_mss_add(struct mem_size_stats *dst,
+			  const struct mem_size_stats *src)
+{
+	dst->resident += src->resident;
+	dst->shared_clean += src->shared_clean;
+	dst->shared_dirty += src->shared_dirty;
+	dst->private_clean += src->private_clean;
+	dst->private_dirty += src->private_dirty;
+	dst->referenced += src->referenced;
+	dst->anonymous += src->anonymous;
+	dst->lazyfree += src->lazyfree;
+	dst->anonymous_thp += src->anonymous_thp;
+	dst->shmem_thp += src->shmem_thp;
+	dst->file_thp += src->file_thp;
+	dst->swap += src->swap;
+	dst->shared_hugetlb += src->shared_hugetlb;
+	dst->private_hugetlb += src->private_hugetlb;
+	dst->pss += src->pss;
+	dst->pss_anon += src->pss_anon;
+	dst->pss_file += src->pss_file;
+	dst->pss_shmem += src->pss_shmem;
+	dst->pss_locked += src->pss_locked;
+	dst->swap_pss += src->swap_pss;
+}
+
+/* The VMAs are visited in address order, so the cache is searched in step */
+static struct smaps_rollup_entry *
+smaps_rollup_lookup(struct smaps_rollup_private *rpriv,
+		    struct vm_area_struct *vma)
+{
+	struct smaps_rollup_entry *e;
+
+	while (rpriv->cursor < rpriv->nr_cache &&
+	       rpriv->cache[rpriv->cursor].start < vma->vm_start)
+		rpriv->cursor++;
+	if (rpriv->cursor == rpriv->nr_cache)
+		return NULL;
+
+	e = &rpriv->cache[rpriv->cursor];
+	if (e->start != vma->vm_start || e->end != vma->vm_end ||
+	    e->pgoff != vma->vm_pgoff || e->flags != vma->vm_flags ||
+	    e->file != vma->vm_file || e->anon_vma != vma->anon_vma)
+		return NULL;
+	if (time_after(jiffies, e->stamp + rpriv->max_age))
+		return NULL;
+	return e;
+}
+
+static void smaps_rollup_gather(struct smaps_rollup_private *rpriv,
+				struct vm_area_struct *vma,
+				struct mem_size_stats *mss)
+{
+	struct smaps_rollup_entry *e, *n;
+
+	if (rpriv->mode != SMAPS_ROLLUP_CACHED) {
+		smap_gather_stats(vma, mss, 0);
+		return;
+	}
+
+	e = smaps_rollup_lookup(rpriv, vma);
+	if (rpriv->nr_next == rpriv->max_next) {
+		/* More VMAs than when the read started, don't cache those */
+		if (e)
+			smaps_mss_add(mss, &e->mss);
+		else
+			smap_gather_stats(vma, mss, 0);
+		return;
+	}
+
+	n = &rpriv->next[rpriv->nr_next++];
+	if (e) {
+		*n = *e;
+	} else {
+		n->start = vma->vm_start;
+		n->end = vma->vm_end;
+		n->pgoff = vma->vm_pgoff;
+		n->flags = vma->vm_flags;
+		n->file = vma->vm_file;
+		n->anon_vma = vma->anon_vma;
+		n->stamp = jiffies;
+		memset(&n->mss, 0, sizeof(n->mss));
+		smap_gather_stats(vma, &n->mss, 0);
+	}
+	smaps_mss_add(mss, &n->mss);
+}
+
+static int smaps_rollup_cache_start(struct smaps_rollup_private *rpriv,
+				    struct mm_struct *mm)
+{
+	if (rpriv->mode != SMAPS_ROLLUP_CACHED)
+		return 0;
+
+	/* Sized before taking the mmap_lock, leave room for a few new VMAs */
+	rpriv->max_next = READ_ONCE(mm->map_count) + 16;
+	rpriv->next = kvmalloc_array(rpriv->max_next, sizeof(*rpriv->next),
+				     GFP_KERNEL_ACCOUNT);
+	if (!rpriv->next)
+		return -ENOMEM;
+	rpriv->nr_next = 0;
+	rpriv->cursor = 0;
+	return 0;
+}
+
+static void smaps_rollup_cache_end(struct smaps_rollup_private *rpriv,
+				   bool done)
+{
+	if (!rpriv->next)
+		return;
+
+	if (done) {
+		kvfree(rpriv->cache);
+		rpriv->cache = rpriv->next;
+		rpriv->nr_cache = rpriv->nr_next;
+	} else {
+		kvfree(rpriv->next);
+	}
+	rpriv->next = NULL;
+}
+
+static void smaps_rollup_cache_free(struct smaps_rollup_private *rpriv)
+{
+	kvfree(rpriv->cache);
+	rpriv->cache = NULL;
+	rpriv->nr_cache = 0;
+}
+
 #define SEQ_PUT_DEC(str, val) \
 		seq_put_decimal_ull_width(m, str, (val) << (PAGE_SHIFT-10), 8)
 void task_mem(struct seq_file *m, struct mm_struct *mm)
@@ -268,17 +445,66 @@ static void show_vma_header_prefix(struct seq_file *m,
 	seq_putc(m, ' ');
 }
 
+/*
+ * The name of a VMA as shown in maps: the mapped file, a special name like
+ * [heap] or the name given to an anonymous mapping with prctl.  At most one
+ * of *file, *name and *anon_name is set.  Needs the mmap_lock.
+ */
+static void get_vma_name(struct vm_area_struct *vma, struct file **file,
+			 const char **name, struct anon_vma_name **anon_name)
+{
+	struct mm_struct *mm = vma->vm_mm;
+
+	*file = NULL;
+	*name = NULL;
+	*anon_name = NULL;
+
+	if (vma->vm_file) {
+		*file = vma->vm_file;
+		return;
+	}
+
+	if (vma->vm_ops && vma->vm_ops->name) {
+		*name = vma->vm_ops->name(vma);
+		if (*name)
+			return;
+	}
+
+	*name = arch_vma_name(vma);
+	if (*name)
+		return;
+
+	if (!mm) {
+		*name = "[vdso]";
+		return;
+	}
+
+	if (vma->vm_start <= mm->brk &&
+	    vma->vm_end >= mm->start_brk) {
+		*name = "[heap]";
+		return;
+	}
+
+	if (is_stack(vma)) {
+		*name = "[stack]";
+		return;
+	}
+
+	*anon_name = anon_vma_name(vma);
+}
+
 static void
 show_map_vma(struct seq_file *m, struct vm_area_struct *vma)
 {
-	struct mm_struct *mm = vma->vm_mm;
 	struct file *file = vma->vm_file;
 	vm_flags_t flags = vma->vm_flags;
 	unsigned long ino = 0;
 	unsigned long long pgoff = 0;
 	unsigned long start, end;
 	dev_t dev = 0;
-	const char *name = NULL;
+	const char *name;
+	struct file *name_file;
+	struct anon_vma_name *anon_name;
 
 	if (file) {
 		struct inode *inode = file_inode(vma->vm_file);
@@ -295,49 +521,16 @@ show_map_vma(struct seq_file *m, struct vm_area_struct *vma)
 	 * Print the dentry name for named mappings, and a
 	 * special [heap] marker for the heap:
 	 */
-	if (file) {
+	get_vma_name(vma, &name_file, &name, &anon_name);
+	if (name_file) {
 		seq_pad(m, ' ');
-		seq_file_path(m, file, "\n");
-		goto done;
-	}
-
-	if (vma->vm_ops && vma->vm_ops->name) {
-		name = vma->vm_ops->name(vma);
-		if (name)
-			goto done;
-	}
-
-	name = arch_vma_name(vma);
-	if (!name) {
-		struct anon_vma_name *anon_name;
-
-		if (!mm) {
-			name = "[vdso]";
-			goto done;
-		}
-
-		if (vma->vm_start <= mm->brk &&
-		    vma->vm_end >= mm->start_brk) {
-			name = "[heap]";
-			goto done;
-		}
-
-		if (is_stack(vma)) {
-			name = "[stack]";
-			goto done;
-		}
-
-		anon_name = anon_vma_name(vma);
-		if (anon_name) {
-			seq_pad(m, ' ');
-			seq_printf(m, "[anon:%s]", anon_name->name);
-		}
-	}
-
-done:
-	if (name) {
+		seq_file_path(m, name_file, "\n");
+	} else if (name) {
 		seq_pad(m, ' ');
 		seq_puts(m, name);
+	} else if (anon_name) {
+		seq_pad(m, ' ');
+		seq_printf(m, "[anon:%s]", anon_name->name);
 	}
 	seq_putc(m, '\n');
 }
@@ -360,11 +553,241 @@ static int pid_maps_open(struct inode *inode, struct file *file)
 	return do_maps_open(inode, file, &proc_pid_maps_op);
 }
 
+#define PROCMAP_QUERY_VMA_FLAGS (				\
+		PROCMAP_QUERY_VMA_READABLE |			\
+		PROCMAP_QUERY_VMA_WRITABLE |			\
+		PROCMAP_QUERY_VMA_EXECUTABLE |			\
+		PROCMAP_QUERY_VMA_SHARED			\
+)
+
+#define PROCMAP_QUERY_VALID_FLAGS_MASK (			\
+		PROCMAP_QUERY_COVERING_OR_NEXT_VMA |		\
+		PROCMAP_QUERY_FILE_BACKED_VMA |			\
+		PROCMAP_QUERY_VMA_FLAGS				\
+)
+
+static u64 procmap_vma_flags(struct vm_area_struct *vma)
+{
+	u64 flags = 0;
+
+	if (vma->vm_flags & VM_READ)
+		flags |= PROCMAP_QUERY_VMA_READABLE;
+	if (vma->vm_flags & VM_WRITE)
+		flags |= PROCMAP_QUERY_VMA_WRITABLE;
+	if (vma->vm_flags & VM_EXEC)
+		flags |= PROCMAP_QUERY_VMA_EXECUTABLE;
+	if (vma->vm_flags & VM_MAYSHARE)
+		flags |= PROCMAP_QUERY_VMA_SHARED;
+
+	return flags;
+}
+
+static struct vm_area_struct *query_matching_vma(struct mm_struct *mm,
+						 unsigned long addr, u64 flags)
+{
+	u64 want = flags & PROCMAP_QUERY_VMA_FLAGS;
+	struct vm_area_struct *vma;
+
+	for (vma = find_vma(mm, addr); vma; vma = vma->vm_next) {
+		/* Only the covering VMA unless the caller asked for the next */
+		if (vma->vm_start > addr &&
+		    !(flags & PROCMAP_QUERY_COVERING_OR_NEXT_VMA))
+			break;
+
+		if (((flags & PROCMAP_QUERY_FILE_BACKED_VMA) && !vma->vm_file) ||
+		    (procmap_vma_flags(vma) & want) != want) {
+			if (!(flags & PROCMAP_QUERY_COVERING_OR_NEXT_VMA))
+				break;
+			continue;
+		}
+
+		return vma;
+	}
+
+	return ERR_PTR(-ENOENT);
+}
+
+/*
+ * Copies the name of the VMA into buf, returns its length including the
+ * NUL, 0 if the VMA has no name or a negative error.  The name string is
+ * returned in *name, for files d_path() builds it at the end of buf.
+ */
+static int procmap_vma_name(struct vm_area_struct *vma, char *buf,
+			    size_t size, const char **name)
+{
+	struct anon_vma_name *anon_name;
+	struct file *file;
+	int len;
+
+	get_vma_name(vma, &file, name, &anon_name);
+	if (file) {
+		*name = d_path(&file->f_path, buf, size);
+		if (IS_ERR(*name))
+			return PTR_ERR(*name);
+		return buf + size - *name;
+	}
+
+	if (*name)
+		len = snprintf(buf, size, "%s", *name);
+	else if (anon_name)
+		len = snprintf(buf, size, "[anon:%s]", anon_name->name);
+	else
+		return 0;
+
+	if (len >= size)
+		return -ENAMETOOLONG;
+	*name = buf;
+	return len + 1;
+}
+
+static int do_procmap_query(struct proc_maps_private *priv, void __user *uarg)
+{
+	unsigned char build_id[BUILD_ID_SIZE_MAX];
+	struct procmap_query karg;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	const char *name = NULL;
+	char *name_buf = NULL;
+	size_t name_buf_size = 0;
+	u64 usize;
+	int err;
+
+	if (get_user(usize, (u64 __user *)uarg))
+		return -EFAULT;
+	/* The struct can never be that large, don't copy_struct_from_user() it */
+	if (usize > PAGE_SIZE)
+		return -E2BIG;
+	/* At the very least query_flags and query_addr are needed */
+	if (usize < offsetofend(struct procmap_query, query_addr))
+		return -EINVAL;
+	err = copy_struct_from_user(&karg, sizeof(karg), uarg, usize);
+	if (err)
+		return err;
+
+	if (karg.query_flags & ~PROCMAP_QUERY_VALID_FLAGS_MASK)
+		return -EINVAL;
+	/* A buffer needs both its address and size */
+	if (!!karg.vma_name_size != !!karg.vma_name_addr)
+		return -EINVAL;
+	if (!!karg.build_id_size != !!karg.build_id_addr)
+		return -EINVAL;
+
+	if (karg.vma_name_size) {
+		name_buf_size = min_t(size_t, PATH_MAX, karg.vma_name_size);
+		name_buf = kmalloc(name_buf_size, GFP_KERNEL);
+		if (!name_buf)
+			return -ENOMEM;
+	}
+
+	mm = priv->mm;
+	if (!mm || !mmget_not_zero(mm)) {
+		err = -ESRCH;
+		goto out_free;
+	}
+
+	if (mmap_read_lock_killable(mm)) {
+		err = -EINTR;
+		goto out_mmput;
+	}
+
+	vma = query_matching_vma(mm, karg.query_addr, karg.query_flags);
+	if (IS_ERR(vma)) {
+		err = PTR_ERR(vma);
+		goto out_unlock;
+	}
+
+	karg.vma_start = vma->vm_start;
+	karg.vma_end = vma->vm_end;
+	karg.vma_flags = procmap_vma_flags(vma);
+	karg.vma_page_size = vma_kernel_pagesize(vma);
+
+	if (vma->vm_file) {
+		struct inode *inode = file_inode(vma->vm_file);
+
+		karg.vma_offset = ((u64)vma->vm_pgoff) << PAGE_SHIFT;
+		karg.dev_major = MAJOR(inode->i_sb->s_dev);
+		karg.dev_minor = MINOR(inode->i_sb->s_dev);
+		karg.inode = inode->i_ino;
+	} else {
+		karg.vma_offset = 0;
+		karg.dev_major = 0;
+		karg.dev_minor = 0;
+		karg.inode = 0;
+	}
+
+	if (karg.build_id_size) {
+		__u32 build_id_size;
+
+		/* Only looks at pages in the page cache, never faults */
+		if (build_id_parse(vma, build_id, &build_id_size)) {
+			karg.build_id_size = 0;
+		} else if (karg.build_id_size < build_id_size) {
+			err = -ENAMETOOLONG;
+			goto out_unlock;
+		} else {
+			karg.build_id_size = build_id_size;
+		}
+	}
+
+	if (karg.vma_name_size) {
+		err = procmap_vma_name(vma, name_buf, name_buf_size, &name);
+		if (err < 0)
+			goto out_unlock;
+		karg.vma_name_size = err;
+		err = 0;
+	}
+
+	/*
+	 * The copies to user memory may fault on this very mm, so they are
+	 * only done after dropping the mmap_lock.
+	 */
+	mmap_read_unlock(mm);
+	mmput(mm);
+
+	if (karg.vma_name_size &&
+	    copy_to_user(u64_to_user_ptr(karg.vma_name_addr), name,
+			 karg.vma_name_size))
+		err = -EFAULT;
+	else if (karg.build_id_size &&
+		 copy_to_user(u64_to_user_ptr(karg.build_id_addr), build_id,
+			      karg.build_id_size))
+		err = -EFAULT;
+	else if (copy_to_user(uarg, &karg, min_t(size_t, sizeof(karg), usize)))
+		err = -EFAULT;
+
+	kfree(name_buf);
+	return err;
+
+out_unlock:
+	mmap_read_unlock(mm);
+out_mmput:
+	mmput(mm);
+out_free:
+	kfree(name_buf);
+	return err;
+}
+
+static long procfs_procmap_ioctl(struct file *file, unsigned int cmd,
+				 unsigned long arg)
+{
+	struct seq_file *seq = file->private_data;
+	struct proc_maps_private *priv = seq->private;
+
+	switch (cmd) {
+	case PROCMAP_QUERY:
+		return do_procmap_query(priv, (void __user *)arg);
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
 const struct file_operations proc_pid_maps_operations = {
 	.open		= pid_maps_open,
 	.read		= seq_read,
 	.llseek		= seq_lseek,
 	.release	= proc_map_release,
+	.unlocked_ioctl	= procfs_procmap_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
 };
 
 /*
@@ -869,9 +1292,29 @@ static int show_smap(struct seq_file *m, void *v)
 	return 0;
 }
 
+static void show_smaps_rollup_rss(struct seq_file *m, struct mm_struct *mm)
+{
+	unsigned long anon = get_mm_counter(mm, MM_ANONPAGES);
+	unsigned long file = get_mm_counter(mm, MM_FILEPAGES);
+	unsigned long shmem = get_mm_counter(mm, MM_SHMEMPAGES);
+	unsigned long swap = get_mm_counter(mm, MM_SWAPENTS);
+
+	/* The first VMA would need the mmap_lock, so the range starts at 0 */
+	show_vma_header_prefix(m, 0, READ_ONCE(mm->highest_vm_end),
+			       0, 0, 0, 0);
+	seq_pad(m, ' ');
+	seq_puts(m, "[rollup]\n");
+
+	SEQ_PUT_DEC("Rss:            ", (anon + file + shmem) << PAGE_SHIFT);
+	SEQ_PUT_DEC(" kB\nAnonymous:      ", anon << PAGE_SHIFT);
+	SEQ_PUT_DEC(" kB\nSwap:           ", swap << PAGE_SHIFT);
+	seq_puts(m, " kB\n");
+}
+
 static int show_smaps_rollup(struct seq_file *m, void *v)
 {
-	struct proc_maps_private *priv = m->private;
+	struct smaps_rollup_private *rpriv = m->private;
+	struct proc_maps_private *priv = &rpriv->maps;
 	struct mem_size_stats mss;
 	struct mm_struct *mm;
 	struct vm_area_struct *vma;
@@ -888,16 +1331,25 @@ static int show_smaps_rollup(struct seq_file *m, void *v)
 		goto out_put_task;
 	}
 
+	if (rpriv->mode == SMAPS_ROLLUP_RSS) {
+		show_smaps_rollup_rss(m, mm);
+		goto out_put_mm;
+	}
+
 	memset(&mss, 0, sizeof(mss));
 
-	ret = mmap_read_lock_killable(mm);
+	ret = smaps_rollup_cache_start(rpriv, mm);
 	if (ret)
 		goto out_put_mm;
 
+	ret = mmap_read_lock_killable(mm);
+	if (ret)
+		goto out_cache_end;
+
 	hold_task_mempolicy(priv);
 
 	for (vma = priv->mm->mmap; vma;) {
-		smap_gather_stats(vma, &mss, 0);
+		smaps_rollup_gather(rpriv, vma, &mss);
 		last_vma_end = vma->vm_end;
 
 		/*
@@ -909,7 +1361,7 @@ static int show_smaps_rollup(struct seq_file *m, void *v)
 			ret = mmap_read_lock_killable(mm);
 			if (ret) {
 				release_task_mempolicy(priv);
-				goto out_put_mm;
+				goto out_cache_end;
 			}
 
 			/*
@@ -975,6 +1427,8 @@ static int show_smaps_rollup(struct seq_file *m, void *v)
 	release_task_mempolicy(priv);
 	mmap_read_unlock(mm);
 
+out_cache_end:
+	smaps_rollup_cache_end(rpriv, !ret);
 out_put_mm:
 	mmput(mm);
 out_put_task:
@@ -1000,13 +1454,15 @@ static int pid_smaps_open(struct inode *inode, struct file *file)
 static int smaps_rollup_open(struct inode *inode, struct file *file)
 {
 	int ret;
+	struct smaps_rollup_private *rpriv;
 	struct proc_maps_private *priv;
 
-	priv = kzalloc(sizeof(*priv), GFP_KERNEL_ACCOUNT);
-	if (!priv)
+	rpriv = kzalloc(sizeof(*rpriv), GFP_KERNEL_ACCOUNT);
+	if (!rpriv)
 		return -ENOMEM;
+	priv = &rpriv->maps;
 
-	ret = single_open(file, show_smaps_rollup, priv);
+	ret = single_open(file, show_smaps_rollup, rpriv);
 	if (ret)
 		goto out_free;
 
@@ -1022,19 +1478,61 @@ static int smaps_rollup_open(struct inode *inode, struct file *file)
 	return 0;
 
 out_free:
-	kfree(priv);
+	kfree(rpriv);
 	return ret;
 }
 
+static ssize_t smaps_rollup_write(struct file *file, const char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	struct seq_file *seq = file->private_data;
+	struct smaps_rollup_private *rpriv = seq->private;
+	unsigned int max_age_ms = SMAPS_ROLLUP_MAX_AGE_MS;
+	enum smaps_rollup_mode mode;
+	char buffer[32];
+	char *p;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+	p = strstrip(buffer);
+
+	if (!strcmp(p, "full")) {
+		mode = SMAPS_ROLLUP_FULL;
+	} else if (!strcmp(p, "rss")) {
+		mode = SMAPS_ROLLUP_RSS;
+	} else if (str_has_prefix(p, "cached")) {
+		p += strlen("cached");
+		if (*p && (!isspace(*p) ||
+			   kstrtouint(skip_spaces(p), 10, &max_age_ms)))
+			return -EINVAL;
+		mode = SMAPS_ROLLUP_CACHED;
+	} else {
+		return -EINVAL;
+	}
+
+	mutex_lock(&seq->lock);
+	rpriv->mode = mode;
+	rpriv->max_age = msecs_to_jiffies(max_age_ms);
+	if (mode != SMAPS_ROLLUP_CACHED)
+		smaps_rollup_cache_free(rpriv);
+	mutex_unlock(&seq->lock);
+
+	return count;
+}
+
 static int smaps_rollup_release(struct inode *inode, struct file *file)
 {
 	struct seq_file *seq = file->private_data;
-	struct proc_maps_private *priv = seq->private;
+	struct smaps_rollup_private *rpriv = seq->private;
 
-	if (priv->mm)
-		mmdrop(priv->mm);
+	if (rpriv->maps.mm)
+		mmdrop(rpriv->maps.mm);
 
-	kfree(priv);
+	smaps_rollup_cache_free(rpriv);
+	kfree(rpriv);
 	return single_release(inode, file);
 }
 
@@ -1048,6 +1546,7 @@ const struct file_operations proc_pid_smaps_operations = {
 const struct file_operations proc_pid_smaps_rollup_operations = {
 	.open		= smaps_rollup_open,
 	.read		= seq_read,
+	.write		= smaps_rollup_write,
 	.llseek		= seq_lseek,
 	.release	= smaps_rollup_release,
 };
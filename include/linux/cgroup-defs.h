@@ -456,6 +456,14 @@ struct cgroup {
 	struct cgroup_rstat_cpu __percpu *rstat_cpu;
 	struct list_head rstat_css_list;
 
+	/*
+	 * Generation and jiffies of the last completed rstat flush rooted
+	 * at this cgroup.  Used to coalesce concurrent flushes and to rate
+	 * limit approximate readers.  Updated under cgroup_rstat_lock.
+	 */
+	u64 rstat_flush_gen;
+	unsigned long rstat_flush_time;
+
 	/* cgroup basic resource statistics */
 	struct cgroup_base_stat last_bstat;
 	struct cgroup_base_stat bstat;
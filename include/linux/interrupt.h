@@ -299,6 +299,9 @@ struct irq_affinity_notify {
  *			of interrupt sets
  * @priv:		Private data for usage by @calc_sets, usually a
  *			pointer to driver/device specific data.
+ * @topology_aware:	Keep the CPUs of a vector within a cluster, spread
+ *			the vectors over the clusters and prefer cores
+ *			which carry few managed interrupts already
  */
 struct irq_affinity {
 	unsigned int	pre_vectors;
@@ -307,6 +310,7 @@ struct irq_affinity {
 	unsigned int	set_size[IRQ_AFFINITY_MAX_SETS];
 	void		(*calc_sets)(struct irq_affinity *, unsigned int nvecs);
 	void		*priv;
+	bool		topology_aware;
 };
 
 /**
@@ -817,10 +821,32 @@ static inline void init_irq_proc(void)
 }
 #endif
 
+/**
+ * struct irq_timings_hint - interrupt arrival prediction
+ * @interval:	predicted interval after the last interrupt, in ns
+ * @next_event:	predicted time of the next interrupt, local_clock() based
+ * @confidence:	periodicity confidence in percent, 100 if the interval
+ *		suite follows a repeating pattern
+ */
+struct irq_timings_hint {
+	u64		interval;
+	u64		next_event;
+	unsigned int	confidence;
+};
+
 #ifdef CONFIG_IRQ_TIMINGS
 void irq_timings_enable(void);
 void irq_timings_disable(void);
 u64 irq_timings_next_event(u64 now);
+int irq_timings_get_hint(unsigned int irq, struct irq_timings_hint *hint);
+#else
+static inline void irq_timings_enable(void) { }
+static inline void irq_timings_disable(void) { }
+static inline int irq_timings_get_hint(unsigned int irq,
+				       struct irq_timings_hint *hint)
+{
+	return -EOPNOTSUPP;
+}
 #endif
 
 struct seq_file;
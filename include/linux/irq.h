@@ -1237,6 +1237,13 @@ void irq_matrix_assign(struct irq_matrix *m, unsigned int bit);
 unsigned int irq_matrix_available(struct irq_matrix *m, bool cpudown);
 unsigned int irq_matrix_allocated(struct irq_matrix *m);
 unsigned int irq_matrix_reserved(struct irq_matrix *m);
+unsigned int irq_matrix_managed_allocated(struct irq_matrix *m, unsigned int cpu);
+
+#ifdef CONFIG_SMP
+void irq_affinity_set_load_matrix(struct irq_matrix *m);
+#else
+static inline void irq_affinity_set_load_matrix(struct irq_matrix *m) { }
+#endif
 void irq_matrix_debug_show(struct seq_file *sf, struct irq_matrix *m, int ind);
 
 /* Contrary to Linux irqs, for hardware irqs the irq number 0 is valid */
@@ -9,12 +9,15 @@
 #include <linux/rcu_sync.h>
 #include <linux/lockdep.h>
 
+struct percpu_rwsem_holdoff;
+
 struct percpu_rw_semaphore {
 	struct rcu_sync		rss;
 	unsigned int __percpu	*read_count;
 	struct rcuwait		writer;
 	wait_queue_head_t	waiters;
 	atomic_t		block;
+	struct percpu_rwsem_holdoff *holdoff;
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
 #endif
@@ -129,6 +132,9 @@ extern int __percpu_init_rwsem(struct percpu_rw_semaphore *,
 
 extern void percpu_free_rwsem(struct percpu_rw_semaphore *);
 
+extern int percpu_rwsem_set_holdoff(struct percpu_rw_semaphore *,
+				    unsigned long delay);
+
 #define percpu_init_rwsem(sem)					\
 ({								\
 	static struct lock_class_key rwsem_key;			\
@@ -57,6 +57,25 @@ int virtqueue_add_sgs(struct virtqueue *vq,
 		      void *data,
 		      gfp_t gfp);
 
+/**
+ * virtqueue_buf - one buffer for virtqueue_add_sgs_batch()
+ * @sgs: array of terminated scatterlists.
+ * @out_sgs: the number of scatterlists readable by other side
+ * @in_sgs: the number of scatterlists which are writable (after readable ones)
+ * @data: the token identifying the buffer.
+ */
+struct virtqueue_buf {
+	struct scatterlist **sgs;
+	unsigned int out_sgs;
+	unsigned int in_sgs;
+	void *data;
+};
+
+int virtqueue_add_sgs_batch(struct virtqueue *vq,
+			    struct virtqueue_buf *bufs,
+			    unsigned int num,
+			    gfp_t gfp);
+
 bool virtqueue_kick(struct virtqueue *vq);
 
 bool virtqueue_kick_prepare(struct virtqueue *vq);
@@ -68,6 +87,9 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len);
 void *virtqueue_get_buf_ctx(struct virtqueue *vq, unsigned int *len,
 			    void **ctx);
 
+unsigned int virtqueue_get_bufs(struct virtqueue *vq, void **bufs,
+				unsigned int *lens, unsigned int num);
+
 void virtqueue_disable_cb(struct virtqueue *vq);
 
 bool virtqueue_enable_cb(struct virtqueue *vq);
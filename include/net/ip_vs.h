@@ -500,7 +500,7 @@ struct ip_vs_conn_param {
 
 /* IP_VS structure allocated for each dynamically scheduled connection */
 struct ip_vs_conn {
-	struct hlist_node	c_list;         /* hashed list heads */
+	struct hlist_node	c_list[2];      /* hashed list heads, per table */
 	/* Protocol, addresses and port numbers */
 	__be16                  cport;
 	__be16                  dport;
@@ -14,6 +14,7 @@
 
 struct mptcp_info;
 struct mptcp_sock;
+struct mptcp_subflow_context;
 struct seq_file;
 
 /* MPTCP sk_buff extension data */
@@ -57,6 +58,41 @@ struct mptcp_addr_info {
 	};
 };
 
+#define MPTCP_PM_ADDR_MAX	8
+
+#define MPTCP_SCHED_NAME_MAX	16
+/* the initial subflow plus the ones the path manager can add */
+#define MPTCP_SUBFLOWS_MAX	(MPTCP_PM_ADDR_MAX + 1)
+
+/* push every chunk of data on all the active subflows */
+#define MPTCP_SCHED_FLAG_REDUNDANT	BIT(0)
+#define MPTCP_SCHED_FLAGS		MPTCP_SCHED_FLAG_REDUNDANT
+
+/* the active subflows a scheduler can pick from */
+struct mptcp_sched_data {
+	struct mptcp_subflow_context *contexts[MPTCP_SUBFLOWS_MAX];
+	u8 subflows;
+};
+
+struct mptcp_sched_ops {
+	/* return the index in data->contexts of the subflow that will
+	 * transmit the next chunk of data, a negative value if none can
+	 */
+	int (*get_subflow)(struct mptcp_sock *msk,
+			   struct mptcp_sched_data *data);
+
+	/* optional, called with the msk socket lock held or in atomic
+	 * context when a passive msk is created
+	 */
+	void (*init)(struct mptcp_sock *msk);
+	void (*release)(struct mptcp_sock *msk);
+
+	u32			flags;
+	char			name[MPTCP_SCHED_NAME_MAX];
+	struct module		*owner;
+	struct list_head	list;
+};
+
 struct mptcp_out_options {
 #if IS_ENABLED(CONFIG_MPTCP)
 	u16 suboptions;
@@ -99,6 +135,9 @@ extern struct request_sock_ops mptcp_subflow_request_sock_ops;
 
 void mptcp_init(void);
 
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched);
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched);
+
 static inline bool sk_is_mptcp(const struct sock *sk)
 {
 	return tcp_sk(sk)->is_mptcp;
@@ -56,6 +56,9 @@ struct netns_xfrm {
 	struct work_struct	policy_hash_work;
 	struct xfrm_policy_hthresh policy_hthresh;
 	struct list_head	inexact_bins;
+	struct xfrm_pol_cache __percpu *policy_cache;
+	atomic_t		policy_cache_genid;
+	unsigned int		policy_labeled;
 
 
 	struct sock		*nlsk;
@@ -41,6 +41,7 @@
 #include <linux/tcp.h>
 #include <linux/skmsg.h>
 #include <linux/mutex.h>
+#include <linux/llist.h>
 #include <linux/netdevice.h>
 #include <linux/rcupdate.h>
 
@@ -97,6 +98,7 @@ enum {
  */
 struct tls_rec {
 	struct list_head list;
+	struct llist_node encrypt_node;
 	int tx_ready;
 	int tx_flags;
 
@@ -138,6 +140,11 @@ struct tls_sw_context_tx {
 	spinlock_t encrypt_compl_lock;
 	int async_notify;
 	u8 async_capable:1;
+	/* records followed by more data of the same write, encrypted by
+	 * encrypt_work while the next ones are built
+	 */
+	struct llist_head encrypt_list;
+	struct work_struct encrypt_work;
 
 #define BIT_TX_SCHEDULED	0
 #define BIT_TX_CLOSING		1
@@ -155,6 +162,7 @@ struct tls_sw_context_rx {
 	u8 control;
 	u8 async_capable:1;
 	u8 decrypted:1;
+	u8 zc_type;		/* TLS 1.3 record type of a zero-copy decrypt */
 	atomic_t decrypt_pending;
 	/* protect crypto_wait with decrypt_pending*/
 	spinlock_t decrypt_compl_lock;
@@ -245,6 +253,7 @@ struct tls_context {
 
 	u8 tx_conf:3;
 	u8 rx_conf:3;
+	u8 rx_zc:1;
 
 	int (*push_pending_record)(struct sock *sk, int flags);
 	void (*sk_write_space)(struct sock *sk);
@@ -17,6 +17,7 @@
 struct net_device;
 struct xsk_queue;
 struct xdp_buff;
+struct xsk_tx_cache;
 
 struct xdp_umem {
 	void *addrs;
@@ -59,6 +60,8 @@ struct xdp_sock {
 
 	struct xsk_queue *tx ____cacheline_aligned_in_smp;
 	struct list_head tx_list;
+	/* Generic Tx skb allocation and batching, protected by mutex */
+	struct xsk_tx_cache *tx_cache;
 	/* Protects generic receive. */
 	spinlock_t rx_lock;
 
@@ -305,4 +305,75 @@ typedef int __bitwise __kernel_rwf_t;
 #define RWF_SUPPORTED	(RWF_HIPRI | RWF_DSYNC | RWF_SYNC | RWF_NOWAIT |\
 			 RWF_APPEND)
 
+/* /proc/<pid>/maps ioctls */
+#define PROCFS_IOCTL_MAGIC 'f'
+
+/* Query a VMA of a process, see struct procmap_query */
+#define PROCMAP_QUERY	_IOWR(PROCFS_IOCTL_MAGIC, 17, struct procmap_query)
+
+enum procmap_query_flags {
+	/*
+	 * VMA permission flags.  As query flags they restrict the lookup to
+	 * VMAs that have at least these permissions, in vma_flags they
+	 * report the permissions of the VMA found.
+	 */
+	PROCMAP_QUERY_VMA_READABLE		= 0x01,
+	PROCMAP_QUERY_VMA_WRITABLE		= 0x02,
+	PROCMAP_QUERY_VMA_EXECUTABLE		= 0x04,
+	PROCMAP_QUERY_VMA_SHARED		= 0x08,
+	/*
+	 * Without this flag only the VMA covering query_addr is returned,
+	 * with it the first VMA that ends after query_addr and matches the
+	 * other query flags.  Querying from 0 and then from vma_end of the
+	 * previous reply walks all the matching VMAs of the process.
+	 */
+	PROCMAP_QUERY_COVERING_OR_NEXT_VMA	= 0x10,
+	/* Only return VMAs that map a file */
+	PROCMAP_QUERY_FILE_BACKED_VMA		= 0x20,
+};
+
+/*
+ * Input/output argument of PROCMAP_QUERY.  The size field makes the struct
+ * extensible: the kernel accepts any size that covers at least query_addr,
+ * zero fills the fields it doesn't get and only writes back up to size.
+ */
+struct procmap_query {
+	/* Query struct size, for backwards/forward compatibility */
+	__u64 size;
+	/* Query flags, a combination of enum procmap_query_flags (in) */
+	__u64 query_flags;
+	/* Address to look up (in) */
+	__u64 query_addr;
+	/* VMA start and end addresses (out) */
+	__u64 vma_start;
+	__u64 vma_end;
+	/* VMA permissions, PROCMAP_QUERY_VMA_* flags (out) */
+	__u64 vma_flags;
+	/* VMA backing page size, larger than PAGE_SIZE for hugetlb (out) */
+	__u64 vma_page_size;
+	/* File offset of vma_start, zero for anonymous VMAs (out) */
+	__u64 vma_offset;
+	/* Inode number and device of the mapped file, or zero (out) */
+	__u64 inode;
+	__u32 dev_major;
+	__u32 dev_minor;
+	/*
+	 * Size of the buffer at vma_name_addr on input, length of the VMA
+	 * name including the terminating NUL on output, zero if the VMA has
+	 * no name.  Zero on input skips the name.  The name is the same as
+	 * in /proc/<pid>/maps, e.g. the file path, [heap] or [anon:<name>].
+	 * (in/out)
+	 */
+	__u32 vma_name_size;
+	/*
+	 * Size of the buffer at build_id_addr on input, size of the ELF
+	 * build ID of the mapped file on output, zero if there is none.
+	 * Zero on input skips the build ID.  (in/out)
+	 */
+	__u32 build_id_size;
+	/* User buffers for the VMA name and the build ID (in) */
+	__u64 vma_name_addr;
+	__u64 build_id_addr;
+};
+
 #endif /* _UAPI_LINUX_FS_H */
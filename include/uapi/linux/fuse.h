@@ -194,6 +194,13 @@
  *  - add FUSE_SECURITY_CTX init flag
  *  - add security context to create, mkdir, symlink, and mknod requests
  *  - add FUSE_HAS_INODE_DAX, FUSE_ATTR_DAX
+ *
+ *  7.37
+ *  - add FUSE_PER_CPU_QUEUES init flag and FUSE_DEV_IOC_BIND_CPU
+ *  - add FUSE_DEV_IOC_RING_SETUP and FUSE_DEV_IOC_RING_ENTER
+ *  - add FUSE_PASSTHROUGH init flag, FOPEN_PASSTHROUGH and backing_id in
+ *    fuse_open_out
+ *  - add FUSE_DEV_IOC_BACKING_OPEN and FUSE_DEV_IOC_BACKING_CLOSE
  */
 
 #ifndef _LINUX_FUSE_H
@@ -229,7 +236,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 36
+#define FUSE_KERNEL_MINOR_VERSION 37
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -301,6 +308,7 @@ struct fuse_file_lock {
  * FOPEN_CACHE_DIR: allow caching this directory
  * FOPEN_STREAM: the file is stream-like (no file position at all)
  * FOPEN_NOFLUSH: don't flush data cache on close (unless FUSE_WRITEBACK_CACHE)
+ * FOPEN_PASSTHROUGH: read, write and mmap go to the backing file backing_id
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
@@ -308,6 +316,7 @@ struct fuse_file_lock {
 #define FOPEN_CACHE_DIR		(1 << 3)
 #define FOPEN_STREAM		(1 << 4)
 #define FOPEN_NOFLUSH		(1 << 5)
+#define FOPEN_PASSTHROUGH	(1 << 6)
 
 /**
  * INIT request/reply flags
@@ -353,6 +362,10 @@ struct fuse_file_lock {
  * FUSE_SECURITY_CTX:	add security context to create, mkdir, symlink, and
  *			mknod
  * FUSE_HAS_INODE_DAX:  use per inode DAX
+ * FUSE_PER_CPU_QUEUES: queue requests on the device clone bound to the
+ *			submitting CPU with FUSE_DEV_IOC_BIND_CPU
+ * FUSE_PASSTHROUGH: allow FOPEN_PASSTHROUGH with backing files registered
+ *		     with FUSE_DEV_IOC_BACKING_OPEN
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -389,6 +402,8 @@ struct fuse_file_lock {
 /* bits 32..63 get shifted down 32 bits into the flags2 field */
 #define FUSE_SECURITY_CTX	(1ULL << 32)
 #define FUSE_HAS_INODE_DAX	(1ULL << 33)
+#define FUSE_PER_CPU_QUEUES	(1ULL << 34)
+#define FUSE_PASSTHROUGH	(1ULL << 35)
 
 /**
  * CUSE INIT request/reply flags
@@ -663,7 +678,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	uint64_t	fh;
 	uint32_t	open_flags;
-	uint32_t	padding;
+	int32_t		backing_id;
 };
 
 struct fuse_release_in {
@@ -953,6 +968,78 @@ struct fuse_notify_retrieve_in {
 /* Device ioctls: */
 #define FUSE_DEV_IOC_MAGIC		229
 #define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, uint32_t)
+#define FUSE_DEV_IOC_BIND_CPU		_IOW(FUSE_DEV_IOC_MAGIC, 1, uint32_t)
+#define FUSE_DEV_IOC_RING_SETUP		_IOWR(FUSE_DEV_IOC_MAGIC, 2, \
+					      struct fuse_ring_setup)
+#define FUSE_DEV_IOC_RING_ENTER		_IOW(FUSE_DEV_IOC_MAGIC, 3, uint32_t)
+#define FUSE_DEV_IOC_BACKING_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 4, \
+					     struct fuse_backing_map)
+#define FUSE_DEV_IOC_BACKING_CLOSE	_IOW(FUSE_DEV_IOC_MAGIC, 5, uint32_t)
+
+/*
+ * Shared memory ring of a device
+ *
+ * The area to mmap at offset 0 starts with a struct fuse_ring_ctrl, the
+ * submission and completion queues are at sq_off and cq_off, and the
+ * slots at slots_off.  The kernel copies each request into a free slot
+ * and queues a submission entry with the slot and the size of the
+ * request.  The server puts the reply in the same slot and queues a
+ * completion entry with the size of the reply, or zero if there is
+ * nothing to reply.  A request larger than a slot only has its header
+ * copied, the server reads it with read() or splice() and replies with
+ * write() or splice(), and completes the slot with zero.
+ *
+ * The kernel sets the status of each completion entry it reaps to zero,
+ * or to a negative errno if the reply or the entry was rejected.  It is
+ * valid once cq_head has moved past the entry, until the server queues a
+ * new completion in it.
+ *
+ * FUSE_DEV_IOC_RING_ENTER reaps the completions and queues the pending
+ * requests, returns the number of requests queued.  With
+ * FUSE_RING_ENTER_WAIT it waits for at least one, after busy polling
+ * for busy_poll_us microseconds.
+ */
+#define FUSE_RING_ENTER_WAIT		(1 << 0)
+
+struct fuse_ring_setup {
+	uint32_t	entries;	/* power of two */
+	uint32_t	entry_size;	/* multiple of the page size */
+	uint32_t	busy_poll_us;
+	uint32_t	flags;
+	uint64_t	mmap_size;	/* set by the kernel */
+	uint32_t	sq_off;		/* set by the kernel */
+	uint32_t	cq_off;		/* set by the kernel */
+	uint64_t	slots_off;	/* set by the kernel */
+};
+
+struct fuse_ring_ctrl {
+	uint32_t	sq_head;	/* advanced by the server */
+	uint32_t	sq_tail;	/* advanced by the kernel */
+	uint32_t	cq_head;	/* advanced by the kernel */
+	uint32_t	cq_tail;	/* advanced by the server */
+};
+
+struct fuse_ring_entry {
+	uint32_t	slot;
+	uint32_t	len;
+	int32_t		status;		/* set by the kernel on completion */
+	uint32_t	padding;
+};
+
+/*
+ * Backing file of a passthrough open
+ *
+ * FUSE_DEV_IOC_BACKING_OPEN registers the file open at fd and returns a
+ * positive backing_id for fuse_open_out.  The connection keeps a reference
+ * to the file until FUSE_DEV_IOC_BACKING_CLOSE, and every file opened with
+ * it keeps its own until it is released.  I/O on the backing file is done
+ * with the credentials the file was opened with.
+ */
+struct fuse_backing_map {
+	int32_t		fd;
+	uint32_t	flags;
+	uint64_t	padding;
+};
 
 struct fuse_lseek_in {
 	uint64_t	fh;
@@ -129,6 +129,9 @@ struct tpacket_auxdata {
 /* Rx ring - feature request bits */
 #define TP_FT_REQ_FILL_RXHASH	0x1
 
+/* Tx ring - feature request bits */
+#define TP_FT_REQ_TX_BLOCK	0x2	/* V3 only, send whole blocks */
+
 struct tpacket_hdr {
 	unsigned long	tp_status;
 	unsigned int	tp_len;
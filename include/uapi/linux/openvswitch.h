@@ -92,6 +92,9 @@ enum ovs_datapath_attr {
 	OVS_DP_ATTR_PER_CPU_PIDS,   /* Netlink PIDS to receive upcalls in
 				     * per-cpu dispatch mode
 				     */
+	OVS_DP_ATTR_MICROFLOW_CACHE_SIZE, /* u32 entries of the per-cpu
+					   * exact-match flow cache
+					   */
 	__OVS_DP_ATTR_MAX
 };
 
@@ -109,7 +112,8 @@ struct ovs_dp_megaflow_stats {
 	__u32 n_masks;		 /* Number of masks for the datapath. */
 	__u32 pad0;		 /* Pad for future expension. */
 	__u64 n_cache_hit;       /* Number of cache matches for flow lookups. */
-	__u64 pad1;		 /* Pad for future expension. */
+	__u64 n_microflow_hit;	 /* Number of lookups which hit the microflow
+				  * cache, without any mask lookup. */
 };
 
 struct ovs_vport_stats {
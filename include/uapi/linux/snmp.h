@@ -327,6 +327,8 @@ enum
 	LINUX_MIB_XFRMFWDHDRERROR,		/* XfrmFwdHdrError*/
 	LINUX_MIB_XFRMOUTSTATEINVALID,		/* XfrmOutStateInvalid */
 	LINUX_MIB_XFRMACQUIREERROR,		/* XfrmAcquireError */
+	LINUX_MIB_XFRMPOLCACHEHIT,		/* XfrmPolCacheHit */
+	LINUX_MIB_XFRMPOLCACHEMISS,		/* XfrmPolCacheMiss */
 	__LINUX_MIB_XFRMMAX
 };
 
@@ -344,6 +346,8 @@ enum
 	LINUX_MIB_TLSRXDEVICE,			/* TlsRxDevice */
 	LINUX_MIB_TLSDECRYPTERROR,		/* TlsDecryptError */
 	LINUX_MIB_TLSRXDEVICERESYNC,		/* TlsRxDeviceResync */
+	LINUX_MIB_TLSRXZCTAIL,			/* TlsRxZcTail */
+	LINUX_MIB_TLSRXZCRETRY,			/* TlsRxZcRetry */
 	__LINUX_MIB_TLSMAX
 };
 
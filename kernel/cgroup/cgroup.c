@@ -112,6 +112,12 @@ static DEFINE_SPINLOCK(cgroup_file_kn_lock);
 
 DEFINE_PERCPU_RWSEM(cgroup_threadgroup_rwsem);
 
+/*
+ * How long, in msecs, forks and exits stay in the slow path of
+ * cgroup_threadgroup_rwsem after a migration. 0 keeps them there forever.
+ */
+static unsigned int cgroup_threadgroup_holdoff __initdata = MSEC_PER_SEC;
+
 #define cgroup_assert_mutex_or_rcu_locked()				\
 	RCU_LOCKDEP_WARN(!rcu_read_lock_held() &&			\
 			   !lockdep_is_held(&cgroup_mutex),		\
@@ -5844,9 +5850,13 @@ int __init cgroup_init(void)
 
 	/*
 	 * The latency of the synchronize_rcu() is too high for cgroups,
-	 * avoid it at the cost of forcing all readers into the slow path.
+	 * avoid it for migrations close to each other at the cost of
+	 * forcing the readers into the slow path in the meantime.
 	 */
-	rcu_sync_enter_start(&cgroup_threadgroup_rwsem.rss);
+	if (!cgroup_threadgroup_holdoff ||
+	    percpu_rwsem_set_holdoff(&cgroup_threadgroup_rwsem,
+				     msecs_to_jiffies(cgroup_threadgroup_holdoff)))
+		rcu_sync_enter_start(&cgroup_threadgroup_rwsem.rss);
 
 	get_user_ns(init_cgroup_ns.user_ns);
 
@@ -6494,6 +6504,14 @@ static int __init enable_cgroup_debug(char *str)
 }
 __setup("cgroup_debug", enable_cgroup_debug);
 
+static int __init cgroup_threadgroup_holdoff_setup(char *str)
+{
+	if (kstrtouint(str, 0, &cgroup_threadgroup_holdoff))
+		pr_warn("invalid cgroup_threadgroup_holdoff=%s\n", str);
+	return 1;
+}
+__setup("cgroup_threadgroup_holdoff=", cgroup_threadgroup_holdoff_setup);
+
 /**
  * css_tryget_online_from_dir - get corresponding css from a cgroup dentry
  * @dentry: directory dentry of interest
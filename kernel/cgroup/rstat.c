@@ -6,6 +6,17 @@
 static DEFINE_SPINLOCK(cgroup_rstat_lock);
 static DEFINE_PER_CPU(raw_spinlock_t, cgroup_rstat_cpu_lock);
 
+/*
+ * Incremented under cgroup_rstat_lock whenever a flush starts.  A flush
+ * request which samples the generation before acquiring the lock is
+ * satisfied by any flush of the same subtree or of an ancestor which
+ * started with a higher generation and has completed.
+ */
+static atomic64_t cgroup_rstat_flush_gen = ATOMIC64_INIT(0);
+
+/* How stale the cputime shown in cpu.stat may be */
+#define CGROUP_BASE_STAT_MAX_AGE	(HZ / 10)
+
 static void cgroup_base_stat_flush(struct cgroup *cgrp, int cpu);
 
 static struct cgroup_rstat_cpu *cgroup_rstat_cpu(struct cgroup *cgrp, int cpu)
@@ -145,10 +156,13 @@ static struct cgroup *cgroup_rstat_cpu_pop_updated(struct cgroup *pos,
 static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
 	__releases(&cgroup_rstat_lock) __acquires(&cgroup_rstat_lock)
 {
+	u64 gen;
 	int cpu;
 
 	lockdep_assert_held(&cgroup_rstat_lock);
 
+	gen = atomic64_inc_return(&cgroup_rstat_flush_gen);
+
 	for_each_possible_cpu(cpu) {
 		raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock,
 						       cpu);
@@ -186,6 +200,32 @@ static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
 			spin_lock_irq(&cgroup_rstat_lock);
 		}
 	}
+
+	/* flushes may interleave while the lock is dropped above */
+	if (gen > cgrp->rstat_flush_gen)
+		cgrp->rstat_flush_gen = gen;
+	WRITE_ONCE(cgrp->rstat_flush_time, jiffies);
+}
+
+/*
+ * Flush @cgrp's subtree unless a flush covering it has started after @gen
+ * was sampled and completed while we were waiting for cgroup_rstat_lock.
+ * This coalesces concurrent readers of the same or nested subtrees into a
+ * single traversal.
+ */
+static void cgroup_rstat_flush_coalesced(struct cgroup *cgrp, u64 gen,
+					 bool may_sleep)
+	__releases(&cgroup_rstat_lock) __acquires(&cgroup_rstat_lock)
+{
+	struct cgroup *pos;
+
+	lockdep_assert_held(&cgroup_rstat_lock);
+
+	for (pos = cgrp; pos; pos = cgroup_parent(pos))
+		if (pos->rstat_flush_gen > gen)
+			return;
+
+	cgroup_rstat_flush_locked(cgrp, may_sleep);
 }
 
 /**
@@ -199,14 +239,20 @@ static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
  * This also gets all cgroups in the subtree including @cgrp off the
  * ->updated_children lists.
  *
+ * If a flush of @cgrp or one of its ancestors starts and completes while
+ * we are waiting for cgroup_rstat_lock, our request is already satisfied
+ * and no further traversal is done.
+ *
  * This function may block.
  */
 void cgroup_rstat_flush(struct cgroup *cgrp)
 {
+	u64 gen = atomic64_read(&cgroup_rstat_flush_gen);
+
 	might_sleep();
 
 	spin_lock_irq(&cgroup_rstat_lock);
-	cgroup_rstat_flush_locked(cgrp, true);
+	cgroup_rstat_flush_coalesced(cgrp, gen, true);
 	spin_unlock_irq(&cgroup_rstat_lock);
 }
 
@@ -218,13 +264,41 @@ void cgroup_rstat_flush(struct cgroup *cgrp)
  */
 void cgroup_rstat_flush_irqsafe(struct cgroup *cgrp)
 {
+	u64 gen = atomic64_read(&cgroup_rstat_flush_gen);
 	unsigned long flags;
 
 	spin_lock_irqsave(&cgroup_rstat_lock, flags);
-	cgroup_rstat_flush_locked(cgrp, false);
+	cgroup_rstat_flush_coalesced(cgrp, gen, false);
 	spin_unlock_irqrestore(&cgroup_rstat_lock, flags);
 }
 
+/**
+ * cgroup_rstat_flush_ratelimited - flush stats in @cgrp's subtree unless fresh
+ * @cgrp: target cgroup
+ * @max_age: maximum staleness in jiffies
+ *
+ * Like cgroup_rstat_flush() but skips flushing if @cgrp's subtree has been
+ * flushed within the last @max_age jiffies, either directly or as part of
+ * an ancestor's flush.  This is meant for monitoring readers which can
+ * tolerate slightly stale stats and shouldn't contend on the flush lock.
+ *
+ * This function may block.
+ */
+void cgroup_rstat_flush_ratelimited(struct cgroup *cgrp, unsigned long max_age)
+{
+	unsigned long now = jiffies;
+	struct cgroup *pos;
+
+	for (pos = cgrp; pos; pos = cgroup_parent(pos)) {
+		unsigned long last = READ_ONCE(pos->rstat_flush_time);
+
+		if (time_in_range(now, last, last + max_age))
+			return;
+	}
+
+	cgroup_rstat_flush(cgrp);
+}
+
 /**
  * cgroup_rstat_flush_hold - flush stats in @cgrp's subtree and hold
  * @cgrp: target cgroup
@@ -237,9 +311,11 @@ void cgroup_rstat_flush_irqsafe(struct cgroup *cgrp)
 void cgroup_rstat_flush_hold(struct cgroup *cgrp)
 	__acquires(&cgroup_rstat_lock)
 {
+	u64 gen = atomic64_read(&cgroup_rstat_flush_gen);
+
 	might_sleep();
 	spin_lock_irq(&cgroup_rstat_lock);
-	cgroup_rstat_flush_locked(cgrp, true);
+	cgroup_rstat_flush_coalesced(cgrp, gen, true);
 }
 
 /**
@@ -277,7 +353,10 @@ void cgroup_rstat_exit(struct cgroup *cgrp)
 {
 	int cpu;
 
-	cgroup_rstat_flush(cgrp);
+	/* don't coalesce, the updated lists must be empty afterwards */
+	spin_lock_irq(&cgroup_rstat_lock);
+	cgroup_rstat_flush_locked(cgrp, true);
+	spin_unlock_irq(&cgroup_rstat_lock);
 
 	/* sanity check */
 	for_each_possible_cpu(cpu) {
@@ -448,11 +527,12 @@ void cgroup_base_stat_cputime_show(struct seq_file *seq)
 	struct task_cputime cputime;
 
 	if (cgroup_parent(cgrp)) {
-		cgroup_rstat_flush_hold(cgrp);
+		cgroup_rstat_flush_ratelimited(cgrp, CGROUP_BASE_STAT_MAX_AGE);
+		spin_lock_irq(&cgroup_rstat_lock);
 		usage = cgrp->bstat.cputime.sum_exec_runtime;
 		cputime_adjust(&cgrp->bstat.cputime, &cgrp->prev_cputime,
 			       &utime, &stime);
-		cgroup_rstat_flush_release();
+		spin_unlock_irq(&cgroup_rstat_lock);
 	} else {
 		root_cgroup_cputime(&cputime);
 		usage = cputime.sum_exec_runtime;
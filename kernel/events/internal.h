@@ -3,20 +3,23 @@
 #define _KERNEL_EVENTS_INTERNAL_H
 
 #include <linux/hardirq.h>
+#include <linux/hrtimer.h>
 #include <linux/uaccess.h>
 #include <linux/refcount.h>
+#include <asm/local64.h>
 
 /* Buffer handling */
 
 #define RING_BUFFER_WRITABLE		0x01
+#define RING_BUFFER_HIGH_ORDER		0x02
 
 struct perf_buffer {
 	refcount_t			refcount;
 	struct rcu_head			rcu_head;
 #ifdef CONFIG_PERF_USE_VMALLOC
 	struct work_struct		work;
-	int				page_order;	/* allocation order  */
 #endif
+	int				page_order;	/* allocation order  */
 	int				nr_pages;	/* nr of data pages  */
 	int				overwrite;	/* can overwrite itself */
 	int				paused;		/* can write into ring buffer */
@@ -31,6 +34,15 @@ struct perf_buffer {
 
 	long				watermark;	/* wakeup watermark  */
 	long				aux_watermark;
+
+	/* rate limited wakeups */
+	u64				wakeup_interval; /* ns, 0 if unlimited */
+	atomic64_t			wakeup_next;	/* earliest next wakeup, CLOCK_MONOTONIC */
+	int				wakeup_deferred;
+	atomic_t			wakeup_armed;
+	struct irq_work			wakeup_work;	/* arms wakeup_timer */
+	struct hrtimer			wakeup_timer;
+
 	/* poll crap */
 	spinlock_t			event_lock;
 	struct list_head		event_list;
@@ -96,25 +108,21 @@ void perf_event_aux_event(struct perf_event *event, unsigned long head,
 extern struct page *
 perf_mmap_to_page(struct perf_buffer *rb, unsigned long pgoff);
 
-#ifdef CONFIG_PERF_USE_VMALLOC
 /*
- * Back perf_mmap() with vmalloc memory.
- *
- * Required for architectures that have d-cache aliasing issues.
+ * The data pages are either a single vmalloc area, on architectures that
+ * have d-cache aliasing issues (CONFIG_PERF_USE_VMALLOC), or nr_pages
+ * physically contiguous chunks of the same order.
  */
-
 static inline int page_order(struct perf_buffer *rb)
 {
 	return rb->page_order;
 }
 
-#else
-
-static inline int page_order(struct perf_buffer *rb)
+/* The number of PAGE_SIZE data pages */
+static inline int data_page_nr(struct perf_buffer *rb)
 {
-	return 0;
+	return rb->nr_pages << page_order(rb);
 }
-#endif
 
 static inline unsigned long perf_data_size(struct perf_buffer *rb)
 {
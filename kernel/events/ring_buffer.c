@@ -17,9 +17,84 @@
 
 #include "internal.h"
 
+/*
+ * Flag a wakeup for the timer and make sure it is armed. This can run
+ * in NMI context, so the timer is started from an irq_work.
+ */
+static void perf_rb_defer_wakeup(struct perf_buffer *rb)
+{
+	WRITE_ONCE(rb->wakeup_deferred, 1);
+
+	/* Ordered after the flag, pairs with perf_rb_wakeup_timer() */
+	if (!atomic_xchg(&rb->wakeup_armed, 1))
+		irq_work_queue(&rb->wakeup_work);
+}
+
+static void perf_rb_wakeup_arm(struct irq_work *work)
+{
+	struct perf_buffer *rb = container_of(work, struct perf_buffer,
+					      wakeup_work);
+
+	hrtimer_start(&rb->wakeup_timer,
+		      ns_to_ktime(atomic64_read(&rb->wakeup_next)),
+		      HRTIMER_MODE_ABS);
+}
+
+/*
+ * Deliver the deferred wakeups the same way as the direct ones, so that
+ * the events also get their SIGIO.
+ */
+static enum hrtimer_restart perf_rb_wakeup_timer(struct hrtimer *timer)
+{
+	struct perf_buffer *rb = container_of(timer, struct perf_buffer,
+					      wakeup_timer);
+	struct perf_event *event;
+
+	/*
+	 * A wakeup deferred after the flag is cleared below sees the timer
+	 * disarmed, and arms it again.
+	 */
+	atomic_set(&rb->wakeup_armed, 0);
+	smp_mb__after_atomic();
+
+	if (!xchg(&rb->wakeup_deferred, 0))
+		return HRTIMER_NORESTART;
+
+	atomic64_set(&rb->wakeup_next,
+		     ktime_get_mono_fast_ns() + rb->wakeup_interval);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(event, &rb->event_list, rb_entry) {
+		event->pending_wakeup = 1;
+		irq_work_queue(&event->pending);
+	}
+	rcu_read_unlock();
+
+	return HRTIMER_NORESTART;
+}
+
 static void perf_output_wakeup(struct perf_output_handle *handle)
 {
-	atomic_set(&handle->rb->poll, EPOLLIN);
+	struct perf_buffer *rb = handle->rb;
+
+	atomic_set(&rb->poll, EPOLLIN);
+
+	/*
+	 * With rate limited wakeups, raise the irq_work at most once per
+	 * interval. A crossing within the interval, or one racing with
+	 * another CPU that just took the slot, is left to the wakeup timer.
+	 */
+	if (rb->wakeup_interval) {
+		u64 now = ktime_get_mono_fast_ns();
+		u64 next = atomic64_read(&rb->wakeup_next);
+
+		if (now < next ||
+		    atomic64_cmpxchg(&rb->wakeup_next, next,
+				     now + rb->wakeup_interval) != next) {
+			perf_rb_defer_wakeup(rb);
+			return;
+		}
+	}
 
 	handle->event->pending_wakeup = 1;
 	irq_work_queue(&handle->event->pending);
@@ -313,6 +388,10 @@ ring_buffer_init(struct perf_buffer *rb, long watermark, int flags)
 	if (!rb->watermark)
 		rb->watermark = max_size / 2;
 
+	hrtimer_init(&rb->wakeup_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	rb->wakeup_timer.function = perf_rb_wakeup_timer;
+	init_irq_work(&rb->wakeup_work, perf_rb_wakeup_arm);
+
 	if (flags & RING_BUFFER_WRITABLE)
 		rb->overwrite = 0;
 	else
@@ -772,13 +851,15 @@ void rb_free_aux(struct perf_buffer *rb)
 static struct page *
 __perf_mmap_to_page(struct perf_buffer *rb, unsigned long pgoff)
 {
-	if (pgoff > rb->nr_pages)
+	if (pgoff > data_page_nr(rb))
 		return NULL;
 
 	if (pgoff == 0)
 		return virt_to_page(rb->user_page);
 
-	return virt_to_page(rb->data_pages[pgoff - 1]);
+	pgoff--;
+	return virt_to_page(rb->data_pages[pgoff >> page_order(rb)]) +
+	       (pgoff & ((1UL << page_order(rb)) - 1));
 }
 
 static void *perf_mmap_alloc_page(int cpu)
@@ -802,11 +883,67 @@ static void perf_mmap_free_page(void *addr)
 	__free_page(page);
 }
 
+#define PERF_DATA_GFP	(GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN | __GFP_NORETRY)
+
+/*
+ * Allocate a physically contiguous chunk of data pages. Like for the AUX
+ * area, the chunk is split so that its pages can be mapped and freed
+ * individually.
+ */
+static void *perf_mmap_alloc_chunk(int cpu, int order)
+{
+	struct page *page;
+	int node;
+
+	if (!order)
+		return perf_mmap_alloc_page(cpu);
+
+	node = (cpu == -1) ? cpu : cpu_to_node(cpu);
+	page = alloc_pages_node(node, PERF_DATA_GFP, order);
+	if (!page)
+		return NULL;
+
+	split_page(page, order);
+
+	return page_address(page);
+}
+
+static void perf_mmap_free_chunk(void *addr, int order)
+{
+	int i;
+
+	for (i = 0; i < (1 << order); i++)
+		perf_mmap_free_page(addr + i * PAGE_SIZE);
+}
+
+static int rb_alloc_data_pages(struct perf_buffer *rb, int nr_pages, int cpu,
+			       int order)
+{
+	int i;
+
+	for (i = 0; i < nr_pages >> order; i++) {
+		rb->data_pages[i] = perf_mmap_alloc_chunk(cpu, order);
+		if (!rb->data_pages[i])
+			goto fail;
+	}
+
+	rb->nr_pages = nr_pages >> order;
+	rb->page_order = order;
+
+	return 0;
+
+fail:
+	for (i--; i >= 0; i--)
+		perf_mmap_free_chunk(rb->data_pages[i], order);
+
+	return -ENOMEM;
+}
+
 struct perf_buffer *rb_alloc(int nr_pages, long watermark, int cpu, int flags)
 {
 	struct perf_buffer *rb;
 	unsigned long size;
-	int i, node;
+	int node, order = 0;
 
 	size = sizeof(struct perf_buffer);
 	size += nr_pages * sizeof(void *);
@@ -823,22 +960,25 @@ struct perf_buffer *rb_alloc(int nr_pages, long watermark, int cpu, int flags)
 	if (!rb->user_page)
 		goto fail_user_page;
 
-	for (i = 0; i < nr_pages; i++) {
-		rb->data_pages[i] = perf_mmap_alloc_page(cpu);
-		if (!rb->data_pages[i])
+	/*
+	 * High-order chunks reduce the page crossings of the writer and the
+	 * TLB footprint of the data area. Fall back to smaller orders, down
+	 * to order-0 pages, if memory is fragmented.
+	 */
+	if ((flags & RING_BUFFER_HIGH_ORDER) && nr_pages > 1)
+		order = min_t(int, ilog2(nr_pages),
+			      min_t(int, MAX_ORDER - 1, PMD_SHIFT - PAGE_SHIFT));
+
+	while (rb_alloc_data_pages(rb, nr_pages, cpu, order)) {
+		if (!order--)
 			goto fail_data_pages;
 	}
 
-	rb->nr_pages = nr_pages;
-
 	ring_buffer_init(rb, watermark, flags);
 
 	return rb;
 
 fail_data_pages:
-	for (i--; i >= 0; i--)
-		perf_mmap_free_page(rb->data_pages[i]);
-
 	perf_mmap_free_page(rb->user_page);
 
 fail_user_page:
@@ -852,17 +992,16 @@ void rb_free(struct perf_buffer *rb)
 {
 	int i;
 
+	irq_work_sync(&rb->wakeup_work);
+	hrtimer_cancel(&rb->wakeup_timer);
+
 	perf_mmap_free_page(rb->user_page);
 	for (i = 0; i < rb->nr_pages; i++)
-		perf_mmap_free_page(rb->data_pages[i]);
+		perf_mmap_free_chunk(rb->data_pages[i], page_order(rb));
 	kfree(rb);
 }
 
 #else
-static int data_page_nr(struct perf_buffer *rb)
-{
-	return rb->nr_pages << page_order(rb);
-}
 
 static struct page *
 __perf_mmap_to_page(struct perf_buffer *rb, unsigned long pgoff)
@@ -890,6 +1029,9 @@ static void rb_free_work(struct work_struct *work)
 	rb = container_of(work, struct perf_buffer, work);
 	nr = data_page_nr(rb);
 
+	irq_work_sync(&rb->wakeup_work);
+	hrtimer_cancel(&rb->wakeup_timer);
+
 	base = rb->user_page;
 	/* The '<=' counts in the user page. */
 	for (i = 0; i <= nr; i++)
@@ -7,7 +7,9 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/cpu.h>
+#include <linux/irq.h>
 #include <linux/sort.h>
+#include <linux/topology.h>
 
 static void irq_spread_init_one(struct cpumask *irqmsk, struct cpumask *nmsk,
 				unsigned int cpus_per_vec)
@@ -40,6 +42,156 @@ static void irq_spread_init_one(struct cpumask *irqmsk, struct cpumask *nmsk,
 	}
 }
 
+/*
+ * Topology and load information used by the topology aware spreading.
+ * Indirected so that the spreading can be tested on synthetic topologies.
+ */
+struct irq_spread_topology {
+	const struct cpumask	*(*sibling_mask)(unsigned int cpu);
+	const struct cpumask	*(*cluster_mask)(unsigned int cpu);
+	unsigned int		(*cpu_load)(unsigned int cpu);
+};
+
+static bool irq_affinity_topo_default __read_mostly;
+
+static int __init irq_affinity_topo_setup(char *str)
+{
+	irq_affinity_topo_default = true;
+	return 1;
+}
+__setup("irqaffinity_topology", irq_affinity_topo_setup);
+
+#ifdef CONFIG_GENERIC_IRQ_MATRIX_ALLOCATOR
+static struct irq_matrix *irq_spread_matrix __read_mostly;
+
+/**
+ * irq_affinity_set_load_matrix - Set the matrix providing the managed
+ *				  interrupt load for affinity spreading
+ * @m:		Matrix pointer
+ */
+void irq_affinity_set_load_matrix(struct irq_matrix *m)
+{
+	WRITE_ONCE(irq_spread_matrix, m);
+}
+
+static unsigned int irq_spread_cpu_load(unsigned int cpu)
+{
+	struct irq_matrix *m = READ_ONCE(irq_spread_matrix);
+
+	return m ? irq_matrix_managed_allocated(m, cpu) : 0;
+}
+#else
+static unsigned int irq_spread_cpu_load(unsigned int cpu)
+{
+	return 0;
+}
+#endif
+
+static const struct cpumask *irq_spread_sibling_mask(unsigned int cpu)
+{
+	return topology_sibling_cpumask(cpu);
+}
+
+static const struct cpumask *irq_spread_cluster_mask(unsigned int cpu)
+{
+	return topology_cluster_cpumask(cpu);
+}
+
+static const struct irq_spread_topology irq_spread_default_topology = {
+	.sibling_mask	= irq_spread_sibling_mask,
+	.cluster_mask	= irq_spread_cluster_mask,
+	.cpu_load	= irq_spread_cpu_load,
+};
+
+static unsigned int irq_spread_core_load(unsigned int cpu,
+					 const struct irq_spread_topology *topo)
+{
+	unsigned int sibl, load = 0;
+
+	for_each_cpu(sibl, topo->sibling_mask(cpu))
+		load += topo->cpu_load(sibl);
+
+	return load;
+}
+
+/*
+ * Pick the next CPU for a vector. Stay in the cluster the vector already
+ * uses as long as it has CPUs left, otherwise start in the cluster with
+ * the most CPUs left, so that consecutive vectors end up in different
+ * caches. Within the cluster, take the core which carries the fewest
+ * managed interrupts already. A cluster of a single core, as with the
+ * generic topology_cluster_cpumask() fallback or per core L2 caches, says
+ * nothing about shared caches, so then the least loaded core of the whole
+ * node is taken.
+ */
+static unsigned int irq_spread_pick_cpu(const struct cpumask *irqmsk,
+					const struct cpumask *nmsk,
+					const struct irq_spread_topology *topo)
+{
+	unsigned int cpu, best_cpu = nr_cpu_ids, best_load = UINT_MAX;
+	const struct cpumask *cluster = NULL;
+
+	cpu = cpumask_first(irqmsk);
+	if (cpu < nr_cpu_ids && cpumask_intersects(topo->cluster_mask(cpu), nmsk))
+		cluster = topo->cluster_mask(cpu);
+
+	if (!cluster) {
+		unsigned int left, most_left = 0, c, first = nr_cpu_ids;
+
+		for_each_cpu(cpu, nmsk) {
+			left = 0;
+			for_each_cpu_and(c, topo->cluster_mask(cpu), nmsk)
+				left++;
+			if (left > most_left) {
+				most_left = left;
+				cluster = topo->cluster_mask(cpu);
+				first = cpu;
+			}
+		}
+		if (!cluster)
+			return nr_cpu_ids;
+
+		if (cpumask_subset(cluster, topo->sibling_mask(first)))
+			cluster = nmsk;
+	}
+
+	for_each_cpu_and(cpu, cluster, nmsk) {
+		unsigned int load = irq_spread_core_load(cpu, topo);
+
+		if (load < best_load) {
+			best_load = load;
+			best_cpu = cpu;
+		}
+	}
+	return best_cpu;
+}
+
+static void irq_spread_init_one_topo(struct cpumask *irqmsk, struct cpumask *nmsk,
+				     unsigned int cpus_per_vec,
+				     const struct irq_spread_topology *topo)
+{
+	int cpu, sibl;
+
+	while (cpus_per_vec > 0) {
+		cpu = irq_spread_pick_cpu(irqmsk, nmsk, topo);
+		if (cpu >= nr_cpu_ids)
+			return;
+
+		cpumask_clear_cpu(cpu, nmsk);
+		cpumask_set_cpu(cpu, irqmsk);
+		cpus_per_vec--;
+
+		/* Keep the whole core in the vector */
+		for_each_cpu_and(sibl, topo->sibling_mask(cpu), nmsk) {
+			if (!cpus_per_vec)
+				break;
+			cpumask_clear_cpu(sibl, nmsk);
+			cpumask_set_cpu(sibl, irqmsk);
+			cpus_per_vec--;
+		}
+	}
+}
+
 static cpumask_var_t *alloc_node_to_cpumask(void)
 {
 	cpumask_var_t *masks;
@@ -250,7 +402,8 @@ static int __irq_build_affinity_masks(unsigned int startvec,
 				      cpumask_var_t *node_to_cpumask,
 				      const struct cpumask *cpu_mask,
 				      struct cpumask *nmsk,
-				      struct irq_affinity_desc *masks)
+				      struct irq_affinity_desc *masks,
+				      const struct irq_spread_topology *topo)
 {
 	unsigned int i, n, nodes, cpus_per_vec, extra_vecs, done = 0;
 	unsigned int last_affv = firstvec + numvecs;
@@ -321,8 +474,13 @@ static int __irq_build_affinity_masks(unsigned int startvec,
 			 */
 			if (curvec >= last_affv)
 				curvec = firstvec;
-			irq_spread_init_one(&masks[curvec].mask, nmsk,
-						cpus_per_vec);
+			if (topo)
+				irq_spread_init_one_topo(&masks[curvec].mask,
+							 nmsk, cpus_per_vec,
+							 topo);
+			else
+				irq_spread_init_one(&masks[curvec].mask, nmsk,
+						    cpus_per_vec);
 		}
 		done += nv->nvectors;
 	}
@@ -337,7 +495,8 @@ static int __irq_build_affinity_masks(unsigned int startvec,
  */
 static int irq_build_affinity_masks(unsigned int startvec, unsigned int numvecs,
 				    unsigned int firstvec,
-				    struct irq_affinity_desc *masks)
+				    struct irq_affinity_desc *masks,
+				    const struct irq_spread_topology *topo)
 {
 	unsigned int curvec = startvec, nr_present = 0, nr_others = 0;
 	cpumask_var_t *node_to_cpumask;
@@ -361,7 +520,7 @@ static int irq_build_affinity_masks(unsigned int startvec, unsigned int numvecs,
 	/* Spread on present CPUs starting from affd->pre_vectors */
 	ret = __irq_build_affinity_masks(curvec, numvecs, firstvec,
 					 node_to_cpumask, cpu_present_mask,
-					 nmsk, masks);
+					 nmsk, masks, topo);
 	if (ret < 0)
 		goto fail_build_affinity;
 	nr_present = ret;
@@ -379,7 +538,7 @@ static int irq_build_affinity_masks(unsigned int startvec, unsigned int numvecs,
 	cpumask_andnot(npresmsk, cpu_possible_mask, cpu_present_mask);
 	ret = __irq_build_affinity_masks(curvec, numvecs, firstvec,
 					 node_to_cpumask, npresmsk, nmsk,
-					 masks);
+					 masks, topo);
 	if (ret >= 0)
 		nr_others = ret;
 
@@ -415,6 +574,7 @@ static void default_calc_sets(struct irq_affinity *affd, unsigned int affvecs)
 struct irq_affinity_desc *
 irq_create_affinity_masks(unsigned int nvecs, struct irq_affinity *affd)
 {
+	const struct irq_spread_topology *topo = NULL;
 	unsigned int affvecs, curvec, usedvecs, i;
 	struct irq_affinity_desc *masks = NULL;
 
@@ -454,6 +614,9 @@ irq_create_affinity_masks(unsigned int nvecs, struct irq_affinity *affd)
 	for (curvec = 0; curvec < affd->pre_vectors; curvec++)
 		cpumask_copy(&masks[curvec].mask, irq_default_affinity);
 
+	if (affd->topology_aware || irq_affinity_topo_default)
+		topo = &irq_spread_default_topology;
+
 	/*
 	 * Spread on present CPUs starting from affd->pre_vectors. If we
 	 * have multiple sets, build each sets affinity mask separately.
@@ -463,7 +626,7 @@ irq_create_affinity_masks(unsigned int nvecs, struct irq_affinity *affd)
 		int ret;
 
 		ret = irq_build_affinity_masks(curvec, this_vecs,
-					       curvec, masks);
+					       curvec, masks, topo);
 		if (ret) {
 			kfree(masks);
 			return NULL;
@@ -512,3 +675,7 @@ unsigned int irq_calc_affinity_vectors(unsigned int minvec, unsigned int maxvec,
 
 	return resv + min(set_vecs, maxvec - resv);
 }
+
+#ifdef CONFIG_IRQ_AFFINITY_KUNIT_TEST
+#include "affinity_kunit.c"
+#endif
@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the topology aware managed interrupt spreading.
+ *
+ * The spreading is run on synthetic topologies built from the first CPU
+ * ids, so the tests are skipped on machines with too few possible CPUs.
+ */
+#include <kunit/test.h>
+
+#define TEST_NR_CPUS	16
+
+static struct cpumask *test_sibling;
+static struct cpumask *test_cluster;
+static unsigned int test_load[TEST_NR_CPUS];
+
+static const struct cpumask *test_sibling_mask(unsigned int cpu)
+{
+	return &test_sibling[cpu];
+}
+
+static const struct cpumask *test_cluster_mask(unsigned int cpu)
+{
+	return &test_cluster[cpu];
+}
+
+static unsigned int test_cpu_load(unsigned int cpu)
+{
+	return cpu < TEST_NR_CPUS ? test_load[cpu] : 0;
+}
+
+static const struct irq_spread_topology test_topology = {
+	.sibling_mask	= test_sibling_mask,
+	.cluster_mask	= test_cluster_mask,
+	.cpu_load	= test_cpu_load,
+};
+
+/* @smt threads per core, @cluster_cpus CPUs sharing a cluster */
+static int test_build_topology(struct kunit *test, unsigned int smt,
+			       unsigned int cluster_cpus)
+{
+	unsigned int cpu, i;
+
+	if (nr_cpu_ids < TEST_NR_CPUS)
+		return -ENODEV;
+
+	test_sibling = kunit_kcalloc(test, TEST_NR_CPUS, sizeof(*test_sibling),
+				     GFP_KERNEL);
+	test_cluster = kunit_kcalloc(test, TEST_NR_CPUS, sizeof(*test_cluster),
+				     GFP_KERNEL);
+	if (!test_sibling || !test_cluster)
+		return -ENOMEM;
+
+	for (cpu = 0; cpu < TEST_NR_CPUS; cpu++) {
+		for (i = 0; i < smt; i++)
+			cpumask_set_cpu(cpu / smt * smt + i, &test_sibling[cpu]);
+		for (i = 0; i < cluster_cpus; i++)
+			cpumask_set_cpu(cpu / cluster_cpus * cluster_cpus + i,
+					&test_cluster[cpu]);
+	}
+	memset(test_load, 0, sizeof(test_load));
+
+	return 0;
+}
+
+/* Same per node spreading as __irq_build_affinity_masks() */
+static struct cpumask *test_spread(struct kunit *test, unsigned int nvec)
+{
+	unsigned int v, cpus_per_vec, extra_vecs;
+	struct cpumask *masks, *nmsk;
+
+	masks = kunit_kcalloc(test, nvec, sizeof(*masks), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, masks);
+	nmsk = kunit_kzalloc(test, sizeof(*nmsk), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, nmsk);
+
+	for (v = 0; v < TEST_NR_CPUS; v++)
+		cpumask_set_cpu(v, nmsk);
+
+	extra_vecs = TEST_NR_CPUS - nvec * (TEST_NR_CPUS / nvec);
+	for (v = 0; v < nvec; v++) {
+		cpus_per_vec = TEST_NR_CPUS / nvec;
+		if (extra_vecs) {
+			cpus_per_vec++;
+			--extra_vecs;
+		}
+		irq_spread_init_one_topo(&masks[v], nmsk, cpus_per_vec,
+					 &test_topology);
+	}
+	KUNIT_EXPECT_TRUE(test, cpumask_empty(nmsk));
+
+	return masks;
+}
+
+static void test_show(struct kunit *test, struct cpumask *masks,
+		      unsigned int nvec)
+{
+	unsigned int v;
+
+	for (v = 0; v < nvec; v++)
+		kunit_info(test, "vector %u: %*pbl\n", v,
+			   cpumask_pr_args(&masks[v]));
+}
+
+/* Every CPU ends up in exactly one vector, for any number of vectors */
+static void irq_spread_test_coverage(struct kunit *test)
+{
+	unsigned int nvec, v, cpu;
+
+	if (test_build_topology(test, 2, 8))
+		kunit_skip(test, "needs %d possible CPUs\n", TEST_NR_CPUS);
+
+	for (nvec = 1; nvec <= TEST_NR_CPUS; nvec++) {
+		struct cpumask *masks = test_spread(test, nvec);
+
+		for (cpu = 0; cpu < TEST_NR_CPUS; cpu++) {
+			unsigned int found = 0;
+
+			for (v = 0; v < nvec; v++)
+				found += cpumask_test_cpu(cpu, &masks[v]);
+			KUNIT_EXPECT_EQ(test, found, 1);
+		}
+	}
+}
+
+/* 2 clusters of 4 SMT2 cores: vectors stay within and alternate clusters */
+static void irq_spread_test_clusters(struct kunit *test)
+{
+	struct cpumask *masks;
+	unsigned int v;
+
+	if (test_build_topology(test, 2, 8))
+		kunit_skip(test, "needs %d possible CPUs\n", TEST_NR_CPUS);
+
+	masks = test_spread(test, 4);
+	test_show(test, masks, 4);
+
+	for (v = 0; v < 4; v++) {
+		unsigned int cpu = cpumask_first(&masks[v]);
+
+		KUNIT_EXPECT_EQ(test, cpumask_weight(&masks[v]), 4);
+		KUNIT_EXPECT_TRUE(test, cpumask_subset(&masks[v],
+						       &test_cluster[cpu]));
+		if (v) {
+			unsigned int prev = cpumask_first(&masks[v - 1]);
+
+			KUNIT_EXPECT_FALSE(test,
+				cpumask_equal(&test_cluster[cpu],
+					      &test_cluster[prev]));
+		}
+	}
+}
+
+/* One vector per core: each vector gets both threads of a core */
+static void irq_spread_test_smt(struct kunit *test)
+{
+	struct cpumask *masks;
+	unsigned int v;
+
+	if (test_build_topology(test, 2, 8))
+		kunit_skip(test, "needs %d possible CPUs\n", TEST_NR_CPUS);
+
+	masks = test_spread(test, TEST_NR_CPUS / 2);
+	test_show(test, masks, TEST_NR_CPUS / 2);
+
+	for (v = 0; v < TEST_NR_CPUS / 2; v++) {
+		unsigned int cpu = cpumask_first(&masks[v]);
+
+		KUNIT_EXPECT_TRUE(test, cpumask_equal(&masks[v],
+						      &test_sibling[cpu]));
+	}
+}
+
+/* The first vectors avoid the cores loaded by another device */
+static void irq_spread_test_load(struct kunit *test)
+{
+	struct cpumask *masks;
+	unsigned int cpu;
+
+	if (test_build_topology(test, 2, 8))
+		kunit_skip(test, "needs %d possible CPUs\n", TEST_NR_CPUS);
+
+	/* A device already has managed interrupts on cores 0 and 1 */
+	for (cpu = 0; cpu < 4; cpu++)
+		test_load[cpu] = 1;
+
+	masks = test_spread(test, TEST_NR_CPUS / 2);
+	test_show(test, masks, TEST_NR_CPUS / 2);
+
+	/* Cluster 0 is picked first, but on its first unloaded core */
+	KUNIT_EXPECT_EQ(test, cpumask_first(&masks[0]), 4);
+	/* then cluster 1 */
+	KUNIT_EXPECT_EQ(test, cpumask_first(&masks[1]), 8);
+	/* the loaded cores of cluster 0 are used after the unloaded ones */
+	KUNIT_EXPECT_EQ(test, cpumask_first(&masks[2]), 6);
+	KUNIT_EXPECT_EQ(test, cpumask_first(&masks[4]), 0);
+	KUNIT_EXPECT_EQ(test, cpumask_first(&masks[6]), 2);
+}
+
+/* Clusters of a single core: the load is weighed across the node */
+static void irq_spread_test_core_cluster(struct kunit *test)
+{
+	static const unsigned int first[] = { 4, 6, 8, 12, 14, 0, 2, 10 };
+	struct cpumask *masks;
+	unsigned int cpu, v;
+
+	if (test_build_topology(test, 2, 2))
+		kunit_skip(test, "needs %d possible CPUs\n", TEST_NR_CPUS);
+
+	/* A device already has managed interrupts on cores 0, 1 and 5 */
+	for (cpu = 0; cpu < 4; cpu++)
+		test_load[cpu] = 1;
+	test_load[10] = test_load[11] = 1;
+
+	masks = test_spread(test, TEST_NR_CPUS / 2);
+	test_show(test, masks, TEST_NR_CPUS / 2);
+
+	/* All the unloaded cores in order, then the loaded ones */
+	for (v = 0; v < TEST_NR_CPUS / 2; v++) {
+		cpu = cpumask_first(&masks[v]);
+		KUNIT_EXPECT_EQ(test, cpu, first[v]);
+		KUNIT_EXPECT_TRUE(test, cpumask_equal(&masks[v],
+						      &test_sibling[cpu]));
+	}
+}
+
+static struct kunit_case irq_spread_test_cases[] = {
+	KUNIT_CASE(irq_spread_test_coverage),
+	KUNIT_CASE(irq_spread_test_clusters),
+	KUNIT_CASE(irq_spread_test_smt),
+	KUNIT_CASE(irq_spread_test_load),
+	KUNIT_CASE(irq_spread_test_core_cluster),
+	{}
+};
+
+static struct kunit_suite irq_spread_test_suite = {
+	.name = "irq_affinity_spread",
+	.test_cases = irq_spread_test_cases,
+};
+
+kunit_test_suite(irq_spread_test_suite);
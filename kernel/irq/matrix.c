@@ -7,6 +7,7 @@
 #include <linux/percpu.h>
 #include <linux/cpu.h>
 #include <linux/irq.h>
+#include <linux/topology.h>
 
 #define IRQ_MATRIX_SIZE	(BITS_TO_LONGS(IRQ_MATRIX_BITS))
 
@@ -146,23 +147,47 @@ static unsigned int matrix_find_best_cpu(struct irq_matrix *m,
 	return best_cpu;
 }
 
-/* Find the best CPU which has the lowest number of managed IRQs allocated */
+/* Managed IRQs allocated on the SMT siblings of a CPU */
+static unsigned int matrix_sibling_managed(struct irq_matrix *m,
+					   unsigned int cpu)
+{
+	unsigned int sibl, allocated = 0;
+
+	for_each_cpu(sibl, topology_sibling_cpumask(cpu)) {
+		if (sibl != cpu)
+			allocated += per_cpu_ptr(m->maps, sibl)->managed_allocated;
+	}
+	return allocated;
+}
+
+/*
+ * Find the best CPU which has the lowest number of managed IRQs allocated.
+ * On a tie prefer the CPU whose SMT siblings have the fewest, so that the
+ * managed interrupts of different devices don't pile up on one core.
+ */
 static unsigned int matrix_find_best_cpu_managed(struct irq_matrix *m,
 						const struct cpumask *msk)
 {
-	unsigned int cpu, best_cpu, allocated = UINT_MAX;
+	unsigned int cpu, best_cpu, allocated = UINT_MAX, sibl_allocated = UINT_MAX;
 	struct cpumap *cm;
 
 	best_cpu = UINT_MAX;
 
 	for_each_cpu(cpu, msk) {
+		unsigned int sibl;
+
 		cm = per_cpu_ptr(m->maps, cpu);
 
 		if (!cm->online || cm->managed_allocated > allocated)
 			continue;
 
+		sibl = matrix_sibling_managed(m, cpu);
+		if (cm->managed_allocated == allocated && sibl > sibl_allocated)
+			continue;
+
 		best_cpu = cpu;
 		allocated = cm->managed_allocated;
+		sibl_allocated = sibl;
 	}
 	return best_cpu;
 }
@@ -465,6 +490,16 @@ unsigned int irq_matrix_reserved(struct irq_matrix *m)
 	return m->global_reserved;
 }
 
+/**
+ * irq_matrix_managed_allocated - Get the number of allocated managed irqs
+ * @m:		Pointer to the matrix to query
+ * @cpu:	The CPU to query
+ */
+unsigned int irq_matrix_managed_allocated(struct irq_matrix *m, unsigned int cpu)
+{
+	return per_cpu_ptr(m->maps, cpu)->managed_allocated;
+}
+
 /**
  * irq_matrix_allocated - Get the number of allocated irqs on the local cpu
  * @m:		Pointer to the matrix to search
@@ -23,15 +23,21 @@ DEFINE_PER_CPU(struct irq_timings, irq_timings);
 
 static DEFINE_IDR(irqt_stats);
 
+/*
+ * The timings may be wanted by several users, the idle governor and
+ * drivers asking for hints, so the enablement is reference counted.
+ */
 void irq_timings_enable(void)
 {
-	static_branch_enable(&irq_timing_enabled);
+	static_branch_inc(&irq_timing_enabled);
 }
+EXPORT_SYMBOL_GPL(irq_timings_enable);
 
 void irq_timings_disable(void)
 {
-	static_branch_disable(&irq_timing_enabled);
+	static_branch_dec(&irq_timing_enabled);
 }
+EXPORT_SYMBOL_GPL(irq_timings_disable);
 
 /*
  * The main goal of this algorithm is to predict the next interrupt
@@ -379,14 +385,15 @@ static int irq_timings_next_event_index(int *buffer, size_t len, int period_max)
 	return -1;
 }
 
-static u64 __irq_timings_next_event(struct irqt_stat *irqs, int irq, u64 now)
+/*
+ * Returns the index in the ema table of the predicted next interval, or
+ * -1 if there are not enough values. If @confidence is not NULL, it is
+ * set to 100 when a repeating pattern was found, otherwise to the
+ * percentage of recent intervals which fell into the returned slot.
+ */
+static int __irq_timings_next_index(struct irqt_stat *irqs, int *confidence)
 {
-	int index, i, period_max, count, start, min = INT_MAX;
-
-	if ((now - irqs->last_ts) >= NSEC_PER_SEC) {
-		irqs->count = irqs->last_ts = 0;
-		return U64_MAX;
-	}
+	int index, i, period_max, count, start, hits, min = INT_MAX;
 
 	/*
 	 * As we want to find three times the repetition, we need a
@@ -401,7 +408,7 @@ static u64 __irq_timings_next_event(struct irqt_stat *irqs, int irq, u64 now)
 	 * just bail out.
 	 */
 	if (period_max <= PREDICTION_PERIOD_MIN)
-		return U64_MAX;
+		return -1;
 
 	/*
 	 * 'count' will depends if the circular buffer wrapped or not
@@ -426,12 +433,56 @@ static u64 __irq_timings_next_event(struct irqt_stat *irqs, int irq, u64 now)
 	}
 
 	index = irq_timings_next_event_index(irqs->timings, count, period_max);
+	if (index >= 0) {
+		if (confidence)
+			*confidence = 100;
+		return index;
+	}
+
+	if (confidence) {
+		for (i = 0, hits = 0; i < count; i++)
+			hits += irqs->timings[i] == min;
+		*confidence = hits * 100 / count;
+	}
+
+	return min;
+}
+
+static u64 __irq_timings_next_event(struct irqt_stat *irqs, int irq, u64 now)
+{
+	int index;
+
+	if ((now - irqs->last_ts) >= NSEC_PER_SEC) {
+		irqs->count = irqs->last_ts = 0;
+		return U64_MAX;
+	}
+
+	index = __irq_timings_next_index(irqs, NULL);
 	if (index < 0)
-		return irqs->last_ts + irqs->ema_time[min];
+		return U64_MAX;
 
 	return irqs->last_ts + irqs->ema_time[index];
 }
 
+static int __irq_timings_hint(struct irqt_stat *irqs, u64 now,
+			      struct irq_timings_hint *hint)
+{
+	int index, confidence;
+
+	if (!irqs->last_ts || (now - irqs->last_ts) >= NSEC_PER_SEC)
+		return -ENODATA;
+
+	index = __irq_timings_next_index(irqs, &confidence);
+	if (index < 0)
+		return -ENODATA;
+
+	hint->interval = irqs->ema_time[index];
+	hint->next_event = irqs->last_ts + hint->interval;
+	hint->confidence = confidence;
+
+	return 0;
+}
+
 static __always_inline int irq_timings_interval_index(u64 interval)
 {
 	/*
@@ -507,6 +558,36 @@ static inline void irq_timings_store(int irq, struct irqt_stat *irqs, u64 ts)
 	__irq_timings_store(irq, irqs, interval);
 }
 
+/*
+ * Inject the measured irq/timestamp values of the current CPU into the
+ * pattern prediction model. The values are consumed, so the circular
+ * buffer is empty afterwards. Must be called with the local irq
+ * disabled.
+ */
+static void irq_timings_drain(struct irq_timings *irqts)
+{
+	struct irqt_stat __percpu *s;
+	int i, irq;
+	u64 ts;
+
+	/*
+	 * Number of elements in the circular buffer: If it happens it
+	 * was flushed before, then the number of elements could be
+	 * smaller than IRQ_TIMINGS_SIZE, so the count is used,
+	 * otherwise the array size is used as we wrapped. The index
+	 * begins from zero when we did not wrap. That could be done
+	 * in a nicer way with the proper circular array structure
+	 * type but with the cost of extra computation in the
+	 * interrupt handler hot path. We choose efficiency.
+	 */
+	for_each_irqts(i, irqts) {
+		irq = irq_timing_decode(irqts->values[i], &ts);
+		s = idr_find(&irqt_stats, irq);
+		if (s)
+			irq_timings_store(irq, this_cpu_ptr(s), ts);
+	}
+}
+
 /**
  * irq_timings_next_event - Return when the next event is supposed to arrive
  *
@@ -539,7 +620,7 @@ u64 irq_timings_next_event(u64 now)
 	struct irqt_stat *irqs;
 	struct irqt_stat __percpu *s;
 	u64 ts, next_evt = U64_MAX;
-	int i, irq = 0;
+	int i;
 
 	/*
 	 * This function must be called with the local irq disabled in
@@ -551,26 +632,7 @@ u64 irq_timings_next_event(u64 now)
 	if (!irqts->count)
 		return next_evt;
 
-	/*
-	 * Number of elements in the circular buffer: If it happens it
-	 * was flushed before, then the number of elements could be
-	 * smaller than IRQ_TIMINGS_SIZE, so the count is used,
-	 * otherwise the array size is used as we wrapped. The index
-	 * begins from zero when we did not wrap. That could be done
-	 * in a nicer way with the proper circular array structure
-	 * type but with the cost of extra computation in the
-	 * interrupt handler hot path. We choose efficiency.
-	 *
-	 * Inject measured irq/timestamp to the pattern prediction
-	 * model while decrementing the counter because we consume the
-	 * data from our circular buffer.
-	 */
-	for_each_irqts(i, irqts) {
-		irq = irq_timing_decode(irqts->values[i], &ts);
-		s = idr_find(&irqt_stats, irq);
-		if (s)
-			irq_timings_store(irq, this_cpu_ptr(s), ts);
-	}
+	irq_timings_drain(irqts);
 
 	/*
 	 * Look in the list of interrupts' statistics, the earliest
@@ -591,6 +653,50 @@ u64 irq_timings_next_event(u64 now)
 	return next_evt;
 }
 
+/**
+ * irq_timings_get_hint - Return the arrival prediction for an interrupt
+ * @irq: the interrupt number
+ * @hint: the prediction to fill in
+ *
+ * Allows drivers to use the interrupt timings prediction, for instance
+ * to switch between interrupt and polling mode or to tune their
+ * interrupt coalescing timers. The timings must have been enabled with
+ * irq_timings_enable().
+ *
+ * The statistics are per CPU, so the prediction is the one for the
+ * current CPU. It is meaningful when called on the CPU the interrupt
+ * is affine to, typically from the interrupt handler or the NAPI poll
+ * function.
+ *
+ * Returns 0 on success, -EOPNOTSUPP if the timings are disabled, -EINVAL
+ * if @irq has no timings statistics or -ENODATA if there is not enough
+ * recent activity to predict anything.
+ */
+int irq_timings_get_hint(unsigned int irq, struct irq_timings_hint *hint)
+{
+	struct irqt_stat __percpu *s;
+	unsigned long flags;
+	int ret;
+
+	if (!static_branch_likely(&irq_timing_enabled))
+		return -EOPNOTSUPP;
+
+	local_irq_save(flags);
+
+	irq_timings_drain(this_cpu_ptr(&irq_timings));
+
+	s = idr_find(&irqt_stats, irq);
+	if (s)
+		ret = __irq_timings_hint(this_cpu_ptr(s), local_clock(), hint);
+	else
+		ret = -EINVAL;
+
+	local_irq_restore(flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(irq_timings_get_hint);
+
 void irq_timings_free(int irq)
 {
 	struct irqt_stat __percpu *s;
@@ -701,6 +807,16 @@ static u64 intervals4[] __initdata = {
 	10000,
 };
 
+/*
+ * Irregular intervals, no repeating pattern
+ */
+static u64 intervals_noise[] __initdata = {
+	141000, 192000, 275000, 92000, 143000,
+	358000, 207000, 80000, 396000, 358000,
+	138000, 121000, 354000, 380000, 179000,
+	117000, 21000, 193000, 299000, 44000,
+};
+
 static struct timings_intervals tis[] __initdata = {
 	{ intervals0, ARRAY_SIZE(intervals0) },
 	{ intervals1, ARRAY_SIZE(intervals1) },
@@ -833,6 +949,95 @@ static int __init irq_timings_irqs_selftest(void)
 	return ret;
 }
 
+/*
+ * Simulate a workload by injecting all the intervals except the last
+ * one, then check the hint given to the drivers predicts the last
+ * interval and reflects whether the suite is periodic.
+ */
+static int __init irq_timings_test_hint(struct timings_intervals *ti,
+					bool periodic)
+{
+	struct irq_timings_hint hint;
+	struct irqt_stat __percpu *s;
+	struct irqt_stat *irqs;
+	int i, index, ret, irq = 0xACE5;
+	u64 ts = 1;
+
+	ret = irq_timings_alloc(irq);
+	if (ret) {
+		pr_err("Failed to allocate irq timings\n");
+		return ret;
+	}
+
+	s = idr_find(&irqt_stats, irq);
+	if (!s) {
+		ret = -EIDRM;
+		goto out;
+	}
+
+	irqs = this_cpu_ptr(s);
+
+	for (i = 0; i < ti->count - 1; i++) {
+		ts += ti->intervals[i];
+		__irq_timings_store(irq, irqs, ti->intervals[i]);
+	}
+	irqs->last_ts = ts;
+
+	ret = __irq_timings_hint(irqs, ts, &hint);
+	if (ret) {
+		pr_err("No hint for the simulated workload\n");
+		goto out;
+	}
+
+	pr_debug("hint: interval=%llu next_event=%llu confidence=%u\n",
+		 hint.interval, hint.next_event, hint.confidence);
+
+	if (periodic != (hint.confidence == 100)) {
+		pr_err("Wrong confidence (%u) for a %speriodic suite\n",
+		       hint.confidence, periodic ? "" : "non ");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (hint.next_event != ts + hint.interval) {
+		pr_err("Next event and interval are inconsistent\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	index = irq_timings_interval_index(ti->intervals[ti->count - 1]);
+	if (periodic && irq_timings_interval_index(hint.interval) != index) {
+		pr_err("Expected (%d) and predicted (%d) indexes differ\n",
+		       index, irq_timings_interval_index(hint.interval));
+		ret = -EINVAL;
+	}
+out:
+	irq_timings_free(irq);
+
+	return ret;
+}
+
+static int __init irq_timings_hint_selftest(void)
+{
+	struct timings_intervals noise = {
+		intervals_noise, ARRAY_SIZE(intervals_noise)
+	};
+	int i, ret;
+
+	for (i = 0; i < ARRAY_SIZE(tis); i++) {
+		pr_info("---> Injecting intervals number #%d (count=%zd)\n",
+			i, tis[i].count);
+		ret = irq_timings_test_hint(&tis[i], true);
+		if (ret)
+			return ret;
+	}
+
+	pr_info("---> Injecting irregular intervals (count=%zd)\n",
+		noise.count);
+
+	return irq_timings_test_hint(&noise, false);
+}
+
 static int __init irq_timings_test_irqts(struct irq_timings *irqts,
 					 unsigned count)
 {
@@ -948,6 +1153,10 @@ static int __init irq_timings_selftest(void)
 		goto out;
 
 	ret = irq_timings_next_index_selftest();
+	if (ret)
+		goto out;
+
+	ret = irq_timings_hint_selftest();
 out:
 	pr_info("---------- selftest end with %s -----------\n",
 		ret ? "failure" : "success");
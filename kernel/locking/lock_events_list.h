@@ -67,3 +67,14 @@ LOCK_EVENT(rwsem_rlock_handoff)	/* # of read lock handoffs		*/
 LOCK_EVENT(rwsem_wlock)		/* # of write locks acquired		*/
 LOCK_EVENT(rwsem_wlock_fail)	/* # of failed write lock acquisitions	*/
 LOCK_EVENT(rwsem_wlock_handoff)	/* # of write lock handoffs		*/
+
+/*
+ * Locking events for percpu_rw_semaphore
+ */
+LOCK_EVENT(percpu_rwsem_rlock_slowpath)	/* # of read locks via the slowpath	*/
+LOCK_EVENT(percpu_rwsem_rlock_sleep)	/* # of reader sleeps			*/
+LOCK_EVENT(percpu_rwsem_wlock)		/* # of write locks acquired		*/
+LOCK_EVENT(percpu_rwsem_wlock_holdoff)	/* # of write locks w/o grace period	*/
+LOCK_EVENT(percpu_rwsem_wlock_sleep)	/* # of writer sleeps behind a writer	*/
+LOCK_EVENT(percpu_rwsem_wlock_spin)	/* # of readers drained while spinning	*/
+LOCK_EVENT(percpu_rwsem_wlock_wait_us)	/* Total writer wait time (us)		*/
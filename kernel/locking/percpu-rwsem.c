@@ -8,7 +8,30 @@
 #include <linux/sched.h>
 #include <linux/sched/task.h>
 #include <linux/sched/debug.h>
+#include <linux/sched/clock.h>
 #include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "lock_events.h"
+
+/*
+ * Keeps the readers in the slow path for a while after the last writer
+ * went away, so that a writer arriving in that window does not have to
+ * wait for a grace period in rcu_sync_enter().
+ */
+struct percpu_rwsem_holdoff {
+	struct percpu_rw_semaphore	*sem;
+	struct delayed_work		work;
+	unsigned long			delay;
+	unsigned long			held;	/* owns a rcu_sync reference */
+};
+
+/*
+ * Upper bound of the time a writer spins waiting for the active readers
+ * to leave before going to sleep.
+ */
+#define PERCPU_RWSEM_WRITER_SPIN_NS	(20 * NSEC_PER_USEC)
 
 int __percpu_init_rwsem(struct percpu_rw_semaphore *sem,
 			const char *name, struct lock_class_key *key)
@@ -21,6 +44,7 @@ int __percpu_init_rwsem(struct percpu_rw_semaphore *sem,
 	rcuwait_init(&sem->writer);
 	init_waitqueue_head(&sem->waiters);
 	atomic_set(&sem->block, 0);
+	sem->holdoff = NULL;
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	debug_check_no_locks_freed((void *)sem, sizeof(*sem));
 	lockdep_init_map(&sem->dep_map, name, key, 0);
@@ -38,12 +62,64 @@ void percpu_free_rwsem(struct percpu_rw_semaphore *sem)
 	if (!sem->read_count)
 		return;
 
+	if (sem->holdoff) {
+		cancel_delayed_work_sync(&sem->holdoff->work);
+		if (test_and_clear_bit(0, &sem->holdoff->held))
+			rcu_sync_exit(&sem->rss);
+		kfree(sem->holdoff);
+		sem->holdoff = NULL;
+	}
+
 	rcu_sync_dtor(&sem->rss);
 	free_percpu(sem->read_count);
 	sem->read_count = NULL; /* catch use after free bugs */
 }
 EXPORT_SYMBOL_GPL(percpu_free_rwsem);
 
+static void percpu_rwsem_holdoff_fn(struct work_struct *work)
+{
+	struct percpu_rwsem_holdoff *holdoff =
+		container_of(to_delayed_work(work), struct percpu_rwsem_holdoff, work);
+
+	if (test_and_clear_bit(0, &holdoff->held))
+		rcu_sync_exit(&holdoff->sem->rss);
+}
+
+/**
+ * percpu_rwsem_set_holdoff - keep readers in the slow path after a writer
+ * @sem: the percpu_rw_semaphore
+ * @delay: time in jiffies the readers stay in the slow path
+ *
+ * A writer normally waits for a grace period before it can block the
+ * readers, unless the previous writer left less than a grace period ago.
+ * With a holdoff, the readers are only switched back to their fast path
+ * once no writer took @sem for @delay jiffies, so that back to back
+ * writers do not each pay for a synchronize_rcu(), at the cost of a
+ * slower read side in the meantime.
+ *
+ * Must be called before @sem is write locked for the first time.
+ */
+int percpu_rwsem_set_holdoff(struct percpu_rw_semaphore *sem,
+			     unsigned long delay)
+{
+	struct percpu_rwsem_holdoff *holdoff;
+
+	if (WARN_ON_ONCE(sem->holdoff))
+		return -EBUSY;
+
+	holdoff = kzalloc(sizeof(*holdoff), GFP_KERNEL);
+	if (!holdoff)
+		return -ENOMEM;
+
+	holdoff->sem = sem;
+	holdoff->delay = delay;
+	INIT_DELAYED_WORK(&holdoff->work, percpu_rwsem_holdoff_fn);
+	sem->holdoff = holdoff;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(percpu_rwsem_set_holdoff);
+
 static bool __percpu_down_read_trylock(struct percpu_rw_semaphore *sem)
 {
 	this_cpu_inc(*sem->read_count);
@@ -149,6 +225,8 @@ static void percpu_rwsem_wait(struct percpu_rw_semaphore *sem, bool reader)
 	 */
 	wait = !__percpu_rwsem_trylock(sem, reader);
 	if (wait) {
+		lockevent_cond_inc(percpu_rwsem_rlock_sleep, reader);
+		lockevent_cond_inc(percpu_rwsem_wlock_sleep, !reader);
 		wq_entry.flags |= WQ_FLAG_EXCLUSIVE | reader * WQ_FLAG_CUSTOM;
 		__add_wait_queue_entry_tail(&sem->waiters, &wq_entry);
 	}
@@ -165,6 +243,8 @@ static void percpu_rwsem_wait(struct percpu_rw_semaphore *sem, bool reader)
 
 bool __sched __percpu_down_read(struct percpu_rw_semaphore *sem, bool try)
 {
+	lockevent_inc(percpu_rwsem_rlock_slowpath);
+
 	if (__percpu_down_read_trylock(sem))
 		return true;
 
@@ -212,12 +292,49 @@ static bool readers_active_check(struct percpu_rw_semaphore *sem)
 	return true;
 }
 
+/*
+ * Spin for a short while waiting for the active readers to leave, they
+ * are usually about to, rather than sleeping right away.
+ */
+static bool percpu_rwsem_spin_on_readers(struct percpu_rw_semaphore *sem)
+{
+	u64 threshold;
+	int loop = 0;
+	bool ret;
+
+	preempt_disable();
+	threshold = sched_clock() + PERCPU_RWSEM_WRITER_SPIN_NS;
+	for (;;) {
+		ret = readers_active_check(sem);
+		if (ret || need_resched())
+			break;
+		/* don't call sched_clock() too frequently */
+		if (!(++loop & 0xf) && sched_clock() > threshold)
+			break;
+		cpu_relax();
+	}
+	preempt_enable();
+
+	return ret;
+}
+
 void __sched percpu_down_write(struct percpu_rw_semaphore *sem)
 {
+	u64 start = 0;
+
 	might_sleep();
 	rwsem_acquire(&sem->dep_map, 0, 0, _RET_IP_);
 
-	/* Notify readers to take the slow path. */
+	if (IS_ENABLED(CONFIG_LOCK_EVENT_COUNTS))
+		start = sched_clock();
+
+	lockevent_cond_inc(percpu_rwsem_wlock_holdoff,
+			   sem->holdoff && test_bit(0, &sem->holdoff->held));
+
+	/*
+	 * Notify readers to take the slow path. This doesn't wait for a grace
+	 * period if the readers are still there after a previous writer.
+	 */
 	rcu_sync_enter(&sem->rss);
 
 	/*
@@ -236,7 +353,15 @@ void __sched percpu_down_write(struct percpu_rw_semaphore *sem)
 	 */
 
 	/* Wait for all active readers to complete. */
-	rcuwait_wait_event(&sem->writer, readers_active_check(sem), TASK_UNINTERRUPTIBLE);
+	if (percpu_rwsem_spin_on_readers(sem))
+		lockevent_inc(percpu_rwsem_wlock_spin);
+	else
+		rcuwait_wait_event(&sem->writer, readers_active_check(sem), TASK_UNINTERRUPTIBLE);
+
+	lockevent_inc(percpu_rwsem_wlock);
+	if (IS_ENABLED(CONFIG_LOCK_EVENT_COUNTS))
+		lockevent_add(percpu_rwsem_wlock_wait_us,
+			      div_u64(sched_clock() - start, NSEC_PER_USEC));
 }
 EXPORT_SYMBOL_GPL(percpu_down_write);
 
@@ -261,6 +386,20 @@ void percpu_up_write(struct percpu_rw_semaphore *sem)
 	 */
 	__wake_up(&sem->waiters, TASK_NORMAL, 1, sem);
 
+	/*
+	 * With a holdoff, our rcu_sync reference is handed over to the
+	 * holdoff work unless it already holds one, and the readers stay in
+	 * the slow path until it runs.
+	 */
+	if (sem->holdoff) {
+		struct percpu_rwsem_holdoff *holdoff = sem->holdoff;
+
+		if (test_and_set_bit(0, &holdoff->held))
+			rcu_sync_exit(&sem->rss);
+		mod_delayed_work(system_wq, &holdoff->work, holdoff->delay);
+		return;
+	}
+
 	/*
 	 * Once this completes (at least one RCU-sched grace period hence) the
 	 * reader fast path will be available again. Safe to use outside the
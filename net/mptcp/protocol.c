@@ -490,16 +490,6 @@ static long mptcp_timeout_from_subflow(const struct mptcp_subflow_context *subfl
 	       inet_csk(ssk)->icsk_timeout - jiffies : 0;
 }
 
-static void mptcp_set_timeout(struct sock *sk)
-{
-	struct mptcp_subflow_context *subflow;
-	long tout = 0;
-
-	mptcp_for_each_subflow(mptcp_sk(sk), subflow)
-		tout = max(tout, mptcp_timeout_from_subflow(subflow));
-	__mptcp_set_timeout(sk, tout);
-}
-
 static bool tcp_can_send_ack(const struct sock *ssk)
 {
 	return !((1 << inet_sk_state_load(ssk)) &
@@ -1365,17 +1355,6 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 	return copy;
 }
 
-#define MPTCP_SEND_BURST_SIZE		((1 << 16) - \
-					 sizeof(struct tcphdr) - \
-					 MAX_TCP_OPTION_SPACE - \
-					 sizeof(struct ipv6hdr) - \
-					 sizeof(struct frag_hdr))
-
-struct subflow_send_info {
-	struct sock *ssk;
-	u64 linger_time;
-};
-
 void mptcp_subflow_set_active(struct mptcp_subflow_context *subflow)
 {
 	if (!subflow->stale)
@@ -1398,24 +1377,19 @@ bool mptcp_subflow_active(struct mptcp_subflow_context *subflow)
 	return __mptcp_subflow_active(subflow);
 }
 
-#define SSK_MODE_ACTIVE	0
-#define SSK_MODE_BACKUP	1
-#define SSK_MODE_MAX	2
-
 /* implement the mptcp packet scheduler;
- * returns the subflow that will transmit the next DSS
+ * returns the subflow that will transmit the next DSS, as picked by
+ * the msk scheduler among the active subflows
  * additionally updates the rtx timeout
  */
 static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 {
-	struct subflow_send_info send_info[SSK_MODE_MAX];
 	struct mptcp_subflow_context *subflow;
 	struct sock *sk = (struct sock *)msk;
-	u32 pace, burst, wmem;
-	int i, nr_active = 0;
+	struct mptcp_sched_data data;
 	struct sock *ssk;
-	u64 linger_time;
 	long tout = 0;
+	int idx;
 
 	sock_owned_by_me(sk);
 
@@ -1425,75 +1399,115 @@ static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 		return sk_stream_memory_free(msk->first) ? msk->first : NULL;
 	}
 
-	/* re-use last subflow, if the burst allow that */
-	if (msk->last_snd && msk->snd_burst > 0 &&
-	    sk_stream_memory_free(msk->last_snd) &&
-	    mptcp_subflow_active(mptcp_subflow_ctx(msk->last_snd))) {
-		mptcp_set_timeout(sk);
-		return msk->last_snd;
-	}
-
-	/* pick the subflow with the lower wmem/wspace ratio */
-	for (i = 0; i < SSK_MODE_MAX; ++i) {
-		send_info[i].ssk = NULL;
-		send_info[i].linger_time = -1;
-	}
-
+	data.subflows = 0;
 	mptcp_for_each_subflow(msk, subflow) {
 		trace_mptcp_subflow_get_send(subflow);
-		ssk =  mptcp_subflow_tcp_sock(subflow);
 		if (!mptcp_subflow_active(subflow))
 			continue;
 
 		tout = max(tout, mptcp_timeout_from_subflow(subflow));
-		nr_active += !subflow->backup;
-		pace = subflow->avg_pacing_rate;
-		if (unlikely(!pace)) {
-			/* init pacing rate from socket */
-			subflow->avg_pacing_rate = READ_ONCE(ssk->sk_pacing_rate);
-			pace = subflow->avg_pacing_rate;
-			if (!pace)
-				continue;
-		}
-
-		linger_time = div_u64((u64)READ_ONCE(ssk->sk_wmem_queued) << 32, pace);
-		if (linger_time < send_info[subflow->backup].linger_time) {
-			send_info[subflow->backup].ssk = ssk;
-			send_info[subflow->backup].linger_time = linger_time;
-		}
+		if (data.subflows < MPTCP_SUBFLOWS_MAX)
+			data.contexts[data.subflows++] = subflow;
 	}
 	__mptcp_set_timeout(sk, tout);
 
-	/* pick the best backup if no other subflow is active */
-	if (!nr_active)
-		send_info[SSK_MODE_ACTIVE].ssk = send_info[SSK_MODE_BACKUP].ssk;
-
-	/* According to the blest algorithm, to avoid HoL blocking for the
-	 * faster flow, we need to:
-	 * - estimate the faster flow linger time
-	 * - use the above to estimate the amount of byte transferred
-	 *   by the faster flow
-	 * - check that the amount of queued data is greter than the above,
-	 *   otherwise do not use the picked, slower, subflow
-	 * We select the subflow with the shorter estimated time to flush
-	 * the queued mem, which basically ensure the above. We just need
-	 * to check that subflow has a non empty cwin.
-	 */
-	ssk = send_info[SSK_MODE_ACTIVE].ssk;
-	if (!ssk || !sk_stream_memory_free(ssk) || !tcp_sk(ssk)->snd_wnd)
+	if (!data.subflows)
+		return NULL;
+
+	idx = msk->sched->get_subflow(msk, &data);
+	if (idx < 0 || idx >= data.subflows)
+		return NULL;
+
+	ssk = mptcp_subflow_tcp_sock(data.contexts[idx]);
+	if (!sk_stream_memory_free(ssk) || !tcp_sk(ssk)->snd_wnd)
 		return NULL;
 
-	burst = min_t(int, MPTCP_SEND_BURST_SIZE, tcp_sk(ssk)->snd_wnd);
-	wmem = READ_ONCE(ssk->sk_wmem_queued);
-	subflow = mptcp_subflow_ctx(ssk);
-	subflow->avg_pacing_rate = div_u64((u64)subflow->avg_pacing_rate * wmem +
-					   READ_ONCE(ssk->sk_pacing_rate) * burst,
-					   burst + wmem);
 	msk->last_snd = ssk;
-	msk->snd_burst = burst;
 	return ssk;
 }
 
+static bool mptcp_sched_redundant(const struct mptcp_sock *msk)
+{
+	return msk->sched->flags & MPTCP_SCHED_FLAG_REDUNDANT;
+}
+
+/* With a redundant scheduler, replicate on @ssk the data already sent
+ * on other subflows and not yet acked at the MPTCP level.
+ * subflow->redundant_seq tracks how far @ssk got; it only moves forward
+ * on contiguous transmissions, so any gap is filled here.
+ */
+static int __mptcp_redundant_xmit(struct sock *sk, struct sock *ssk,
+				  struct mptcp_sendmsg_info *info)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_data_frag *dfrag;
+	int ret, copied = 0;
+
+	if (__mptcp_check_fallback(msk) || !mptcp_subflow_active(subflow))
+		return 0;
+
+	if (before64(subflow->redundant_seq, msk->snd_una))
+		subflow->redundant_seq = msk->snd_una;
+
+	list_for_each_entry(dfrag, &msk->rtx_queue, list) {
+		if (!dfrag->already_sent)
+			break;
+		if (!after64(dfrag->data_seq + dfrag->already_sent,
+			     subflow->redundant_seq))
+			continue;
+
+		info->sent = 0;
+		if (after64(subflow->redundant_seq, dfrag->data_seq))
+			info->sent = subflow->redundant_seq - dfrag->data_seq;
+		info->limit = dfrag->already_sent;
+		while (info->sent < info->limit) {
+			ret = mptcp_sendmsg_frag(sk, ssk, dfrag, info);
+			if (ret <= 0)
+				return copied;
+
+			info->sent += ret;
+			copied += ret;
+			subflow->redundant_seq = dfrag->data_seq + info->sent;
+		}
+	}
+
+	return copied;
+}
+
+static void mptcp_update_redundant_seq(struct sock *ssk, u64 data_seq,
+				       int sent)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+
+	if (!before64(subflow->redundant_seq, data_seq))
+		subflow->redundant_seq = max(subflow->redundant_seq,
+					     data_seq + sent);
+}
+
+/* replicate the data sent so far on all the subflows lagging behind */
+static void __mptcp_push_redundant(struct sock *sk, unsigned int flags)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		struct mptcp_sendmsg_info info = {
+			.flags = flags,
+		};
+
+		if (!before64(subflow->redundant_seq, msk->snd_nxt))
+			continue;
+
+		lock_sock(ssk);
+		if (__mptcp_redundant_xmit(sk, ssk, &info))
+			tcp_push(ssk, 0, info.mss_now, tcp_sk(ssk)->nonagle,
+				 info.size_goal);
+		release_sock(ssk);
+	}
+}
+
 static void mptcp_push_release(struct sock *ssk, struct mptcp_sendmsg_info *info)
 {
 	tcp_push(ssk, 0, info->mss_now, tcp_sk(ssk)->nonagle, info->size_goal);
@@ -1563,15 +1577,25 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 			 * from the previous one, otherwise we are still
 			 * helding the relevant lock
 			 */
-			if (ssk != prev_ssk)
+			if (ssk != prev_ssk) {
 				lock_sock(ssk);
 
+				/* catch up before sending new data */
+				if (mptcp_sched_redundant(msk)) {
+					__mptcp_redundant_xmit(sk, ssk, &info);
+					info.sent = dfrag->already_sent;
+					info.limit = dfrag->data_len;
+				}
+			}
+
 			ret = mptcp_sendmsg_frag(sk, ssk, dfrag, &info);
 			if (ret <= 0) {
 				mptcp_push_release(ssk, &info);
 				goto out;
 			}
 
+			mptcp_update_redundant_seq(ssk, dfrag->data_seq + info.sent,
+						   ret);
 			info.sent += ret;
 			copied += ret;
 			len -= ret;
@@ -1586,6 +1610,9 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 		mptcp_push_release(ssk, &info);
 
 out:
+	if (mptcp_sched_redundant(msk))
+		__mptcp_push_redundant(sk, flags);
+
 	/* ensure the rtx timer is running */
 	if (!mptcp_timer_pending(sk))
 		mptcp_reset_timer(sk);
@@ -1599,12 +1626,16 @@ static void __mptcp_subflow_push_pending(struct sock *sk, struct sock *ssk)
 	struct mptcp_sendmsg_info info = {
 		.data_lock_held = true,
 	};
+	struct mptcp_subflow_context *subflow;
 	struct mptcp_data_frag *dfrag;
+	int len, copied = 0, dup = 0;
 	struct sock *xmit_ssk;
-	int len, copied = 0;
 	bool first = true;
 
 	info.flags = 0;
+	if (mptcp_sched_redundant(msk))
+		dup = __mptcp_redundant_xmit(sk, ssk, &info);
+
 	while ((dfrag = mptcp_send_head(sk))) {
 		info.sent = dfrag->already_sent;
 		info.limit = dfrag->data_len;
@@ -1629,6 +1660,8 @@ static void __mptcp_subflow_push_pending(struct sock *sk, struct sock *ssk)
 			if (ret <= 0)
 				goto out;
 
+			mptcp_update_redundant_seq(ssk, dfrag->data_seq + info.sent,
+						   ret);
 			info.sent += ret;
 			copied += ret;
 			len -= ret;
@@ -1640,10 +1673,22 @@ static void __mptcp_subflow_push_pending(struct sock *sk, struct sock *ssk)
 	}
 
 out:
+	/* the other subflows can't be locked here, let them replicate
+	 * the new data on their own
+	 */
+	if (copied && mptcp_sched_redundant(msk)) {
+		mptcp_for_each_subflow(msk, subflow) {
+			if (mptcp_subflow_tcp_sock(subflow) != ssk &&
+			    mptcp_subflow_active(subflow))
+				mptcp_subflow_delegate(subflow,
+						       MPTCP_DELEGATE_SEND);
+		}
+	}
+
 	/* __mptcp_alloc_tx_skb could have released some wmem and we are
 	 * not going to flush it via release_sock()
 	 */
-	if (copied) {
+	if (copied || dup) {
 		tcp_push(ssk, 0, info.mss_now, tcp_sk(ssk)->nonagle,
 			 info.size_goal);
 		if (!mptcp_timer_pending(sk))
@@ -2581,6 +2626,15 @@ static int mptcp_init_sock(struct sock *sk)
 	if (ret)
 		return ret;
 
+	rcu_read_lock();
+	ret = mptcp_init_sched(mptcp_sk(sk),
+			       mptcp_sched_find(mptcp_get_scheduler(net)));
+	rcu_read_unlock();
+	if (ret)
+		ret = mptcp_init_sched(mptcp_sk(sk), NULL);
+	if (ret)
+		return ret;
+
 	/* fetch the ca name; do it outside __mptcp_init_sock(), so that clone will
 	 * propagate the correct value
 	 */
@@ -2910,6 +2964,11 @@ struct sock *mptcp_sk_clone(const struct sock *sk,
 	msk->wnd_end = msk->snd_nxt + req->rsk_rcv_wnd;
 	msk->setsockopt_seq = mptcp_sk(sk)->setsockopt_seq;
 
+	/* inherit the listener scheduler, the copied pointer holds no ref */
+	msk->sched = NULL;
+	if (mptcp_init_sched(msk, READ_ONCE(mptcp_sk(sk)->sched)))
+		mptcp_init_sched(msk, NULL);
+
 	if (mp_opt->suboptions & OPTIONS_MPTCP_MPC) {
 		msk->can_ack = true;
 		msk->remote_key = mp_opt->sndr_key;
@@ -3024,6 +3083,7 @@ static void mptcp_destroy(struct sock *sk)
 	struct mptcp_sock *msk = mptcp_sk(sk);
 
 	mptcp_destroy_common(msk);
+	mptcp_release_sched(msk);
 	sk_sockets_allocated_dec(sk);
 }
 
@@ -0,0 +1,319 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP
+ *
+ * Pluggable packet schedulers: pick the subflow that will transmit the
+ * next chunk of data at the MPTCP level.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <net/ipv6.h>
+#include <net/tcp.h>
+
+#include "protocol.h"
+
+static DEFINE_SPINLOCK(mptcp_sched_list_lock);
+static LIST_HEAD(mptcp_sched_list);
+
+static bool mptcp_sched_can_send(const struct sock *ssk)
+{
+	return sk_stream_memory_free(ssk) && tcp_sk(ssk)->snd_wnd;
+}
+
+/* The historical scheduler: keep using the last subflow for a whole burst,
+ * then pick the subflow with the shorter estimated time to flush its
+ * queued data, backups only if no other subflow is active.
+ */
+static int mptcp_sched_default_get_subflow(struct mptcp_sock *msk,
+					   struct mptcp_sched_data *data)
+{
+	u64 linger_time, best_time[SSK_MODE_MAX] = { U64_MAX, U64_MAX };
+	int i, best[SSK_MODE_MAX] = { -1, -1 };
+	struct mptcp_subflow_context *subflow;
+	u32 pace, burst, wmem;
+	int nr_active = 0;
+	struct sock *ssk;
+
+	/* re-use last subflow, if the burst allow that */
+	if (msk->last_snd && msk->snd_burst > 0 &&
+	    sk_stream_memory_free(msk->last_snd)) {
+		for (i = 0; i < data->subflows; i++)
+			if (mptcp_subflow_tcp_sock(data->contexts[i]) ==
+			    msk->last_snd)
+				return i;
+	}
+
+	/* pick the subflow with the lower wmem/wspace ratio */
+	for (i = 0; i < data->subflows; i++) {
+		subflow = data->contexts[i];
+		ssk = mptcp_subflow_tcp_sock(subflow);
+
+		nr_active += !subflow->backup;
+		pace = subflow->avg_pacing_rate;
+		if (unlikely(!pace)) {
+			/* init pacing rate from socket */
+			subflow->avg_pacing_rate = READ_ONCE(ssk->sk_pacing_rate);
+			pace = subflow->avg_pacing_rate;
+			if (!pace)
+				continue;
+		}
+
+		linger_time = div_u64((u64)READ_ONCE(ssk->sk_wmem_queued) << 32, pace);
+		if (linger_time < best_time[subflow->backup]) {
+			best[subflow->backup] = i;
+			best_time[subflow->backup] = linger_time;
+		}
+	}
+
+	/* pick the best backup if no other subflow is active */
+	if (!nr_active)
+		best[SSK_MODE_ACTIVE] = best[SSK_MODE_BACKUP];
+
+	/* According to the blest algorithm, to avoid HoL blocking for the
+	 * faster flow, we need to:
+	 * - estimate the faster flow linger time
+	 * - use the above to estimate the amount of byte transferred
+	 *   by the faster flow
+	 * - check that the amount of queued data is greter than the above,
+	 *   otherwise do not use the picked, slower, subflow
+	 * We select the subflow with the shorter estimated time to flush
+	 * the queued mem, which basically ensure the above. We just need
+	 * to check that subflow has a non empty cwin.
+	 */
+	i = best[SSK_MODE_ACTIVE];
+	if (i < 0)
+		return -1;
+
+	subflow = data->contexts[i];
+	ssk = mptcp_subflow_tcp_sock(subflow);
+	if (!mptcp_sched_can_send(ssk))
+		return -1;
+
+	burst = min_t(int, MPTCP_SEND_BURST_SIZE, tcp_sk(ssk)->snd_wnd);
+	wmem = READ_ONCE(ssk->sk_wmem_queued);
+	subflow->avg_pacing_rate = div_u64((u64)subflow->avg_pacing_rate * wmem +
+					   READ_ONCE(ssk->sk_pacing_rate) * burst,
+					   burst + wmem);
+	msk->snd_burst = burst;
+	return i;
+}
+
+/* Spread the chunks over the subflows in turn, starting from the one next
+ * to the last used, skipping the subflows that can't send right now.
+ */
+static int mptcp_sched_rr_get_subflow(struct mptcp_sock *msk,
+				      struct mptcp_sched_data *data)
+{
+	int i, n, last = -1;
+	bool backup;
+
+	for (i = 0; i < data->subflows; i++) {
+		if (mptcp_subflow_tcp_sock(data->contexts[i]) == msk->last_snd) {
+			last = i;
+			break;
+		}
+	}
+
+	for (backup = false; ; backup = true) {
+		for (n = 1; n <= data->subflows; n++) {
+			i = (last + n) % data->subflows;
+			if (data->contexts[i]->backup != backup)
+				continue;
+			if (mptcp_sched_can_send(mptcp_subflow_tcp_sock(data->contexts[i])))
+				return i;
+		}
+		if (backup)
+			return -1;
+	}
+}
+
+/* Estimated time, in usecs, for a new segment queued on @ssk to reach the
+ * peer: the data already queued must be paced out first, then it takes
+ * one way trip, approximated with srtt.
+ */
+static u64 mptcp_sched_delivery_time(const struct sock *ssk)
+{
+	u64 pace = READ_ONCE(ssk->sk_pacing_rate);
+	u64 time = tcp_sk(ssk)->srtt_us >> 3;
+
+	if (pace)
+		time += div64_u64((u64)READ_ONCE(ssk->sk_wmem_queued) * USEC_PER_SEC,
+				  pace);
+	return time;
+}
+
+static int mptcp_sched_latency_get_subflow(struct mptcp_sock *msk,
+					   struct mptcp_sched_data *data)
+{
+	u64 time, best_time[SSK_MODE_MAX] = { U64_MAX, U64_MAX };
+	int i, best[SSK_MODE_MAX] = { -1, -1 };
+	struct mptcp_subflow_context *subflow;
+	struct sock *ssk;
+
+	for (i = 0; i < data->subflows; i++) {
+		subflow = data->contexts[i];
+		ssk = mptcp_subflow_tcp_sock(subflow);
+		if (!mptcp_sched_can_send(ssk))
+			continue;
+
+		time = mptcp_sched_delivery_time(ssk);
+		if (time < best_time[subflow->backup]) {
+			best[subflow->backup] = i;
+			best_time[subflow->backup] = time;
+		}
+	}
+
+	return best[SSK_MODE_ACTIVE] >= 0 ? best[SSK_MODE_ACTIVE] :
+					    best[SSK_MODE_BACKUP];
+}
+
+static struct mptcp_sched_ops mptcp_sched_default = {
+	.get_subflow	= mptcp_sched_default_get_subflow,
+	.name		= "default",
+	.owner		= THIS_MODULE,
+};
+
+static struct mptcp_sched_ops mptcp_sched_rr = {
+	.get_subflow	= mptcp_sched_rr_get_subflow,
+	.name		= "roundrobin",
+	.owner		= THIS_MODULE,
+};
+
+static struct mptcp_sched_ops mptcp_sched_latency = {
+	.get_subflow	= mptcp_sched_latency_get_subflow,
+	.name		= "latency",
+	.owner		= THIS_MODULE,
+};
+
+/* new data goes on the lowest latency subflow, and is then replicated on
+ * all the other active subflows by the core
+ */
+static struct mptcp_sched_ops mptcp_sched_redundant = {
+	.get_subflow	= mptcp_sched_latency_get_subflow,
+	.flags		= MPTCP_SCHED_FLAG_REDUNDANT,
+	.name		= "redundant",
+	.owner		= THIS_MODULE,
+};
+
+/* Must be called with rcu lock held or with mptcp_sched_list_lock */
+struct mptcp_sched_ops *mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list,
+				lockdep_is_held(&mptcp_sched_list_lock)) {
+		if (!strcmp(sched->name, name))
+			return sched;
+	}
+
+	return NULL;
+}
+
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	if (!sched->get_subflow || !sched->name[0] ||
+	    (sched->flags & ~MPTCP_SCHED_FLAGS))
+		return -EINVAL;
+
+	spin_lock(&mptcp_sched_list_lock);
+	if (mptcp_sched_find(sched->name)) {
+		spin_unlock(&mptcp_sched_list_lock);
+		return -EEXIST;
+	}
+	list_add_tail_rcu(&sched->list, &mptcp_sched_list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	pr_debug("%s registered", sched->name);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_scheduler);
+
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
+{
+	if (sched == &mptcp_sched_default)
+		return;
+
+	spin_lock(&mptcp_sched_list_lock);
+	list_del_rcu(&sched->list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	/* Wait for outstanding readers to complete before the
+	 * module gets removed entirely.
+	 */
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_scheduler);
+
+/* Attach @sched, or the default scheduler if NULL, to a msk without a
+ * scheduler.
+ */
+int mptcp_init_sched(struct mptcp_sock *msk, struct mptcp_sched_ops *sched)
+{
+	if (!sched)
+		sched = &mptcp_sched_default;
+
+	if (!try_module_get(sched->owner))
+		return -EBUSY;
+
+	WRITE_ONCE(msk->sched, sched);
+	if (sched->init)
+		sched->init(msk);
+
+	pr_debug("msk=%p sched=%s", msk, sched->name);
+	return 0;
+}
+
+void mptcp_release_sched(struct mptcp_sock *msk)
+{
+	struct mptcp_sched_ops *sched = msk->sched;
+
+	if (!sched)
+		return;
+
+	WRITE_ONCE(msk->sched, NULL);
+	if (sched->release)
+		sched->release(msk);
+
+	module_put(sched->owner);
+}
+
+/* Switch the scheduler of a msk, called with the msk socket lock held */
+int mptcp_set_scheduler(struct mptcp_sock *msk, const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	rcu_read_lock();
+	sched = mptcp_sched_find(name);
+	if (sched && sched != msk->sched &&
+	    !try_module_get(sched->owner))
+		sched = ERR_PTR(-EBUSY);
+	rcu_read_unlock();
+
+	if (IS_ERR_OR_NULL(sched))
+		return sched ? PTR_ERR(sched) : -ENOENT;
+	if (sched == msk->sched)
+		return 0;
+
+	mptcp_release_sched(msk);
+	WRITE_ONCE(msk->sched, sched);
+	if (sched->init)
+		sched->init(msk);
+
+	/* the new scheduler starts from a clean state */
+	msk->last_snd = NULL;
+	msk->snd_burst = 0;
+	return 0;
+}
+
+void __init mptcp_sched_init(void)
+{
+	mptcp_register_scheduler(&mptcp_sched_default);
+	mptcp_register_scheduler(&mptcp_sched_rr);
+	mptcp_register_scheduler(&mptcp_sched_latency);
+	mptcp_register_scheduler(&mptcp_sched_redundant);
+}
@@ -619,6 +619,7 @@ static void mptcp_sock_destruct(struct sock *sk)
 	}
 
 	mptcp_destroy_common(mptcp_sk(sk));
+	mptcp_release_sched(mptcp_sk(sk));
 	inet_sock_destruct(sk);
 }
 
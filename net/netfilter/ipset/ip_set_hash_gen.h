@@ -6,9 +6,11 @@
 
 #include <linux/rcupdate.h>
 #include <linux/jhash.h>
+#include <linux/prefetch.h>
 #include <linux/types.h>
 #include <linux/netfilter/nfnetlink.h>
 #include <linux/netfilter/ipset/ip_set.h>
+#include <asm/unaligned.h>
 
 #define __ipset_dereference(p)		\
 	rcu_dereference_protected(p, 1)
@@ -67,11 +69,20 @@ tune_bucketsize(u8 curr, u32 multi)
 #define TUNE_BUCKETSIZE(h, multi)
 #endif
 
+/* Number of leading positions in a bucket with a fingerprint */
+#define AHASH_FP_SLOTS			16
+/* Number of prefixes looked up together when testing by nets */
+#define AHASH_LOOKUP_BATCH		8
+
 /* A hash bucket */
 struct hbucket {
 	struct rcu_head rcu;	/* for call_rcu */
 	/* Which positions are used in the array */
 	DECLARE_BITMAP(used, AHASH_MAX_TUNED);
+	/* Top byte of the hash of the elements at the first positions,
+	 * so that the header alone rejects most of the mismatches
+	 */
+	u8 fp[AHASH_FP_SLOTS] __aligned(__alignof__(u64));
 	u8 size;		/* size of the array */
 	u8 pos;			/* position of the first free entry */
 	unsigned char value[]	/* the array of the values */
@@ -111,6 +122,7 @@ struct htable {
 };
 
 #define hbucket(h, i)		((h)->bucket[i])
+#define ahash_fp(hash)		((u8)((hash) >> 24))
 #define ext_size(n, dsize)	\
 	(sizeof(struct hbucket) + (n) * (dsize))
 
@@ -124,6 +136,34 @@ struct net_prefixes {
 	u8 cidr[IPSET_NET_COUNT];  /* the cidr value */
 };
 
+/* Return a bitmap of the fingerprinted positions of the bucket which
+ * match fp: the fingerprints are compared a word at a time, then the
+ * high bit of every matching byte is gathered into the result.
+ */
+static inline u32
+ahash_fp_match(const struct hbucket *n, u8 fp)
+{
+	const u64 lo = 0x0101010101010101ULL, hi = 0x7f7f7f7f7f7f7f7fULL;
+	u64 x;
+	u32 match = 0;
+	int i;
+
+	for (i = 0; i < AHASH_FP_SLOTS; i += sizeof(u64)) {
+		x = get_unaligned_le64(&n->fp[i]) ^ (lo * fp);
+		/* 0x80 in the bytes which are zero, without carries */
+		x = ~(((x & hi) + hi) | x | hi);
+		match |= (u32)(((x >> 7) * 0x0102040810204080ULL) >> 56) << i;
+	}
+	return match;
+}
+
+/* Whether position i can be skipped according to the fingerprints */
+static inline bool
+ahash_fp_miss(u32 match, int i)
+{
+	return i < AHASH_FP_SLOTS && !(match & BIT(i));
+}
+
 /* Compute the hash table size */
 static size_t
 htable_size(u8 hbits)
@@ -222,6 +262,8 @@ htable_size(u8 hbits)
 
 #undef mtype_add
 #undef mtype_del
+#undef mtype_elem_fp
+#undef mtype_test_bucket
 #undef mtype_test_cidrs
 #undef mtype_test
 #undef mtype_uref
@@ -237,6 +279,7 @@ htable_size(u8 hbits)
 #undef mtype_data_match
 
 #undef htype
+#undef HKEY_HASH
 #undef HKEY
 
 #define mtype_data_equal	IPSET_TOKEN(MTYPE, _data_equal)
@@ -266,6 +309,8 @@ htable_size(u8 hbits)
 
 #define mtype_add		IPSET_TOKEN(MTYPE, _add)
 #define mtype_del		IPSET_TOKEN(MTYPE, _del)
+#define mtype_elem_fp		IPSET_TOKEN(MTYPE, _elem_fp)
+#define mtype_test_bucket	IPSET_TOKEN(MTYPE, _test_bucket)
 #define mtype_test_cidrs	IPSET_TOKEN(MTYPE, _test_cidrs)
 #define mtype_test		IPSET_TOKEN(MTYPE, _test)
 #define mtype_uref		IPSET_TOKEN(MTYPE, _uref)
@@ -286,16 +331,19 @@ htable_size(u8 hbits)
 
 #define htype			MTYPE
 
-#define HKEY(data, initval, htable_bits)			\
+#define HKEY_HASH(data, initval)				\
 ({								\
 	const u32 *__k = (const u32 *)data;			\
 	u32 __l = HKEY_DATALEN / sizeof(u32);			\
 								\
 	BUILD_BUG_ON(HKEY_DATALEN % sizeof(u32) != 0);		\
 								\
-	jhash2(__k, __l, initval) & jhash_mask(htable_bits);	\
+	jhash2(__k, __l, initval);				\
 })
 
+#define HKEY(data, initval, htable_bits)			\
+	(HKEY_HASH(data, initval) & jhash_mask(htable_bits))
+
 /* The generic hash structure */
 struct htype {
 	struct htable __rcu *table; /* the hash table */
@@ -390,6 +438,20 @@ mtype_ahash_memsize(const struct htype *h, const struct htable *t)
 #define ahash_data(n, i, dsize)	\
 	((struct mtype_elem *)((n)->value + ((i) * (dsize))))
 
+/* Fingerprint of a stored element, hashed without its flags */
+static u8
+mtype_elem_fp(const struct htype *h, const struct mtype_elem *data)
+{
+#ifdef IP_SET_HASH_WITH_NETS
+	struct mtype_elem tmp = *data;
+	u8 flags = 0;
+
+	mtype_data_reset_flags(&tmp, &flags);
+	data = &tmp;
+#endif
+	return ahash_fp(HKEY_HASH(data, h->initval));
+}
+
 static void
 mtype_ext_cleanup(struct ip_set *set, struct hbucket *n)
 {
@@ -551,6 +613,10 @@ mtype_gc_do(struct ip_set *set, struct htype *h, struct htable *t, u32 r)
 				data = ahash_data(n, j, dsize);
 				memcpy(tmp->value + d * dsize,
 				       data, dsize);
+				if (d < AHASH_FP_SLOTS)
+					tmp->fp[d] = j < AHASH_FP_SLOTS ?
+						n->fp[j] :
+						mtype_elem_fp(h, data);
 				set_bit(d, tmp->used);
 				d++;
 			}
@@ -636,7 +702,7 @@ mtype_resize(struct ip_set *set, bool retried)
 	struct hbucket *n, *m;
 	struct list_head *l, *lt;
 	struct mtype_resize_ad *x;
-	u32 i, j, r, nr, key;
+	u32 i, j, r, nr, hash, key;
 	int ret;
 
 #ifdef IP_SET_HASH_WITH_NETS
@@ -702,7 +768,8 @@ mtype_resize(struct ip_set *set, bool retried)
 				data = tmp;
 				mtype_data_reset_flags(data, &flags);
 #endif
-				key = HKEY(data, h->initval, htable_bits);
+				hash = HKEY_HASH(data, h->initval);
+				key = hash & jhash_mask(htable_bits);
 				m = __ipset_dereference(hbucket(t, key));
 				nr = ahash_region(key, htable_bits);
 				if (!m) {
@@ -745,6 +812,8 @@ mtype_resize(struct ip_set *set, bool retried)
 				}
 				d = ahash_data(m, m->pos, dsize);
 				memcpy(d, data, dsize);
+				if (m->pos < AHASH_FP_SLOTS)
+					m->fp[m->pos] = ahash_fp(hash);
 				set_bit(m->pos++, m->used);
 				t->hregion[nr].elements++;
 #ifdef IP_SET_HASH_WITH_NETS
@@ -849,11 +918,12 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	int i, j = -1, ret;
 	bool flag_exist = flags & IPSET_FLAG_EXIST;
 	bool deleted = false, forceadd = false, reuse = false;
-	u32 r, key, multi = 0, elements, maxelem;
+	u32 r, hash, key, multi = 0, elements, maxelem;
 
 	rcu_read_lock_bh();
 	t = rcu_dereference_bh(h->table);
-	key = HKEY(value, h->initval, t->htable_bits);
+	hash = HKEY_HASH(value, h->initval);
+	key = hash & jhash_mask(t->htable_bits);
 	r = ahash_region(key, t->htable_bits);
 	atomic_inc(&t->uref);
 	elements = t->hregion[r].elements;
@@ -981,6 +1051,8 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	/* Must come last for the case when timed out entry is reused */
 	if (SET_WITH_TIMEOUT(set))
 		ip_set_timeout_set(ext_timeout(data, set), ext->timeout);
+	if (j < AHASH_FP_SLOTS)
+		n->fp[j] = ahash_fp(hash);
 	smp_mb__before_atomic();
 	set_bit(j, n->used);
 	if (old != ERR_PTR(-ENOENT)) {
@@ -1038,7 +1110,7 @@ mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	struct hbucket *n;
 	struct mtype_resize_ad *x = NULL;
 	int i, j, k, r, ret = -IPSET_ERR_EXIST;
-	u32 key, multi = 0;
+	u32 hash, key, match, multi = 0;
 	size_t dsize = set->dsize;
 
 	/* Userspace add and resize is excluded by the mutex.
@@ -1046,7 +1118,8 @@ mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	 */
 	rcu_read_lock_bh();
 	t = rcu_dereference_bh(h->table);
-	key = HKEY(value, h->initval, t->htable_bits);
+	hash = HKEY_HASH(value, h->initval);
+	key = hash & jhash_mask(t->htable_bits);
 	r = ahash_region(key, t->htable_bits);
 	atomic_inc(&t->uref);
 	rcu_read_unlock_bh();
@@ -1055,11 +1128,14 @@ mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	n = rcu_dereference_bh(hbucket(t, key));
 	if (!n)
 		goto out;
+	match = ahash_fp_match(n, ahash_fp(hash));
 	for (i = 0, k = 0; i < n->pos; i++) {
 		if (!test_bit(i, n->used)) {
 			k++;
 			continue;
 		}
+		if (ahash_fp_miss(match, i))
+			continue;
 		data = ahash_data(n, i, dsize);
 		if (!mtype_data_equal(data, d, &multi))
 			continue;
@@ -1112,6 +1188,10 @@ mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 					continue;
 				data = ahash_data(n, j, dsize);
 				memcpy(tmp->value + k * dsize, data, dsize);
+				if (k < AHASH_FP_SLOTS)
+					tmp->fp[k] = j < AHASH_FP_SLOTS ?
+						n->fp[j] :
+						mtype_elem_fp(h, data);
 				set_bit(k, tmp->used);
 				k++;
 			}
@@ -1149,6 +1229,33 @@ mtype_data_match(struct mtype_elem *data, const struct ip_set_ext *ext,
 }
 
 #ifdef IP_SET_HASH_WITH_NETS
+/* Test the masked element d against the elements of bucket n */
+static int
+mtype_test_bucket(struct ip_set *set, struct hbucket *n,
+		  struct mtype_elem *d, u8 fp, const struct ip_set_ext *ext,
+		  struct ip_set_ext *mext, u32 flags, u32 *multi)
+{
+	struct mtype_elem *data;
+	u32 match = ahash_fp_match(n, fp);
+	int ret, i;
+
+	for (i = 0; i < n->pos; i++) {
+		if (!test_bit(i, n->used) || ahash_fp_miss(match, i))
+			continue;
+		data = ahash_data(n, i, set->dsize);
+		if (!mtype_data_equal(data, d, multi))
+			continue;
+		ret = mtype_data_match(data, ext, mext, set, flags);
+		if (ret != 0)
+			return ret;
+#ifdef IP_SET_HASH_WITH_MULTI
+		/* No match, reset multiple match flag */
+		*multi = 0;
+#endif
+	}
+	return 0;
+}
+
 /* Special test function which takes into account the different network
  * sizes added to the set
  */
@@ -1160,49 +1267,69 @@ mtype_test_cidrs(struct ip_set *set, struct mtype_elem *d,
 	struct htype *h = set->data;
 	struct htable *t = rcu_dereference_bh(h->table);
 	struct hbucket *n;
-	struct mtype_elem *data;
 #if IPSET_NET_COUNT == 2
 	struct mtype_elem orig = *d;
-	int ret, i, j = 0, k;
-#else
-	int ret, i, j = 0;
-#endif
-	u32 key, multi = 0;
+	int ret, j = 0, k;
+	u32 hash, multi = 0;
 
 	pr_debug("test by nets\n");
 	for (; j < NLEN && h->nets[j].cidr[0] && !multi; j++) {
-#if IPSET_NET_COUNT == 2
 		mtype_data_reset_elem(d, &orig);
 		mtype_data_netmask(d, NCIDR_GET(h->nets[j].cidr[0]), false);
 		for (k = 0; k < NLEN && h->nets[k].cidr[1] && !multi;
 		     k++) {
 			mtype_data_netmask(d, NCIDR_GET(h->nets[k].cidr[1]),
 					   true);
-#else
-		mtype_data_netmask(d, NCIDR_GET(h->nets[j].cidr[0]));
-#endif
-		key = HKEY(d, h->initval, t->htable_bits);
-		n = rcu_dereference_bh(hbucket(t, key));
-		if (!n)
-			continue;
-		for (i = 0; i < n->pos; i++) {
-			if (!test_bit(i, n->used))
-				continue;
-			data = ahash_data(n, i, set->dsize);
-			if (!mtype_data_equal(data, d, &multi))
+			hash = HKEY_HASH(d, h->initval);
+			n = rcu_dereference_bh(hbucket(t, hash &
+					       jhash_mask(t->htable_bits)));
+			if (!n)
 				continue;
-			ret = mtype_data_match(data, ext, mext, set, flags);
+			ret = mtype_test_bucket(set, n, d, ahash_fp(hash),
+						ext, mext, flags, &multi);
 			if (ret != 0)
 				return ret;
-#ifdef IP_SET_HASH_WITH_MULTI
-			/* No match, reset multiple match flag */
-			multi = 0;
-#endif
 		}
-#if IPSET_NET_COUNT == 2
+	}
+#else
+	struct mtype_elem batch[AHASH_LOOKUP_BATCH];
+	struct hbucket *bn[AHASH_LOOKUP_BATCH];
+	u32 hash[AHASH_LOOKUP_BATCH];
+	u32 mask = jhash_mask(t->htable_bits), multi = 0;
+	int ret, i, j = 0, nr;
+
+	pr_debug("test by nets\n");
+	/* The prefixes are stored from the longest to the shortest one,
+	 * so d can be masked progressively. The elements of a batch are
+	 * masked and hashed first and the bucket loads are issued together,
+	 * then the buckets are tested in the original order.
+	 */
+	for (; j < NLEN && h->nets[j].cidr[0] && !multi; j += nr) {
+		for (nr = 0; nr < AHASH_LOOKUP_BATCH && j + nr < NLEN &&
+			     h->nets[j + nr].cidr[0]; nr++) {
+			mtype_data_netmask(d,
+				NCIDR_GET(h->nets[j + nr].cidr[0]));
+			batch[nr] = *d;
+			hash[nr] = HKEY_HASH(d, h->initval);
+			prefetch(&hbucket(t, hash[nr] & mask));
+		}
+		for (i = 0; i < nr; i++) {
+			bn[i] = rcu_dereference_bh(hbucket(t, hash[i] & mask));
+			if (bn[i])
+				prefetch(bn[i]);
+		}
+		for (i = 0; i < nr && !multi; i++) {
+			n = bn[i];
+			if (!n)
+				continue;
+			ret = mtype_test_bucket(set, n, &batch[i],
+						ahash_fp(hash[i]), ext, mext,
+						flags, &multi);
+			if (ret != 0)
+				return ret;
 		}
-#endif
 	}
+#endif
 	return 0;
 }
 #endif
@@ -1218,7 +1345,7 @@ mtype_test(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	struct hbucket *n;
 	struct mtype_elem *data;
 	int i, ret = 0;
-	u32 key, multi = 0;
+	u32 hash, match, multi = 0;
 
 	rcu_read_lock_bh();
 	t = rcu_dereference_bh(h->table);
@@ -1235,14 +1362,15 @@ mtype_test(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	}
 #endif
 
-	key = HKEY(d, h->initval, t->htable_bits);
-	n = rcu_dereference_bh(hbucket(t, key));
+	hash = HKEY_HASH(d, h->initval);
+	n = rcu_dereference_bh(hbucket(t, hash & jhash_mask(t->htable_bits)));
 	if (!n) {
 		ret = 0;
 		goto out;
 	}
+	match = ahash_fp_match(n, ahash_fp(hash));
 	for (i = 0; i < n->pos; i++) {
-		if (!test_bit(i, n->used))
+		if (!test_bit(i, n->used) || ahash_fp_miss(match, i))
 			continue;
 		data = ahash_data(n, i, set->dsize);
 		if (!mtype_data_equal(data, d, &multi))
@@ -32,6 +32,7 @@
 #include <linux/seq_file.h>
 #include <linux/jhash.h>
 #include <linux/random.h>
+#include <linux/workqueue.h>
 
 #include <net/net_namespace.h>
 #include <net/ip_vs.h>
@@ -41,21 +42,51 @@
 #define CONFIG_IP_VS_TAB_BITS	12
 #endif
 
+#define IP_VS_CONN_TAB_MAX_BITS	24
+
 /*
- * Connection hash size. Default is what was selected at compile time.
+ * Initial and minimum connection hash size. Default is what was selected at
+ * compile time. The table grows with the number of connections, up to
+ * conn_tab_max_bits.
 */
 static int ip_vs_conn_tab_bits = CONFIG_IP_VS_TAB_BITS;
 module_param_named(conn_tab_bits, ip_vs_conn_tab_bits, int, 0444);
-MODULE_PARM_DESC(conn_tab_bits, "Set connections' hash size");
+MODULE_PARM_DESC(conn_tab_bits, "Set connections' initial and minimum hash size");
+
+static int ip_vs_conn_tab_max_bits = IP_VS_CONN_TAB_MAX_BITS;
+module_param_named(conn_tab_max_bits, ip_vs_conn_tab_max_bits, int, 0444);
+MODULE_PARM_DESC(conn_tab_max_bits, "Set connections' maximum hash size");
 
-/* size and mask values */
+/* current size */
 int ip_vs_conn_tab_size __read_mostly;
-static int ip_vs_conn_tab_mask __read_mostly;
 
 /*
  *  Connection hash table: for input and output packets lookups of IPVS
+ *
+ *  The table is resized from a work, without stopping lookups nor
+ *  insertions. Each connection has one list node per table version, the
+ *  resize links every connection in the new table with the node unused by
+ *  the old one, bucket after bucket, while readers keep walking the old
+ *  table. Buckets before old->copied are already in the new table, so
+ *  writers hashing into them update both tables. Both tables use the same
+ *  hash with a different mask, and the lock of a bucket only depends on the
+ *  low hash bits, so it protects the bucket in both tables.
  */
-static struct hlist_head *ip_vs_conn_tab __read_mostly;
+struct ip_vs_conn_tab {
+	struct ip_vs_conn_tab	*new;		/* table being filled */
+	unsigned int		copied;		/* buckets already in new */
+	unsigned int		mask;
+	int			node_ver;	/* index in cp->c_list */
+	struct hlist_head	buckets[];
+};
+
+static struct ip_vs_conn_tab __rcu *ip_vs_conn_tab __read_mostly;
+
+/* number of hashed connections, drives the table resizing */
+static atomic_t ip_vs_conn_tab_count = ATOMIC_INIT(0);
+
+static void ip_vs_conn_tab_resize(struct work_struct *work);
+static DECLARE_WORK(ip_vs_conn_tab_work, ip_vs_conn_tab_resize);
 
 /*  SLAB cache for IPVS connections */
 static struct kmem_cache *ip_vs_conn_cachep __read_mostly;
@@ -101,8 +132,28 @@ static inline void ct_write_unlock_bh(unsigned int key)
 
 static void ip_vs_conn_expire(struct timer_list *t);
 
+static struct ip_vs_conn_tab *ip_vs_conn_tab_alloc(unsigned int size, int ver)
+{
+	struct ip_vs_conn_tab *t;
+	unsigned int idx;
+
+	t = kvmalloc(struct_size(t, buckets, size), GFP_KERNEL);
+	if (!t)
+		return NULL;
+
+	t->new = NULL;
+	t->copied = 0;
+	t->mask = size - 1;
+	t->node_ver = ver;
+	for (idx = 0; idx < size; idx++)
+		INIT_HLIST_HEAD(&t->buckets[idx]);
+
+	return t;
+}
+
 /*
- *	Returns hash value for IPVS connection entry
+ *	Returns hash value for IPVS connection entry, not yet masked with the
+ *	size of the table
  */
 static unsigned int ip_vs_conn_hashkey(struct netns_ipvs *ipvs, int af, unsigned int proto,
 				       const union nf_inet_addr *addr,
@@ -110,13 +161,13 @@ static unsigned int ip_vs_conn_hashkey(struct netns_ipvs *ipvs, int af, unsigned
 {
 #ifdef CONFIG_IP_VS_IPV6
 	if (af == AF_INET6)
-		return (jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
+		return jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
 				    (__force u32)port, proto, ip_vs_conn_rnd) ^
-			((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+			((size_t)ipvs>>8);
 #endif
-	return (jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
+	return jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
 			    ip_vs_conn_rnd) ^
-		((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+		((size_t)ipvs>>8);
 }
 
 static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
@@ -126,8 +177,7 @@ static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
 	__be16 port;
 
 	if (p->pe_data && p->pe->hashkey_raw)
-		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse) &
-			ip_vs_conn_tab_mask;
+		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse);
 
 	if (likely(!inverse)) {
 		addr = p->caddr;
@@ -156,6 +206,46 @@ static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
 	return ip_vs_conn_hashkey_param(&p, false);
 }
 
+/* Link and unlink cp in the current table, and in the table being filled
+ * by a resize once its bucket was copied there. Called with the bucket lock.
+ */
+static void ip_vs_conn_tab_add(struct ip_vs_conn *cp, unsigned int hash)
+{
+	struct ip_vs_conn_tab *t, *new;
+	unsigned int idx;
+
+	t = rcu_dereference_bh(ip_vs_conn_tab);
+	idx = hash & t->mask;
+	hlist_add_head_rcu(&cp->c_list[t->node_ver], &t->buckets[idx]);
+
+	new = READ_ONCE(t->new);
+	if (new && idx < READ_ONCE(t->copied))
+		hlist_add_head_rcu(&cp->c_list[new->node_ver],
+				   &new->buckets[hash & new->mask]);
+
+	/* Keep the chains short, the resize work rechecks the load */
+	if (unlikely(atomic_inc_return(&ip_vs_conn_tab_count) > t->mask + 1 &&
+		     !new && t->mask + 1 < 1U << ip_vs_conn_tab_max_bits))
+		queue_work(system_unbound_wq, &ip_vs_conn_tab_work);
+}
+
+static void ip_vs_conn_tab_del(struct ip_vs_conn *cp, unsigned int hash)
+{
+	struct ip_vs_conn_tab *t, *new;
+
+	t = rcu_dereference_bh(ip_vs_conn_tab);
+	hlist_del_rcu(&cp->c_list[t->node_ver]);
+
+	new = READ_ONCE(t->new);
+	if (new && (hash & t->mask) < READ_ONCE(t->copied))
+		hlist_del_rcu(&cp->c_list[new->node_ver]);
+
+	if (unlikely(atomic_dec_return(&ip_vs_conn_tab_count) <
+		     (t->mask + 1) / 8 &&
+		     !new && t->mask + 1 > 1U << ip_vs_conn_tab_bits))
+		queue_work(system_unbound_wq, &ip_vs_conn_tab_work);
+}
+
 /*
  *	Hashes ip_vs_conn in ip_vs_conn_tab by netns,proto,addr,port.
  *	returns bool success.
@@ -177,7 +267,7 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 	if (!(cp->flags & IP_VS_CONN_F_HASHED)) {
 		cp->flags |= IP_VS_CONN_F_HASHED;
 		refcount_inc(&cp->refcnt);
-		hlist_add_head_rcu(&cp->c_list, &ip_vs_conn_tab[hash]);
+		ip_vs_conn_tab_add(cp, hash);
 		ret = 1;
 	} else {
 		pr_err("%s(): request for already hashed, called from %pS\n",
@@ -208,7 +298,7 @@ static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
 	spin_lock(&cp->lock);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
-		hlist_del_rcu(&cp->c_list);
+		ip_vs_conn_tab_del(cp, hash);
 		cp->flags &= ~IP_VS_CONN_F_HASHED;
 		refcount_dec(&cp->refcnt);
 		ret = 1;
@@ -240,7 +330,7 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
 		/* Decrease refcnt and unlink conn only if we are last user */
 		if (refcount_dec_if_one(&cp->refcnt)) {
-			hlist_del_rcu(&cp->c_list);
+			ip_vs_conn_tab_del(cp, hash);
 			cp->flags &= ~IP_VS_CONN_F_HASHED;
 			ret = true;
 		}
@@ -252,6 +342,57 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 	return ret;
 }
 
+/* Resize the table to twice the number of hashed connections, once they
+ * outnumber the buckets or fill less than 1/8 of them.
+ */
+static void ip_vs_conn_tab_resize(struct work_struct *work)
+{
+	struct ip_vs_conn_tab *t, *new;
+	unsigned int count, size, idx;
+	struct ip_vs_conn *cp;
+
+	/* Only this work replaces the table */
+	t = rcu_dereference_protected(ip_vs_conn_tab, 1);
+	count = atomic_read(&ip_vs_conn_tab_count);
+	if (count <= t->mask + 1 && count >= (t->mask + 1) / 8)
+		return;
+
+	size = roundup_pow_of_two(max(count, 1U) * 2);
+	size = clamp(size, 1U << ip_vs_conn_tab_bits,
+		     1U << ip_vs_conn_tab_max_bits);
+	if (size == t->mask + 1)
+		return;
+
+	new = ip_vs_conn_tab_alloc(size, !t->node_ver);
+	if (!new)
+		return;
+	WRITE_ONCE(t->new, new);
+
+	for (idx = 0; idx <= t->mask; idx++) {
+		ct_write_lock_bh(idx);
+		hlist_for_each_entry(cp, &t->buckets[idx],
+				     c_list[t->node_ver]) {
+			unsigned int hash = ip_vs_conn_hashkey_conn(cp);
+
+			hlist_add_head_rcu(&cp->c_list[new->node_ver],
+					   &new->buckets[hash & new->mask]);
+		}
+		WRITE_ONCE(t->copied, idx + 1);
+		ct_write_unlock_bh(idx);
+		cond_resched();
+	}
+
+	rcu_assign_pointer(ip_vs_conn_tab, new);
+	WRITE_ONCE(ip_vs_conn_tab_size, size);
+	IP_VS_DBG(2, "Connection hash table resized to %u buckets, %u conns\n",
+		  size, count);
+
+	/* Wait for the lookups and writers still walking the old table, also
+	 * before its list nodes can be reused by the next resize.
+	 */
+	synchronize_rcu();
+	kvfree(t);
+}
 
 /*
  *  Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
@@ -262,6 +403,7 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 static inline struct ip_vs_conn *
 __ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
 {
+	struct ip_vs_conn_tab *t;
 	unsigned int hash;
 	struct ip_vs_conn *cp;
 
@@ -269,7 +411,9 @@ __ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
+	t = rcu_dereference(ip_vs_conn_tab);
+	hlist_for_each_entry_rcu(cp, &t->buckets[hash & t->mask],
+				 c_list[t->node_ver]) {
 		if (p->cport == cp->cport && p->vport == cp->vport &&
 		    cp->af == p->af &&
 		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
@@ -348,6 +492,7 @@ EXPORT_SYMBOL_GPL(ip_vs_conn_in_get_proto);
 /* Get reference to connection template */
 struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 {
+	struct ip_vs_conn_tab *t;
 	unsigned int hash;
 	struct ip_vs_conn *cp;
 
@@ -355,7 +500,9 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
+	t = rcu_dereference(ip_vs_conn_tab);
+	hlist_for_each_entry_rcu(cp, &t->buckets[hash & t->mask],
+				 c_list[t->node_ver]) {
 		if (unlikely(p->pe_data && p->pe->ct_match)) {
 			if (cp->ipvs != p->ipvs)
 				continue;
@@ -400,6 +547,7 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
  *	p->vaddr, p->vport: pkt dest address (foreign host) */
 struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 {
+	struct ip_vs_conn_tab *t;
 	unsigned int hash;
 	struct ip_vs_conn *cp, *ret=NULL;
 	const union nf_inet_addr *saddr;
@@ -412,7 +560,9 @@ struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
+	t = rcu_dereference(ip_vs_conn_tab);
+	hlist_for_each_entry_rcu(cp, &t->buckets[hash & t->mask],
+				 c_list[t->node_ver]) {
 		if (p->vport != cp->cport)
 			continue;
 
@@ -953,7 +1103,8 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 		return NULL;
 	}
 
-	INIT_HLIST_NODE(&cp->c_list);
+	INIT_HLIST_NODE(&cp->c_list[0]);
+	INIT_HLIST_NODE(&cp->c_list[1]);
 	timer_setup(&cp->timer, ip_vs_conn_expire, 0);
 	cp->ipvs	   = ipvs;
 	cp->af		   = p->af;
@@ -1046,22 +1197,31 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 #ifdef CONFIG_PROC_FS
 struct ip_vs_iter_state {
 	struct seq_net_private	p;
-	struct hlist_head	*l;
+	unsigned int		idx;
+	int			node_ver;
 };
 
+/* The table may be resized while the RCU lock is dropped between buckets,
+ * so it is looked up again for each bucket. A resize can then make the walk
+ * miss or repeat some entries.
+ */
 static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
 {
-	int idx;
+	unsigned int idx;
+	struct ip_vs_conn_tab *t;
 	struct ip_vs_conn *cp;
 	struct ip_vs_iter_state *iter = seq->private;
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+	for (idx = 0; t = rcu_dereference(ip_vs_conn_tab), idx <= t->mask;
+	     idx++) {
+		hlist_for_each_entry_rcu(cp, &t->buckets[idx],
+					 c_list[t->node_ver]) {
 			/* __ip_vs_conn_get() is not needed by
 			 * ip_vs_conn_seq_show and ip_vs_conn_sync_seq_show
 			 */
 			if (pos-- == 0) {
-				iter->l = &ip_vs_conn_tab[idx];
+				iter->idx = idx;
+				iter->node_ver = t->node_ver;
 				return cp;
 			}
 		}
@@ -1074,9 +1234,6 @@ static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
 static void *ip_vs_conn_seq_start(struct seq_file *seq, loff_t *pos)
 	__acquires(RCU)
 {
-	struct ip_vs_iter_state *iter = seq->private;
-
-	iter->l = NULL;
 	rcu_read_lock();
 	return *pos ? ip_vs_conn_array(seq, *pos - 1) :SEQ_START_TOKEN;
 }
@@ -1085,28 +1242,30 @@ static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
 	struct ip_vs_conn *cp = v;
 	struct ip_vs_iter_state *iter = seq->private;
+	struct ip_vs_conn_tab *t;
 	struct hlist_node *e;
-	struct hlist_head *l = iter->l;
-	int idx;
+	unsigned int idx;
 
 	++*pos;
 	if (v == SEQ_START_TOKEN)
 		return ip_vs_conn_array(seq, 0);
 
 	/* more on same hash chain? */
-	e = rcu_dereference(hlist_next_rcu(&cp->c_list));
+	e = rcu_dereference(hlist_next_rcu(&cp->c_list[iter->node_ver]));
 	if (e)
-		return hlist_entry(e, struct ip_vs_conn, c_list);
-
-	idx = l - ip_vs_conn_tab;
-	while (++idx < ip_vs_conn_tab_size) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			iter->l = &ip_vs_conn_tab[idx];
+		return hlist_entry(e, struct ip_vs_conn,
+				   c_list[iter->node_ver]);
+
+	idx = iter->idx;
+	while (t = rcu_dereference(ip_vs_conn_tab), ++idx <= t->mask) {
+		hlist_for_each_entry_rcu(cp, &t->buckets[idx],
+					 c_list[t->node_ver]) {
+			iter->idx = idx;
+			iter->node_ver = t->node_ver;
 			return cp;
 		}
 		cond_resched_rcu();
 	}
-	iter->l = NULL;
 	return NULL;
 }
 
@@ -1300,17 +1459,20 @@ static inline bool ip_vs_conn_ops_mode(struct ip_vs_conn *cp)
 /* Called from keventd and must protect itself from softirqs */
 void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 {
-	int idx;
+	unsigned int idx;
+	struct ip_vs_conn_tab *t;
 	struct ip_vs_conn *cp;
 
 	rcu_read_lock();
 	/*
 	 * Randomly scan 1/32 of the whole table every second
 	 */
-	for (idx = 0; idx < (ip_vs_conn_tab_size>>5); idx++) {
-		unsigned int hash = prandom_u32() & ip_vs_conn_tab_mask;
+	for (idx = 0; t = rcu_dereference(ip_vs_conn_tab),
+		      idx < ((t->mask + 1) >> 5); idx++) {
+		unsigned int hash = prandom_u32() & t->mask;
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
+		hlist_for_each_entry_rcu(cp, &t->buckets[hash],
+					 c_list[t->node_ver]) {
 			if (cp->ipvs != ipvs)
 				continue;
 			if (atomic_read(&cp->n_control))
@@ -1370,14 +1532,17 @@ void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
  */
 static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
 {
-	int idx;
+	unsigned int idx;
+	struct ip_vs_conn_tab *t;
 	struct ip_vs_conn *cp, *cp_c;
 
 flush_again:
 	rcu_read_lock();
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
+	for (idx = 0; t = rcu_dereference(ip_vs_conn_tab), idx <= t->mask;
+	     idx++) {
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+		hlist_for_each_entry_rcu(cp, &t->buckets[idx],
+					 c_list[t->node_ver]) {
 			if (cp->ipvs != ipvs)
 				continue;
 			if (atomic_read(&cp->n_control))
@@ -1405,13 +1570,16 @@ static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
 #ifdef CONFIG_SYSCTL
 void ip_vs_expire_nodest_conn_flush(struct netns_ipvs *ipvs)
 {
-	int idx;
+	unsigned int idx;
+	struct ip_vs_conn_tab *t;
 	struct ip_vs_conn *cp, *cp_c;
 	struct ip_vs_dest *dest;
 
 	rcu_read_lock();
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+	for (idx = 0; t = rcu_dereference(ip_vs_conn_tab), idx <= t->mask;
+	     idx++) {
+		hlist_for_each_entry_rcu(cp, &t->buckets[idx],
+					 c_list[t->node_ver]) {
 			if (cp->ipvs != ipvs)
 				continue;
 
@@ -1465,6 +1633,7 @@ void __net_exit ip_vs_conn_net_cleanup(struct netns_ipvs *ipvs)
 
 int __init ip_vs_conn_init(void)
 {
+	struct ip_vs_conn_tab *t;
 	int idx;
 
 	/* Compute size and mask */
@@ -1472,36 +1641,38 @@ int __init ip_vs_conn_init(void)
 		pr_info("conn_tab_bits not in [8, 20]. Using default value\n");
 		ip_vs_conn_tab_bits = CONFIG_IP_VS_TAB_BITS;
 	}
+	if (ip_vs_conn_tab_max_bits < ip_vs_conn_tab_bits ||
+	    ip_vs_conn_tab_max_bits > IP_VS_CONN_TAB_MAX_BITS) {
+		pr_info("conn_tab_max_bits not in [conn_tab_bits, %d]. Using %d\n",
+			IP_VS_CONN_TAB_MAX_BITS, IP_VS_CONN_TAB_MAX_BITS);
+		ip_vs_conn_tab_max_bits = IP_VS_CONN_TAB_MAX_BITS;
+	}
 	ip_vs_conn_tab_size = 1 << ip_vs_conn_tab_bits;
-	ip_vs_conn_tab_mask = ip_vs_conn_tab_size - 1;
 
 	/*
 	 * Allocate the connection hash table and initialize its list heads
 	 */
-	ip_vs_conn_tab = vmalloc(array_size(ip_vs_conn_tab_size,
-					    sizeof(*ip_vs_conn_tab)));
-	if (!ip_vs_conn_tab)
+	t = ip_vs_conn_tab_alloc(ip_vs_conn_tab_size, 0);
+	if (!t)
 		return -ENOMEM;
+	RCU_INIT_POINTER(ip_vs_conn_tab, t);
 
 	/* Allocate ip_vs_conn slab cache */
 	ip_vs_conn_cachep = kmem_cache_create("ip_vs_conn",
 					      sizeof(struct ip_vs_conn), 0,
 					      SLAB_HWCACHE_ALIGN, NULL);
 	if (!ip_vs_conn_cachep) {
-		vfree(ip_vs_conn_tab);
+		kvfree(t);
 		return -ENOMEM;
 	}
 
 	pr_info("Connection hash table configured "
-		"(size=%d, memory=%ldKbytes)\n",
-		ip_vs_conn_tab_size,
-		(long)(ip_vs_conn_tab_size*sizeof(struct list_head))/1024);
+		"(size=%d, max size=%d, memory=%ldKbytes)\n",
+		ip_vs_conn_tab_size, 1 << ip_vs_conn_tab_max_bits,
+		(long)(ip_vs_conn_tab_size*sizeof(struct hlist_head))/1024);
 	IP_VS_DBG(0, "Each connection entry needs %zd bytes at least\n",
 		  sizeof(struct ip_vs_conn));
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++)
-		INIT_HLIST_HEAD(&ip_vs_conn_tab[idx]);
-
 	for (idx = 0; idx < CT_LOCKARRAY_SIZE; idx++)  {
 		spin_lock_init(&__ip_vs_conntbl_lock_array[idx].l);
 	}
@@ -1514,9 +1685,10 @@ int __init ip_vs_conn_init(void)
 
 void ip_vs_conn_cleanup(void)
 {
+	cancel_work_sync(&ip_vs_conn_tab_work);
 	/* Wait all ip_vs_conn_rcu_free() callbacks to complete */
 	rcu_barrier();
 	/* Release the empty cache */
 	kmem_cache_destroy(ip_vs_conn_cachep);
-	vfree(ip_vs_conn_tab);
+	kvfree(rcu_dereference_protected(ip_vs_conn_tab, 1));
 }
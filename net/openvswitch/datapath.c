@@ -231,13 +231,15 @@ void ovs_dp_process_packet(struct sk_buff *skb, struct sw_flow_key *key)
 	u64 *stats_counter;
 	u32 n_mask_hit;
 	u32 n_cache_hit;
+	u32 n_microflow_hit;
 	int error;
 
 	stats = this_cpu_ptr(dp->stats_percpu);
 
 	/* Look up flow. */
 	flow = ovs_flow_tbl_lookup_stats(&dp->table, key, skb_get_hash(skb),
-					 &n_mask_hit, &n_cache_hit);
+					 &n_mask_hit, &n_cache_hit,
+					 &n_microflow_hit);
 	if (unlikely(!flow)) {
 		struct dp_upcall_info upcall;
 
@@ -275,6 +277,7 @@ void ovs_dp_process_packet(struct sk_buff *skb, struct sw_flow_key *key)
 	(*stats_counter)++;
 	stats->n_mask_hit += n_mask_hit;
 	stats->n_cache_hit += n_cache_hit;
+	stats->n_microflow_hit += n_microflow_hit;
 	u64_stats_update_end(&stats->syncp);
 }
 
@@ -716,6 +719,7 @@ static void get_dp_stats(const struct datapath *dp, struct ovs_dp_stats *stats,
 		stats->n_lost += local_stats.n_lost;
 		mega_stats->n_mask_hit += local_stats.n_mask_hit;
 		mega_stats->n_cache_hit += local_stats.n_cache_hit;
+		mega_stats->n_microflow_hit += local_stats.n_microflow_hit;
 	}
 }
 
@@ -1515,6 +1519,7 @@ static size_t ovs_dp_cmd_msg_size(void)
 	msgsize += nla_total_size_64bit(sizeof(struct ovs_dp_megaflow_stats));
 	msgsize += nla_total_size(sizeof(u32)); /* OVS_DP_ATTR_USER_FEATURES */
 	msgsize += nla_total_size(sizeof(u32)); /* OVS_DP_ATTR_MASKS_CACHE_SIZE */
+	msgsize += nla_total_size(sizeof(u32)); /* OVS_DP_ATTR_MICROFLOW_CACHE_SIZE */
 
 	return msgsize;
 }
@@ -1556,6 +1561,10 @@ static int ovs_dp_cmd_fill_info(struct datapath *dp, struct sk_buff *skb,
 			ovs_flow_tbl_masks_cache_size(&dp->table)))
 		goto nla_put_failure;
 
+	if (nla_put_u32(skb, OVS_DP_ATTR_MICROFLOW_CACHE_SIZE,
+			ovs_flow_tbl_microflow_cache_size(&dp->table)))
+		goto nla_put_failure;
+
 	genlmsg_end(skb, ovs_header);
 	return 0;
 
@@ -1684,6 +1693,17 @@ static int ovs_dp_change(struct datapath *dp, struct nlattr *a[])
 			return err;
 	}
 
+	if (a[OVS_DP_ATTR_MICROFLOW_CACHE_SIZE]) {
+		int err;
+		u32 cache_size;
+
+		cache_size = nla_get_u32(a[OVS_DP_ATTR_MICROFLOW_CACHE_SIZE]);
+		err = ovs_flow_tbl_microflow_cache_resize(&dp->table,
+							  cache_size);
+		if (err)
+			return err;
+	}
+
 	dp->user_features = user_features;
 
 	if (dp->user_features & OVS_DP_F_DISPATCH_UPCALL_PER_CPU &&
@@ -1996,6 +2016,8 @@ static const struct nla_policy datapath_policy[OVS_DP_ATTR_MAX + 1] = {
 	[OVS_DP_ATTR_USER_FEATURES] = { .type = NLA_U32 },
 	[OVS_DP_ATTR_MASKS_CACHE_SIZE] =  NLA_POLICY_RANGE(NLA_U32, 0,
 		PCPU_MIN_UNIT_SIZE / sizeof(struct mask_cache_entry)),
+	[OVS_DP_ATTR_MICROFLOW_CACHE_SIZE] = NLA_POLICY_RANGE(NLA_U32, 0,
+		PCPU_MIN_UNIT_SIZE / sizeof(struct microflow_cache_entry)),
 };
 
 static const struct genl_small_ops dp_datapath_genl_ops[] = {
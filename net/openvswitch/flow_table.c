@@ -42,6 +42,8 @@
 #define MC_HASH_SHIFT		8
 #define MC_HASH_SEGS		((sizeof(uint32_t) * 8) / MC_HASH_SHIFT)
 
+#define MFC_DEFAULT_ENTRIES	1024
+
 static struct kmem_cache *flow_cache;
 struct kmem_cache *flow_stats_cache __read_mostly;
 
@@ -410,9 +412,105 @@ int ovs_flow_tbl_masks_cache_resize(struct flow_table *table, u32 size)
 	return 0;
 }
 
+static void __microflow_cache_destroy(struct microflow_cache *mfc)
+{
+	free_percpu(mfc->entries);
+	kfree(mfc);
+}
+
+static void microflow_cache_rcu_cb(struct rcu_head *rcu)
+{
+	struct microflow_cache *mfc;
+
+	mfc = container_of(rcu, struct microflow_cache, rcu);
+	__microflow_cache_destroy(mfc);
+}
+
+static bool microflow_cache_size_valid(u32 size)
+{
+	return (is_power_of_2(size) || size == 0) &&
+	       size * sizeof(struct microflow_cache_entry) <=
+	       PCPU_MIN_UNIT_SIZE;
+}
+
+static struct microflow_cache *tbl_microflow_cache_alloc(u32 size)
+{
+	struct microflow_cache *new;
+
+	if (!microflow_cache_size_valid(size))
+		return NULL;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	new->cache_size = size;
+	if (size) {
+		new->entries = __alloc_percpu(array_size(sizeof(*new->entries),
+							 size),
+					      __alignof__(*new->entries));
+		if (!new->entries) {
+			kfree(new);
+			return NULL;
+		}
+	}
+
+	return new;
+}
+
+int ovs_flow_tbl_microflow_cache_resize(struct flow_table *table, u32 size)
+{
+	struct microflow_cache *mfc;
+	struct microflow_cache *new;
+
+	mfc = rcu_dereference_ovsl(table->microflow_cache);
+	if (size == mfc->cache_size)
+		return 0;
+
+	if (!microflow_cache_size_valid(size))
+		return -EINVAL;
+
+	new = tbl_microflow_cache_alloc(size);
+	if (!new)
+		return -ENOMEM;
+
+	rcu_assign_pointer(table->microflow_cache, new);
+	call_rcu(&mfc->rcu, microflow_cache_rcu_cb);
+
+	return 0;
+}
+
+/* Must be called with OVS mutex held. */
+static void tbl_microflow_cache_invalidate(struct flow_table *table)
+{
+	struct microflow_cache *mfc, *new;
+
+	mfc = ovsl_dereference(table->microflow_cache);
+	if (likely(mfc->gen != U32_MAX)) {
+		/* Pairs with smp_load_acquire() in ovs_flow_tbl_lookup_stats(),
+		 * a reader seeing the new generation also sees the table change.
+		 */
+		smp_store_release(&mfc->gen, mfc->gen + 1);
+		return;
+	}
+
+	/* Wrapping the generation around could make stale entries look
+	 * valid again, start over with an empty cache instead.
+	 */
+	new = tbl_microflow_cache_alloc(mfc->cache_size);
+	if (!new) {
+		WRITE_ONCE(mfc->cache_size, 0);
+		return;
+	}
+
+	rcu_assign_pointer(table->microflow_cache, new);
+	call_rcu(&mfc->rcu, microflow_cache_rcu_cb);
+}
+
 int ovs_flow_tbl_init(struct flow_table *table)
 {
 	struct table_instance *ti, *ufid_ti;
+	struct microflow_cache *mfc;
 	struct mask_cache *mc;
 	struct mask_array *ma;
 
@@ -420,9 +518,13 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	if (!mc)
 		return -ENOMEM;
 
+	mfc = tbl_microflow_cache_alloc(MFC_DEFAULT_ENTRIES);
+	if (!mfc)
+		goto free_mask_cache;
+
 	ma = tbl_mask_array_alloc(MASK_ARRAY_SIZE_MIN);
 	if (!ma)
-		goto free_mask_cache;
+		goto free_microflow_cache;
 
 	ti = table_instance_alloc(TBL_MIN_BUCKETS);
 	if (!ti)
@@ -436,6 +538,7 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	rcu_assign_pointer(table->ufid_ti, ufid_ti);
 	rcu_assign_pointer(table->mask_array, ma);
 	rcu_assign_pointer(table->mask_cache, mc);
+	rcu_assign_pointer(table->microflow_cache, mfc);
 	table->last_rehash = jiffies;
 	table->count = 0;
 	table->ufid_count = 0;
@@ -445,6 +548,8 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	__table_instance_destroy(ti);
 free_mask_array:
 	__mask_array_destroy(ma);
+free_microflow_cache:
+	__microflow_cache_destroy(mfc);
 free_mask_cache:
 	__mask_cache_destroy(mc);
 	return -ENOMEM;
@@ -465,6 +570,8 @@ static void table_instance_flow_free(struct flow_table *table,
 {
 	hlist_del_rcu(&flow->flow_table.node[ti->node_ver]);
 	table->count--;
+	/* Before the flow can be freed */
+	tbl_microflow_cache_invalidate(table);
 
 	if (ovs_identifier_is_ufid(&flow->id)) {
 		hlist_del_rcu(&flow->ufid_table.node[ufid_ti->node_ver]);
@@ -517,9 +624,11 @@ void ovs_flow_tbl_destroy(struct flow_table *table)
 	struct table_instance *ti = rcu_dereference_raw(table->ti);
 	struct table_instance *ufid_ti = rcu_dereference_raw(table->ufid_ti);
 	struct mask_cache *mc = rcu_dereference_raw(table->mask_cache);
+	struct microflow_cache *mfc = rcu_dereference_raw(table->microflow_cache);
 	struct mask_array *ma = rcu_dereference_raw(table->mask_array);
 
 	call_rcu(&mc->rcu, mask_cache_rcu_cb);
+	call_rcu(&mfc->rcu, microflow_cache_rcu_cb);
 	call_rcu(&ma->rcu, mask_array_rcu_cb);
 	table_instance_destroy(ti, ufid_ti);
 }
@@ -697,6 +806,26 @@ static bool ovs_flow_cmp_unmasked_key(const struct sw_flow *flow,
 	return cmp_key(flow->id.unmasked_key, key, key_start, key_end);
 }
 
+/* Whether 'key' matches 'flow' under the flow's own mask, without building
+ * the masked key nor hashing it.
+ */
+static bool flow_match_unmasked_key(const struct sw_flow *flow,
+				    const struct sw_flow_key *key)
+{
+	const struct sw_flow_mask *mask = flow->mask;
+	int start = mask->range.start, end = mask->range.end;
+	const long *m = (const long *)((const u8 *)&mask->key + start);
+	const long *f = (const long *)((const u8 *)&flow->key + start);
+	const long *k = (const long *)((const u8 *)key + start);
+	int i;
+
+	for (i = start; i < end; i += sizeof(long))
+		if ((*k++ & *m++) ^ *f++)
+			return false;
+
+	return true;
+}
+
 static struct sw_flow *masked_flow_lookup(struct table_instance *ti,
 					  const struct sw_flow_key *unmasked,
 					  const struct sw_flow_mask *mask,
@@ -782,23 +911,21 @@ static struct sw_flow *flow_lookup(struct flow_table *tbl,
  * This is per cpu cache and is divided in MC_HASH_SEGS segments.
  * In case of a hash collision the entry is hashed in next segment.
  * */
-struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
-					  const struct sw_flow_key *key,
-					  u32 skb_hash,
-					  u32 *n_mask_hit,
-					  u32 *n_cache_hit)
+static struct sw_flow *mask_cache_lookup(struct flow_table *tbl,
+					 struct table_instance *ti,
+					 struct mask_array *ma,
+					 const struct sw_flow_key *key,
+					 u32 skb_hash,
+					 u32 *n_mask_hit,
+					 u32 *n_cache_hit)
 {
 	struct mask_cache *mc = rcu_dereference(tbl->mask_cache);
-	struct mask_array *ma = rcu_dereference(tbl->mask_array);
-	struct table_instance *ti = rcu_dereference(tbl->ti);
 	struct mask_cache_entry *entries, *ce;
 	struct sw_flow *flow;
 	u32 hash;
 	int seg;
 
-	*n_mask_hit = 0;
-	*n_cache_hit = 0;
-	if (unlikely(!skb_hash || mc->cache_size == 0)) {
+	if (unlikely(mc->cache_size == 0)) {
 		u32 mask_index = 0;
 		u32 cache = 0;
 
@@ -806,12 +933,6 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 				   &mask_index);
 	}
 
-	/* Pre and post recirulation flows usually have the same skb_hash
-	 * value. To avoid hash collisions, rehash the 'skb_hash' with
-	 * 'recirc_id'.  */
-	if (key->recirc_id)
-		skb_hash = jhash_1word(skb_hash, key->recirc_id);
-
 	ce = NULL;
 	hash = skb_hash;
 	entries = this_cpu_ptr(mc->mask_cache);
@@ -846,6 +967,69 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 	return flow;
 }
 
+/*
+ * The microflow cache sits in front of the mask cache and maps a packet's
+ * skb_hash straight to the flow it last hit on this CPU. A hit is checked
+ * against the flow's own mask and key, so it costs neither mask iteration
+ * nor masked hashing. Entries are only valid for the cache generation they
+ * were filled in, which changes on any flow insertion or removal: a cached
+ * flow pointer is never used once the flow may have been freed.
+ * This function MUST be called with BH disabled.
+ */
+struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
+					  const struct sw_flow_key *key,
+					  u32 skb_hash,
+					  u32 *n_mask_hit,
+					  u32 *n_cache_hit,
+					  u32 *n_microflow_hit)
+{
+	struct microflow_cache *mfc = rcu_dereference(tbl->microflow_cache);
+	struct mask_array *ma = rcu_dereference(tbl->mask_array);
+	struct table_instance *ti = rcu_dereference(tbl->ti);
+	struct microflow_cache_entry *mfe = NULL;
+	struct sw_flow *flow;
+	u32 size, gen;
+
+	*n_mask_hit = 0;
+	*n_cache_hit = 0;
+	*n_microflow_hit = 0;
+	if (unlikely(!skb_hash)) {
+		u32 mask_index = 0;
+		u32 cache = 0;
+
+		return flow_lookup(tbl, ti, ma, key, n_mask_hit, &cache,
+				   &mask_index);
+	}
+
+	/* Pre and post recirulation flows usually have the same skb_hash
+	 * value. To avoid hash collisions, rehash the 'skb_hash' with
+	 * 'recirc_id'.  */
+	if (key->recirc_id)
+		skb_hash = jhash_1word(skb_hash, key->recirc_id);
+
+	size = READ_ONCE(mfc->cache_size);
+	gen = smp_load_acquire(&mfc->gen);
+	if (size) {
+		mfe = this_cpu_ptr(mfc->entries);
+		mfe += skb_hash & (size - 1);
+		if (mfe->skb_hash == skb_hash && mfe->gen == gen &&
+		    mfe->flow && flow_match_unmasked_key(mfe->flow, key)) {
+			(*n_microflow_hit)++;
+			return mfe->flow;
+		}
+	}
+
+	flow = mask_cache_lookup(tbl, ti, ma, key, skb_hash, n_mask_hit,
+				 n_cache_hit);
+	if (flow && mfe) {
+		mfe->skb_hash = skb_hash;
+		mfe->gen = gen;
+		mfe->flow = flow;
+	}
+
+	return flow;
+}
+
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *tbl,
 				    const struct sw_flow_key *key)
 {
@@ -948,6 +1132,14 @@ u32 ovs_flow_tbl_masks_cache_size(const struct flow_table *table)
 	return READ_ONCE(mc->cache_size);
 }
 
+u32 ovs_flow_tbl_microflow_cache_size(const struct flow_table *table)
+{
+	struct microflow_cache *mfc;
+
+	mfc = rcu_dereference_ovsl(table->microflow_cache);
+	return READ_ONCE(mfc->cache_size);
+}
+
 static struct table_instance *table_instance_expand(struct table_instance *ti,
 						    bool ufid)
 {
@@ -1089,6 +1281,8 @@ int ovs_flow_tbl_insert(struct flow_table *table, struct sw_flow *flow,
 	if (err)
 		return err;
 	flow_key_insert(table, flow);
+	/* A new flow may take precedence over a cached one */
+	tbl_microflow_cache_invalidate(table);
 	if (ovs_identifier_is_ufid(&flow->id))
 		flow_ufid_insert(table, flow);
 
@@ -33,6 +33,19 @@ struct mask_cache {
 	struct mask_cache_entry __percpu *mask_cache;
 };
 
+struct microflow_cache_entry {
+	u32 skb_hash;
+	u32 gen;
+	struct sw_flow *flow;
+};
+
+struct microflow_cache {
+	struct rcu_head rcu;
+	u32 cache_size;  /* Must be ^2 value. */
+	u32 gen;	 /* Bumped on every flow insertion and removal. */
+	struct microflow_cache_entry __percpu *entries;
+};
+
 struct mask_count {
 	int index;
 	u64 counter;
@@ -63,6 +76,7 @@ struct flow_table {
 	struct table_instance __rcu *ti;
 	struct table_instance __rcu *ufid_ti;
 	struct mask_cache __rcu *mask_cache;
+	struct microflow_cache __rcu *microflow_cache;
 	struct mask_array __rcu *mask_array;
 	unsigned long last_rehash;
 	unsigned int count;
@@ -88,13 +102,16 @@ void ovs_flow_tbl_remove(struct flow_table *table, struct sw_flow *flow);
 int  ovs_flow_tbl_num_masks(const struct flow_table *table);
 u32  ovs_flow_tbl_masks_cache_size(const struct flow_table *table);
 int  ovs_flow_tbl_masks_cache_resize(struct flow_table *table, u32 size);
+u32  ovs_flow_tbl_microflow_cache_size(const struct flow_table *table);
+int  ovs_flow_tbl_microflow_cache_resize(struct flow_table *table, u32 size);
 struct sw_flow *ovs_flow_tbl_dump_next(struct table_instance *table,
 				       u32 *bucket, u32 *idx);
 struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *,
 					  const struct sw_flow_key *,
 					  u32 skb_hash,
 					  u32 *n_mask_hit,
-					  u32 *n_cache_hit);
+					  u32 *n_cache_hit,
+					  u32 *n_microflow_hit);
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *,
 				    const struct sw_flow_key *);
 struct sw_flow *ovs_flow_tbl_lookup_exact(struct flow_table *tbl,
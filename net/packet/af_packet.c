@@ -64,6 +64,7 @@
 #include <linux/kmod.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/highmem.h>
 #include <net/net_namespace.h>
 #include <net/ip.h>
 #include <net/protocol.h>
@@ -1331,6 +1332,9 @@ static void packet_sock_destruct(struct sock *sk)
 	WARN_ON(atomic_read(&sk->sk_rmem_alloc));
 	WARN_ON(refcount_read(&sk->sk_wmem_alloc));
 
+	/* Left by packet_set_ring() for the skbs in flight at release */
+	kvfree(pkt_sk(sk)->tx_ring.tx_bdq.blks);
+
 	if (!sock_flag(sk, SOCK_DEAD)) {
 		pr_err("Attempt to release alive packet socket: %p\n", sk);
 		return;
@@ -2502,19 +2506,204 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	goto drop_n_restore;
 }
 
+static int __packet_get_blk_status(struct tpacket_block_desc *pbd)
+{
+	smp_rmb();
+	flush_dcache_page(pgv_to_page(&BLOCK_STATUS(pbd)));
+	return BLOCK_STATUS(pbd);
+}
+
+static void __packet_set_blk_status(struct tpacket_block_desc *pbd,
+				    int status)
+{
+	BLOCK_STATUS(pbd) = status;
+	flush_dcache_page(pgv_to_page(&BLOCK_STATUS(pbd)));
+	smp_wmb();
+}
+
+/*
+ * Tx ring in V3 block mode (TP_FT_REQ_TX_BLOCK):
+ *
+ * User space packs frames in a block the same way the kernel does on Rx,
+ * chained by tp_next_offset, and hands the whole block over by setting
+ * its block_status to TP_STATUS_SEND_REQUEST. Blocks are sent in ring
+ * order. The block being sent is TP_STATUS_SENDING, and is given back as
+ * TP_STATUS_AVAILABLE once the last of its skbs is gone, or with
+ * TP_STATUS_WRONG_FORMAT if it was not entirely sent because it is
+ * malformed or the device refused some of its frames.
+ *
+ * Each block in flight holds a reference on itself for the sender and one
+ * per skb, as well as a reference on its first page: the block may be
+ * completed after the ring is released.
+ */
+static void tpacket_tx_blk_put(struct tpacket_tx_blk *blk)
+{
+	struct tpacket_block_desc *pbd;
+
+	if (!atomic_dec_and_test(&blk->pending))
+		return;
+
+	pbd = kmap_local_page(blk->page);
+	BLOCK_STATUS(pbd) = blk->status;
+	flush_dcache_page(blk->page);
+	kunmap_local(pbd);
+	smp_wmb();
+
+	put_page(blk->page);
+}
+
+/* Returns 1 if the head block was opened, 0 if user space did not hand it
+ * over yet and -EINVAL if it is malformed, in which case it is given back
+ * right away.
+ */
+static int tpacket_tx_blk_open(struct packet_sock *po)
+{
+	struct packet_ring_buffer *rb = &po->tx_ring;
+	struct tpacket_tx_bdq *bdq = &rb->tx_bdq;
+	struct tpacket_tx_blk *blk = &bdq->blks[rb->head];
+	unsigned int hdroff = po->tp_hdrlen - sizeof(struct sockaddr_ll);
+	unsigned int num_pkts, o2fp, blk_len;
+	struct tpacket_block_desc *pbd;
+
+	pbd = (struct tpacket_block_desc *)rb->pg_vec[rb->head].buffer;
+
+	/* The block is only reused once the skbs of its last run are gone */
+	if (__packet_get_blk_status(pbd) != TP_STATUS_SEND_REQUEST ||
+	    atomic_read(&blk->pending))
+		return 0;
+	smp_rmb();
+
+	num_pkts = READ_ONCE(BLOCK_NUM_PKTS(pbd));
+	o2fp = READ_ONCE(BLOCK_O2FP(pbd));
+	blk_len = READ_ONCE(BLOCK_LEN(pbd));
+	if (num_pkts &&
+	    (blk_len > rb->frame_size || blk_len < hdroff ||
+	     o2fp < BLK_HDR_LEN || !IS_ALIGNED(o2fp, V3_ALIGNMENT) ||
+	     o2fp > blk_len - hdroff)) {
+		__packet_set_blk_status(pbd, TP_STATUS_WRONG_FORMAT);
+		packet_increment_head(rb);
+		return -EINVAL;
+	}
+
+	blk->status = TP_STATUS_AVAILABLE;
+	blk->page = pgv_to_page(pbd);
+	atomic_set(&blk->pending, 1);
+	get_page(blk->page);
+	__packet_set_blk_status(pbd, TP_STATUS_SENDING);
+
+	bdq->cur = blk;
+	bdq->blk_len = blk_len;
+	bdq->frame_off = o2fp;
+	bdq->pkts_left = num_pkts;
+	return 1;
+}
+
+static void tpacket_tx_blk_close(struct packet_sock *po, unsigned int status)
+{
+	struct tpacket_tx_bdq *bdq = &po->tx_ring.tx_bdq;
+
+	bdq->cur->status |= status;
+	tpacket_tx_blk_put(bdq->cur);
+	bdq->cur = NULL;
+	bdq->pkts_left = 0;
+	packet_increment_head(&po->tx_ring);
+}
+
+/* The frame header has to fit in the block, sockaddr_ll is Rx only */
+static bool tpacket_tx_blk_has_frame(const struct packet_sock *po)
+{
+	const struct tpacket_tx_bdq *bdq = &po->tx_ring.tx_bdq;
+
+	return bdq->pkts_left &&
+	       bdq->frame_off + po->tp_hdrlen - sizeof(struct sockaddr_ll) <=
+	       bdq->blk_len;
+}
+
+/* Returns the next frame to send, moving on to the next blocks as needed,
+ * NULL if there is none or an ERR_PTR() if a malformed block was found.
+ */
+static void *tpacket_tx_blk_frame(struct packet_sock *po)
+{
+	struct packet_ring_buffer *rb = &po->tx_ring;
+	struct tpacket_tx_bdq *bdq = &rb->tx_bdq;
+	int ret;
+
+	for (;;) {
+		if (tpacket_tx_blk_has_frame(po))
+			return rb->pg_vec[rb->head].buffer + bdq->frame_off;
+
+		if (bdq->cur) {
+			/* Frames left means tp_next_offset went astray */
+			if (unlikely(bdq->pkts_left)) {
+				tpacket_tx_blk_close(po, TP_STATUS_WRONG_FORMAT);
+				if (!po->tp_loss)
+					return ERR_PTR(-EINVAL);
+			} else {
+				tpacket_tx_blk_close(po, TP_STATUS_AVAILABLE);
+			}
+		}
+
+		ret = tpacket_tx_blk_open(po);
+		if (!ret)
+			return NULL;
+		if (ret < 0 && !po->tp_loss)
+			return ERR_PTR(ret);
+	}
+}
+
+static void tpacket_tx_blk_next(struct packet_sock *po, void *frame)
+{
+	struct tpacket_tx_bdq *bdq = &po->tx_ring.tx_bdq;
+	u32 next;
+
+	if (!--bdq->pkts_left)
+		return;
+
+	next = READ_ONCE(((struct tpacket3_hdr *)frame)->tp_next_offset);
+	if (unlikely(!next || !IS_ALIGNED(next, V3_ALIGNMENT) ||
+		     next > bdq->blk_len - bdq->frame_off))
+		bdq->frame_off = bdq->blk_len;
+	else
+		bdq->frame_off += next;
+}
+
+/* Called with pg_vec_lock held, when the ring is replaced or released.
+ * Skbs may still be in flight while closing: the blocks are then only
+ * freed along with the socket.
+ */
+static void tpacket_tx_bdq_swap(struct packet_ring_buffer *rb,
+				struct tpacket_tx_blk **blks, int closing)
+{
+	struct tpacket_tx_bdq *bdq = &rb->tx_bdq;
+
+	if (bdq->cur)
+		tpacket_tx_blk_put(bdq->cur);
+	bdq->cur = NULL;
+	bdq->pkts_left = 0;
+
+	if (!closing)
+		swap(bdq->blks, *blks);
+}
+
 static void tpacket_destruct_skb(struct sk_buff *skb)
 {
 	struct packet_sock *po = pkt_sk(skb->sk);
+	void *ph = skb_zcopy_get_nouarg(skb);
+
+	if (po->tx_ring.tx_bdq.blks) {
+		tpacket_tx_blk_put(ph);
+		ph = NULL;
+	}
 
 	if (likely(po->tx_ring.pg_vec)) {
-		void *ph;
 		__u32 ts;
 
-		ph = skb_zcopy_get_nouarg(skb);
 		packet_dec_pending(&po->tx_ring);
 
-		ts = __packet_set_timestamp(po, ph, skb);
-		__packet_set_status(po, ph, TP_STATUS_AVAILABLE | ts);
+		if (ph) {
+			ts = __packet_set_timestamp(po, ph, skb);
+			__packet_set_status(po, ph, TP_STATUS_AVAILABLE | ts);
+		}
 
 		if (!packet_read_pending(&po->tx_ring))
 			complete(&po->skb_completion);
@@ -2633,7 +2822,7 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 }
 
 static int tpacket_parse_header(struct packet_sock *po, void *frame,
-				int size_max, void **data)
+				int size_max, int frame_size, void **data)
 {
 	union tpacket_uhdr ph;
 	int tp_len, off;
@@ -2642,7 +2831,7 @@ static int tpacket_parse_header(struct packet_sock *po, void *frame,
 
 	switch (po->tp_version) {
 	case TPACKET_V3:
-		if (ph.h3->tp_next_offset != 0) {
+		if (ph.h3->tp_next_offset != 0 && !po->tx_ring.tx_bdq.blks) {
 			pr_warn_once("variable sized slot not supported");
 			return -EINVAL;
 		}
@@ -2664,7 +2853,7 @@ static int tpacket_parse_header(struct packet_sock *po, void *frame,
 		int off_min, off_max;
 
 		off_min = po->tp_hdrlen - sizeof(struct sockaddr_ll);
-		off_max = po->tx_ring.frame_size - tp_len;
+		off_max = frame_size - tp_len;
 		if (po->sk.sk_type == SOCK_DGRAM) {
 			switch (po->tp_version) {
 			case TPACKET_V3:
@@ -2700,11 +2889,278 @@ static int tpacket_parse_header(struct packet_sock *po, void *frame,
 	return tp_len;
 }
 
+/* Returns the skb for a ring frame, or NULL with either *tp_len set to the
+ * error of a malformed frame or, if no skb could be allocated, *err set.
+ */
+static struct sk_buff *tpacket_build_skb(struct packet_sock *po, void *frame,
+					 struct net_device *dev, void *data,
+					 int *tp_len, __be16 proto,
+					 unsigned char *addr, int reserve,
+					 bool need_wait,
+					 const struct sockcm_cookie *sockc,
+					 int *err)
+{
+	struct virtio_net_hdr *vnet_hdr = NULL;
+	int hlen, tlen, copylen = 0;
+	struct sk_buff *skb;
+	int len = *tp_len;
+
+	hlen = LL_RESERVED_SPACE(dev);
+	tlen = dev->needed_tailroom;
+	if (po->has_vnet_hdr) {
+		vnet_hdr = data;
+		data += sizeof(*vnet_hdr);
+		len -= sizeof(*vnet_hdr);
+		if (len < 0 || __packet_snd_vnet_parse(vnet_hdr, len)) {
+			*tp_len = -EINVAL;
+			return NULL;
+		}
+		copylen = __virtio16_to_cpu(vio_le(), vnet_hdr->hdr_len);
+	}
+	copylen = max_t(int, copylen, dev->hard_header_len);
+	skb = sock_alloc_send_skb(&po->sk,
+			hlen + tlen + sizeof(struct sockaddr_ll) +
+			(copylen - dev->hard_header_len),
+			!need_wait, err);
+	if (unlikely(skb == NULL))
+		return NULL;
+
+	len = tpacket_fill_skb(po, skb, frame, dev, data, len, proto, addr,
+			       hlen, copylen, sockc);
+	if (likely(len >= 0) &&
+	    len > dev->mtu + reserve &&
+	    !po->has_vnet_hdr &&
+	    !packet_extra_vlan_len_allowed(dev, skb))
+		len = -EMSGSIZE;
+
+	if (likely(len >= 0) && po->has_vnet_hdr) {
+		if (virtio_net_hdr_to_skb(skb, vnet_hdr, vio_le()))
+			len = -EINVAL;
+		else
+			virtio_net_hdr_set_proto(skb, vnet_hdr);
+	}
+
+	*tp_len = len;
+	if (unlikely(len < 0)) {
+		kfree_skb(skb);
+		return NULL;
+	}
+	return skb;
+}
+
+static bool packet_tx_can_batch(const struct packet_sock *po)
+{
+	return packet_use_direct_xmit(po) && !nf_hook_egress_active();
+}
+
+/* Same as packet_direct_xmit() for skbs going out through the same device,
+ * taking the lock of the queue picked for the first one only once and
+ * letting the driver defer its doorbell to the last one. Returns the
+ * number of skbs the driver took.
+ */
+static unsigned int packet_direct_xmit_batch(struct sk_buff **skbs,
+					     unsigned int nr)
+{
+	struct net_device *dev = skbs[0]->dev;
+	struct netdev_queue *txq;
+	unsigned int i;
+	u16 queue;
+
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev)))
+		return 0;
+
+	queue = packet_pick_tx_queue(skbs[0]);
+	txq = netdev_get_tx_queue(dev, queue);
+
+	local_bh_disable();
+	dev_xmit_recursion_inc();
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+
+	for (i = 0; i < nr; i++) {
+		if (netif_xmit_frozen_or_drv_stopped(txq))
+			break;
+
+		skb_set_queue_mapping(skbs[i], queue);
+		if (!dev_xmit_complete(netdev_start_xmit(skbs[i], dev, txq,
+							 i + 1 < nr)))
+			break;
+	}
+
+	HARD_TX_UNLOCK(dev, txq);
+	dev_xmit_recursion_dec();
+	local_bh_enable();
+
+	return i;
+}
+
+#define PACKET_TX_BATCH		16
+
+struct tpacket_tx_batch {
+	unsigned int		nr;
+	struct sk_buff		*skbs[PACKET_TX_BATCH];
+	int			len[PACKET_TX_BATCH];
+	unsigned int		frame_off[PACKET_TX_BATCH];
+	unsigned int		pkts_left[PACKET_TX_BATCH];
+};
+
+static int tpacket_tx_flush(struct packet_sock *po,
+			    struct tpacket_tx_batch *batch, int *len_sum)
+{
+	struct tpacket_tx_bdq *bdq = &po->tx_ring.tx_bdq;
+	unsigned int i, sent;
+
+	if (!batch->nr)
+		return 0;
+
+	sent = packet_direct_xmit_batch(batch->skbs, batch->nr);
+	for (i = 0; i < sent; i++)
+		*len_sum += batch->len[i];
+
+	if (unlikely(sent < batch->nr)) {
+		/* Resume from the first frame the driver did not take */
+		bdq->frame_off = batch->frame_off[sent];
+		bdq->pkts_left = batch->pkts_left[sent];
+		for (i = sent; i < batch->nr; i++)
+			kfree_skb(batch->skbs[i]);
+		batch->nr = 0;
+		return -ENOBUFS;
+	}
+
+	batch->nr = 0;
+	return 0;
+}
+
+/* Sends the blocks user space handed over, see tpacket_tx_blk_put(). A
+ * block that could not be sent entirely for lack of memory or room in the
+ * device stays open and is resumed by the next call.
+ *
+ * With PACKET_QDISC_BYPASS, the frames of a block are handed to the driver
+ * in batches.
+ */
+static int tpacket_snd_blocks(struct packet_sock *po, struct msghdr *msg,
+			      struct net_device *dev, __be16 proto,
+			      unsigned char *addr, int reserve, int size_max,
+			      const struct sockcm_cookie *sockc)
+{
+	int hdroff = po->tp_hdrlen - sizeof(struct sockaddr_ll);
+	bool need_wait = !(msg->msg_flags & MSG_DONTWAIT);
+	struct tpacket_tx_bdq *bdq = &po->tx_ring.tx_bdq;
+	bool batch_xmit = packet_tx_can_batch(po);
+	struct tpacket_tx_batch batch;
+	int err = 0, len_sum = 0;
+	long timeo;
+
+	batch.nr = 0;
+	for (;;) {
+		int tp_len, room, alloc_err;
+		struct sk_buff *skb;
+		void *ph, *data;
+
+		if (batch.nr == PACKET_TX_BATCH ||
+		    (batch.nr && !tpacket_tx_blk_has_frame(po))) {
+			err = tpacket_tx_flush(po, &batch, &len_sum);
+			if (err)
+				break;
+		}
+
+		ph = tpacket_tx_blk_frame(po);
+		if (IS_ERR(ph)) {
+			err = PTR_ERR(ph);
+			break;
+		}
+		if (!ph) {
+			if (!need_wait || !packet_read_pending(&po->tx_ring))
+				break;
+
+			timeo = sock_sndtimeo(&po->sk, 0);
+			timeo = wait_for_completion_interruptible_timeout(&po->skb_completion, timeo);
+			if (timeo <= 0) {
+				err = !timeo ? -ETIMEDOUT : -ERESTARTSYS;
+				break;
+			}
+			continue;
+		}
+
+		room = bdq->blk_len - bdq->frame_off;
+		tp_len = tpacket_parse_header(po, ph,
+					      min(size_max, room - hdroff),
+					      room, &data);
+		skb = NULL;
+		/* The skbs refer to the block rather than to their frame */
+		if (likely(tp_len >= 0))
+			skb = tpacket_build_skb(po, bdq->cur, dev, data,
+						&tp_len, proto, addr, reserve,
+						need_wait, sockc, &alloc_err);
+		if (unlikely(!skb)) {
+			if (tp_len < 0 && po->tp_loss) {
+				tpacket_tx_blk_next(po, ph);
+				continue;
+			}
+
+			err = tpacket_tx_flush(po, &batch, &len_sum);
+			if (err)
+				break;
+
+			if (tp_len >= 0) {
+				/* we assume the socket was initially writeable ... */
+				err = len_sum > 0 ? 0 : alloc_err;
+				break;
+			}
+
+			tpacket_tx_blk_close(po, TP_STATUS_WRONG_FORMAT);
+			err = tp_len;
+			break;
+		}
+
+		skb->destructor = tpacket_destruct_skb;
+		atomic_inc(&bdq->cur->pending);
+		packet_inc_pending(&po->tx_ring);
+
+		if (batch_xmit) {
+			struct sk_buff *segs;
+			bool again = false;
+
+			/* As __dev_direct_xmit(), which does not segment */
+			segs = validate_xmit_skb_list(skb, dev, &again);
+			if (unlikely(segs != skb)) {
+				/* It would fail again, skip the frame and
+				 * give the block back as not entirely sent.
+				 */
+				atomic_long_inc(&dev->tx_dropped);
+				atomic_inc(&po->tp_drops);
+				kfree_skb_list(segs);
+				bdq->cur->status |= TP_STATUS_WRONG_FORMAT;
+				tpacket_tx_blk_next(po, ph);
+				continue;
+			}
+
+			batch.skbs[batch.nr] = skb;
+			batch.len[batch.nr] = tp_len;
+			batch.frame_off[batch.nr] = bdq->frame_off;
+			batch.pkts_left[batch.nr] = bdq->pkts_left;
+			batch.nr++;
+			tpacket_tx_blk_next(po, ph);
+			continue;
+		}
+
+		err = po->xmit(skb);
+		if (unlikely(err > 0))
+			err = net_xmit_errno(err);
+		/* Dropped, the frame is sent again by the next call */
+		if (unlikely(err))
+			break;
+
+		tpacket_tx_blk_next(po, ph);
+		len_sum += tp_len;
+	}
+
+	return err ?: len_sum;
+}
+
 static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 {
 	struct sk_buff *skb = NULL;
 	struct net_device *dev;
-	struct virtio_net_hdr *vnet_hdr = NULL;
 	struct sockcm_cookie sockc;
 	__be16 proto;
 	int err, reserve = 0;
@@ -2716,7 +3172,6 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	void *data;
 	int len_sum = 0;
 	int status = TP_STATUS_AVAILABLE;
-	int hlen, tlen, copylen = 0;
 	long timeo = 0;
 
 	mutex_lock(&po->pg_vec_lock);
@@ -2773,6 +3228,12 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 
 	reinit_completion(&po->skb_completion);
 
+	if (po->tx_ring.tx_bdq.blks) {
+		err = tpacket_snd_blocks(po, msg, dev, proto, addr, reserve,
+					 size_max, &sockc);
+		goto out_put;
+	}
+
 	do {
 		ph = packet_current_frame(po, &po->tx_ring,
 					  TP_STATUS_SEND_REQUEST);
@@ -2790,52 +3251,26 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		}
 
 		skb = NULL;
-		tp_len = tpacket_parse_header(po, ph, size_max, &data);
+		tp_len = tpacket_parse_header(po, ph, size_max,
+					      po->tx_ring.frame_size, &data);
 		if (tp_len < 0)
 			goto tpacket_error;
 
 		status = TP_STATUS_SEND_REQUEST;
-		hlen = LL_RESERVED_SPACE(dev);
-		tlen = dev->needed_tailroom;
-		if (po->has_vnet_hdr) {
-			vnet_hdr = data;
-			data += sizeof(*vnet_hdr);
-			tp_len -= sizeof(*vnet_hdr);
-			if (tp_len < 0 ||
-			    __packet_snd_vnet_parse(vnet_hdr, tp_len)) {
-				tp_len = -EINVAL;
-				goto tpacket_error;
-			}
-			copylen = __virtio16_to_cpu(vio_le(),
-						    vnet_hdr->hdr_len);
-		}
-		copylen = max_t(int, copylen, dev->hard_header_len);
-		skb = sock_alloc_send_skb(&po->sk,
-				hlen + tlen + sizeof(struct sockaddr_ll) +
-				(copylen - dev->hard_header_len),
-				!need_wait, &err);
-
+		skb = tpacket_build_skb(po, ph, dev, data, &tp_len, proto, addr,
+					reserve, need_wait, &sockc, &err);
 		if (unlikely(skb == NULL)) {
-			/* we assume the socket was initially writeable ... */
-			if (likely(len_sum > 0))
-				err = len_sum;
-			goto out_status;
-		}
-		tp_len = tpacket_fill_skb(po, skb, ph, dev, data, tp_len, proto,
-					  addr, hlen, copylen, &sockc);
-		if (likely(tp_len >= 0) &&
-		    tp_len > dev->mtu + reserve &&
-		    !po->has_vnet_hdr &&
-		    !packet_extra_vlan_len_allowed(dev, skb))
-			tp_len = -EMSGSIZE;
-
-		if (unlikely(tp_len < 0)) {
+			if (tp_len >= 0) {
+				/* we assume the socket was initially writeable ... */
+				if (likely(len_sum > 0))
+					err = len_sum;
+				goto out_status;
+			}
 tpacket_error:
 			if (po->tp_loss) {
 				__packet_set_status(po, ph,
 						TP_STATUS_AVAILABLE);
 				packet_increment_head(&po->tx_ring);
-				kfree_skb(skb);
 				continue;
 			} else {
 				status = TP_STATUS_WRONG_FORMAT;
@@ -2844,14 +3279,6 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 			}
 		}
 
-		if (po->has_vnet_hdr) {
-			if (virtio_net_hdr_to_skb(skb, vnet_hdr, vio_le())) {
-				tp_len = -EINVAL;
-				goto tpacket_error;
-			}
-			virtio_net_hdr_set_proto(skb, vnet_hdr);
-		}
-
 		skb->destructor = tpacket_destruct_skb;
 		__packet_set_status(po, ph, TP_STATUS_SENDING);
 		packet_inc_pending(&po->tx_ring);
@@ -4238,7 +4665,14 @@ static __poll_t packet_poll(struct file *file, struct socket *sock,
 	packet_rcv_try_clear_pressure(po);
 	spin_unlock_bh(&sk->sk_receive_queue.lock);
 	spin_lock_bh(&sk->sk_write_queue.lock);
-	if (po->tx_ring.pg_vec) {
+	if (po->tx_ring.tx_bdq.blks) {
+		struct tpacket_block_desc *pbd;
+
+		pbd = (struct tpacket_block_desc *)
+			po->tx_ring.pg_vec[po->tx_ring.head].buffer;
+		if (__packet_get_blk_status(pbd) == TP_STATUS_AVAILABLE)
+			mask |= EPOLLOUT | EPOLLWRNORM;
+	} else if (po->tx_ring.pg_vec) {
 		if (packet_current_frame(po, &po->tx_ring, TP_STATUS_AVAILABLE))
 			mask |= EPOLLOUT | EPOLLWRNORM;
 	}
@@ -4349,6 +4783,7 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 {
 	struct pgv *pg_vec = NULL;
 	struct packet_sock *po = pkt_sk(sk);
+	struct tpacket_tx_blk *tx_blks = NULL;
 	unsigned long *rx_owner_map = NULL;
 	int was_running, order = 0;
 	struct packet_ring_buffer *rb;
@@ -4420,18 +4855,27 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 			goto out;
 		switch (po->tp_version) {
 		case TPACKET_V3:
-			/* Block transmit is not supported yet */
 			if (!tx_ring) {
 				init_prb_bdqc(po, rb, pg_vec, req_u);
 			} else {
 				struct tpacket_req3 *req3 = &req_u->req3;
 
+				err = -EINVAL;
 				if (req3->tp_retire_blk_tov ||
 				    req3->tp_sizeof_priv ||
-				    req3->tp_feature_req_word) {
-					err = -EINVAL;
+				    (req3->tp_feature_req_word & ~TP_FT_REQ_TX_BLOCK))
+					goto out_free_pg_vec;
+				if (!(req3->tp_feature_req_word & TP_FT_REQ_TX_BLOCK))
+					break;
+
+				/* Blocks are sent whole, a frame per block */
+				if (req->tp_frame_size != req->tp_block_size)
+					goto out_free_pg_vec;
+				err = -ENOMEM;
+				tx_blks = kvcalloc(req->tp_block_nr,
+						   sizeof(*tx_blks), GFP_KERNEL);
+				if (!tx_blks)
 					goto out_free_pg_vec;
-				}
 			}
 			break;
 		default:
@@ -4466,12 +4910,17 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 
 	err = -EBUSY;
 	mutex_lock(&po->pg_vec_lock);
-	if (closing || atomic_read(&po->mapped) == 0) {
+	/* Skbs in flight may still point to V3 Tx blocks of the old ring */
+	if (closing || (atomic_read(&po->mapped) == 0 &&
+			(po->tp_version <= TPACKET_V2 ||
+			 !packet_read_pending(rb)))) {
 		err = 0;
 		spin_lock_bh(&rb_queue->lock);
 		swap(rb->pg_vec, pg_vec);
 		if (po->tp_version <= TPACKET_V2)
 			swap(rb->rx_owner_map, rx_owner_map);
+		else if (tx_ring)
+			tpacket_tx_bdq_swap(rb, &tx_blks, closing);
 		rb->frame_max = (req->tp_frame_nr - 1);
 		rb->head = 0;
 		rb->frame_size = req->tp_frame_size;
@@ -4505,6 +4954,7 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 out_free_pg_vec:
 	if (pg_vec) {
 		bitmap_free(rx_owner_map);
+		kvfree(tx_blks);
 		free_pg_vec(pg_vec, order, req->tp_block_nr);
 	}
 out:
@@ -56,6 +56,22 @@ struct pgv {
 	char *buffer;
 };
 
+/* A V3 Tx block being sent, completed once its last skb is gone */
+struct tpacket_tx_blk {
+	atomic_t		pending;
+	unsigned int		status;
+	struct page		*page;
+};
+
+/* Tx ring in V3 block mode, walked by tpacket_snd_blocks() */
+struct tpacket_tx_bdq {
+	struct tpacket_tx_blk	*blks;
+	struct tpacket_tx_blk	*cur;		/* open block, at head */
+	unsigned int		blk_len;
+	unsigned int		frame_off;	/* next frame to send */
+	unsigned int		pkts_left;
+};
+
 struct packet_ring_buffer {
 	struct pgv		*pg_vec;
 
@@ -74,6 +90,8 @@ struct packet_ring_buffer {
 		unsigned long			*rx_owner_map;
 		struct tpacket_kbdq_core	prb_bdqc;
 	};
+
+	struct tpacket_tx_bdq	tx_bdq;
 };
 
 extern struct mutex fanout_mutex;
@@ -18,6 +18,8 @@ static const struct snmp_mib tls_mib_list[] = {
 	SNMP_MIB_ITEM("TlsRxDevice", LINUX_MIB_TLSRXDEVICE),
 	SNMP_MIB_ITEM("TlsDecryptError", LINUX_MIB_TLSDECRYPTERROR),
 	SNMP_MIB_ITEM("TlsRxDeviceResync", LINUX_MIB_TLSRXDEVICERESYNC),
+	SNMP_MIB_ITEM("TlsRxZcTail", LINUX_MIB_TLSRXZCTAIL),
+	SNMP_MIB_ITEM("TlsRxZcRetry", LINUX_MIB_TLSRXZCRETRY),
 	SNMP_MIB_SENTINEL
 };
 
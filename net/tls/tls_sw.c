@@ -433,10 +433,9 @@ int tls_tx_records(struct sock *sk, int flags)
 	return rc;
 }
 
-static void tls_encrypt_done(struct crypto_async_request *req, int err)
+static void tls_encrypt_complete(struct sock *sk, struct aead_request *aead_req,
+				 int err, unsigned long tx_delay)
 {
-	struct aead_request *aead_req = (struct aead_request *)req;
-	struct sock *sk = req->data;
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_prot_info *prot = &tls_ctx->prot_info;
 	struct tls_sw_context_tx *ctx = tls_sw_ctx_tx(tls_ctx);
@@ -491,14 +490,67 @@ static void tls_encrypt_done(struct crypto_async_request *req, int err)
 
 	/* Schedule the transmission */
 	if (!test_and_set_bit(BIT_TX_SCHEDULED, &ctx->tx_bitmask))
-		schedule_delayed_work(&ctx->tx_work.work, 1);
+		schedule_delayed_work(&ctx->tx_work.work, tx_delay);
+}
+
+static void tls_encrypt_done(struct crypto_async_request *req, int err)
+{
+	/* Moved off the backlog, the final completion follows */
+	if (err == -EINPROGRESS)
+		return;
+
+	tls_encrypt_complete(req->data, (struct aead_request *)req, err, 1);
+}
+
+/* Encrypt the records queued by tls_do_encryption(), in order */
+static void tls_encrypt_work(struct work_struct *work)
+{
+	struct tls_sw_context_tx *ctx = container_of(work,
+						     struct tls_sw_context_tx,
+						     encrypt_work);
+	struct llist_node *head;
+	struct tls_rec *rec, *tmp;
+	int rc;
+
+	head = llist_reverse_order(llist_del_all(&ctx->encrypt_list));
+	llist_for_each_entry_safe(rec, tmp, head, encrypt_node) {
+		rc = crypto_aead_encrypt(&rec->aead_req);
+		/* An async AEAD completes through tls_encrypt_done() */
+		if (rc == -EINPROGRESS || rc == -EBUSY)
+			continue;
+
+		tls_encrypt_complete(rec->aead_req.base.data, &rec->aead_req,
+				     rc, 0);
+	}
+}
+
+static int tls_encrypt_async_wait(struct tls_sw_context_tx *ctx)
+{
+	int pending;
+
+	spin_lock_bh(&ctx->encrypt_compl_lock);
+	ctx->async_notify = true;
+
+	pending = atomic_read(&ctx->encrypt_pending);
+	spin_unlock_bh(&ctx->encrypt_compl_lock);
+	if (pending)
+		crypto_wait_req(-EINPROGRESS, &ctx->async_wait);
+	else
+		reinit_completion(&ctx->async_wait.completion);
+
+	/* There can be no concurrent accesses, since we have no
+	 * pending encrypt operations
+	 */
+	WRITE_ONCE(ctx->async_notify, false);
+
+	return ctx->async_wait.err;
 }
 
 static int tls_do_encryption(struct sock *sk,
 			     struct tls_context *tls_ctx,
 			     struct tls_sw_context_tx *ctx,
 			     struct aead_request *aead_req,
-			     size_t data_len, u32 start)
+			     size_t data_len, u32 start, bool offload)
 {
 	struct tls_prot_info *prot = &tls_ctx->prot_info;
 	struct tls_rec *rec = ctx->open_rec;
@@ -541,7 +593,13 @@ static int tls_do_encryption(struct sock *sk,
 	list_add_tail((struct list_head *)&rec->list, &ctx->tx_list);
 	atomic_inc(&ctx->encrypt_pending);
 
-	rc = crypto_aead_encrypt(aead_req);
+	if (offload) {
+		if (llist_add(&rec->encrypt_node, &ctx->encrypt_list))
+			queue_work(system_unbound_wq, &ctx->encrypt_work);
+		rc = -EINPROGRESS;
+	} else {
+		rc = crypto_aead_encrypt(aead_req);
+	}
 	if (!rc || rc != -EINPROGRESS) {
 		atomic_dec(&ctx->encrypt_pending);
 		sge->offset -= prot->prepend_size;
@@ -689,7 +747,7 @@ static int tls_push_record(struct sock *sk, int flags,
 	u32 i, split_point, orig_end;
 	struct sk_msg *msg_pl, *msg_en;
 	struct aead_request *req;
-	bool split;
+	bool split, offload;
 	int rc;
 
 	if (!rec)
@@ -774,8 +832,17 @@ static int tls_push_record(struct sock *sk, int flags,
 
 	tls_ctx->pending_open_record_frags = false;
 
+	/* A record followed by more data of the same write is encrypted by
+	 * tls_encrypt_work() while the caller builds the next one.  The
+	 * records go to TCP in order as they complete, from the pushes of
+	 * the next records or from tx_work_handler().
+	 */
+	offload = (flags & MSG_MORE) && !split;
+
 	rc = tls_do_encryption(sk, tls_ctx, ctx, req,
-			       msg_pl->sg.size + prot->tail_size, i);
+			       msg_pl->sg.size + prot->tail_size, i, offload);
+	if (offload && rc == -EINPROGRESS)
+		rc = 0;
 	if (rc < 0) {
 		if (rc != -EINPROGRESS) {
 			tls_err_abort(sk, -EBADMSG);
@@ -942,13 +1009,13 @@ int tls_sw_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 	struct sk_msg *msg_pl, *msg_en;
 	struct tls_rec *rec;
 	int required_size;
+	int tx_flags;
 	int num_async = 0;
 	bool full_record;
 	int record_room;
 	int num_zc = 0;
 	int orig_size;
 	int ret = 0;
-	int pending;
 
 	if (msg->msg_flags & ~(MSG_MORE | MSG_DONTWAIT | MSG_NOSIGNAL |
 			       MSG_CMSG_COMPAT))
@@ -1025,10 +1092,15 @@ int tls_sw_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 			num_zc++;
 			copied += try_to_copy;
 
+			/* More of the write follows, see tls_push_record() */
+			tx_flags = msg->msg_flags;
+			if (msg_data_left(msg))
+				tx_flags |= MSG_MORE;
+
 			sk_msg_sg_copy_set(msg_pl, first);
 			ret = bpf_exec_tx_verdict(msg_pl, sk, full_record,
 						  record_type, &copied,
-						  msg->msg_flags);
+						  tx_flags);
 			if (ret) {
 				if (ret == -EINPROGRESS)
 					num_async++;
@@ -1079,9 +1151,13 @@ int tls_sw_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 		tls_ctx->pending_open_record_frags = true;
 		copied += try_to_copy;
 		if (full_record || eor) {
+			tx_flags = msg->msg_flags;
+			if (msg_data_left(msg))
+				tx_flags |= MSG_MORE;
+
 			ret = bpf_exec_tx_verdict(msg_pl, sk, full_record,
 						  record_type, &copied,
-						  msg->msg_flags);
+						  tx_flags);
 			if (ret) {
 				if (ret == -EINPROGRESS)
 					num_async++;
@@ -1112,26 +1188,11 @@ int tls_sw_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 			goto alloc_encrypted;
 	}
 
-	if (!num_async) {
+	if (!num_async && !num_zc) {
 		goto send_end;
 	} else if (num_zc) {
 		/* Wait for pending encryptions to get completed */
-		spin_lock_bh(&ctx->encrypt_compl_lock);
-		ctx->async_notify = true;
-
-		pending = atomic_read(&ctx->encrypt_pending);
-		spin_unlock_bh(&ctx->encrypt_compl_lock);
-		if (pending)
-			crypto_wait_req(-EINPROGRESS, &ctx->async_wait);
-		else
-			reinit_completion(&ctx->async_wait.completion);
-
-		/* There can be no concurrent accesses, since we have no
-		 * pending encrypt operations
-		 */
-		WRITE_ONCE(ctx->async_notify, false);
-
-		if (ctx->async_wait.err) {
+		if (tls_encrypt_async_wait(ctx)) {
 			ret = ctx->async_wait.err;
 			copied = 0;
 		}
@@ -1144,6 +1205,11 @@ int tls_sw_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 	}
 
 send_end:
+	/* Don't return while the user pages of zerocopy records are still
+	 * being encrypted
+	 */
+	if (num_zc && atomic_read(&ctx->encrypt_pending))
+		tls_encrypt_async_wait(ctx);
 	ret = sk_stream_error(sk, msg->msg_flags, ret);
 
 	release_sock(sk);
@@ -1227,7 +1293,8 @@ static int tls_sw_do_sendpage(struct sock *sk, struct page *page,
 		tls_ctx->pending_open_record_frags = true;
 		if (full_record || eor || sk_msg_full(msg_pl)) {
 			ret = bpf_exec_tx_verdict(msg_pl, sk, full_record,
-						  record_type, &copied, flags);
+						  record_type, &copied,
+						  size ? flags | MSG_MORE : flags);
 			if (ret) {
 				if (ret == -EINPROGRESS)
 					num_async++;
@@ -1410,11 +1477,14 @@ static int tls_setup_from_iter(struct sock *sk, struct iov_iter *from,
  * out_iov or out_sg must be non-NULL. In case both out_iov and out_sg are
  * NULL, then the decryption happens inside skb buffers itself, i.e.
  * zero-copy gets disabled and 'zc' is updated.
+ * With out_iov, the last 'tail_len' bytes of the plaintext are decrypted
+ * into the kernel buffer 'tail' instead of the iov.
  */
 
 static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 			    struct iov_iter *out_iov,
 			    struct scatterlist *out_sg,
+			    u8 *tail, int tail_len,
 			    int *chunk, bool *zc, bool async)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
@@ -1433,8 +1503,9 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 
 	if (*zc && (out_iov || out_sg)) {
 		if (out_iov)
-			n_sgout = 1 +
-				iov_iter_npages_cap(out_iov, INT_MAX, data_len);
+			n_sgout = 1 + !!tail_len +
+				iov_iter_npages_cap(out_iov, INT_MAX,
+						    data_len - tail_len);
 		else
 			n_sgout = sg_nents(out_sg);
 		n_sgin = skb_nsg(skb, rxm->offset + prot->prepend_size,
@@ -1524,11 +1595,18 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 			sg_set_buf(&sgout[0], aad, prot->aad_size);
 
 			*chunk = 0;
-			err = tls_setup_from_iter(sk, out_iov, data_len,
+			err = tls_setup_from_iter(sk, out_iov,
+						  data_len - tail_len,
 						  &pages, chunk, &sgout[1],
-						  (n_sgout - 1));
+						  (n_sgout - 1 - !!tail_len));
 			if (err < 0)
 				goto fallback_to_reg_recv;
+
+			if (tail_len) {
+				sg_unmark_end(&sgout[pages]);
+				sg_set_buf(&sgout[pages + 1], tail, tail_len);
+				sg_mark_end(&sgout[pages + 1]);
+			}
 		} else if (out_sg) {
 			memcpy(sgout, out_sg, n_sgout * sizeof(*sgout));
 		} else {
@@ -1557,8 +1635,8 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 }
 
 static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
-			      struct iov_iter *dest, int *chunk, bool *zc,
-			      bool async)
+			      struct iov_iter *dest, u8 *tail, int tail_len,
+			      int *chunk, bool *zc, bool async)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
@@ -1575,8 +1653,9 @@ static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 
 		/* Still not decrypted after tls_device */
 		if (!ctx->decrypted) {
-			err = decrypt_internal(sk, skb, dest, NULL, chunk, zc,
-					       async);
+retry:
+			err = decrypt_internal(sk, skb, dest, NULL, tail,
+					       tail_len, chunk, zc, async);
 			if (err < 0) {
 				if (err == -EINPROGRESS)
 					tls_advance_record_sn(sk, prot,
@@ -1586,11 +1665,25 @@ static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 						      LINUX_MIB_TLSDECRYPTERROR);
 				return err;
 			}
+
+			/* The type of a TLS 1.3 record ends up in the tail.
+			 * Padded or non-data records are decrypted again in
+			 * place, the skb still holds the ciphertext.
+			 */
+			if (*zc && prot->tail_size &&
+			    tail[tail_len - 1] != TLS_RECORD_TYPE_DATA) {
+				TLS_INC_STATS(sock_net(sk),
+					      LINUX_MIB_TLSRXZCRETRY);
+				iov_iter_revert(dest, *chunk);
+				dest = NULL;
+				goto retry;
+			}
 		} else {
 			*zc = false;
 		}
 
-		pad = padding_length(ctx, prot, skb);
+		/* Zero-copy TLS 1.3 records were checked above */
+		pad = *zc ? 0 : padding_length(ctx, prot, skb);
 		if (pad < 0)
 			return pad;
 
@@ -1613,7 +1706,8 @@ int decrypt_skb(struct sock *sk, struct sk_buff *skb,
 	bool zc = true;
 	int chunk;
 
-	return decrypt_internal(sk, skb, NULL, sgout, &chunk, &zc, false);
+	return decrypt_internal(sk, skb, NULL, sgout, NULL, 0, &chunk, &zc,
+				false);
 }
 
 static bool tls_sw_advance_skb(struct sock *sk, struct sk_buff *skb,
@@ -1749,6 +1843,41 @@ static int process_rx_list(struct tls_sw_context_rx *ctx,
 	return copied;
 }
 
+/* Largest plaintext left over by a zero-copy decrypt for the next read */
+#define TLS_RX_ZC_TAIL_MAX	PAGE_SIZE
+
+/* With TLS_RX_ZEROCOPY, records are decrypted into the user buffer even if
+ * they do not fit in it, and TLS 1.3 records even though their type is
+ * only known once decrypted. What does not go to the user, the end of the
+ * plaintext and the TLS 1.3 type byte, is decrypted into a kernel tail:
+ * the context when only the type byte is left, else a new skb which is
+ * then retained on rx_list in place of the record.
+ */
+static bool tls_rx_zc_setup_tail(struct sock *sk, struct tls_prot_info *prot,
+				 int to_decrypt, size_t len,
+				 struct sk_buff **tail_skb, u8 **tail,
+				 int *tail_len)
+{
+	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_get_ctx(sk));
+	size_t over = (size_t)to_decrypt > len ? to_decrypt - len : 0;
+
+	if (over > TLS_RX_ZC_TAIL_MAX)
+		return false;
+
+	*tail_len = over + prot->tail_size;
+	if (!over) {
+		*tail = &ctx->zc_type;
+		return true;
+	}
+
+	*tail_skb = alloc_skb(*tail_len, sk->sk_allocation);
+	if (!*tail_skb)
+		return false;
+	*tail = skb_put(*tail_skb, *tail_len);
+
+	return true;
+}
+
 int tls_sw_recvmsg(struct sock *sk,
 		   struct msghdr *msg,
 		   size_t len,
@@ -1802,12 +1931,15 @@ int tls_sw_recvmsg(struct sock *sk,
 	timeo = sock_rcvtimeo(sk, flags & MSG_DONTWAIT);
 
 	while (len && (decrypted + copied < target || ctx->recv_pkt)) {
+		struct sk_buff *tail_skb = NULL;
 		bool retain_skb = false;
 		bool zc = false;
 		int to_decrypt;
 		int chunk = 0;
 		bool async_capable;
 		bool async = false;
+		u8 *tail = NULL;
+		int tail_len = 0;
 
 		skb = tls_wait_data(sk, psock, flags & MSG_DONTWAIT, timeo, &err);
 		if (!skb) {
@@ -1839,20 +1971,49 @@ int tls_sw_recvmsg(struct sock *sk,
 		    prot->version != TLS_1_3_VERSION &&
 		    !bpf_strp_enabled)
 			zc = true;
-
-		/* Do not use async mode if record is non-data */
-		if (ctx->control == TLS_RECORD_TYPE_DATA && !bpf_strp_enabled)
+		else if (tls_ctx->rx_zc && !ctx->decrypted && !num_async &&
+			 !is_kvec && !is_peek &&
+			 ctx->control == TLS_RECORD_TYPE_DATA &&
+			 !bpf_strp_enabled)
+			zc = tls_rx_zc_setup_tail(sk, prot, to_decrypt, len,
+						  &tail_skb, &tail, &tail_len);
+
+		/* Do not use async mode if record is non-data or has a tail */
+		if (ctx->control == TLS_RECORD_TYPE_DATA && !bpf_strp_enabled &&
+		    !tail_len)
 			async_capable = ctx->async_capable;
 		else
 			async_capable = false;
 
-		err = decrypt_skb_update(sk, skb, &msg->msg_iter,
+		err = decrypt_skb_update(sk, skb, &msg->msg_iter, tail, tail_len,
 					 &chunk, &zc, async_capable);
 		if (err < 0 && err != -EINPROGRESS) {
+			kfree_skb(tail_skb);
 			tls_err_abort(sk, -EBADMSG);
 			goto recv_end;
 		}
 
+		/* The rest of the plaintext is in the tail, which replaces the
+		 * record until it is retained below.
+		 */
+		if (tail_skb && zc) {
+			struct strp_msg *tail_rxm = strp_msg(tail_skb);
+
+			tail_rxm->offset = 0;
+			tail_rxm->full_len = tail_len - prot->tail_size;
+			tls_msg(tail_skb)->control = tlm->control;
+
+			consume_skb(skb);
+			ctx->recv_pkt = tail_skb;
+			skb = tail_skb;
+			rxm = tail_rxm;
+			tlm = tls_msg(tail_skb);
+			retain_skb = true;
+			TLS_INC_STATS(sock_net(sk), LINUX_MIB_TLSRXZCTAIL);
+		} else if (tail_skb) {
+			kfree_skb(tail_skb);
+		}
+
 		if (err == -EINPROGRESS) {
 			async = true;
 			num_async++;
@@ -2026,7 +2187,8 @@ ssize_t tls_sw_splice_read(struct socket *sock,  loff_t *ppos,
 		if (!skb)
 			goto splice_read_end;
 
-		err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc, false);
+		err = decrypt_skb_update(sk, skb, NULL, NULL, 0, &chunk, &zc,
+					 false);
 		if (err < 0) {
 			tls_err_abort(sk, -EBADMSG);
 			goto splice_read_end;
@@ -2197,6 +2359,8 @@ void tls_sw_release_resources_tx(struct sock *sk)
 
 	if (pending)
 		crypto_wait_req(-EINPROGRESS, &ctx->async_wait);
+	/* tls_encrypt_work() may still be running past the last record */
+	flush_work(&ctx->encrypt_work);
 
 	tls_tx_records(sk, -1);
 
@@ -2382,6 +2546,8 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 		INIT_LIST_HEAD(&sw_ctx_tx->tx_list);
 		INIT_DELAYED_WORK(&sw_ctx_tx->tx_work.work, tx_work_handler);
 		sw_ctx_tx->tx_work.sk = sk;
+		init_llist_head(&sw_ctx_tx->encrypt_list);
+		INIT_WORK(&sw_ctx_tx->encrypt_work, tls_encrypt_work);
 	} else {
 		crypto_init_wait(&sw_ctx_rx->async_wait);
 		spin_lock_init(&sw_ctx_rx->decrypt_compl_lock);
@@ -32,6 +32,27 @@
 
 #define TX_BATCH_SIZE 32
 
+/* Generic Tx state. The skb heads are bulk allocated ahead of time and the
+ * linear data is carved out of a page fragment cache, which is a lot
+ * cheaper than going through sock_alloc_send_skb() for every frame. The
+ * skbs of a batch are then handed to the driver under a single Tx lock
+ * with xmit_more set for all but the last one.
+ */
+struct xsk_tx_cache {
+	struct page_frag_cache nc;
+	u32 nr_heads;
+	void *heads[TX_BATCH_SIZE];
+	struct sk_buff *skbs[TX_BATCH_SIZE];
+	u32 cons[TX_BATCH_SIZE]; /* Tx ring position of each skb */
+	bool drop_contd; /* Skipping the rest of a dropped packet */
+};
+
+/* Completion addresses of a packet made of several descriptors */
+struct xsk_tx_addrs {
+	u32 nr;
+	u64 addrs[MAX_SKB_FRAGS + 1];
+};
+
 static DEFINE_PER_CPU(struct list_head, xskmap_flush_list);
 
 void xsk_set_rx_need_wakeup(struct xsk_buff_pool *pool)
@@ -141,7 +162,7 @@ static int __xsk_rcv_zc(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len)
 	int err;
 
 	addr = xp_get_handle(xskb);
-	err = xskq_prod_reserve_desc(xs->rx, addr, len);
+	err = xskq_prod_reserve_desc(xs->rx, addr, len, 0);
 	if (err) {
 		xs->rx_queue_full++;
 		return err;
@@ -169,6 +190,82 @@ static void xsk_copy_xdp(struct xdp_buff *to, struct xdp_buff *from, u32 len)
 	memcpy(to_buf, from_buf, len + metalen);
 }
 
+/* Copy a packet spanning several frames, linear part and fragments alike,
+ * into as many buffers as needed, chained with XDP_PKT_CONTD. Either the
+ * whole packet makes it to the Rx ring or none of it does.
+ */
+static int __xsk_rcv_sg(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len)
+{
+	struct xdp_buff *bufs[MAX_SKB_FRAGS + 1];
+	struct xsk_buff_pool *pool = xs->pool;
+	struct skb_shared_info *sinfo = NULL;
+	u32 frame_size, nb_bufs, copied, i;
+	u32 src_len, frag = 0;
+	void *src;
+
+	frame_size = xsk_pool_get_rx_frame_size(pool);
+	nb_bufs = DIV_ROUND_UP(len, frame_size);
+	if (nb_bufs > ARRAY_SIZE(bufs)) {
+		xs->rx_dropped++;
+		return -ENOSPC;
+	}
+
+	if (xskq_prod_nb_free(xs->rx, nb_bufs) < nb_bufs) {
+		xs->rx_queue_full++;
+		return -ENOBUFS;
+	}
+
+	for (i = 0; i < nb_bufs; i++) {
+		bufs[i] = xsk_buff_alloc(pool);
+		if (!bufs[i]) {
+			while (i--)
+				xsk_buff_free(bufs[i]);
+			xs->rx_dropped++;
+			return -ENOSPC;
+		}
+	}
+
+	if (xdp_buff_has_frags(xdp))
+		sinfo = xdp_get_shared_info_from_buff(xdp);
+
+	/* Metadata only goes with the first buffer */
+	src_len = xdp->data_end - xdp->data;
+	xsk_copy_xdp(bufs[0], xdp, 0);
+	src = xdp->data;
+
+	for (i = 0; i < nb_bufs; i++) {
+		struct xdp_buff_xsk *xskb;
+		u32 buf_len = min(len, frame_size);
+		void *dst = bufs[i]->data;
+
+		for (copied = 0; copied < buf_len; ) {
+			u32 copy;
+
+			while (!src_len) {
+				skb_frag_t *f = &sinfo->frags[frag++];
+
+				src = skb_frag_address(f);
+				src_len = skb_frag_size(f);
+			}
+
+			copy = min(src_len, buf_len - copied);
+			memcpy(dst + copied, src, copy);
+			copied += copy;
+			src += copy;
+			src_len -= copy;
+		}
+		len -= buf_len;
+
+		xskb = container_of(bufs[i], struct xdp_buff_xsk, xdp);
+		/* Room was checked above */
+		xskq_prod_reserve_desc(xs->rx, xp_get_handle(xskb), buf_len,
+				       len ? XDP_PKT_CONTD : 0);
+		xp_release(xskb);
+	}
+
+	return 0;
+}
+
 static int __xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp)
 {
 	struct xdp_buff *xsk_xdp;
@@ -176,7 +273,10 @@ static int __xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp)
 	u32 len;
 
 	len = xdp->data_end - xdp->data;
-	if (len > xsk_pool_get_rx_frame_size(xs->pool)) {
+	if (unlikely(xdp_buff_has_frags(xdp) ||
+		     len > xsk_pool_get_rx_frame_size(xs->pool))) {
+		if (xs->pool->sg)
+			return __xsk_rcv_sg(xs, xdp, xdp_get_buff_len(xdp));
 		xs->rx_dropped++;
 		return -ENOSPC;
 	}
@@ -419,24 +519,86 @@ static void xsk_destruct_skb(struct sk_buff *skb)
 	sock_wfree(skb);
 }
 
-static struct sk_buff *xsk_build_skb_zerocopy(struct xdp_sock *xs,
-					      struct xdp_desc *desc)
+static void xsk_destruct_skb_sg(struct sk_buff *skb)
 {
-	struct xsk_buff_pool *pool = xs->pool;
-	u32 hr, len, ts, offset, copy, copied;
+	struct xsk_tx_addrs *tx_addrs = skb_shinfo(skb)->destructor_arg;
+	struct xdp_sock *xs = xdp_sk(skb->sk);
+	unsigned long flags;
+	u32 i;
+
+	spin_lock_irqsave(&xs->pool->cq_lock, flags);
+	for (i = 0; i < tx_addrs->nr; i++)
+		xskq_prod_submit_addr(xs->pool->cq, tx_addrs->addrs[i]);
+	spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
+
+	kfree(tx_addrs);
+	sock_wfree(skb);
+}
+
+static struct sk_buff *xsk_alloc_skb(struct xdp_sock *xs, u32 size, int *err)
+{
+	struct xsk_tx_cache *cache = xs->tx_cache;
+	struct sock *sk = &xs->sk;
+	unsigned int fragsz;
 	struct sk_buff *skb;
-	struct page *page;
-	void *buffer;
-	int err, i;
-	u64 addr;
+	void *data;
+
+	fragsz = SKB_DATA_ALIGN(size) +
+		 SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+
+	/* Let the regular allocator deal with a full send buffer */
+	if (!cache || fragsz > PAGE_SIZE ||
+	    sk_wmem_alloc_get(sk) >= READ_ONCE(sk->sk_sndbuf))
+		goto fallback;
+
+	if (!cache->nr_heads) {
+		cache->nr_heads = kmem_cache_alloc_bulk(skbuff_head_cache,
+							GFP_KERNEL,
+							TX_BATCH_SIZE,
+							cache->heads);
+		if (unlikely(!cache->nr_heads))
+			goto fallback;
+	}
 
-	hr = max(NET_SKB_PAD, L1_CACHE_ALIGN(xs->dev->needed_headroom));
+	data = page_frag_alloc(&cache->nc, fragsz, GFP_KERNEL);
+	if (unlikely(!data))
+		goto fallback;
 
-	skb = sock_alloc_send_skb(&xs->sk, hr, 1, &err);
-	if (unlikely(!skb))
-		return ERR_PTR(err);
+	skb = build_skb_around(cache->heads[--cache->nr_heads], data, fragsz);
+	skb_set_owner_w(skb, sk);
 
-	skb_reserve(skb, hr);
+	return skb;
+
+fallback:
+	return sock_alloc_send_skb(sk, size, 1, err);
+}
+
+static void xsk_free_tx_cache(struct xdp_sock *xs)
+{
+	struct xsk_tx_cache *cache = xs->tx_cache;
+
+	if (!cache)
+		return;
+
+	if (cache->nr_heads)
+		kmem_cache_free_bulk(skbuff_head_cache, cache->nr_heads,
+				     cache->heads);
+	if (cache->nc.va)
+		__page_frag_cache_drain(virt_to_head_page(cache->nc.va),
+					cache->nc.pagecnt_bias);
+	kfree(cache);
+	xs->tx_cache = NULL;
+}
+
+static int xsk_skb_add_umem_frags(struct xdp_sock *xs, struct sk_buff *skb,
+				  struct xdp_desc *desc)
+{
+	struct xsk_buff_pool *pool = xs->pool;
+	u32 len, ts, offset, copy, copied;
+	struct page *page;
+	void *buffer;
+	u64 addr;
+	int i;
 
 	addr = desc->addr;
 	len = desc->len;
@@ -446,7 +608,11 @@ static struct sk_buff *xsk_build_skb_zerocopy(struct xdp_sock *xs,
 	offset = offset_in_page(buffer);
 	addr = buffer - pool->addrs;
 
-	for (copied = 0, i = 0; copied < len; i++) {
+	if (skb_shinfo(skb)->nr_frags + DIV_ROUND_UP(offset + len, PAGE_SIZE) >
+	    MAX_SKB_FRAGS)
+		return -EOVERFLOW;
+
+	for (copied = 0, i = skb_shinfo(skb)->nr_frags; copied < len; i++) {
 		page = pool->umem->pgs[addr >> PAGE_SHIFT];
 		get_page(page);
 
@@ -464,9 +630,98 @@ static struct sk_buff *xsk_build_skb_zerocopy(struct xdp_sock *xs,
 
 	refcount_add(ts, &xs->sk.sk_wmem_alloc);
 
+	return 0;
+}
+
+static struct sk_buff *xsk_build_skb_zerocopy(struct xdp_sock *xs,
+					      struct xdp_desc *desc)
+{
+	struct sk_buff *skb;
+	int err;
+	u32 hr;
+
+	hr = max(NET_SKB_PAD, L1_CACHE_ALIGN(xs->dev->needed_headroom));
+
+	skb = sock_alloc_send_skb(&xs->sk, hr, 1, &err);
+	if (unlikely(!skb))
+		return ERR_PTR(err);
+
+	skb_reserve(skb, hr);
+
+	err = xsk_skb_add_umem_frags(xs, skb, desc);
+	if (unlikely(err)) {
+		kfree_skb(skb);
+		return ERR_PTR(err);
+	}
+
 	return skb;
 }
 
+/* Append the next buffer of a multi-buffer packet to its skb */
+static int xsk_skb_add_copy_frag(struct xdp_sock *xs, struct sk_buff *skb,
+				 struct xdp_desc *desc)
+{
+	struct page *page;
+	void *data;
+
+	if (skb_shinfo(skb)->nr_frags >= MAX_SKB_FRAGS)
+		return -EOVERFLOW;
+
+	data = page_frag_alloc(&xs->tx_cache->nc, desc->len, GFP_KERNEL);
+	if (unlikely(!data))
+		return -ENOMEM;
+
+	memcpy(data, xsk_buff_raw_get_data(xs->pool, desc->addr), desc->len);
+
+	page = virt_to_head_page(data);
+	skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags, page,
+			data - page_address(page), desc->len, desc->len);
+	refcount_add(desc->len, &xs->sk.sk_wmem_alloc);
+
+	return 0;
+}
+
+static int xsk_skb_add_desc(struct xdp_sock *xs, struct sk_buff *skb,
+			    struct xdp_desc *desc)
+{
+	struct xsk_tx_addrs *tx_addrs;
+	int err;
+
+	if (skb->destructor != xsk_destruct_skb_sg) {
+		tx_addrs = kmalloc(sizeof(*tx_addrs), GFP_KERNEL);
+		if (!tx_addrs)
+			return -ENOMEM;
+
+		tx_addrs->nr = 1;
+		tx_addrs->addrs[0] = (u64)(long)skb_shinfo(skb)->destructor_arg;
+		skb_shinfo(skb)->destructor_arg = tx_addrs;
+		skb->destructor = xsk_destruct_skb_sg;
+	} else {
+		tx_addrs = skb_shinfo(skb)->destructor_arg;
+	}
+
+	if (xs->dev->priv_flags & IFF_TX_SKB_NO_LINEAR)
+		err = xsk_skb_add_umem_frags(xs, skb, desc);
+	else
+		err = xsk_skb_add_copy_frag(xs, skb, desc);
+	if (err)
+		return err;
+
+	tx_addrs->addrs[tx_addrs->nr++] = desc->addr;
+	return 0;
+}
+
+static u32 xsk_skb_nr_descs(struct sk_buff *skb)
+{
+	struct xsk_tx_addrs *tx_addrs;
+
+	if (skb->destructor != xsk_destruct_skb_sg)
+		return 1;
+
+	tx_addrs = skb_shinfo(skb)->destructor_arg;
+	return tx_addrs->nr;
+}
+
 static struct sk_buff *xsk_build_skb(struct xdp_sock *xs,
 				     struct xdp_desc *desc)
 {
@@ -486,7 +741,7 @@ static struct sk_buff *xsk_build_skb(struct xdp_sock *xs,
 		tr = dev->needed_tailroom;
 		len = desc->len;
 
-		skb = sock_alloc_send_skb(&xs->sk, hr + len + tr, 1, &err);
+		skb = xsk_alloc_skb(xs, hr + len + tr, &err);
 		if (unlikely(!skb))
 			return ERR_PTR(err);
 
@@ -510,38 +765,299 @@ static struct sk_buff *xsk_build_skb(struct xdp_sock *xs,
 	return skb;
 }
 
-static int xsk_generic_xmit(struct sock *sk)
+/* Hand a batch of skbs to the driver under a single Tx lock. Returns the
+ * number of skbs consumed by the driver, @ret holding the status of the
+ * last attempt. The skbs that were not consumed are still owned by the
+ * caller.
+ */
+static u32 xsk_direct_xmit_batch(struct xdp_sock *xs, struct sk_buff **skbs,
+				 u32 nb_skbs, int *ret)
 {
-	struct xdp_sock *xs = xdp_sk(sk);
-	u32 max_batch = TX_BATCH_SIZE;
-	bool sent_frame = false;
+	struct net_device *dev = xs->dev;
+	struct netdev_queue *txq;
+	u32 i;
+
+	txq = netdev_get_tx_queue(dev, xs->queue_id);
+
+	local_bh_disable();
+	dev_xmit_recursion_inc();
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+
+	*ret = NETDEV_TX_BUSY;
+	for (i = 0; i < nb_skbs; i++) {
+		if (netif_xmit_frozen_or_drv_stopped(txq)) {
+			*ret = NETDEV_TX_BUSY;
+			break;
+		}
+
+		*ret = netdev_start_xmit(skbs[i], dev, txq, i + 1 < nb_skbs);
+		if (!dev_xmit_complete(*ret))
+			break;
+	}
+
+	HARD_TX_UNLOCK(dev, txq);
+	dev_xmit_recursion_dec();
+	local_bh_enable();
+
+	return i;
+}
+
+static void xsk_cq_cancel(struct xdp_sock *xs, u32 nb_entries)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&xs->pool->cq_lock, flags);
+	while (nb_entries--)
+		xskq_prod_cancel(xs->pool->cq);
+	spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
+}
+
+static void xsk_cancel_skbs(struct xdp_sock *xs, struct sk_buff **skbs,
+			    u32 nb_skbs)
+{
+	u32 i;
+
+	for (i = 0; i < nb_skbs; i++) {
+		xsk_cq_cancel(xs, xsk_skb_nr_descs(skbs[i]));
+		if (skbs[i]->destructor == xsk_destruct_skb_sg)
+			kfree(skb_shinfo(skbs[i])->destructor_arg);
+		skbs[i]->destructor = sock_wfree;
+		/* Free skb without triggering the perf drop trace */
+		consume_skb(skbs[i]);
+	}
+}
+
+/* Run the checks __dev_direct_xmit() does on an skb of the batch. If the
+ * skb is dropped, its descriptors are completed when @complete is set,
+ * otherwise their completion slots are given back so that the packet can
+ * be read from the Tx ring again.
+ */
+static bool xsk_validate_skb(struct xdp_sock *xs, struct sk_buff *skb,
+			     bool complete)
+{
+	void (*destructor)(struct sk_buff *skb) = skb->destructor;
+	void *arg = skb_shinfo(skb)->destructor_arg;
+	u32 nr_descs = xsk_skb_nr_descs(skb);
+	struct sk_buff *segs;
+	bool again = false;
+
+	if (!complete)
+		skb->destructor = sock_wfree;
+
+	segs = validate_xmit_skb_list(skb, xs->dev, &again);
+	if (likely(segs == skb)) {
+		skb->destructor = destructor;
+		return true;
+	}
+
+	/* skb was consumed */
+	atomic_long_inc(&xs->dev->tx_dropped);
+	kfree_skb_list(segs);
+	if (!complete) {
+		xsk_cq_cancel(xs, nr_descs);
+		if (destructor == xsk_destruct_skb_sg)
+			kfree(arg);
+	}
+	return false;
+}
+
+/* Read the next Tx descriptor, refreshing the producer once the cached
+ * entries are used up. The consumer must not be published beyond a
+ * descriptor that might have to be given back, that is only done once the
+ * batch is sent.
+ */
+static bool xsk_tx_read_desc(struct xdp_sock *xs, struct xdp_desc *desc)
+{
+	if (xskq_cons_read_desc(xs->tx, desc, xs->pool))
+		return true;
+
+	__xskq_cons_peek(xs->tx);
+	return xskq_cons_read_desc(xs->tx, desc, xs->pool);
+}
+
+/* Complete a dropped descriptor in its reserved completion slot */
+static void xsk_cq_submit(struct xdp_sock *xs, u64 addr)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&xs->pool->cq_lock, flags);
+	xskq_prod_submit_addr(xs->pool->cq, addr);
+	spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
+}
+
+/* Build up to a batch of skbs from the Tx ring, reserving room for their
+ * completions, and send them in one go. The descriptors are only released
+ * once the driver took the skbs, on NETDEV_TX_BUSY the ring is rewound to
+ * the first skb that was not sent so that user-space can retry. A packet
+ * made of several descriptors is only sent once all of them are in the
+ * ring. A dropped packet is only completed at the head of a batch, so
+ * that the ring is never rewound behind a completed descriptor.
+ */
+static int xsk_generic_xmit_batch(struct xdp_sock *xs, bool *sent_frame)
+{
+	struct xsk_tx_cache *cache = xs->tx_cache;
+	struct net_device *dev = xs->dev;
+	struct sk_buff **skbs = cache->skbs;
+	u32 nb_skbs = 0, chain_cons = 0, sent, i;
+	struct sk_buff *skb = NULL;
 	struct xdp_desc desc;
-	struct sk_buff *skb;
 	unsigned long flags;
-	int err = 0;
+	int err = 0, ret;
 
-	mutex_lock(&xs->mutex);
+	if (!xskq_cons_nb_entries(xs->tx, 1)) {
+		xs->tx->queue_empty_descs++;
+		return 0;
+	}
 
-	/* Since we dropped the RCU read lock, the socket state might have changed. */
-	if (unlikely(!xsk_is_bound(xs))) {
-		err = -ENXIO;
-		goto out;
+	while (xsk_tx_read_desc(xs, &desc)) {
+		if (!skb && nb_skbs == TX_BATCH_SIZE)
+			break;
+
+		/* This is the backpressure mechanism for the Tx path.
+		 * Reserve space in the completion queue and only proceed
+		 * if there is space in it. This avoids having to implement
+		 * any buffering in the Tx path.
+		 */
+		spin_lock_irqsave(&xs->pool->cq_lock, flags);
+		if (xskq_prod_reserve(xs->pool->cq)) {
+			spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
+			break;
+		}
+		spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
+
+		if (unlikely(cache->drop_contd)) {
+			/* The rest of a dropped packet, at the head of a batch */
+			cache->drop_contd = desc.options & XDP_PKT_CONTD;
+			xs->tx->invalid_descs++;
+			xsk_cq_submit(xs, desc.addr);
+			xskq_cons_release(xs->tx);
+			continue;
+		}
+
+		if (!skb) {
+			chain_cons = xs->tx->cached_cons;
+			skb = xsk_build_skb(xs, &desc);
+			if (IS_ERR(skb)) {
+				err = PTR_ERR(skb);
+				skb = NULL;
+			}
+		} else {
+			err = xsk_skb_add_desc(xs, skb, &desc);
+		}
+
+		if (unlikely(err == -EOVERFLOW)) {
+			err = 0;
+			if (nb_skbs) {
+				/* Send the batch, the drop heads the next one */
+				xsk_cq_cancel(xs, 1);
+				if (skb)
+					xsk_cancel_skbs(xs, &skb, 1);
+				skb = NULL;
+				xs->tx->cached_cons = chain_cons;
+				break;
+			}
+
+			/* Too many buffers for an skb, drop the whole packet.
+			 * Its descriptors so far are completed by the skb,
+			 * this one and the rest of the packet right here.
+			 */
+			if (skb)
+				kfree_skb(skb);
+			skb = NULL;
+			cache->drop_contd = desc.options & XDP_PKT_CONTD;
+			xs->tx->invalid_descs++;
+			xsk_cq_submit(xs, desc.addr);
+			xskq_cons_release(xs->tx);
+			continue;
+		}
+		if (unlikely(err)) {
+			xsk_cq_cancel(xs, 1);
+			break;
+		}
+
+		xskq_cons_release(xs->tx);
+		if (desc.options & XDP_PKT_CONTD)
+			continue;
+
+		if (unlikely(!xsk_validate_skb(xs, skb, !nb_skbs))) {
+			skb = NULL;
+			if (nb_skbs) {
+				/* Send the batch, the drop heads the next one */
+				xs->tx->cached_cons = chain_cons;
+			} else {
+				err = -EBUSY;
+			}
+			break;
+		}
+
+		skb_set_queue_mapping(skb, xs->queue_id);
+		cache->cons[nb_skbs] = chain_cons;
+		skbs[nb_skbs++] = skb;
+		skb = NULL;
 	}
 
-	if (xs->queue_id >= xs->dev->real_num_tx_queues)
+	if (skb) {
+		/* Wait for the rest of the packet */
+		xs->tx->cached_cons = chain_cons;
+		xsk_cancel_skbs(xs, &skb, 1);
+		if (!err)
+			xs->tx->queue_empty_descs++;
+	}
+
+	if (!nb_skbs)
+		goto out;
+
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev))) {
+		/* The skbs are completed but not sent */
+		atomic_long_add(nb_skbs, &dev->tx_dropped);
+		for (i = 0; i < nb_skbs; i++)
+			kfree_skb(skbs[i]);
+		err = -EBUSY;
 		goto out;
+	}
+
+	sent = xsk_direct_xmit_batch(xs, skbs, nb_skbs, &ret);
+	if (sent)
+		*sent_frame = true;
+
+	if (sent < nb_skbs) {
+		/* Tell user-space to retry the send */
+		xs->tx->cached_cons = cache->cons[sent];
+		xsk_cancel_skbs(xs, skbs + sent, nb_skbs - sent);
+		err = -EAGAIN;
+	} else if (!err && ret == NET_XMIT_DROP) {
+		/* Ignore NET_XMIT_CN as packet might have been sent */
+		err = -EBUSY;
+	}
+
+out:
+	/* Have user-space send again while there is anything left */
+	if (!err && xskq_cons_nb_entries(xs->tx, 1))
+		err = -EAGAIN;
+	__xskq_cons_release(xs->tx);
+	return err;
+}
+
+/* Send frame by frame when the batch state can't be allocated */
+static int xsk_generic_xmit_single(struct xdp_sock *xs, bool *sent_frame)
+{
+	u32 max_batch = TX_BATCH_SIZE;
+	struct xdp_desc desc;
+	struct sk_buff *skb;
+	unsigned long flags;
+	int err = 0;
 
 	while (xskq_cons_peek_desc(xs->tx, &desc, xs->pool)) {
-		if (max_batch-- == 0) {
-			err = -EAGAIN;
-			goto out;
-		}
+		if (max_batch-- == 0)
+			return -EAGAIN;
+
+		/* Only the batch path builds packets of several buffers */
+		if (desc.options & XDP_PKT_CONTD)
+			return -ENOMEM;
 
 		skb = xsk_build_skb(xs, &desc);
-		if (IS_ERR(skb)) {
-			err = PTR_ERR(skb);
-			goto out;
-		}
+		if (IS_ERR(skb))
+			return PTR_ERR(skb);
 
 		/* This is the backpressure mechanism for the Tx path.
 		 * Reserve space in the completion queue and only proceed
@@ -552,7 +1068,7 @@ static int xsk_generic_xmit(struct sock *sk)
 		if (xskq_prod_reserve(xs->pool->cq)) {
 			spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
 			kfree_skb(skb);
-			goto out;
+			return 0;
 		}
 		spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
 
@@ -565,22 +1081,46 @@ static int xsk_generic_xmit(struct sock *sk)
 			spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
 			/* Free skb without triggering the perf drop trace */
 			consume_skb(skb);
-			err = -EAGAIN;
-			goto out;
+			return -EAGAIN;
 		}
 
 		xskq_cons_release(xs->tx);
 		/* Ignore NET_XMIT_CN as packet might have been sent */
 		if (err == NET_XMIT_DROP) {
 			/* SKB completed but not sent */
-			err = -EBUSY;
-			goto out;
+			return -EBUSY;
 		}
 
-		sent_frame = true;
+		*sent_frame = true;
 	}
 
 	xs->tx->queue_empty_descs++;
+	return 0;
+}
+
+static int xsk_generic_xmit(struct sock *sk)
+{
+	struct xdp_sock *xs = xdp_sk(sk);
+	bool sent_frame = false;
+	int err = 0;
+
+	mutex_lock(&xs->mutex);
+
+	/* Since we dropped the RCU read lock, the socket state might have changed. */
+	if (unlikely(!xsk_is_bound(xs))) {
+		err = -ENXIO;
+		goto out;
+	}
+
+	if (xs->queue_id >= xs->dev->real_num_tx_queues)
+		goto out;
+
+	if (!xs->tx_cache)
+		xs->tx_cache = kzalloc(sizeof(*xs->tx_cache), GFP_KERNEL);
+	if (xs->tx_cache)
+		err = xsk_generic_xmit_batch(xs, &sent_frame);
+	else
+		err = xsk_generic_xmit_single(xs, &sent_frame);
 
 out:
 	if (sent_frame)
@@ -883,7 +1423,7 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 
 	flags = sxdp->sxdp_flags;
 	if (flags & ~(XDP_SHARED_UMEM | XDP_COPY | XDP_ZEROCOPY |
-		      XDP_USE_NEED_WAKEUP))
+		      XDP_USE_NEED_WAKEUP | XDP_USE_SG))
 		return -EINVAL;
 
 	rtnl_lock();
@@ -911,7 +1451,7 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 		struct socket *sock;
 
 		if ((flags & XDP_COPY) || (flags & XDP_ZEROCOPY) ||
-		    (flags & XDP_USE_NEED_WAKEUP)) {
+		    (flags & XDP_USE_NEED_WAKEUP) || (flags & XDP_USE_SG)) {
 			/* Cannot specify flags for shared sockets. */
 			err = -EINVAL;
 			goto out_unlock;
@@ -948,6 +1488,7 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 				goto out_unlock;
 			}
 
+			xs->pool->sg = umem_xs->pool->sg;
 			err = xp_assign_dev_shared(xs->pool, umem_xs->umem,
 						   dev, qid);
 			if (err) {
@@ -1375,6 +1916,8 @@ static void xsk_destruct(struct sock *sk)
 	if (!sock_flag(sk, SOCK_DEAD))
 		return;
 
+	xsk_free_tx_cache(xs);
+
 	if (!xp_put_pool(xs->pool))
 		xdp_put_umem(xs->umem, !xs->pool);
 
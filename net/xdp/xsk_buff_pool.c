@@ -147,6 +147,14 @@ int xp_assign_dev(struct xsk_buff_pool *pool,
 	if (force_zc && force_copy)
 		return -EINVAL;
 
+	/* Multi-buffer packets are only handled in copy mode. */
+	if (flags & XDP_USE_SG) {
+		if (force_zc)
+			return -EOPNOTSUPP;
+		pool->sg = true;
+		force_copy = true;
+	}
+
 	if (xsk_get_pool_from_qid(netdev, queue_id))
 		return -EBUSY;
 
@@ -216,6 +224,8 @@ int xp_assign_dev_shared(struct xsk_buff_pool *pool, struct xdp_umem *umem,
 	flags = umem->zc ? XDP_ZEROCOPY : XDP_COPY;
 	if (pool->uses_need_wakeup)
 		flags |= XDP_USE_NEED_WAKEUP;
+	if (pool->sg)
+		flags |= XDP_USE_SG;
 
 	return xp_assign_dev(pool, dev, queue_id, flags);
 }
@@ -129,6 +129,16 @@ static inline bool xskq_cons_read_addr_unchecked(struct xsk_queue *q, u64 *addr)
 	return false;
 }
 
+static inline bool xp_validate_desc_options(struct xsk_buff_pool *pool,
+					    struct xdp_desc *desc)
+{
+	if (desc->options & XDP_PKT_CONTD)
+		return pool->sg && desc->len &&
+		       !(desc->options & ~XDP_PKT_CONTD);
+
+	return !desc->options;
+}
+
 static inline bool xp_aligned_validate_desc(struct xsk_buff_pool *pool,
 					    struct xdp_desc *desc)
 {
@@ -144,9 +154,7 @@ static inline bool xp_aligned_validate_desc(struct xsk_buff_pool *pool,
 	if (chunk >= pool->addrs_cnt)
 		return false;
 
-	if (desc->options)
-		return false;
-	return true;
+	return xp_validate_desc_options(pool, desc);
 }
 
 static inline bool xp_unaligned_validate_desc(struct xsk_buff_pool *pool,
@@ -164,9 +172,7 @@ static inline bool xp_unaligned_validate_desc(struct xsk_buff_pool *pool,
 	    xp_desc_crosses_non_contig_pg(pool, addr, desc->len))
 		return false;
 
-	if (desc->options)
-		return false;
-	return true;
+	return xp_validate_desc_options(pool, desc);
 }
 
 static inline bool xp_validate_desc(struct xsk_buff_pool *pool,
@@ -376,7 +382,7 @@ static inline u32 xskq_prod_reserve_addr_batch(struct xsk_queue *q, struct xdp_d
 }
 
 static inline int xskq_prod_reserve_desc(struct xsk_queue *q,
-					 u64 addr, u32 len)
+					 u64 addr, u32 len, u32 flags)
 {
 	struct xdp_rxtx_ring *ring = (struct xdp_rxtx_ring *)q->ring;
 	u32 idx;
@@ -388,6 +394,7 @@ static inline int xskq_prod_reserve_desc(struct xsk_queue *q,
 	idx = q->cached_prod++ & q->ring_mask;
 	ring->desc[idx].addr = addr;
 	ring->desc[idx].len = len;
+	ring->desc[idx].options = flags;
 
 	return 0;
 }
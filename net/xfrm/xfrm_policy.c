@@ -149,6 +149,72 @@ struct xfrm_pol_inexact_candidates {
 	struct hlist_head *res[XFRM_POL_CAND_MAX];
 };
 
+/* Per-cpu cache of the results of xfrm_policy_lookup_bytype(), so that
+ * repeated lookups for the same flow skip the bydst chains and the
+ * inexact bins. Entries hold no reference on the policy, they are only
+ * valid while policy_cache_genid is unchanged, which is bumped whenever
+ * a policy is linked or unlinked.
+ */
+#define XFRM_POL_CACHE_BITS	7
+#define XFRM_POL_CACHE_SIZE	(1 << XFRM_POL_CACHE_BITS)
+
+struct xfrm_pol_cache_key {
+	xfrm_address_t		daddr;
+	xfrm_address_t		saddr;
+	__be16			dport;
+	__be16			sport;
+	u32			mark;
+	u32			if_id;
+	int			oif;
+	u16			family;
+	u8			proto;
+	u8			type;
+	u8			dir;
+	u8			pad[3];
+};
+
+struct xfrm_pol_cache_entry {
+	seqcount_t		seq;
+	u32			genid;
+	struct xfrm_policy	*pol;
+	struct xfrm_pol_cache_key key;
+};
+
+struct xfrm_pol_cache {
+	struct xfrm_pol_cache_entry ent[XFRM_POL_CACHE_SIZE];
+};
+
+/* Make all the cached lookup results stale, once the policy change that
+ * calls it is visible to the lookups.
+ */
+static void xfrm_pol_cache_flush(struct net *net)
+{
+	atomic_inc_return_release(&net->xfrm.policy_cache_genid);
+}
+
+/* The cache is only set up once the first policy is inserted, so that
+ * namespaces without IPsec do not pay for it. Without it, lookups just
+ * go the slow way.
+ */
+static void xfrm_pol_cache_alloc(struct net *net)
+{
+	struct xfrm_pol_cache __percpu *c;
+	int cpu, i;
+
+	if (READ_ONCE(net->xfrm.policy_cache))
+		return;
+
+	c = alloc_percpu(struct xfrm_pol_cache);
+	if (!c)
+		return;
+	for_each_possible_cpu(cpu)
+		for (i = 0; i < XFRM_POL_CACHE_SIZE; i++)
+			seqcount_init(&per_cpu_ptr(c, cpu)->ent[i].seq);
+
+	if (cmpxchg(&net->xfrm.policy_cache, NULL, c))
+		free_percpu(c);
+}
+
 static DEFINE_SPINLOCK(xfrm_if_cb_lock);
 static struct xfrm_if_cb const __rcu *xfrm_if_cb __read_mostly;
 
@@ -1355,6 +1421,7 @@ static void xfrm_hash_rebuild(struct work_struct *work)
 
 out_unlock:
 	__xfrm_policy_inexact_flush(net);
+	xfrm_pol_cache_flush(net);
 	write_seqcount_end(&net->xfrm.xfrm_policy_hash_generation);
 	spin_unlock_bh(&net->xfrm.xfrm_policy_lock);
 
@@ -1575,6 +1642,8 @@ int xfrm_policy_insert(int dir, struct xfrm_policy *policy, int excl)
 	struct xfrm_policy *delpol;
 	struct hlist_head *chain;
 
+	xfrm_pol_cache_alloc(net);
+
 	spin_lock_bh(&net->xfrm.xfrm_policy_lock);
 	chain = policy_hash_bysel(net, &policy->selector, policy->family, dir);
 	if (chain)
@@ -2074,6 +2143,86 @@ xfrm_policy_eval_candidates(struct xfrm_pol_inexact_candidates *cand,
 	return prefer;
 }
 
+static bool xfrm_pol_cache_key_init(struct xfrm_pol_cache_key *k,
+				    const struct flowi *fl, u8 type,
+				    u16 family, u8 dir, u32 if_id)
+{
+	const union flowi_uli *uli;
+	size_t alen;
+
+	switch (family) {
+	case AF_INET:
+		uli = &fl->u.ip4.uli;
+		alen = sizeof(k->daddr.a4);
+		break;
+	case AF_INET6:
+		uli = &fl->u.ip6.uli;
+		alen = sizeof(k->daddr.a6);
+		break;
+	default:
+		return false;
+	}
+
+	memset(k, 0, sizeof(*k));
+	memcpy(&k->daddr, xfrm_flowi_daddr(fl, family), alen);
+	memcpy(&k->saddr, xfrm_flowi_saddr(fl, family), alen);
+	k->dport = xfrm_flowi_dport(fl, uli);
+	k->sport = xfrm_flowi_sport(fl, uli);
+	k->mark = fl->flowi_mark;
+	k->if_id = if_id;
+	k->oif = fl->flowi_oif;
+	k->family = family;
+	k->proto = fl->flowi_proto;
+	k->type = type;
+	k->dir = dir;
+	return true;
+}
+
+static u32 xfrm_pol_cache_hash(const struct xfrm_pol_cache_key *k)
+{
+	BUILD_BUG_ON(sizeof(*k) % sizeof(u32));
+
+	return jhash2((const u32 *)k, sizeof(*k) / sizeof(u32), 0) &
+	       (XFRM_POL_CACHE_SIZE - 1);
+}
+
+/* Returns true and the cached policy, which may be NULL, on a hit */
+static bool xfrm_pol_cache_lookup(struct xfrm_pol_cache __percpu *c,
+				  const struct xfrm_pol_cache_key *k,
+				  u32 hash, u32 genid,
+				  struct xfrm_policy **pol)
+{
+	struct xfrm_pol_cache_entry *e;
+	unsigned int seq;
+	bool hit;
+
+	/* Lookups may migrate, the seqcount also covers other cpus' caches */
+	e = &raw_cpu_ptr(c)->ent[hash];
+	do {
+		seq = read_seqcount_begin(&e->seq);
+		hit = e->genid == genid && !memcmp(&e->key, k, sizeof(*k));
+		*pol = e->pol;
+	} while (read_seqcount_retry(&e->seq, seq));
+
+	return hit;
+}
+
+static void xfrm_pol_cache_store(struct xfrm_pol_cache __percpu *c,
+				 const struct xfrm_pol_cache_key *k,
+				 u32 hash, u32 genid, struct xfrm_policy *pol)
+{
+	struct xfrm_pol_cache_entry *e;
+
+	local_bh_disable();
+	e = &this_cpu_ptr(c)->ent[hash];
+	raw_write_seqcount_begin(&e->seq);
+	e->key = *k;
+	e->pol = pol;
+	e->genid = genid;
+	raw_write_seqcount_end(&e->seq);
+	local_bh_enable();
+}
+
 static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 						     const struct flowi *fl,
 						     u16 family, u8 dir,
@@ -2081,10 +2230,13 @@ static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 {
 	struct xfrm_pol_inexact_candidates cand;
 	const xfrm_address_t *daddr, *saddr;
+	struct xfrm_pol_cache __percpu *cache;
 	struct xfrm_pol_inexact_bin *bin;
 	struct xfrm_policy *pol, *ret;
+	struct xfrm_pol_cache_key key;
 	struct hlist_head *chain;
 	unsigned int sequence;
+	u32 hash = 0, genid = 0;
 	int err;
 
 	daddr = xfrm_flowi_daddr(fl, family);
@@ -2093,6 +2245,23 @@ static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 		return NULL;
 
 	rcu_read_lock();
+	/* Results of labeled policies depend on the LSM, don't cache them */
+	cache = READ_ONCE(net->xfrm.policy_cache);
+	if (cache && (fl->flowi_secid || READ_ONCE(net->xfrm.policy_labeled) ||
+		      !xfrm_pol_cache_key_init(&key, fl, type, family, dir,
+					       if_id)))
+		cache = NULL;
+	if (cache) {
+		genid = atomic_read_acquire(&net->xfrm.policy_cache_genid);
+		hash = xfrm_pol_cache_hash(&key);
+		if (xfrm_pol_cache_lookup(cache, &key, hash, genid, &ret) &&
+		    (!ret || xfrm_pol_hold_rcu(ret))) {
+			XFRM_INC_STATS(net, LINUX_MIB_XFRMPOLCACHEHIT);
+			rcu_read_unlock();
+			return ret;
+		}
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMPOLCACHEMISS);
+	}
  retry:
 	do {
 		sequence = read_seqcount_begin(&net->xfrm.xfrm_policy_hash_generation);
@@ -2133,6 +2302,9 @@ static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 
 	if (ret && !xfrm_pol_hold_rcu(ret))
 		goto retry;
+
+	if (cache)
+		xfrm_pol_cache_store(cache, &key, hash, genid, ret);
 fail:
 	rcu_read_unlock();
 
@@ -2204,7 +2376,10 @@ static void __xfrm_policy_link(struct xfrm_policy *pol, int dir)
 
 	list_add(&pol->walk.all, &net->xfrm.policy_all);
 	net->xfrm.policy_count[dir]++;
+	if (pol->security)
+		net->xfrm.policy_labeled++;
 	xfrm_pol_hold(pol);
+	xfrm_pol_cache_flush(net);
 }
 
 static struct xfrm_policy *__xfrm_policy_unlink(struct xfrm_policy *pol,
@@ -2224,6 +2399,9 @@ static struct xfrm_policy *__xfrm_policy_unlink(struct xfrm_policy *pol,
 
 	list_del_init(&pol->walk.all);
 	net->xfrm.policy_count[dir]--;
+	if (pol->security)
+		net->xfrm.policy_labeled--;
+	xfrm_pol_cache_flush(net);
 
 	return pol;
 }
@@ -4104,6 +4282,8 @@ static void xfrm_policy_fini(struct net *net)
 	WARN_ON(!hlist_empty(net->xfrm.policy_byidx));
 	xfrm_hash_free(net->xfrm.policy_byidx, sz);
 
+	free_percpu(net->xfrm.policy_cache);
+
 	spin_lock_bh(&net->xfrm.xfrm_policy_lock);
 	list_for_each_entry_safe(b, t, &net->xfrm.inexact_bins, inexact_bins)
 		__xfrm_policy_inexact_prune_bin(b, true);
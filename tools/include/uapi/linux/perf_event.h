@@ -411,7 +411,8 @@ struct perf_event_attr {
 				inherit_thread :  1, /* children only inherit if cloned with CLONE_THREAD */
 				remove_on_exec :  1, /* event is removed from task on exec */
 				sigtrap        :  1, /* send synchronous SIGTRAP on event */
-				__reserved_1   : 26;
+				mmap_high_order:  1, /* back ring buffer data with high-order pages */
+				__reserved_1   : 25;
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -462,7 +463,13 @@ struct perf_event_attr {
 	__u16	sample_max_stack;
 	__u16	__reserved_2;
 	__u32	aux_sample_size;
-	__u32	__reserved_3;
+
+	/*
+	 * Minimum time in microseconds between two ring buffer wakeups.
+	 * Wakeups due to wakeup_events or wakeup_watermark within that
+	 * interval are batched and delivered by a timer.
+	 */
+	__u32	wakeup_interval;
 
 	/*
 	 * User provided data if sigtrap=1, passed back to user via
@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Benchmark parallel reads of cpu.stat over a large number of cgroups.
+ *
+ * Creates a flat set of child cgroups below a test cgroup, then lets a
+ * number of threads read cpu.stat of all of them concurrently while the
+ * parent's stats are also read, which exercises flush coalescing.
+ *
+ * Usage: rstat_bench [-n nr_cgroups] [-t nr_threads] [-l loops]
+ */
+
+#include <errno.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+#include "cgroup_util.h"
+
+static char *parent;
+static char **children;
+static int nr_cgroups = 10000;
+static int nr_threads = 16;
+static int loops = 10;
+
+struct reader {
+	pthread_t thread;
+	int idx;
+	long reads;
+	int err;
+};
+
+static void *reader_fn(void *arg)
+{
+	struct reader *r = arg;
+	char buf[PAGE_SIZE];
+	int i, j;
+
+	for (i = 0; i < loops; i++) {
+		/* stagger the threads so they hit different subtrees */
+		for (j = 0; j < nr_cgroups; j++) {
+			int k = (j + r->idx * (nr_cgroups / nr_threads)) %
+				nr_cgroups;
+
+			if (cg_read(children[k], "cpu.stat", buf, sizeof(buf))) {
+				r->err = errno;
+				return NULL;
+			}
+			r->reads++;
+		}
+
+		if (cg_read(parent, "cpu.stat", buf, sizeof(buf))) {
+			r->err = errno;
+			return NULL;
+		}
+		r->reads++;
+	}
+
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	char root[PATH_MAX];
+	struct reader *readers;
+	int ret = KSFT_FAIL;
+	long total = 0;
+	int created = 0, started;
+	double start, elapsed;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "n:t:l:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_cgroups = atoi(optarg);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n nr_cgroups] [-t nr_threads] [-l loops]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+
+	if (nr_cgroups <= 0 || nr_threads <= 0 || loops <= 0)
+		return KSFT_FAIL;
+
+	if (cg_find_unified_root(root, sizeof(root)))
+		ksft_exit_skip("cgroup v2 isn't mounted\n");
+
+	if (cg_read_strstr(root, "cgroup.controllers", "cpu") ||
+	    cg_write(root, "cgroup.subtree_control", "+cpu"))
+		ksft_exit_skip("cpu controller isn't available\n");
+
+	parent = cg_name(root, "rstat_bench");
+	children = calloc(nr_cgroups, sizeof(*children));
+	readers = calloc(nr_threads, sizeof(*readers));
+	if (!parent || !children || !readers)
+		goto cleanup;
+
+	if (cg_create(parent))
+		goto cleanup;
+
+	for (created = 0; created < nr_cgroups; created++) {
+		children[created] = cg_name_indexed(parent, "child", created);
+		if (!children[created] || cg_create(children[created]))
+			goto cleanup;
+	}
+
+	start = now();
+	for (started = 0; started < nr_threads; started++) {
+		readers[started].idx = started;
+		if (pthread_create(&readers[started].thread, NULL, reader_fn,
+				   &readers[started])) {
+			fprintf(stderr, "pthread_create failed\n");
+			break;
+		}
+	}
+
+	/* the readers already running must be done before the cleanup */
+	ret = started == nr_threads ? KSFT_PASS : KSFT_FAIL;
+	for (i = 0; i < started; i++) {
+		pthread_join(readers[i].thread, NULL);
+		if (readers[i].err) {
+			fprintf(stderr, "reader %d: %s\n", i,
+				strerror(readers[i].err));
+			ret = KSFT_FAIL;
+		}
+		total += readers[i].reads;
+	}
+	elapsed = now() - start;
+
+	if (started == nr_threads)
+		printf("cgroups %d threads %d reads %ld time %.3fs rate %.0f reads/s\n",
+		       nr_cgroups, nr_threads, total, elapsed, total / elapsed);
+
+cleanup:
+	for (i = 0; children && i < nr_cgroups; i++) {
+		if (i < created)
+			cg_destroy(children[i]);
+		free(children[i]);
+	}
+	if (parent)
+		cg_destroy(parent);
+	free(parent);
+	free(children);
+	free(readers);
+	return ret;
+}
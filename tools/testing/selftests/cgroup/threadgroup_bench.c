@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Benchmark forks while processes are migrated between cgroups.
+ *
+ * A number of threads fork and reap short lived children as fast as they
+ * can, while another thread keeps moving a process between two cgroups,
+ * optionally sleeping between migrations. Both sides contend on
+ * cgroup_threadgroup_rwsem; the fork rate and the worst fork latency show
+ * how much the migrations stall the rest of the system.
+ *
+ * Usage: threadgroup_bench [-t nr_threads] [-d seconds] [-i interval_us]
+ */
+
+#include <errno.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+#include "cgroup_util.h"
+
+static int nr_threads = 8;
+static int duration = 10;
+static int interval_us;
+static volatile bool stop;
+
+static char *cg_a, *cg_b;
+static pid_t victim;
+
+struct forker {
+	pthread_t thread;
+	long forks;
+	double max_lat;
+	int err;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *forker_fn(void *arg)
+{
+	struct forker *f = arg;
+
+	while (!stop) {
+		double start = now(), lat;
+		pid_t pid;
+
+		pid = fork();
+		if (pid < 0) {
+			f->err = errno;
+			return NULL;
+		}
+		if (!pid)
+			_exit(0);
+
+		lat = now() - start;
+		if (lat > f->max_lat)
+			f->max_lat = lat;
+
+		if (waitpid(pid, NULL, 0) < 0) {
+			f->err = errno;
+			return NULL;
+		}
+		f->forks++;
+	}
+
+	return NULL;
+}
+
+static long migrations;
+static int migrate_err;
+
+static void *migrator_fn(void *arg)
+{
+	while (!stop) {
+		if (cg_enter(migrations & 1 ? cg_a : cg_b, victim)) {
+			migrate_err = errno;
+			return NULL;
+		}
+		migrations++;
+		if (interval_us)
+			usleep(interval_us);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	char root[PATH_MAX];
+	struct forker *forkers;
+	pthread_t migrator;
+	char *parent = NULL;
+	int ret = KSFT_FAIL;
+	double start, elapsed, max_lat = 0;
+	long total = 0;
+	int i, opt, started = 0;
+
+	while ((opt = getopt(argc, argv, "t:d:i:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'i':
+			interval_us = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-t nr_threads] [-d seconds] [-i interval_us]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+
+	if (nr_threads <= 0 || duration <= 0 || interval_us < 0)
+		return KSFT_FAIL;
+
+	if (cg_find_unified_root(root, sizeof(root)))
+		ksft_exit_skip("cgroup v2 isn't mounted\n");
+
+	forkers = calloc(nr_threads, sizeof(*forkers));
+	parent = cg_name(root, "threadgroup_bench");
+	if (!forkers || !parent)
+		goto cleanup;
+	cg_a = cg_name(parent, "a");
+	cg_b = cg_name(parent, "b");
+	if (!cg_a || !cg_b)
+		goto cleanup;
+
+	if (cg_create(parent) || cg_create(cg_a) || cg_create(cg_b))
+		goto cleanup;
+
+	victim = fork();
+	if (victim < 0)
+		goto cleanup;
+	if (!victim) {
+		pause();
+		_exit(0);
+	}
+
+	start = now();
+	for (i = 0; i < nr_threads; i++, started++) {
+		if (pthread_create(&forkers[i].thread, NULL, forker_fn,
+				   &forkers[i]))
+			break;
+	}
+	if (started == nr_threads &&
+	    !pthread_create(&migrator, NULL, migrator_fn, NULL)) {
+		sleep(duration);
+		stop = true;
+		pthread_join(migrator, NULL);
+		ret = KSFT_PASS;
+	}
+	stop = true;
+
+	for (i = 0; i < started; i++) {
+		pthread_join(forkers[i].thread, NULL);
+		if (forkers[i].err) {
+			fprintf(stderr, "forker %d: %s\n", i,
+				strerror(forkers[i].err));
+			ret = KSFT_FAIL;
+		}
+		total += forkers[i].forks;
+		if (forkers[i].max_lat > max_lat)
+			max_lat = forkers[i].max_lat;
+	}
+	elapsed = now() - start;
+
+	if (migrate_err) {
+		fprintf(stderr, "migration: %s\n", strerror(migrate_err));
+		ret = KSFT_FAIL;
+	}
+
+	if (ret == KSFT_PASS)
+		printf("threads %d forks %ld (%.0f/s) max fork latency %.3fms migrations %ld (%.0f/s)\n",
+		       nr_threads, total, total / elapsed, max_lat * 1000,
+		       migrations, migrations / elapsed);
+
+	kill(victim, SIGKILL);
+	waitpid(victim, NULL, 0);
+
+cleanup:
+	if (cg_a)
+		cg_destroy(cg_a);
+	if (cg_b)
+		cg_destroy(cg_b);
+	if (parent)
+		cg_destroy(parent);
+	free(cg_a);
+	free(cg_b);
+	free(parent);
+	free(forkers);
+	return ret;
+}
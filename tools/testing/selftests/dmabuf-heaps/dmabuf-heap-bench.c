@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Allocation latency of a dma-buf heap for the buffer sizes camera and
+ * video pipelines allocate at stream start: allocate, dirty and free a
+ * buffer in a loop and report the allocation and release times.  Every
+ * buffer is checked to come out cleared.
+ *
+ * Usage: dmabuf-heap-bench [-H heap] [-n iterations] [size_mb...]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <linux/dma-buf.h>
+
+#include "../../../../include/uapi/linux/dma-heap.h"
+#include "../kselftest.h"
+
+#define DEVPATH "/dev/dma_heap"
+#define POOL_STATS "/sys/kernel/dmabuf_page_pool"
+#define ONE_MEG (1024 * 1024)
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_times(const char *what, uint64_t *t, int n)
+{
+	qsort(t, n, sizeof(*t), cmp_u64);
+	printf("  %-8s p50 %8llu us  p99 %8llu us  max %8llu us\n", what,
+	       (unsigned long long)t[n / 2],
+	       (unsigned long long)t[(n * 99) / 100],
+	       (unsigned long long)t[n - 1]);
+}
+
+static void print_pool_stats(void)
+{
+	static const char * const stats[] = {
+		"pages", "zeroed_pages", "hits", "dirty_hits", "misses",
+		"shrunk",
+	};
+	char path[128], val[32];
+	unsigned int i;
+	FILE *f;
+
+	for (i = 0; i < sizeof(stats) / sizeof(stats[0]); i++) {
+		snprintf(path, sizeof(path), "%s/%s", POOL_STATS, stats[i]);
+		f = fopen(path, "r");
+		if (!f)
+			return;
+		if (fgets(val, sizeof(val), f))
+			printf("  pool %-12s %s", stats[i], val);
+		fclose(f);
+	}
+}
+
+/* returns 0, or -1 if the heap handed out a buffer that was not cleared */
+static int bench_size(int heap_fd, size_t len, int iterations)
+{
+	uint64_t *alloc_t, *free_t, start;
+	struct dma_heap_allocation_data data;
+	size_t i, pgsz = getpagesize();
+	int n, ret = 0;
+	char *p;
+
+	alloc_t = calloc(iterations, sizeof(*alloc_t));
+	free_t = calloc(iterations, sizeof(*free_t));
+	if (!alloc_t || !free_t)
+		ksft_exit_fail_msg("out of memory\n");
+
+	for (n = 0; n < iterations; n++) {
+		memset(&data, 0, sizeof(data));
+		data.len = len;
+		data.fd_flags = O_RDWR | O_CLOEXEC;
+
+		start = now_us();
+		if (ioctl(heap_fd, DMA_HEAP_IOCTL_ALLOC, &data) < 0)
+			ksft_exit_fail_msg("allocation of %zu bytes failed: %s\n",
+					   len, strerror(errno));
+		alloc_t[n] = now_us() - start;
+
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 data.fd, 0);
+		if (p == MAP_FAILED)
+			ksft_exit_fail_msg("mmap failed: %s\n", strerror(errno));
+
+		/* the previous iteration dirtied every page */
+		for (i = 0; i < len; i += pgsz) {
+			if (p[i]) {
+				ret = -1;
+				break;
+			}
+		}
+		memset(p, 0xa5, len);
+		munmap(p, len);
+
+		start = now_us();
+		close(data.fd);
+		free_t[n] = now_us() - start;
+	}
+
+	printf("%zu MiB buffers, %d iterations%s\n", len / ONE_MEG, iterations,
+	       ret ? ", FOUND NON ZEROED BUFFER" : "");
+	print_times("alloc", alloc_t, iterations);
+	print_times("free", free_t, iterations);
+	print_pool_stats();
+
+	free(alloc_t);
+	free(free_t);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	static const int default_sizes[] = { 8, 16, 32 };
+	const char *heap = "system";
+	int iterations = 100;
+	char path[256];
+	int heap_fd, opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "H:n:")) != -1) {
+		switch (opt) {
+		case 'H':
+			heap = optarg;
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-H heap] [-n iterations] [size_mb...]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (iterations <= 0)
+		ksft_exit_fail_msg("bad number of iterations\n");
+
+	snprintf(path, sizeof(path), "%s/%s", DEVPATH, heap);
+	heap_fd = open(path, O_RDWR);
+	if (heap_fd < 0)
+		ksft_exit_skip("Could not open %s: %s\n", path, strerror(errno));
+
+	if (optind < argc) {
+		for (i = optind; i < argc; i++)
+			ret |= bench_size(heap_fd, atol(argv[i]) * ONE_MEG,
+					  iterations);
+	} else {
+		for (i = 0; i < 3; i++)
+			ret |= bench_size(heap_fd, default_sizes[i] * ONE_MEG,
+					  iterations);
+	}
+
+	close(heap_fd);
+	return ret ? KSFT_FAIL : KSFT_PASS;
+}
@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sequential write and read throughput of a file on a FUSE filesystem
+ * whose daemon serves it from a backing file, first with READ and WRITE
+ * requests and then with the file opened FOPEN_PASSTHROUGH, so that the
+ * kernel does the I/O on the backing file itself.  The data read back is
+ * checked in both modes.
+ *
+ * Usage: fuse_passthrough_bench [-m size_mb] [-b block_kb]
+ *
+ * Needs to run as root, to mount and to register the backing file.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include "../../../../../include/uapi/linux/fuse.h"
+#include "../../kselftest.h"
+
+#define MAX_WRITE	(128 * 1024)
+#define BUF_SIZE	(MAX_WRITE + 4096)
+#define FILE_NODEID	2
+#define FILE_NAME	"data"
+
+static int backing_fd;
+static int backing_id;
+static bool passthrough;
+static size_t size_mb = 256;
+static size_t block_kb = 1024;
+static char backing[] = "/tmp/fuse-passthrough-backing-XXXXXX";
+static char mnt[] = "/tmp/fuse-passthrough-XXXXXX";
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void fill_attr(uint64_t nodeid, struct fuse_attr *attr)
+{
+	struct stat st;
+
+	fstat(backing_fd, &st);
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->size = nodeid == FILE_NODEID ? st.st_size : 0;
+	attr->blocks = nodeid == FILE_NODEID ? st.st_blocks : 0;
+	attr->mode = nodeid == FILE_NODEID ? S_IFREG | 0644 : S_IFDIR | 0755;
+	attr->nlink = nodeid == FILE_NODEID ? 1 : 2;
+	attr->mtime = st.st_mtim.tv_sec;
+	attr->mtimensec = st.st_mtim.tv_nsec;
+	attr->blksize = 4096;
+}
+
+/* Handle the request at @in_buf, returns the size of the reply at @out_buf */
+static size_t handle(const void *in_buf, void *out_buf)
+{
+	const struct fuse_in_header *in = in_buf;
+	const void *arg = in + 1;
+	struct fuse_out_header *out = out_buf;
+	void *res = out + 1;
+	ssize_t len = 0;
+	int err = 0;
+
+	switch (in->opcode) {
+	case FUSE_LOOKUP: {
+		struct fuse_entry_out entry = {};
+
+		if (in->nodeid != FUSE_ROOT_ID || strcmp(arg, FILE_NAME)) {
+			err = -ENOENT;
+			break;
+		}
+		entry.nodeid = FILE_NODEID;
+		entry.entry_valid = 1;
+		entry.attr_valid = 1;
+		fill_attr(FILE_NODEID, &entry.attr);
+		memcpy(res, &entry, sizeof(entry));
+		len = sizeof(entry);
+		break;
+	}
+	case FUSE_GETATTR: {
+		struct fuse_attr_out attr = {};
+
+		attr.attr_valid = 1;
+		fill_attr(in->nodeid, &attr.attr);
+		memcpy(res, &attr, sizeof(attr));
+		len = sizeof(attr);
+		break;
+	}
+	case FUSE_OPEN: {
+		struct fuse_open_out open_out = {};
+
+		if (passthrough) {
+			open_out.open_flags = FOPEN_PASSTHROUGH;
+			open_out.backing_id = backing_id;
+		}
+		memcpy(res, &open_out, sizeof(open_out));
+		len = sizeof(open_out);
+		break;
+	}
+	case FUSE_READ: {
+		const struct fuse_read_in *read_in = arg;
+
+		len = pread(backing_fd, res, read_in->size, read_in->offset);
+		if (len < 0) {
+			err = -errno;
+			len = 0;
+		}
+		break;
+	}
+	case FUSE_WRITE: {
+		const struct fuse_write_in *write_in = arg;
+		struct fuse_write_out write_out = {};
+		ssize_t ret;
+
+		ret = pwrite(backing_fd, write_in + 1, write_in->size,
+			     write_in->offset);
+		if (ret < 0) {
+			err = -errno;
+			break;
+		}
+		write_out.size = ret;
+		memcpy(res, &write_out, sizeof(write_out));
+		len = sizeof(write_out);
+		break;
+	}
+	case FUSE_FSYNC:
+		if (fsync(backing_fd))
+			err = -errno;
+		break;
+	case FUSE_OPENDIR:
+	case FUSE_RELEASEDIR:
+	case FUSE_FLUSH:
+	case FUSE_RELEASE:
+	case FUSE_DESTROY:
+		break;
+	case FUSE_FORGET:
+	case FUSE_BATCH_FORGET:
+	case FUSE_INTERRUPT:
+		return 0;
+	default:
+		err = -ENOSYS;
+		break;
+	}
+
+	out->len = sizeof(*out) + len;
+	out->error = err;
+	out->unique = in->unique;
+	return out->len;
+}
+
+static void *daemon_thread(void *arg)
+{
+	char *buf = malloc(BUF_SIZE), *reply = malloc(BUF_SIZE);
+	int fd = (intptr_t)arg;
+	size_t len;
+
+	while (buf && reply) {
+		if (read(fd, buf, BUF_SIZE) < 0) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			break;
+		}
+		len = handle(buf, reply);
+		/* ENOENT if the request got interrupted meanwhile */
+		if (len)
+			write(fd, reply, len);
+	}
+	free(buf);
+	free(reply);
+	return NULL;
+}
+
+static void do_init(int fd)
+{
+	char *buf = malloc(BUF_SIZE);
+	struct fuse_in_header *in = (struct fuse_in_header *)buf;
+	struct fuse_init_in *init_in = (struct fuse_init_in *)(in + 1);
+	struct {
+		struct fuse_out_header h;
+		struct fuse_init_out arg;
+	} out = {};
+
+	if (!buf)
+		ksft_exit_fail_msg("out of memory\n");
+	if (read(fd, buf, BUF_SIZE) < (ssize_t)sizeof(*in) ||
+	    in->opcode != FUSE_INIT)
+		ksft_exit_fail_msg("no INIT request: %s\n", strerror(errno));
+
+	if (passthrough && (!(init_in->flags & FUSE_INIT_EXT) ||
+			    !(init_in->flags2 & (FUSE_PASSTHROUGH >> 32))))
+		ksft_exit_skip("Kernel doesn't support FUSE_PASSTHROUGH\n");
+
+	out.h.len = sizeof(out);
+	out.h.unique = in->unique;
+	out.arg.major = FUSE_KERNEL_VERSION;
+	out.arg.minor = FUSE_KERNEL_MINOR_VERSION;
+	out.arg.max_readahead = init_in->max_readahead;
+	out.arg.max_background = 64;
+	out.arg.congestion_threshold = 48;
+	out.arg.max_write = MAX_WRITE;
+	out.arg.flags = FUSE_ASYNC_READ | FUSE_BIG_WRITES | FUSE_MAX_PAGES |
+			FUSE_INIT_EXT;
+	if (passthrough)
+		out.arg.flags2 = FUSE_PASSTHROUGH >> 32;
+	out.arg.max_pages = MAX_WRITE / 4096;
+	if (write(fd, &out, sizeof(out)) != sizeof(out))
+		ksft_exit_fail_msg("INIT reply failed: %s\n", strerror(errno));
+	free(buf);
+}
+
+/* Measures the write and read throughput in MB/s */
+static void bench(double *write_mbs, double *read_mbs)
+{
+	size_t bs = block_kb * 1024, nr = size_mb * 1024 / block_kb, i, j;
+	struct fuse_backing_map map = {};
+	uint64_t start, elapsed;
+	pthread_t daemon;
+	char opts[128], path[64];
+	int fd, dev;
+	char *buf;
+
+	buf = malloc(bs);
+	if (!buf)
+		ksft_exit_fail_msg("out of memory\n");
+	if (ftruncate(backing_fd, 0))
+		ksft_exit_fail_msg("ftruncate: %s\n", strerror(errno));
+
+	dev = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (dev < 0)
+		ksft_exit_skip("Could not open /dev/fuse: %s\n", strerror(errno));
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0,allow_other", dev);
+	if (mount("fuse-passthrough", mnt, "fuse.passthrough",
+		  MS_NOSUID | MS_NODEV, opts))
+		ksft_exit_skip("Could not mount: %s\n", strerror(errno));
+	do_init(dev);
+
+	if (passthrough) {
+		map.fd = backing_fd;
+		backing_id = ioctl(dev, FUSE_DEV_IOC_BACKING_OPEN, &map);
+		if (backing_id < 0)
+			ksft_exit_skip("Could not register the backing file: %s\n",
+				       strerror(errno));
+	}
+	pthread_create(&daemon, NULL, daemon_thread, (void *)(intptr_t)dev);
+
+	snprintf(path, sizeof(path), "%s/%s", mnt, FILE_NAME);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+	start = now_us();
+	for (i = 0; i < nr; i++) {
+		memset(buf, (int)i, bs);
+		if (write(fd, buf, bs) != (ssize_t)bs)
+			ksft_exit_fail_msg("write: %s\n", strerror(errno));
+	}
+	if (fsync(fd))
+		ksft_exit_fail_msg("fsync: %s\n", strerror(errno));
+	elapsed = now_us() - start;
+	close(fd);
+	*write_mbs = (double)size_mb * 1000000 / elapsed;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+	start = now_us();
+	for (i = 0; i < nr; i++) {
+		if (read(fd, buf, bs) != (ssize_t)bs)
+			ksft_exit_fail_msg("short read: %s\n", strerror(errno));
+		for (j = 0; j < bs; j += 4096) {
+			if (buf[j] != (char)i)
+				ksft_exit_fail_msg("bad data at %zu\n",
+						   i * bs + j);
+		}
+	}
+	elapsed = now_us() - start;
+	close(fd);
+	*read_mbs = (double)size_mb * 1000000 / elapsed;
+
+	if (passthrough &&
+	    ioctl(dev, FUSE_DEV_IOC_BACKING_CLOSE, &(uint32_t){ backing_id }))
+		ksft_exit_fail_msg("Could not unregister the backing file: %s\n",
+				   strerror(errno));
+
+	umount2(mnt, MNT_DETACH);
+	close(dev);
+	pthread_join(daemon, NULL);
+	free(buf);
+}
+
+int main(int argc, char **argv)
+{
+	double rw_write, rw_read, pt_write, pt_read;
+	char path[64];
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:b:")) != -1) {
+		switch (opt) {
+		case 'm':
+			size_mb = atol(optarg);
+			break;
+		case 'b':
+			block_kb = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-m size_mb] [-b block_kb]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (!size_mb || !block_kb || (size_mb * 1024) % block_kb)
+		ksft_exit_fail_msg("bad arguments\n");
+
+	if (geteuid())
+		ksft_exit_skip("Needs to run as root\n");
+
+	if (!mkdtemp(backing) || !mkdtemp(mnt))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+	snprintf(path, sizeof(path), "%s/%s", backing, FILE_NAME);
+	backing_fd = open(path, O_CREAT | O_RDWR, 0644);
+	if (backing_fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+
+	bench(&rw_write, &rw_read);
+	passthrough = true;
+	bench(&pt_write, &pt_read);
+
+	close(backing_fd);
+	unlink(path);
+	rmdir(backing);
+	rmdir(mnt);
+
+	printf("%zu MiB in %zu KiB blocks\n", size_mb, block_kb);
+	printf("  read/write    write %8.1f MB/s  read %8.1f MB/s\n",
+	       rw_write, rw_read);
+	printf("  passthrough   write %8.1f MB/s  read %8.1f MB/s\n",
+	       pt_write, pt_read);
+
+	return KSFT_PASS;
+}
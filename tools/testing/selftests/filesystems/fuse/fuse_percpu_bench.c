@@ -0,0 +1,383 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Random read IOPS through a FUSE passthrough of one file, with the
+ * requests going through the shared input queue and then through the
+ * per-CPU queues (FUSE_PER_CPU_QUEUES).  The daemon runs one thread per
+ * CPU, each on its own /dev/fuse clone, pinned to and bound to its CPU.
+ * The file is opened with FOPEN_DIRECT_IO, so that every read goes to
+ * the daemon.
+ *
+ * Usage: fuse_percpu_bench [-s seconds] [-b block_size] backing_file
+ *
+ * Needs to run as root, to mount.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "../../../../../include/uapi/linux/fuse.h"
+#include "../../kselftest.h"
+
+#define ROOT_ID		FUSE_ROOT_ID
+#define FILE_ID		2
+#define FILE_NAME	"data"
+#define MAX_WRITE	(128 * 1024)
+#define BUF_SIZE	(MAX_WRITE + 4096)
+
+static int backing_fd;
+static struct stat backing_st;
+static int nr_cpus;
+static int block_size = 4096;
+static int seconds = 2;
+static char mnt[] = "/tmp/fuse-bench-XXXXXX";
+
+struct daemon {
+	pthread_t thread;
+	int fd;
+	int cpu;
+};
+
+struct job {
+	pthread_t thread;
+	int cpu;
+	volatile bool *stop;
+	unsigned long ops;
+	int err;
+};
+
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+}
+
+static void reply(int fd, uint64_t unique, int error, const void *arg,
+		  size_t len)
+{
+	struct fuse_out_header out = {
+		.len = sizeof(out) + len,
+		.error = error,
+		.unique = unique,
+	};
+	struct iovec iov[2] = {
+		{ .iov_base = &out, .iov_len = sizeof(out) },
+		{ .iov_base = (void *)arg, .iov_len = len },
+	};
+
+	/* ENOENT if the request got interrupted meanwhile */
+	writev(fd, iov, len ? 2 : 1);
+}
+
+static void fill_attr(uint64_t nodeid, struct fuse_attr *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->nlink = 1;
+	if (nodeid == ROOT_ID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+	} else {
+		attr->mode = S_IFREG | 0444;
+		attr->size = backing_st.st_size;
+		attr->blocks = backing_st.st_blocks;
+	}
+	attr->blksize = 4096;
+}
+
+/* returns false once the connection is gone */
+static bool handle_one(int fd, char *buf)
+{
+	struct fuse_in_header *in = (struct fuse_in_header *)buf;
+	void *arg = buf + sizeof(*in);
+	ssize_t len;
+
+	len = read(fd, buf, BUF_SIZE);
+	if (len < 0)
+		return errno == EINTR || errno == ENOENT || errno == EAGAIN;
+	if (len < (ssize_t)sizeof(*in))
+		return false;
+
+	switch (in->opcode) {
+	case FUSE_LOOKUP: {
+		struct fuse_entry_out entry = {};
+
+		if (in->nodeid != ROOT_ID || strcmp(arg, FILE_NAME)) {
+			reply(fd, in->unique, -ENOENT, NULL, 0);
+			break;
+		}
+		entry.nodeid = FILE_ID;
+		entry.attr_valid = 3600;
+		entry.entry_valid = 3600;
+		fill_attr(FILE_ID, &entry.attr);
+		reply(fd, in->unique, 0, &entry, sizeof(entry));
+		break;
+	}
+	case FUSE_GETATTR: {
+		struct fuse_attr_out attr = { .attr_valid = 3600 };
+
+		fill_attr(in->nodeid, &attr.attr);
+		reply(fd, in->unique, 0, &attr, sizeof(attr));
+		break;
+	}
+	case FUSE_OPEN: {
+		struct fuse_open_out open = { .open_flags = FOPEN_DIRECT_IO };
+
+		reply(fd, in->unique, 0, &open, sizeof(open));
+		break;
+	}
+	case FUSE_READ: {
+		struct fuse_read_in *read_in = arg;
+		char *data = buf + sizeof(*in) + sizeof(*read_in);
+		size_t size = read_in->size;
+		ssize_t ret;
+
+		if (size > BUF_SIZE - sizeof(*in) - sizeof(*read_in))
+			size = BUF_SIZE - sizeof(*in) - sizeof(*read_in);
+		ret = pread(backing_fd, data, size, read_in->offset);
+		if (ret < 0)
+			reply(fd, in->unique, -errno, NULL, 0);
+		else
+			reply(fd, in->unique, 0, data, ret);
+		break;
+	}
+	case FUSE_FLUSH:
+	case FUSE_RELEASE:
+	case FUSE_DESTROY:
+		reply(fd, in->unique, 0, NULL, 0);
+		break;
+	case FUSE_FORGET:
+	case FUSE_BATCH_FORGET:
+	case FUSE_INTERRUPT:
+		/* no reply */
+		break;
+	default:
+		reply(fd, in->unique, -ENOSYS, NULL, 0);
+		break;
+	}
+	return true;
+}
+
+static void *daemon_thread(void *arg)
+{
+	struct daemon *d = arg;
+	char *buf = malloc(BUF_SIZE);
+
+	if (!buf)
+		return NULL;
+	pin(d->cpu);
+	while (handle_one(d->fd, buf))
+		;
+	free(buf);
+	return NULL;
+}
+
+/* Answer INIT, returns whether the kernel took the per-CPU queues */
+static bool do_init(int fd, bool per_cpu)
+{
+	char *buf = malloc(BUF_SIZE);
+	struct fuse_in_header *in = (struct fuse_in_header *)buf;
+	struct fuse_init_in *init_in = (struct fuse_init_in *)(in + 1);
+	struct fuse_init_out out = {};
+	uint64_t flags;
+
+	if (!buf)
+		ksft_exit_fail_msg("out of memory\n");
+	if (read(fd, buf, BUF_SIZE) < (ssize_t)sizeof(*in) ||
+	    in->opcode != FUSE_INIT)
+		ksft_exit_fail_msg("no INIT request: %s\n", strerror(errno));
+
+	flags = init_in->flags;
+	if (flags & FUSE_INIT_EXT)
+		flags |= (uint64_t)init_in->flags2 << 32;
+
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = FUSE_KERNEL_MINOR_VERSION;
+	out.max_readahead = init_in->max_readahead;
+	out.max_background = 64;
+	out.congestion_threshold = 48;
+	out.max_write = MAX_WRITE;
+	out.flags = FUSE_ASYNC_READ | FUSE_MAX_PAGES;
+	out.max_pages = MAX_WRITE / 4096;
+	if (per_cpu && (flags & FUSE_PER_CPU_QUEUES)) {
+		out.flags |= FUSE_INIT_EXT;
+		out.flags2 = FUSE_PER_CPU_QUEUES >> 32;
+	}
+	reply(fd, in->unique, 0, &out, sizeof(out));
+	free(buf);
+
+	return out.flags2 != 0;
+}
+
+static void *job_thread(void *arg)
+{
+	struct job *j = arg;
+	char path[64];
+	uint64_t blocks, off;
+	unsigned int seed = j->cpu + 1;
+	char *buf;
+	int fd;
+
+	pin(j->cpu);
+	snprintf(path, sizeof(path), "%s/%s", mnt, FILE_NAME);
+	fd = open(path, O_RDONLY);
+	buf = malloc(block_size);
+	if (fd < 0 || !buf) {
+		j->err = errno;
+		return NULL;
+	}
+
+	blocks = backing_st.st_size / block_size;
+	while (!*j->stop) {
+		off = (uint64_t)rand_r(&seed) % blocks * block_size;
+		if (pread(fd, buf, block_size, off) != block_size) {
+			j->err = errno ? errno : EIO;
+			break;
+		}
+		j->ops++;
+	}
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static unsigned long run_jobs(int nr_jobs)
+{
+	volatile bool stop = false;
+	unsigned long ops = 0;
+	struct job *jobs;
+	int i;
+
+	jobs = calloc(nr_jobs, sizeof(*jobs));
+	if (!jobs)
+		ksft_exit_fail_msg("out of memory\n");
+	for (i = 0; i < nr_jobs; i++) {
+		jobs[i].cpu = i % nr_cpus;
+		jobs[i].stop = &stop;
+		pthread_create(&jobs[i].thread, NULL, job_thread, &jobs[i]);
+	}
+	sleep(seconds);
+	stop = true;
+	for (i = 0; i < nr_jobs; i++) {
+		pthread_join(jobs[i].thread, NULL);
+		if (jobs[i].err)
+			ksft_exit_fail_msg("read failed: %s\n",
+					   strerror(jobs[i].err));
+		ops += jobs[i].ops;
+	}
+	free(jobs);
+	return ops / seconds;
+}
+
+static void bench(bool per_cpu, unsigned long *iops)
+{
+	struct daemon *daemons;
+	char opts[128];
+	int fd, i, n;
+
+	fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		ksft_exit_skip("Could not open /dev/fuse: %s\n", strerror(errno));
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0,allow_other", fd);
+	if (mount("fuse-bench", mnt, "fuse.bench", MS_NOSUID | MS_NODEV, opts))
+		ksft_exit_skip("Could not mount: %s\n", strerror(errno));
+
+	if (do_init(fd, per_cpu) != per_cpu)
+		ksft_exit_skip("FUSE_PER_CPU_QUEUES not supported\n");
+
+	daemons = calloc(nr_cpus, sizeof(*daemons));
+	if (!daemons)
+		ksft_exit_fail_msg("out of memory\n");
+	for (i = 0; i < nr_cpus; i++) {
+		uint32_t cpu = i;
+
+		daemons[i].cpu = i;
+		daemons[i].fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+		if (daemons[i].fd < 0 ||
+		    ioctl(daemons[i].fd, FUSE_DEV_IOC_CLONE, &(uint32_t){ fd }))
+			ksft_exit_fail_msg("Could not clone /dev/fuse: %s\n",
+					   strerror(errno));
+		if (per_cpu && ioctl(daemons[i].fd, FUSE_DEV_IOC_BIND_CPU, &cpu))
+			ksft_exit_fail_msg("Could not bind to CPU %d: %s\n", i,
+					   strerror(errno));
+		pthread_create(&daemons[i].thread, NULL, daemon_thread,
+			       &daemons[i]);
+	}
+
+	for (n = 1, i = 0; n <= nr_cpus; n *= 2, i++)
+		iops[i] = run_jobs(n);
+
+	umount2(mnt, MNT_DETACH);
+	close(fd);
+	for (i = 0; i < nr_cpus; i++) {
+		pthread_join(daemons[i].thread, NULL);
+		close(daemons[i].fd);
+	}
+	free(daemons);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long shared[32], per_cpu[32];
+	int opt, i, n;
+
+	while ((opt = getopt(argc, argv, "s:b:")) != -1) {
+		switch (opt) {
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			block_size = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-s seconds] [-b block_size] backing_file\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1 || seconds <= 0 || block_size <= 0 ||
+	    block_size > MAX_WRITE)
+		ksft_exit_fail_msg("bad arguments\n");
+
+	if (geteuid())
+		ksft_exit_skip("Needs to run as root\n");
+
+	backing_fd = open(argv[optind], O_RDONLY);
+	if (backing_fd < 0 || fstat(backing_fd, &backing_st))
+		ksft_exit_fail_msg("Could not open %s: %s\n", argv[optind],
+				   strerror(errno));
+	if (backing_st.st_size < block_size)
+		ksft_exit_fail_msg("%s is smaller than a block\n", argv[optind]);
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!mkdtemp(mnt))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+
+	bench(false, shared);
+	bench(true, per_cpu);
+	rmdir(mnt);
+
+	printf("%8s %14s %14s\n", "jobs", "shared IOPS", "per-CPU IOPS");
+	for (n = 1, i = 0; n <= nr_cpus; n *= 2, i++)
+		printf("%8d %14lu %14lu\n", n, shared[i], per_cpu[i]);
+
+	return KSFT_PASS;
+}
@@ -0,0 +1,414 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * stat() throughput on a FUSE passthrough of a directory of small files,
+ * with the daemon threads on read()/write() and then on the shared memory
+ * ring (FUSE_DEV_IOC_RING_SETUP).  The entry and attribute timeouts are
+ * zero, so that every stat() goes to the daemon with a LOOKUP and a
+ * GETATTR.
+ *
+ * Usage: fuse_ring_bench [-s seconds] [-t threads] [-j jobs] [-p busy_poll_us]
+ *
+ * Needs to run as root, to mount.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include "../../../../../include/uapi/linux/fuse.h"
+#include "../../kselftest.h"
+
+#define NR_FILES	1024
+#define MAX_WRITE	(128 * 1024)
+#define BUF_SIZE	(MAX_WRITE + 4096)
+#define RING_ENTRIES	64
+#define RING_SLOT	8192
+
+static int backing_fd;
+static int seconds = 2;
+static int nr_threads = 4;
+static int nr_jobs = 4;
+static unsigned int busy_poll_us;
+static char backing[] = "/tmp/fuse-ring-backing-XXXXXX";
+static char mnt[] = "/tmp/fuse-ring-XXXXXX";
+
+struct daemon {
+	pthread_t thread;
+	int fd;
+};
+
+struct job {
+	pthread_t thread;
+	volatile bool *stop;
+	unsigned long ops;
+	int err;
+};
+
+static void fill_attr(const struct stat *st, uint64_t nodeid,
+		      struct fuse_attr *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->size = st->st_size;
+	attr->blocks = st->st_blocks;
+	attr->mode = st->st_mode;
+	attr->nlink = st->st_nlink;
+	attr->uid = st->st_uid;
+	attr->gid = st->st_gid;
+	attr->mtime = st->st_mtim.tv_sec;
+	attr->mtimensec = st->st_mtim.tv_nsec;
+	attr->blksize = st->st_blksize;
+}
+
+/* the files are named after their index, their node ID is index + 2 */
+static int backing_stat(uint64_t nodeid, struct stat *st)
+{
+	char name[16];
+
+	if (nodeid == FUSE_ROOT_ID)
+		return fstat(backing_fd, st) ? -errno : 0;
+	if (nodeid < 2 || nodeid >= NR_FILES + 2)
+		return -ENOENT;
+	snprintf(name, sizeof(name), "%d", (int)(nodeid - 2));
+	return fstatat(backing_fd, name, st, 0) ? -errno : 0;
+}
+
+/*
+ * Handle the request at @in, put the reply at @out, which may be the same
+ * buffer.  Returns the size of the reply, 0 if there is none.
+ */
+static size_t handle(const void *in_buf, void *out_buf)
+{
+	struct fuse_in_header in = *(const struct fuse_in_header *)in_buf;
+	const void *arg = (const char *)in_buf + sizeof(in);
+	struct fuse_out_header *out = out_buf;
+	void *res = out + 1;
+	size_t len = 0;
+	struct stat st;
+	int err = 0;
+
+	switch (in.opcode) {
+	case FUSE_LOOKUP: {
+		struct fuse_entry_out entry = {};
+		char *end;
+		long idx;
+
+		idx = strtol(arg, &end, 10);
+		if (in.nodeid != FUSE_ROOT_ID || *end || idx < 0 ||
+		    idx >= NR_FILES) {
+			err = -ENOENT;
+			break;
+		}
+		err = backing_stat(idx + 2, &st);
+		if (err)
+			break;
+		entry.nodeid = idx + 2;
+		fill_attr(&st, entry.nodeid, &entry.attr);
+		memcpy(res, &entry, sizeof(entry));
+		len = sizeof(entry);
+		break;
+	}
+	case FUSE_GETATTR: {
+		struct fuse_attr_out attr = {};
+
+		err = backing_stat(in.nodeid, &st);
+		if (err)
+			break;
+		fill_attr(&st, in.nodeid, &attr.attr);
+		memcpy(res, &attr, sizeof(attr));
+		len = sizeof(attr);
+		break;
+	}
+	case FUSE_FORGET:
+	case FUSE_BATCH_FORGET:
+	case FUSE_INTERRUPT:
+		return 0;
+	case FUSE_DESTROY:
+		break;
+	default:
+		err = -ENOSYS;
+		break;
+	}
+
+	out->len = sizeof(*out) + len;
+	out->error = err;
+	out->unique = in.unique;
+	return out->len;
+}
+
+static void *rw_thread(void *arg)
+{
+	struct daemon *d = arg;
+	char *buf = malloc(BUF_SIZE), *reply = malloc(BUF_SIZE);
+	size_t len;
+
+	while (buf && reply) {
+		if (read(d->fd, buf, BUF_SIZE) < 0) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			break;
+		}
+		len = handle(buf, reply);
+		/* ENOENT if the request got interrupted meanwhile */
+		if (len)
+			write(d->fd, reply, len);
+	}
+	free(buf);
+	free(reply);
+	return NULL;
+}
+
+static void *ring_thread(void *arg)
+{
+	struct fuse_ring_setup setup = {
+		.entries = RING_ENTRIES,
+		.entry_size = RING_SLOT,
+		.busy_poll_us = busy_poll_us,
+	};
+	uint32_t flags = FUSE_RING_ENTER_WAIT;
+	struct fuse_ring_entry *sq, *cq, *e;
+	struct fuse_ring_ctrl *ctrl;
+	struct daemon *d = arg;
+	char *area, *slot, *buf;
+	uint32_t sq_head = 0, cq_head = 0, cq_tail = 0, len, n;
+	char req[RING_SLOT];
+
+	if (ioctl(d->fd, FUSE_DEV_IOC_RING_SETUP, &setup))
+		ksft_exit_fail_msg("ring setup failed: %s\n", strerror(errno));
+	area = mmap(NULL, setup.mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    d->fd, 0);
+	if (area == MAP_FAILED)
+		ksft_exit_fail_msg("ring mmap failed: %s\n", strerror(errno));
+	buf = malloc(BUF_SIZE);
+	if (!buf)
+		ksft_exit_fail_msg("out of memory\n");
+
+	ctrl = (struct fuse_ring_ctrl *)area;
+	sq = (struct fuse_ring_entry *)(area + setup.sq_off);
+	cq = (struct fuse_ring_entry *)(area + setup.cq_off);
+
+	for (;;) {
+		if (ioctl(d->fd, FUSE_DEV_IOC_RING_ENTER, &flags) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		/* the replies the kernel rejected */
+		while (cq_head != __atomic_load_n(&ctrl->cq_head,
+						  __ATOMIC_ACQUIRE)) {
+			e = &cq[cq_head++ & (RING_ENTRIES - 1)];
+			if (e->status)
+				ksft_print_msg("reply in slot %u rejected: %s\n",
+					       e->slot, strerror(-e->status));
+		}
+
+		while (sq_head != __atomic_load_n(&ctrl->sq_tail,
+						  __ATOMIC_ACQUIRE)) {
+			e = &sq[sq_head++ & (RING_ENTRIES - 1)];
+			n = e->slot;
+			slot = area + setup.slots_off + (uint64_t)n * RING_SLOT;
+			len = 0;
+			if (((struct fuse_in_header *)slot)->len > e->len) {
+				/* too large for the slot, read it whole */
+				if (read(d->fd, buf, BUF_SIZE) > 0)
+					write(d->fd, buf, handle(buf, buf));
+			} else {
+				memcpy(req, slot, e->len);
+				len = handle(req, slot);
+			}
+
+			e = &cq[cq_tail++ & (RING_ENTRIES - 1)];
+			e->slot = n;
+			e->len = len;
+		}
+		__atomic_store_n(&ctrl->sq_head, sq_head, __ATOMIC_RELEASE);
+		__atomic_store_n(&ctrl->cq_tail, cq_tail, __ATOMIC_RELEASE);
+	}
+	free(buf);
+	munmap(area, setup.mmap_size);
+	return NULL;
+}
+
+static void do_init(int fd)
+{
+	char *buf = malloc(BUF_SIZE);
+	struct fuse_in_header *in = (struct fuse_in_header *)buf;
+	struct fuse_init_in *init_in = (struct fuse_init_in *)(in + 1);
+	struct {
+		struct fuse_out_header h;
+		struct fuse_init_out arg;
+	} out = {};
+
+	if (!buf)
+		ksft_exit_fail_msg("out of memory\n");
+	if (read(fd, buf, BUF_SIZE) < (ssize_t)sizeof(*in) ||
+	    in->opcode != FUSE_INIT)
+		ksft_exit_fail_msg("no INIT request: %s\n", strerror(errno));
+
+	out.h.len = sizeof(out);
+	out.h.unique = in->unique;
+	out.arg.major = FUSE_KERNEL_VERSION;
+	out.arg.minor = FUSE_KERNEL_MINOR_VERSION;
+	out.arg.max_readahead = init_in->max_readahead;
+	out.arg.max_background = 64;
+	out.arg.congestion_threshold = 48;
+	out.arg.max_write = MAX_WRITE;
+	out.arg.flags = FUSE_ASYNC_READ | FUSE_MAX_PAGES;
+	out.arg.max_pages = MAX_WRITE / 4096;
+	if (write(fd, &out, sizeof(out)) != sizeof(out))
+		ksft_exit_fail_msg("INIT reply failed: %s\n", strerror(errno));
+	free(buf);
+}
+
+static void *job_thread(void *arg)
+{
+	struct job *j = arg;
+	unsigned int seed = (uintptr_t)j;
+	char path[64];
+	struct stat st;
+
+	while (!*j->stop) {
+		snprintf(path, sizeof(path), "%s/%d", mnt,
+			 rand_r(&seed) % NR_FILES);
+		if (stat(path, &st)) {
+			j->err = errno;
+			break;
+		}
+		j->ops++;
+	}
+	return NULL;
+}
+
+static unsigned long bench(bool ring)
+{
+	volatile bool stop = false;
+	struct daemon *daemons;
+	unsigned long ops = 0;
+	struct job *jobs;
+	char opts[128];
+	int fd, i;
+
+	fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		ksft_exit_skip("Could not open /dev/fuse: %s\n", strerror(errno));
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0,allow_other", fd);
+	if (mount("fuse-ring", mnt, "fuse.ring", MS_NOSUID | MS_NODEV, opts))
+		ksft_exit_skip("Could not mount: %s\n", strerror(errno));
+	do_init(fd);
+
+	daemons = calloc(nr_threads, sizeof(*daemons));
+	jobs = calloc(nr_jobs, sizeof(*jobs));
+	if (!daemons || !jobs)
+		ksft_exit_fail_msg("out of memory\n");
+	for (i = 0; i < nr_threads; i++) {
+		daemons[i].fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+		if (daemons[i].fd < 0 ||
+		    ioctl(daemons[i].fd, FUSE_DEV_IOC_CLONE, &(uint32_t){ fd }))
+			ksft_exit_fail_msg("Could not clone /dev/fuse: %s\n",
+					   strerror(errno));
+		pthread_create(&daemons[i].thread, NULL,
+			       ring ? ring_thread : rw_thread, &daemons[i]);
+	}
+
+	for (i = 0; i < nr_jobs; i++) {
+		jobs[i].stop = &stop;
+		pthread_create(&jobs[i].thread, NULL, job_thread, &jobs[i]);
+	}
+	sleep(seconds);
+	stop = true;
+	for (i = 0; i < nr_jobs; i++) {
+		pthread_join(jobs[i].thread, NULL);
+		if (jobs[i].err)
+			ksft_exit_fail_msg("stat failed: %s\n",
+					   strerror(jobs[i].err));
+		ops += jobs[i].ops;
+	}
+
+	umount2(mnt, MNT_DETACH);
+	close(fd);
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(daemons[i].thread, NULL);
+		close(daemons[i].fd);
+	}
+	free(daemons);
+	free(jobs);
+
+	return ops / seconds;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long rw, ring;
+	char name[16];
+	int opt, i, fd;
+
+	while ((opt = getopt(argc, argv, "s:t:j:p:")) != -1) {
+		switch (opt) {
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'j':
+			nr_jobs = atoi(optarg);
+			break;
+		case 'p':
+			busy_poll_us = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-s seconds] [-t threads] [-j jobs] [-p busy_poll_us]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (seconds <= 0 || nr_threads <= 0 || nr_jobs <= 0)
+		ksft_exit_fail_msg("bad arguments\n");
+
+	if (geteuid())
+		ksft_exit_skip("Needs to run as root\n");
+
+	if (!mkdtemp(backing) || !mkdtemp(mnt))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+	backing_fd = open(backing, O_RDONLY | O_DIRECTORY);
+	if (backing_fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", backing, strerror(errno));
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(name, sizeof(name), "%d", i);
+		fd = openat(backing_fd, name, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0)
+			ksft_exit_fail_msg("create: %s\n", strerror(errno));
+		close(fd);
+	}
+
+	rw = bench(false);
+	ring = bench(true);
+
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(name, sizeof(name), "%d", i);
+		unlinkat(backing_fd, name, 0);
+	}
+	close(backing_fd);
+	rmdir(backing);
+	rmdir(mnt);
+
+	printf("%d jobs, %d daemon threads\n", nr_jobs, nr_threads);
+	printf("  read/write %10lu stat/s\n", rw);
+	printf("  ring       %10lu stat/s\n", ring);
+
+	return KSFT_PASS;
+}
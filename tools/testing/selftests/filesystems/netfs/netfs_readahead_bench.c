@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sequential read throughput of a file on a network filesystem backed by
+ * fscache/cachefiles, for readahead that is all from the server, partly
+ * from the cache and partly from the server, and all from the cache.  The
+ * mixed case is where the cache reads and the downloads of one readahead
+ * run in parallel.  Every read is checked against the pattern the file was
+ * written with, and the netfs read helper stats are printed for each pass.
+ *
+ * Usage: netfs_readahead_bench -f file [-m size_mb] [-n iterations]
+ *
+ * The file is created, so it must be on a mount with caching enabled, e.g.
+ * a 9p loopback mount with cachefilesd running:
+ *
+ *   diod -n -f -e /srv/export -l 127.0.0.1:5640 &
+ *   mount -t 9p -o trans=tcp,port=5640,aname=/srv/export,cache=fscache \
+ *	127.0.0.1 /mnt/9p
+ *   netfs_readahead_bench -f /mnt/9p/bench
+ *
+ * Needs to run as root, to drop the caches.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../kselftest.h"
+
+#define ONE_MEG		(1024 * 1024)
+#define FSCACHE_STATS	"/proc/fs/fscache/stats"
+
+static const char *path;
+static size_t size_mb = 256;
+static char *buf, *want;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* Every 8 bytes of the file hold their own offset */
+static void fill_pattern(char *p, uint64_t off, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i += sizeof(off), off += sizeof(off))
+		memcpy(p + i, &off, sizeof(off));
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1)
+		ksft_exit_fail_msg("drop_caches: %s\n", strerror(errno));
+	close(fd);
+}
+
+static void print_stats(void)
+{
+	char line[256];
+	FILE *f;
+
+	f = fopen(FSCACHE_STATS, "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, "RdHelp", 6))
+			printf("  %s", line);
+	fclose(f);
+}
+
+static void create_file(void)
+{
+	uint64_t off;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		ksft_exit_fail_msg("create %s: %s\n", path, strerror(errno));
+	for (off = 0; off < size_mb * ONE_MEG; off += ONE_MEG) {
+		fill_pattern(buf, off, ONE_MEG);
+		if (write(fd, buf, ONE_MEG) != ONE_MEG)
+			ksft_exit_fail_msg("write %s: %s\n", path,
+					   strerror(errno));
+	}
+	if (fsync(fd))
+		ksft_exit_fail_msg("fsync %s: %s\n", path, strerror(errno));
+	close(fd);
+}
+
+/*
+ * Read the file in 1MiB chunks, every stride'th of them, and check the
+ * data.  Returns the throughput in MiB/s, or a negative value for bad data.
+ */
+static double read_file(int stride)
+{
+	uint64_t off, start, elapsed;
+	size_t nr = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+
+	start = now_us();
+	for (off = 0; off < size_mb * ONE_MEG; off += stride * ONE_MEG) {
+		if (pread(fd, buf, ONE_MEG, off) != ONE_MEG)
+			ksft_exit_fail_msg("read %s: %s\n", path,
+					   strerror(errno));
+		fill_pattern(want, off, ONE_MEG);
+		if (memcmp(buf, want, ONE_MEG)) {
+			ksft_print_msg("bad data in the MiB at %llu\n",
+				       (unsigned long long)off);
+			close(fd);
+			return -1;
+		}
+		nr++;
+	}
+	elapsed = now_us() - start;
+	close(fd);
+
+	return nr * 1000000.0 / (elapsed ? elapsed : 1);
+}
+
+static int pass(const char *what, int stride)
+{
+	double mbs;
+
+	drop_caches();
+	mbs = read_file(stride);
+	if (mbs < 0) {
+		printf("%-28s FOUND BAD DATA\n", what);
+		return -1;
+	}
+	printf("%-28s %8.1f MiB/s\n", what, mbs);
+	print_stats();
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 3;
+	int opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "f:m:n:")) != -1) {
+		switch (opt) {
+		case 'f':
+			path = optarg;
+			break;
+		case 'm':
+			size_mb = atol(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s -f file [-m size_mb] [-n iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (!path)
+		ksft_exit_skip("needs -f with a file on a cached netfs mount\n");
+	if (size_mb < 2 || iterations <= 0)
+		ksft_exit_fail_msg("bad size or number of iterations\n");
+	if (geteuid())
+		ksft_exit_skip("must be run as root\n");
+	if (access(FSCACHE_STATS, R_OK))
+		ksft_exit_skip("fscache not available\n");
+
+	buf = malloc(ONE_MEG);
+	want = malloc(ONE_MEG);
+	if (!buf || !want)
+		ksft_exit_fail_msg("out of memory\n");
+
+	/*
+	 * A fresh file for each part, so that only what was read through
+	 * the mount is in the cache: nothing for the first pass, and every
+	 * other MiB for the mixed pass.  A netfs that writes to the cache on
+	 * write shows as fast server reads here.
+	 */
+	for (i = 0; i < iterations && !ret; i++) {
+		create_file();
+		ret |= pass("server", 1);
+		unlink(path);
+		create_file();
+		ret |= pass("fill every other MiB", 2);
+		ret |= pass("mixed cache and server", 1);
+		ret |= pass("cache", 1);
+		unlink(path);
+	}
+
+	free(buf);
+	free(want);
+	return ret ? KSFT_FAIL : KSFT_PASS;
+}
@@ -0,0 +1,270 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Latency of the first write to a large lower file on overlayfs: the time
+ * to open the file for write, which copies it up, plus the first pwrite.
+ * Measured with metacopy=on and lazy_copyup=off, where the open copies up
+ * all of the data, and with lazy_copyup=on, where only the chunk that is
+ * written to is copied up before the write.  After every run the overlay is
+ * mounted again and the data is checked, including the data of the chunks
+ * the lazy copy up may not have reached yet.
+ *
+ * Usage: ovl_lazy_copyup_bench [-d dir] [-m size_mb] [-n iterations]
+ *
+ * Needs to run as root, to mount.  The lower, upper and work directories
+ * are created in a temporary directory under dir, /tmp by default.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include "../../kselftest.h"
+
+#define ONE_MEG		(1024 * 1024)
+#define BLOCK		4096
+#define FILE_NAME	"data"
+#define WRITE_BYTE	0x5a
+
+static char base[PATH_MAX];
+static char lower[PATH_MAX + 16], upper[PATH_MAX + 16];
+static char work[PATH_MAX + 16], merged[PATH_MAX + 16];
+static size_t size_mb = 1024;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* Every block of the lower file starts with its offset */
+static void fill_block(char *buf, uint64_t off)
+{
+	memset(buf, (int)(off / BLOCK) & 0xff, BLOCK);
+	memcpy(buf, &off, sizeof(off));
+}
+
+static void create_lower(void)
+{
+	char path[PATH_MAX + 32];
+	uint64_t off;
+	char *buf;
+	size_t i;
+	int fd;
+
+	buf = malloc(ONE_MEG);
+	if (!buf)
+		ksft_exit_fail_msg("out of memory\n");
+
+	snprintf(path, sizeof(path), "%s/%s", lower, FILE_NAME);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		ksft_exit_fail_msg("create %s: %s\n", path, strerror(errno));
+
+	for (off = 0; off < size_mb * ONE_MEG; off += ONE_MEG) {
+		for (i = 0; i < ONE_MEG; i += BLOCK)
+			fill_block(buf + i, off + i);
+		if (write(fd, buf, ONE_MEG) != ONE_MEG)
+			ksft_exit_fail_msg("write %s: %s\n", path,
+					   strerror(errno));
+	}
+	if (fsync(fd))
+		ksft_exit_fail_msg("fsync %s: %s\n", path, strerror(errno));
+	close(fd);
+	free(buf);
+}
+
+static int rm_entry(const char *path, const struct stat *st, int flag,
+		    struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static void reset_upper(void)
+{
+	nftw(upper, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+	nftw(work, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+	if (mkdir(upper, 0755) || mkdir(work, 0755))
+		ksft_exit_fail_msg("mkdir: %s\n", strerror(errno));
+}
+
+static int mount_overlay(int lazy)
+{
+	char opts[4 * PATH_MAX];
+
+	snprintf(opts, sizeof(opts),
+		 "lowerdir=%s,upperdir=%s,workdir=%s,metacopy=on,lazy_copyup=%s",
+		 lower, upper, work, lazy ? "on" : "off");
+	return mount("overlay", merged, "overlay", 0, opts);
+}
+
+static int check_block(int fd, uint64_t off, uint64_t written)
+{
+	char buf[BLOCK], want[BLOCK];
+
+	if (off == written)
+		memset(want, WRITE_BYTE, BLOCK);
+	else
+		fill_block(want, off);
+
+	if (pread(fd, buf, BLOCK, off) != BLOCK || memcmp(buf, want, BLOCK)) {
+		ksft_print_msg("bad data at offset %llu\n",
+			       (unsigned long long)off);
+		return -1;
+	}
+	return 0;
+}
+
+/* Check the first and last block of every MiB, that covers the written one */
+static int verify(uint64_t written)
+{
+	char path[PATH_MAX + 32];
+	uint64_t off;
+	int fd, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", merged, FILE_NAME);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+
+	for (off = 0; off < size_mb * ONE_MEG && !ret; off += ONE_MEG) {
+		ret = check_block(fd, off, written);
+		if (!ret)
+			ret = check_block(fd, off + ONE_MEG - BLOCK, written);
+	}
+	close(fd);
+	return ret;
+}
+
+/* returns the open + first write latency in us, or 0 if the data was bad */
+static uint64_t first_write(int lazy)
+{
+	char path[PATH_MAX + 32], buf[BLOCK];
+	uint64_t start, elapsed, off;
+	int fd;
+
+	reset_upper();
+	if (mount_overlay(lazy))
+		ksft_exit_fail_msg("mount overlay: %s\n", strerror(errno));
+
+	/* A block in the middle, past what a background copy gets to first */
+	off = (size_mb / 2) * ONE_MEG - BLOCK;
+	memset(buf, WRITE_BYTE, BLOCK);
+	snprintf(path, sizeof(path), "%s/%s", merged, FILE_NAME);
+
+	start = now_us();
+	fd = open(path, O_RDWR);
+	if (fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+	if (pwrite(fd, buf, BLOCK, off) != BLOCK)
+		ksft_exit_fail_msg("pwrite: %s\n", strerror(errno));
+	elapsed = now_us() - start;
+	close(fd);
+
+	if (verify(off))
+		elapsed = 0;
+
+	/* The lazy copy up resumes from the map on the next mount */
+	if (umount2(merged, 0))
+		ksft_exit_fail_msg("umount: %s\n", strerror(errno));
+	if (mount_overlay(lazy))
+		ksft_exit_fail_msg("mount overlay: %s\n", strerror(errno));
+	if (verify(off))
+		elapsed = 0;
+	if (umount2(merged, 0))
+		ksft_exit_fail_msg("umount: %s\n", strerror(errno));
+
+	return elapsed;
+}
+
+static int bench(int lazy, int iterations)
+{
+	uint64_t t, min = UINT64_MAX, total = 0;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		t = first_write(lazy);
+		if (!t) {
+			printf("lazy_copyup=%-3s  FOUND BAD DATA\n",
+			       lazy ? "on" : "off");
+			return -1;
+		}
+		if (t < min)
+			min = t;
+		total += t;
+	}
+
+	printf("lazy_copyup=%-3s  %zu MiB  open + first write: min %10llu us  avg %10llu us\n",
+	       lazy ? "on" : "off", size_mb, (unsigned long long)min,
+	       (unsigned long long)(total / iterations));
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "/tmp";
+	int iterations = 3;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "d:m:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'm':
+			size_mb = atol(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d dir] [-m size_mb] [-n iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (size_mb < 2 || iterations <= 0)
+		ksft_exit_fail_msg("bad size or number of iterations\n");
+
+	if (geteuid())
+		ksft_exit_skip("must be run as root\n");
+
+	snprintf(base, sizeof(base), "%s/ovl-lazy-XXXXXX", dir);
+	if (!mkdtemp(base))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+	snprintf(lower, sizeof(lower), "%s/lower", base);
+	snprintf(upper, sizeof(upper), "%s/upper", base);
+	snprintf(work, sizeof(work), "%s/work", base);
+	snprintf(merged, sizeof(merged), "%s/merged", base);
+	if (mkdir(lower, 0755) || mkdir(merged, 0755))
+		ksft_exit_fail_msg("mkdir: %s\n", strerror(errno));
+
+	reset_upper();
+	if (mount_overlay(1)) {
+		ret = errno;
+		nftw(base, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+		ksft_exit_skip("Could not mount overlay with lazy_copyup=on: %s\n",
+			       strerror(ret));
+	}
+	umount2(merged, 0);
+
+	create_lower();
+
+	ret = bench(0, iterations);
+	ret |= bench(1, iterations);
+
+	nftw(base, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+	return ret ? KSFT_FAIL : KSFT_PASS;
+}
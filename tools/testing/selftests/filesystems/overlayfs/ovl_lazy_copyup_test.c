@@ -0,0 +1,436 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Data of a file on overlayfs with lazy_copyup=on after it was changed in
+ * the middle of the lazy copy up: extended with pwrite or ftruncate past
+ * the end of the lower file, which doesn't end on a chunk boundary, and
+ * truncated down and extended again.  The data is checked right away, and
+ * again on a read-only mount of the same layers, where the lazy copy up
+ * can't progress.  Also checks the mappings of a file in the middle of a
+ * lazy copy up: read-only private ones, before and after the file is
+ * written to and on a read-only mount, and shared writable ones.
+ *
+ * Usage: ovl_lazy_copyup_test [-d dir]
+ *
+ * Needs to run as root, to mount.  The lower, upper and work directories
+ * are created in a temporary directory under dir, /tmp by default.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include "../../kselftest.h"
+
+#define ONE_MEG		(1024 * 1024)
+/* Large enough to be copied up lazily, the last chunk is a partial one */
+#define LOWER_SIZE	(256ULL * ONE_MEG + 1000)
+#define FILE_NAME	"data"
+#define WRITE_BYTE	0x5a
+
+static char base[PATH_MAX];
+static char lower[PATH_MAX + 16], upper[PATH_MAX + 16];
+static char work[PATH_MAX + 16], merged[PATH_MAX + 16];
+static char path[PATH_MAX + 32];
+
+/* Every 8 bytes of the lower file hold their own offset */
+static void fill_pattern(char *p, uint64_t off, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i += sizeof(off), off += sizeof(off))
+		memcpy(p + i, &off, sizeof(off));
+}
+
+static void create_lower(void)
+{
+	char lower_path[PATH_MAX + 32];
+	uint64_t off;
+	size_t len;
+	char *buf;
+	int fd;
+
+	buf = malloc(ONE_MEG);
+	if (!buf)
+		ksft_exit_fail_msg("out of memory\n");
+
+	snprintf(lower_path, sizeof(lower_path), "%s/%s", lower, FILE_NAME);
+	fd = open(lower_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		ksft_exit_fail_msg("create %s: %s\n", lower_path,
+				   strerror(errno));
+
+	for (off = 0; off < LOWER_SIZE; off += len) {
+		len = LOWER_SIZE - off < ONE_MEG ? LOWER_SIZE - off : ONE_MEG;
+		fill_pattern(buf, off, len);
+		if (write(fd, buf, len) != len)
+			ksft_exit_fail_msg("write %s: %s\n", lower_path,
+					   strerror(errno));
+	}
+	if (fsync(fd))
+		ksft_exit_fail_msg("fsync %s: %s\n", lower_path,
+				   strerror(errno));
+	close(fd);
+	free(buf);
+}
+
+static int rm_entry(const char *path, const struct stat *st, int flag,
+		    struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static void reset_upper(void)
+{
+	nftw(upper, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+	nftw(work, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+	if (mkdir(upper, 0755) || mkdir(work, 0755))
+		ksft_exit_fail_msg("mkdir: %s\n", strerror(errno));
+}
+
+static int mount_overlay(unsigned long flags)
+{
+	char opts[4 * PATH_MAX];
+
+	snprintf(opts, sizeof(opts),
+		 "lowerdir=%s,upperdir=%s,workdir=%s,metacopy=on,lazy_copyup=on",
+		 lower, upper, work);
+	return mount("overlay", merged, "overlay", flags, opts);
+}
+
+static void remount(unsigned long flags)
+{
+	if (umount2(merged, 0))
+		ksft_exit_fail_msg("umount: %s\n", strerror(errno));
+	if (mount_overlay(flags))
+		ksft_exit_fail_msg("mount overlay: %s\n", strerror(errno));
+}
+
+/*
+ * The file is the lower data up to lower_end, zeroes up to size, except
+ * for [written, written + written_len) that holds WRITE_BYTE.  Reads all
+ * of the file past start, in reads that cross the chunk boundaries.
+ */
+struct layout {
+	uint64_t lower_end;
+	uint64_t written;
+	uint64_t written_len;
+	uint64_t size;
+};
+
+static int check_data(const struct layout *l, uint64_t start)
+{
+	static char buf[ONE_MEG + 4096], want[ONE_MEG + 4096];
+	uint64_t off, o;
+	struct stat st;
+	ssize_t n;
+	size_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+	if (fstat(fd, &st) || st.st_size != l->size) {
+		ksft_print_msg("size %llu, expected %llu\n",
+			       (unsigned long long)st.st_size,
+			       (unsigned long long)l->size);
+		close(fd);
+		return -1;
+	}
+
+	for (off = start; off < l->size; off += len) {
+		len = l->size - off < sizeof(buf) ? l->size - off : sizeof(buf);
+		n = pread(fd, buf, len, off);
+		if (n != len) {
+			ksft_print_msg("read %zu at %llu returned %zd\n", len,
+				       (unsigned long long)off, n);
+			close(fd);
+			return -1;
+		}
+
+		fill_pattern(want, off, len);
+		for (o = off; o < off + len; o++) {
+			if (o >= l->written && o < l->written + l->written_len)
+				want[o - off] = WRITE_BYTE;
+			else if (o >= l->lower_end)
+				want[o - off] = 0;
+		}
+		if (memcmp(buf, want, len)) {
+			ksft_print_msg("bad data in the %zu bytes at %llu\n",
+				       len, (unsigned long long)off);
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+/* Only a write-only open leaves the copy up in the middle */
+static int open_wr(void)
+{
+	int fd;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+	return fd;
+}
+
+/* Checks on the mount it was changed on and on a read-only mount */
+static void check(const char *name, const struct layout *l)
+{
+	/* The last few MiB of lower data and everything past it */
+	uint64_t start = l->lower_end - 3 * ONE_MEG - 8;
+	int ret;
+
+	ret = check_data(l, start);
+	if (!ret) {
+		remount(MS_RDONLY);
+		ret = check_data(l, start);
+	}
+	if (umount2(merged, 0))
+		ksft_exit_fail_msg("umount: %s\n", strerror(errno));
+
+	ksft_test_result(!ret, "%s\n", name);
+}
+
+static void start(void)
+{
+	reset_upper();
+	if (mount_overlay(0))
+		ksft_exit_fail_msg("mount overlay: %s\n", strerror(errno));
+}
+
+static void test_pwrite_extend(void)
+{
+	struct layout l = {
+		.lower_end	= LOWER_SIZE,
+		.written	= LOWER_SIZE + 2 * ONE_MEG + 16,
+		.written_len	= 4096,
+		.size		= LOWER_SIZE + 2 * ONE_MEG + 16 + 4096,
+	};
+	char buf[4096];
+	int fd;
+
+	start();
+	memset(buf, WRITE_BYTE, sizeof(buf));
+	fd = open_wr();
+	if (pwrite(fd, buf, sizeof(buf), l.written) != sizeof(buf))
+		ksft_exit_fail_msg("pwrite: %s\n", strerror(errno));
+	close(fd);
+
+	check("pwrite past the end of the lower file", &l);
+}
+
+static void test_ftruncate_extend(void)
+{
+	struct layout l = {
+		.lower_end	= LOWER_SIZE,
+		.size		= LOWER_SIZE + 3 * ONE_MEG + 100,
+	};
+	int fd;
+
+	start();
+	fd = open_wr();
+	if (ftruncate(fd, l.size))
+		ksft_exit_fail_msg("ftruncate: %s\n", strerror(errno));
+	close(fd);
+
+	check("ftruncate past the end of the lower file", &l);
+}
+
+static void test_ftruncate_shrink_extend(void)
+{
+	struct layout l = {
+		.lower_end	= LOWER_SIZE - 2 * ONE_MEG - 200,
+		.size		= LOWER_SIZE + ONE_MEG,
+	};
+	int fd;
+
+	start();
+	fd = open_wr();
+	if (ftruncate(fd, l.lower_end) || ftruncate(fd, l.size))
+		ksft_exit_fail_msg("ftruncate: %s\n", strerror(errno));
+	close(fd);
+
+	check("ftruncate down and up again", &l);
+}
+
+/* Maps all of the file read-only and private, like ld.so does */
+static int check_mmap(const struct layout *l)
+{
+	char *want, *p;
+	uint64_t o;
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+	p = mmap(NULL, l->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		ksft_print_msg("mmap: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	want = malloc(l->size);
+	if (!want)
+		ksft_exit_fail_msg("out of memory\n");
+	fill_pattern(want, 0, l->size);
+	for (o = l->written; o < l->written + l->written_len; o++)
+		want[o] = WRITE_BYTE;
+	ret = memcmp(p, want, l->size) ? -1 : 0;
+	if (ret)
+		ksft_print_msg("bad data in the mapping\n");
+
+	free(want);
+	munmap(p, l->size);
+	close(fd);
+	return ret;
+}
+
+static void test_mmap_private(void)
+{
+	struct layout l = {
+		.lower_end	= LOWER_SIZE,
+		.size		= LOWER_SIZE,
+	};
+	int fd, ret;
+
+	start();
+	/* Opening for write starts the lazy copy up */
+	fd = open_wr();
+	ret = check_mmap(&l);
+	close(fd);
+	if (umount2(merged, 0))
+		ksft_exit_fail_msg("umount: %s\n", strerror(errno));
+
+	ksft_test_result(!ret, "read-only private mapping\n");
+}
+
+static void test_mmap_modified(void)
+{
+	struct layout l = {
+		.lower_end	= LOWER_SIZE,
+		.written	= 64 * ONE_MEG - 100,
+		.written_len	= 4096,
+		.size		= LOWER_SIZE,
+	};
+	char buf[4096];
+	int fd, ret;
+
+	start();
+	memset(buf, WRITE_BYTE, sizeof(buf));
+	fd = open_wr();
+	if (pwrite(fd, buf, sizeof(buf), l.written) != sizeof(buf))
+		ksft_exit_fail_msg("pwrite: %s\n", strerror(errno));
+
+	ret = check_mmap(&l);
+	close(fd);
+	if (!ret) {
+		remount(MS_RDONLY);
+		ret = check_mmap(&l);
+	}
+	if (umount2(merged, 0))
+		ksft_exit_fail_msg("umount: %s\n", strerror(errno));
+
+	ksft_test_result(!ret, "private mapping after write, also read-only mount\n");
+}
+
+static void test_mmap_shared(void)
+{
+	struct layout l = {
+		.lower_end	= LOWER_SIZE,
+		.written	= LOWER_SIZE - 4096,
+		.written_len	= 4096,
+		.size		= LOWER_SIZE,
+	};
+	int fd, ret;
+	char *p;
+
+	start();
+	fd = open_wr();
+	/* The lazy copy up is completed on open for read and write */
+	ret = open(path, O_RDWR);
+	if (ret < 0)
+		ksft_exit_fail_msg("open %s: %s\n", path, strerror(errno));
+	close(fd);
+	fd = ret;
+
+	p = mmap(NULL, LOWER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		ksft_exit_fail_msg("mmap: %s\n", strerror(errno));
+	memset(p + l.written, WRITE_BYTE, l.written_len);
+	ret = msync(p, LOWER_SIZE, MS_SYNC);
+	munmap(p, LOWER_SIZE);
+	close(fd);
+	if (ret)
+		ksft_exit_fail_msg("msync: %s\n", strerror(errno));
+
+	check("shared writable mapping", &l);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "/tmp";
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "d:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-d dir]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	ksft_print_header();
+
+	if (geteuid())
+		ksft_exit_skip("must be run as root\n");
+
+	snprintf(base, sizeof(base), "%s/ovl-lazy-XXXXXX", dir);
+	if (!mkdtemp(base))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+	snprintf(lower, sizeof(lower), "%s/lower", base);
+	snprintf(upper, sizeof(upper), "%s/upper", base);
+	snprintf(work, sizeof(work), "%s/work", base);
+	snprintf(merged, sizeof(merged), "%s/merged", base);
+	snprintf(path, sizeof(path), "%s/%s", merged, FILE_NAME);
+	if (mkdir(lower, 0755) || mkdir(merged, 0755))
+		ksft_exit_fail_msg("mkdir: %s\n", strerror(errno));
+
+	reset_upper();
+	if (mount_overlay(0)) {
+		ret = errno;
+		nftw(base, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+		ksft_exit_skip("Could not mount overlay with lazy_copyup=on: %s\n",
+			       strerror(ret));
+	}
+	umount2(merged, 0);
+
+	create_lower();
+
+	ksft_set_plan(6);
+	test_pwrite_extend();
+	test_ftruncate_extend();
+	test_ftruncate_shrink_extend();
+	test_mmap_private();
+	test_mmap_modified();
+	test_mmap_shared();
+
+	nftw(base, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+	ksft_finished();
+}
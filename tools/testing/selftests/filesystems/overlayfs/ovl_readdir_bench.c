@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Parallel readdir of a large merged overlayfs directory: a number of
+ * threads each open, read to the end and close the same merged dir in a
+ * loop, the way many concurrent "ls" of a package tree do.  Measured with
+ * the readdir_cache_kb module parameter set to 0, so that every opener that
+ * doesn't overlap with another one merges the layers again, and with the
+ * default, where the merged listing is kept after the last close.  Every
+ * listing is checked to have all the entries.
+ *
+ * Usage: ovl_readdir_bench [-d dir] [-e entries] [-t threads] [-n iterations]
+ *
+ * Needs to run as root, to mount and to set the module parameter.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include "../../kselftest.h"
+
+#define CACHE_PARAM	"/sys/module/overlay/parameters/readdir_cache_kb"
+#define CACHE_STATS	"/sys/kernel/debug/overlay/readdir_cache"
+#define UPPER_ENTRIES	1000
+
+static char base[PATH_MAX];
+static char lower[PATH_MAX + 16], upper[PATH_MAX + 16];
+static char work[PATH_MAX + 16], merged[PATH_MAX + 16];
+static char opts[4 * PATH_MAX];
+static long nr_entries = 100000;
+static int iterations = 20;
+static int bad_listing;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void create_entries(const char *dir, const char *prefix, long n)
+{
+	char path[PATH_MAX + 64];
+	long i;
+	int fd;
+
+	for (i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "%s/%s%08ld", dir, prefix, i);
+		fd = open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0)
+			ksft_exit_fail_msg("create %s: %s\n", path,
+					   strerror(errno));
+		close(fd);
+	}
+}
+
+static int rm_entry(const char *path, const struct stat *st, int flag,
+		    struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static void cleanup(void)
+{
+	umount2(merged, MNT_DETACH);
+	nftw(base, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static int read_param(void)
+{
+	char buf[32] = "";
+	int fd;
+
+	fd = open(CACHE_PARAM, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (read(fd, buf, sizeof(buf) - 1) < 0)
+		buf[0] = '\0';
+	close(fd);
+	return atoi(buf);
+}
+
+static void write_param(int kb)
+{
+	char buf[32];
+	int fd, len;
+
+	len = snprintf(buf, sizeof(buf), "%d\n", kb);
+	fd = open(CACHE_PARAM, O_WRONLY);
+	if (fd < 0 || write(fd, buf, len) != len)
+		ksft_exit_fail_msg("set %s: %s\n", CACHE_PARAM, strerror(errno));
+	close(fd);
+}
+
+static void print_stats(void)
+{
+	char line[128];
+	FILE *f;
+
+	f = fopen(CACHE_STATS, "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f))
+		printf("  %s", line);
+	fclose(f);
+}
+
+static void *reader(void *arg)
+{
+	long expected = nr_entries + UPPER_ENTRIES + 2;
+	struct dirent *de;
+	long count;
+	DIR *dir;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		dir = opendir(merged);
+		if (!dir)
+			ksft_exit_fail_msg("opendir: %s\n", strerror(errno));
+		count = 0;
+		while ((de = readdir(dir)))
+			count++;
+		closedir(dir);
+
+		if (count != expected) {
+			ksft_print_msg("listed %ld entries, expected %ld\n",
+				       count, expected);
+			__atomic_store_n(&bad_listing, 1, __ATOMIC_RELAXED);
+		}
+	}
+	return NULL;
+}
+
+static void bench(const char *what, int threads)
+{
+	pthread_t *tids;
+	uint64_t start, elapsed;
+	int i;
+
+	tids = calloc(threads, sizeof(*tids));
+	if (!tids)
+		ksft_exit_fail_msg("out of memory\n");
+
+	/* Start every run without a merged listing */
+	umount2(merged, 0);
+	if (mount("overlay", merged, "overlay", 0, opts))
+		ksft_exit_fail_msg("mount overlay: %s\n", strerror(errno));
+
+	start = now_us();
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&tids[i], NULL, reader, NULL))
+			ksft_exit_fail_msg("pthread_create failed\n");
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	elapsed = now_us() - start;
+
+	printf("%-20s %d threads x %d readdirs: %8.1f readdir/s  avg %8llu us\n",
+	       what, threads, iterations,
+	       threads * iterations * 1000000.0 / elapsed,
+	       (unsigned long long)(elapsed / iterations));
+	print_stats();
+	free(tids);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "/tmp";
+	int threads = 8;
+	int opt, cache_kb;
+
+	while ((opt = getopt(argc, argv, "d:e:t:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'e':
+			nr_entries = atol(optarg);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d dir] [-e entries] [-t threads] [-n iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (nr_entries <= 0 || threads <= 0 || iterations <= 0)
+		ksft_exit_fail_msg("bad number of entries, threads or iterations\n");
+
+	if (geteuid())
+		ksft_exit_skip("must be run as root\n");
+
+	cache_kb = read_param();
+	if (cache_kb < 0)
+		ksft_exit_skip("overlay readdir cache not supported\n");
+
+	snprintf(base, sizeof(base), "%s/ovl-readdir-XXXXXX", dir);
+	if (!mkdtemp(base))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+	snprintf(lower, sizeof(lower), "%s/lower", base);
+	snprintf(upper, sizeof(upper), "%s/upper", base);
+	snprintf(work, sizeof(work), "%s/work", base);
+	snprintf(merged, sizeof(merged), "%s/merged", base);
+	if (mkdir(lower, 0755) || mkdir(upper, 0755) || mkdir(work, 0755) ||
+	    mkdir(merged, 0755))
+		ksft_exit_fail_msg("mkdir: %s\n", strerror(errno));
+	snprintf(opts, sizeof(opts), "lowerdir=%s,upperdir=%s,workdir=%s",
+		 lower, upper, work);
+
+	create_entries(lower, "lower-", nr_entries);
+	create_entries(upper, "upper-", UPPER_ENTRIES);
+
+	write_param(0);
+	bench("readdir_cache_kb=0", threads);
+	write_param(cache_kb ? cache_kb : 32768);
+	bench("readdir_cache_kb", threads);
+	write_param(cache_kb);
+
+	cleanup();
+	return bad_listing ? KSFT_FAIL : KSFT_PASS;
+}
@@ -39,6 +39,12 @@ extern int optind;
 #ifndef TCP_ULP
 #define TCP_ULP 31
 #endif
+#ifndef SOL_MPTCP
+#define SOL_MPTCP 284
+#endif
+#ifndef MPTCP_SCHEDULER
+#define MPTCP_SCHEDULER 4
+#endif
 
 static int  poll_timeout = 10 * 1000;
 static bool listen_mode;
@@ -72,6 +78,7 @@ static int cfg_wait;
 static uint32_t cfg_mark;
 static char *cfg_input;
 static int cfg_repeat = 1;
+static const char *cfg_scheduler;
 
 struct cfg_cmsg_types {
 	unsigned int cmsg_enabled:1;
@@ -108,7 +115,7 @@ static void die_usage(void)
 	fprintf(stderr, "\t-l     -- listens mode, accepts incoming connection\n");
 	fprintf(stderr, "\t-m [poll|mmap|sendfile] -- use poll(default)/mmap+write/sendfile\n");
 	fprintf(stderr, "\t-M mark -- set socket packet mark\n");
-	fprintf(stderr, "\t-o option -- test sockopt <option>\n");
+	fprintf(stderr, "\t-o option -- test sockopt <option>, TRANSPARENT or SCHEDULER=<name>\n");
 	fprintf(stderr, "\t-p num -- use port num\n");
 	fprintf(stderr,
 		"\t-P [saveWithPeek|saveAfterPeek] -- save data with/after MSG_PEEK form tcp socket\n");
@@ -226,6 +233,12 @@ static void set_transparent(int fd, int pf)
 	}
 }
 
+static void set_scheduler(int fd, const char *name)
+{
+	if (-1 == setsockopt(fd, SOL_MPTCP, MPTCP_SCHEDULER, name, strlen(name)))
+		xerror("can't set MPTCP_SCHEDULER %s: %d", name, errno);
+}
+
 static int do_ulp_so(int sock, const char *name)
 {
 	return setsockopt(sock, IPPROTO_TCP, TCP_ULP, name, strlen(name));
@@ -294,6 +307,9 @@ static int sock_listen_mptcp(const char * const listenaddr,
 		if (cfg_sockopt_types.transparent)
 			set_transparent(sock, pf);
 
+		if (cfg_scheduler && cfg_sock_proto == IPPROTO_MPTCP)
+			set_scheduler(sock, cfg_scheduler);
+
 		if (bind(sock, a->ai_addr, a->ai_addrlen) == 0)
 			break; /* success */
 
@@ -348,6 +364,9 @@ static int sock_connect_mptcp(const char * const remoteaddr,
 		if (cfg_mark)
 			set_mark(sock, cfg_mark);
 
+		if (cfg_scheduler && proto == IPPROTO_MPTCP)
+			set_scheduler(sock, cfg_scheduler);
+
 		if (connect(sock, a->ai_addr, a->ai_addrlen) == 0) {
 			*peer = a;
 			break; /* success */
@@ -1089,6 +1108,11 @@ static void parse_setsock_options(const char *name)
 		return;
 	}
 
+	if (strncmp(name, "SCHEDULER=", 10) == 0 && len > 10) {
+		cfg_scheduler = strndup(name + 10, len - 10);
+		return;
+	}
+
 	fprintf(stderr, "Unrecognized setsockopt option %s\n", name);
 	exit(1);
 }
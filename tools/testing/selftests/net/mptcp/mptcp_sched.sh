@@ -0,0 +1,255 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare the MPTCP packet schedulers over two netem shaped subflows:
+# for each scheduler, report the throughput of a bulk transfer and the
+# median and tail completion time of a series of short transfers.
+# The short transfers include the 200ms mp_join wait of mptcp_connect -j
+# on each side.
+
+sec=$(date +%s)
+rndh=$(printf %x $sec)-$(mktemp -u XXXXXX)
+ns1="ns1-$rndh"
+ns2="ns2-$rndh"
+ns3="ns3-$rndh"
+ksft_skip=4
+timeout_poll=30
+timeout_test=$((timeout_poll * 2 + 1))
+schedulers="default roundrobin latency redundant"
+short_runs=20
+test_cnt=1
+ret=0
+
+usage() {
+	echo "Usage: $0 [ -d ] [ -n runs ] [ -s schedulers ]"
+	echo -e "\t-d: debug this script"
+	echo -e "\t-n: number of short transfers per scheduler (default: $short_runs)"
+	echo -e "\t-s: space separated list of schedulers (default: \"$schedulers\")"
+}
+
+cleanup()
+{
+	rm -f "$cout" "$sout"
+	rm -f "$large" "$small"
+
+	local netns
+	for netns in "$ns1" "$ns2" "$ns3";do
+		ip netns del $netns
+	done
+}
+
+ip -Version > /dev/null 2>&1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+#  "$ns1"              ns2                    ns3
+#     ns1eth1    ns2eth1   ns2eth3      ns3eth1
+#            netem
+#     ns1eth2    ns2eth2
+#            netem
+
+setup()
+{
+	large=$(mktemp)
+	small=$(mktemp)
+	sout=$(mktemp)
+	cout=$(mktemp)
+	size=$((2 * 2048 * 4096))
+	dd if=/dev/zero of=$small bs=4096 count=20 >/dev/null 2>&1
+	dd if=/dev/zero of=$large bs=4096 count=$((size / 4096)) >/dev/null 2>&1
+
+	trap cleanup EXIT
+
+	for i in "$ns1" "$ns2" "$ns3";do
+		ip netns add $i || exit $ksft_skip
+		ip -net $i link set lo up
+		ip netns exec $i sysctl -q net.ipv4.conf.all.rp_filter=0
+		ip netns exec $i sysctl -q net.ipv4.conf.default.rp_filter=0
+	done
+
+	ip link add ns1eth1 netns "$ns1" type veth peer name ns2eth1 netns "$ns2"
+	ip link add ns1eth2 netns "$ns1" type veth peer name ns2eth2 netns "$ns2"
+	ip link add ns2eth3 netns "$ns2" type veth peer name ns3eth1 netns "$ns3"
+
+	ip -net "$ns1" addr add 10.0.1.1/24 dev ns1eth1
+	ip -net "$ns1" link set ns1eth1 up mtu 1500
+	ip -net "$ns1" route add default via 10.0.1.2
+
+	ip -net "$ns1" addr add 10.0.2.1/24 dev ns1eth2
+	ip -net "$ns1" link set ns1eth2 up mtu 1500
+	ip -net "$ns1" route add default via 10.0.2.2 metric 101
+
+	ip netns exec "$ns1" ./pm_nl_ctl limits 1 1
+	ip netns exec "$ns1" ./pm_nl_ctl add 10.0.2.1 dev ns1eth2 flags subflow
+
+	ip -net "$ns2" addr add 10.0.1.2/24 dev ns2eth1
+	ip -net "$ns2" link set ns2eth1 up mtu 1500
+
+	ip -net "$ns2" addr add 10.0.2.2/24 dev ns2eth2
+	ip -net "$ns2" link set ns2eth2 up mtu 1500
+
+	ip -net "$ns2" addr add 10.0.3.2/24 dev ns2eth3
+	ip -net "$ns2" link set ns2eth3 up mtu 1500
+	ip netns exec "$ns2" sysctl -q net.ipv4.ip_forward=1
+
+	ip -net "$ns3" addr add 10.0.3.3/24 dev ns3eth1
+	ip -net "$ns3" link set ns3eth1 up mtu 1500
+	ip -net "$ns3" route add default via 10.0.3.2
+
+	ip netns exec "$ns3" ./pm_nl_ctl limits 1 1
+}
+
+# $1: ns, $2: port
+wait_local_port_listen()
+{
+	local listener_ns="${1}"
+	local port="${2}"
+
+	local port_hex i
+
+	port_hex="$(printf "%04X" "${port}")"
+	for i in $(seq 10); do
+		ip netns exec "${listener_ns}" cat /proc/net/tcp* | \
+			awk "BEGIN {rc=1} {if (\$2 ~ /:${port_hex}\$/ && \$4 ~ /0A/) {rc=0; exit}} END {exit rc}" &&
+			break
+		sleep 0.1
+	done
+}
+
+# $1: scheduler, $2: file sent by the client
+# prints the transfer time in ms, fails if the data got corrupted
+do_transfer()
+{
+	local sched=$1
+	local cin=$2
+	local port
+	port=$((10000+$test_cnt))
+	test_cnt=$((test_cnt+1))
+
+	:> "$cout"
+	:> "$sout"
+
+	timeout ${timeout_test} \
+		ip netns exec ${ns3} \
+			./mptcp_connect -jt ${timeout_poll} -l -p $port \
+				-o SCHEDULER=$sched 0.0.0.0 < "$small" > "$sout" &
+	local spid=$!
+
+	wait_local_port_listen "${ns3}" "${port}"
+
+	local start
+	start=$(date +%s%N)
+	timeout ${timeout_test} \
+		ip netns exec ${ns1} \
+			./mptcp_connect -jt ${timeout_poll} -p $port \
+				-o SCHEDULER=$sched 10.0.3.3 < "$cin" > "$cout"
+	local retc=$?
+	local stop
+	stop=$(date +%s%N)
+	wait $spid
+	local rets=$?
+
+	cmp $small $cout > /dev/null 2>&1 && cmp $cin $sout > /dev/null 2>&1
+	local cmpr=$?
+
+	if [ $retc -ne 0 ] || [ $rets -ne 0 ] || [ $cmpr -ne 0 ]; then
+		echo "client exit code $retc, server $rets, cmp $cmpr" 1>&2
+		return 1
+	fi
+
+	echo $(((stop - start) / 1000000))
+	return 0
+}
+
+run_test()
+{
+	local rate1=$1
+	local rate2=$2
+	local delay1=$3
+	local delay2=$4
+	local sched
+	local dev
+	shift 4
+	local msg=$*
+
+	[ $delay1 -gt 0 ] && delay1="delay ${delay1}ms" || delay1=""
+	[ $delay2 -gt 0 ] && delay2="delay ${delay2}ms" || delay2=""
+
+	for dev in ns1eth1 ns1eth2; do
+		tc -n $ns1 qdisc del dev $dev root >/dev/null 2>&1
+	done
+	for dev in ns2eth1 ns2eth2; do
+		tc -n $ns2 qdisc del dev $dev root >/dev/null 2>&1
+	done
+	tc -n $ns1 qdisc add dev ns1eth1 root netem rate ${rate1}mbit $delay1
+	tc -n $ns1 qdisc add dev ns1eth2 root netem rate ${rate2}mbit $delay2
+	tc -n $ns2 qdisc add dev ns2eth1 root netem rate ${rate1}mbit $delay1
+	tc -n $ns2 qdisc add dev ns2eth2 root netem rate ${rate2}mbit $delay2
+
+	echo "$msg"
+	printf "%-12s %12s %10s %10s\n" "scheduler" "bulk Mbit/s" "p50 ms" "p95 ms"
+	for sched in $schedulers; do
+		local bulk
+		local times=""
+		local i
+
+		if ! bulk=$(do_transfer $sched $large); then
+			echo "$sched: bulk transfer failed"
+			ret=1
+			continue
+		fi
+
+		for i in $(seq $short_runs); do
+			local t
+
+			if ! t=$(do_transfer $sched $small); then
+				echo "$sched: short transfer failed"
+				ret=1
+				continue 2
+			fi
+			times="$times $t"
+		done
+
+		local sorted
+		sorted=$(echo $times | tr ' ' '\n' | sort -n)
+		printf "%-12s %12d %10d %10d\n" $sched \
+			$((size * 8 / 1000 / bulk)) \
+			$(echo "$sorted" | sed -n "$(( (short_runs + 1) / 2 ))p") \
+			$(echo "$sorted" | sed -n "$(( (short_runs * 95 + 99) / 100 ))p")
+	done
+}
+
+while getopts "dhn:s:" option;do
+	case "$option" in
+	"h")
+		usage $0
+		exit 0
+		;;
+	"d")
+		set -x
+		;;
+	"n")
+		short_runs=$OPTARG
+		;;
+	"s")
+		schedulers=$OPTARG
+		;;
+	"?")
+		usage $0
+		exit 1
+		;;
+	esac
+done
+
+if [ ! -f /proc/sys/net/mptcp/scheduler ]; then
+	echo "SKIP: MPTCP packet schedulers are not supported"
+	exit $ksft_skip
+fi
+
+setup
+run_test 10 10 1 1 "balanced bwidth and delay"
+run_test 30 10 1 50 "unbalanced bwidth with unbalanced delay"
+run_test 30 10 50 1 "unbalanced bwidth with opposed, unbalanced delay"
+exit $ret
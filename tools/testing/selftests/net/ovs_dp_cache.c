@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sets the size of the Open vSwitch datapath microflow cache and dumps the
+ * datapath lookup statistics, for the microflow cache benchmark.
+ *
+ * Usage: ovs_dp_cache <datapath> [microflow_cache_size]
+ */
+
+#include <errno.h>
+#include <error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/openvswitch.h>
+#include <linux/rtnetlink.h>
+
+#define OVS_DP_ATTR_MICROFLOW_CACHE_SIZE_	(OVS_DP_ATTR_PER_CPU_PIDS + 1)
+
+/* Mirrors struct ovs_dp_megaflow_stats, which system headers may predate */
+struct megaflow_stats {
+	__u64 n_mask_hit;
+	__u32 n_masks;
+	__u32 pad0;
+	__u64 n_cache_hit;
+	__u64 n_microflow_hit;
+};
+
+#define BUF_SIZE	8192
+
+static int init_genl_req(char *data, int family, int cmd, int flags)
+{
+	struct nlmsghdr *nh = (void *)data;
+	struct genlmsghdr *gh;
+	int off = 0;
+
+	nh->nlmsg_type = family;
+	nh->nlmsg_flags = NLM_F_REQUEST | flags;
+	off += NLMSG_ALIGN(sizeof(*nh));
+
+	gh = (void *)(data + off);
+	gh->cmd = cmd;
+	gh->version = family == GENL_ID_CTRL ? 0 : OVS_DATAPATH_VERSION;
+	off += NLMSG_ALIGN(sizeof(*gh));
+
+	/* The controller does not take any family specific header */
+	if (family != GENL_ID_CTRL) {
+		memset(data + off, 0, sizeof(struct ovs_header));
+		off += NLMSG_ALIGN(sizeof(struct ovs_header));
+	}
+	return off;
+}
+
+static int add_attr(char *data, int off, int type, const void *val, int len)
+{
+	struct rtattr *rta = (void *)(data + off);
+
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), val, len);
+	return off + RTA_ALIGN(rta->rta_len);
+}
+
+/* Send a request and return the first reply, bailing out on errors */
+static struct nlmsghdr *do_nl_req(int fd, char *data, int len)
+{
+	struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
+	struct nlmsghdr *nh = (void *)data;
+	int ret;
+
+	nh->nlmsg_len = len;
+	ret = sendto(fd, data, len, 0, (void *)&nladdr, sizeof(nladdr));
+	if (ret != len)
+		error(1, errno, "send netlink: %dB != %dB", ret, len);
+
+	ret = recv(fd, data, BUF_SIZE, 0);
+	if (ret < 0)
+		error(1, errno, "recv netlink");
+	if (!NLMSG_OK(nh, ret))
+		error(1, 0, "truncated netlink reply");
+
+	if (nh->nlmsg_type == NLMSG_ERROR) {
+		struct nlmsgerr *err = NLMSG_DATA(nh);
+
+		if (err->error)
+			error(1, -err->error, "netlink request");
+	}
+	return nh;
+}
+
+static struct rtattr *find_attr(struct nlmsghdr *nh, int hdrlen, int type)
+{
+	struct rtattr *rta = (void *)((char *)NLMSG_DATA(nh) + hdrlen);
+	int len = nh->nlmsg_len - NLMSG_LENGTH(hdrlen);
+
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+		if (rta->rta_type == type)
+			return rta;
+	return NULL;
+}
+
+static int resolve_family(int fd, char *data)
+{
+	struct nlmsghdr *nh;
+	struct rtattr *rta;
+	int off;
+
+	off = init_genl_req(data, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0);
+	off = add_attr(data, off, CTRL_ATTR_FAMILY_NAME, OVS_DATAPATH_FAMILY,
+		       sizeof(OVS_DATAPATH_FAMILY));
+
+	nh = do_nl_req(fd, data, off);
+	rta = find_attr(nh, GENL_HDRLEN, CTRL_ATTR_FAMILY_ID);
+	if (!rta)
+		error(1, 0, "can't find CTRL_ATTR_FAMILY_ID attr");
+	return *(__u16 *)RTA_DATA(rta);
+}
+
+static struct nlmsghdr *get_dp(int fd, char *data, int family,
+			       const char *name)
+{
+	int off;
+
+	memset(data, 0, BUF_SIZE);
+	off = init_genl_req(data, family, OVS_DP_CMD_GET, 0);
+	off = add_attr(data, off, OVS_DP_ATTR_NAME, name, strlen(name) + 1);
+	return do_nl_req(fd, data, off);
+}
+
+int main(int argc, char *argv[])
+{
+	int hdrlen = GENL_HDRLEN + NLMSG_ALIGN(sizeof(struct ovs_header));
+	struct megaflow_stats stats = {};
+	struct nlmsghdr *nh;
+	struct rtattr *rta;
+	int fd, family, off;
+	static char data[BUF_SIZE];
+
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "Usage: %s <datapath> [microflow_cache_size]\n",
+			argv[0]);
+		return 1;
+	}
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+	if (fd < 0)
+		error(1, errno, "socket netlink");
+
+	family = resolve_family(fd, data);
+	nh = get_dp(fd, data, family, argv[1]);
+
+	if (argc == 3) {
+		__u32 size = strtoul(argv[2], NULL, 0);
+		__u32 features = 0;
+
+		/* OVS_DP_CMD_SET resets any user feature it is not given */
+		rta = find_attr(nh, hdrlen, OVS_DP_ATTR_USER_FEATURES);
+		if (rta)
+			features = *(__u32 *)RTA_DATA(rta);
+
+		memset(data, 0, BUF_SIZE);
+		off = init_genl_req(data, family, OVS_DP_CMD_SET, NLM_F_ACK);
+		off = add_attr(data, off, OVS_DP_ATTR_NAME, argv[1],
+			       strlen(argv[1]) + 1);
+		off = add_attr(data, off, OVS_DP_ATTR_USER_FEATURES,
+			       &features, sizeof(features));
+		off = add_attr(data, off, OVS_DP_ATTR_MICROFLOW_CACHE_SIZE_,
+			       &size, sizeof(size));
+		do_nl_req(fd, data, off);
+
+		nh = get_dp(fd, data, family, argv[1]);
+	}
+
+	rta = find_attr(nh, hdrlen, OVS_DP_ATTR_MEGAFLOW_STATS);
+	if (rta)
+		memcpy(&stats, RTA_DATA(rta),
+		       RTA_PAYLOAD(rta) < sizeof(stats) ? RTA_PAYLOAD(rta) :
+							  sizeof(stats));
+
+	rta = find_attr(nh, hdrlen, OVS_DP_ATTR_MICROFLOW_CACHE_SIZE_);
+	if (!rta) {
+		fprintf(stderr, "SKIP: no microflow cache in this datapath\n");
+		return 4;
+	}
+
+	printf("%s: microflow cache %u entries, masks %u, mask hits %llu, mask cache hits %llu, microflow hits %llu\n",
+	       argv[1], *(__u32 *)RTA_DATA(rta), stats.n_masks,
+	       (unsigned long long)stats.n_mask_hit,
+	       (unsigned long long)stats.n_cache_hit,
+	       (unsigned long long)stats.n_microflow_hit);
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,101 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Benchmark the Open vSwitch datapath microflow cache: forward many UDP
+# flows between two veth pairs through a bridge whose OpenFlow rules
+# generate many megaflow masks, with the microflow cache disabled and
+# enabled, and report the forwarding rate and the datapath lookup stats.
+# Needs a running ovs-vswitchd and pktgen.
+
+readonly ksft_skip=4
+readonly BR="ovsbench$(mktemp -u XXXX)"
+readonly NS="ovs-bench-$(mktemp -u XXXXXX)"
+readonly DURATION=${DURATION:-10}
+readonly NR_MASKS=${NR_MASKS:-32}
+readonly NR_FLOWS=${NR_FLOWS:-4096}
+readonly PGDEV=/proc/net/pktgen
+
+cleanup() {
+	echo "reset" > ${PGDEV}/pgctrl 2>/dev/null
+	ovs-vsctl --if-exists del-br "${BR}"
+	ip link del vbench0 2>/dev/null
+	ip netns del "${NS}" 2>/dev/null
+}
+
+pgset() {
+	echo "$2" > "${PGDEV}/$1" || exit 1
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+for tool in ovs-vsctl ovs-ofctl; do
+	if ! command -v ${tool} > /dev/null; then
+		echo "SKIP: ${tool} not found"
+		exit $ksft_skip
+	fi
+done
+
+if ! ovs-vsctl show > /dev/null 2>&1; then
+	echo "SKIP: ovs-vswitchd is not running"
+	exit $ksft_skip
+fi
+
+if [ ! -d ${PGDEV} ] && ! modprobe pktgen 2>/dev/null; then
+	echo "SKIP: pktgen is not available"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+ip netns add "${NS}" || exit $ksft_skip
+ip link add vbench0 type veth peer name vbench1 || exit $ksft_skip
+ip link add vbench2 type veth peer name vbench3 netns "${NS}" || exit 1
+ip -netns "${NS}" addr add 10.0.0.2/8 dev vbench3
+for dev in vbench0 vbench1 vbench2; do
+	ip link set ${dev} up
+done
+ip -netns "${NS}" link set vbench3 up
+
+ovs-vsctl add-br "${BR}" -- \
+	set bridge "${BR}" datapath_type=system -- \
+	add-port "${BR}" vbench1 -- add-port "${BR}" vbench2 || exit 1
+
+# Every prefix length of the destination address is a different mask, ports
+# are matched exactly so that each flow gets its own megaflow.
+ovs-ofctl del-flows "${BR}"
+for i in $(seq 1 ${NR_MASKS}); do
+	ovs-ofctl add-flow "${BR}" \
+		"priority=${i},udp,nw_dst=10.0.0.2/${i},actions=output:vbench2"
+done
+ovs-ofctl add-flow "${BR}" "priority=0,actions=drop"
+
+echo "reset" > ${PGDEV}/pgctrl
+pgset kpktgend_0 "rem_device_all"
+pgset kpktgend_0 "add_device vbench0"
+pgset vbench0 "count 0"
+pgset vbench0 "pkt_size 64"
+pgset vbench0 "dst 10.0.0.2"
+pgset vbench0 "dst_mac $(ip -netns "${NS}" -br link show vbench3 | awk '{print $3}')"
+pgset vbench0 "udp_src_min 1024"
+pgset vbench0 "udp_src_max $((1024 + NR_FLOWS - 1))"
+pgset vbench0 "flag UDPSRC_RND"
+pgset vbench0 "flag NO_TIMESTAMP"
+
+dp="ovs-system"
+for size in 0 1024; do
+	./ovs_dp_cache ${dp} ${size} > /dev/null || exit $?
+
+	rx_start=$(ip netns exec "${NS}" cat /sys/class/net/vbench3/statistics/rx_packets)
+	echo "start" > ${PGDEV}/pgctrl &
+	sleep ${DURATION}
+	echo "stop" > ${PGDEV}/pgctrl
+	wait
+	rx_end=$(ip netns exec "${NS}" cat /sys/class/net/vbench3/statistics/rx_packets)
+
+	echo "microflow cache ${size}, ${NR_MASKS} masks, ${NR_FLOWS} flows:" \
+	     "$(( (rx_end - rx_start) / DURATION )) pps"
+	./ovs_dp_cache ${dp}
+done
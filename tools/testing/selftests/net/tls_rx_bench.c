@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * kTLS software Rx benchmark over a loopback TCP connection.
+ *
+ * A child process sends fixed size records through a kTLS Tx socket, the
+ * parent reads them with a given read size from a kTLS Rx socket for a
+ * given time, optionally with TLS_RX_ZEROCOPY, checks the plaintext and
+ * reports the throughput. Read sizes smaller than the records exercise the
+ * partial reads.
+ *
+ * Usage: tls_rx_bench [-v 2|3] [-s record_size] [-r read_size]
+ *                     [-d seconds] [-z]
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+#ifndef TLS_RX_ZEROCOPY
+#define TLS_RX_ZEROCOPY	3
+#endif
+
+#define KSFT_SKIP	4
+#define PATTERN_MOD	251
+
+static int version = 3;
+static unsigned int record_size = 16384;
+static unsigned int read_size = 16384;
+static unsigned int duration = 10;
+static bool zerocopy;
+
+static void error(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void connect_pair(int *tx, int *rx)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int lfd;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		error("socket");
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &len) ||
+	    listen(lfd, 1))
+		error("listen");
+
+	*tx = socket(AF_INET, SOCK_STREAM, 0);
+	if (*tx < 0)
+		error("socket");
+	if (connect(*tx, (struct sockaddr *)&addr, sizeof(addr)))
+		error("connect");
+
+	*rx = accept(lfd, NULL, NULL);
+	if (*rx < 0)
+		error("accept");
+	close(lfd);
+}
+
+static void setup_tls(int fd, int dir)
+{
+	struct tls12_crypto_info_aes_gcm_128 ci = {};
+
+	ci.info.version = version == 2 ? TLS_1_2_VERSION : TLS_1_3_VERSION;
+	ci.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+	memset(ci.key, 0x11, sizeof(ci.key));
+	memset(ci.iv, 0x22, sizeof(ci.iv));
+	memset(ci.salt, 0x33, sizeof(ci.salt));
+
+	if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"))) {
+		if (errno == ENOENT || errno == ENOPROTOOPT) {
+			fprintf(stderr, "SKIP: kTLS is not available\n");
+			exit(KSFT_SKIP);
+		}
+		error("TCP_ULP");
+	}
+	if (setsockopt(fd, SOL_TLS, dir, &ci, sizeof(ci)))
+		error(dir == TLS_TX ? "TLS_TX" : "TLS_RX");
+}
+
+static void sender(int fd)
+{
+	unsigned char *buf;
+	unsigned long off = 0;
+	unsigned int i;
+
+	/* The byte at stream offset n is n % PATTERN_MOD */
+	buf = malloc(record_size + PATTERN_MOD);
+	if (!buf)
+		error("malloc");
+	for (i = 0; i < record_size + PATTERN_MOD; i++)
+		buf[i] = i % PATTERN_MOD;
+
+	signal(SIGPIPE, SIG_IGN);
+	for (;;) {
+		ssize_t ret;
+
+		ret = send(fd, buf + off % PATTERN_MOD, record_size, 0);
+		if (ret < 0)
+			break;
+		off += ret;
+	}
+	_exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long received = 0;
+	double start, elapsed;
+	unsigned char *buf;
+	int tx, rx, c, val;
+	pid_t pid;
+
+	while ((c = getopt(argc, argv, "v:s:r:d:z")) != -1) {
+		switch (c) {
+		case 'v':
+			version = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			record_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			read_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'z':
+			zerocopy = true;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if ((version != 2 && version != 3) || !record_size ||
+	    record_size > 16384 || !read_size || !duration)
+		goto usage;
+
+	buf = malloc(read_size);
+	if (!buf)
+		error("malloc");
+
+	connect_pair(&tx, &rx);
+	setup_tls(tx, TLS_TX);
+	setup_tls(rx, TLS_RX);
+
+	val = 1;
+	if (zerocopy &&
+	    setsockopt(rx, SOL_TLS, TLS_RX_ZEROCOPY, &val, sizeof(val))) {
+		fprintf(stderr, "SKIP: TLS_RX_ZEROCOPY is not supported\n");
+		return KSFT_SKIP;
+	}
+
+	pid = fork();
+	if (pid < 0)
+		error("fork");
+	if (!pid) {
+		close(rx);
+		sender(tx);
+	}
+	close(tx);
+
+	start = now();
+	do {
+		ssize_t ret, i;
+
+		ret = recv(rx, buf, read_size, 0);
+		if (ret <= 0)
+			error("recv");
+		for (i = 0; i < ret; i++) {
+			if (buf[i] != (received + i) % PATTERN_MOD) {
+				fprintf(stderr, "bad data at offset %lu\n",
+					received + i);
+				return 1;
+			}
+		}
+		received += ret;
+	} while (now() - start < duration);
+	elapsed = now() - start;
+
+	close(rx);
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	printf("TLS 1.%d%s, %u byte records, %u byte reads: %lu bytes in %.2fs, %.2f Gbit/s\n",
+	       version, zerocopy ? " zero-copy" : "", record_size, read_size,
+	       received, elapsed, received * 8 / elapsed / 1e9);
+
+	free(buf);
+	return 0;
+
+usage:
+	fprintf(stderr,
+		"Usage: %s [-v 2|3] [-s record_size] [-r read_size] [-d seconds] [-z]\n",
+		argv[0]);
+	return 1;
+}
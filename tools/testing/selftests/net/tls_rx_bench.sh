@@ -0,0 +1,33 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare kTLS software Rx with and without TLS_RX_ZEROCOPY over loopback,
+# for TLS 1.2 and 1.3, with reads of whole records and partial reads.
+
+readonly ksft_skip=4
+readonly NS="tls-rx-bench-$(mktemp -u XXXXXX)"
+
+cleanup() {
+	ip netns del "${NS}" 2>/dev/null
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+ip netns add "${NS}" || exit $ksft_skip
+ip -netns "${NS}" link set lo up
+
+for version in 2 3; do
+	for read in 16384 65536 15000 4096; do
+		for zc in "" "-z"; do
+			ip netns exec "${NS}" ./tls_rx_bench -v ${version} \
+				-s 16384 -r ${read} -d 5 ${zc} "$@"
+			ret=$?
+			[ ${ret} -eq 0 ] || exit ${ret}
+		done
+	done
+done
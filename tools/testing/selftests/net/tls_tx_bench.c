@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * kTLS software Tx benchmark over a loopback TCP connection.
+ *
+ * The parent writes through a kTLS Tx socket with a given write size for a
+ * given time, while a child process drains a kTLS Rx socket. Reports the
+ * write throughput and the CPU time the writer spent per byte.
+ *
+ * Usage: tls_tx_bench [-v 2|3] [-w write_size] [-d seconds]
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+#define KSFT_SKIP	4
+
+static int version = 3;
+static unsigned int write_size = 1 << 20;
+static unsigned int duration = 10;
+
+static void error(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void connect_pair(int *tx, int *rx)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int lfd;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		error("socket");
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &len) ||
+	    listen(lfd, 1))
+		error("listen");
+
+	*tx = socket(AF_INET, SOCK_STREAM, 0);
+	if (*tx < 0)
+		error("socket");
+	if (connect(*tx, (struct sockaddr *)&addr, sizeof(addr)))
+		error("connect");
+
+	*rx = accept(lfd, NULL, NULL);
+	if (*rx < 0)
+		error("accept");
+	close(lfd);
+}
+
+static void setup_tls(int fd, int dir)
+{
+	struct tls12_crypto_info_aes_gcm_128 ci = {};
+
+	ci.info.version = version == 2 ? TLS_1_2_VERSION : TLS_1_3_VERSION;
+	ci.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+	memset(ci.key, 0x11, sizeof(ci.key));
+	memset(ci.iv, 0x22, sizeof(ci.iv));
+	memset(ci.salt, 0x33, sizeof(ci.salt));
+
+	if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"))) {
+		if (errno == ENOENT || errno == ENOPROTOOPT) {
+			fprintf(stderr, "SKIP: kTLS is not available\n");
+			exit(KSFT_SKIP);
+		}
+		error("TCP_ULP");
+	}
+	if (setsockopt(fd, SOL_TLS, dir, &ci, sizeof(ci)))
+		error(dir == TLS_TX ? "TLS_TX" : "TLS_RX");
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru))
+		error("getrusage");
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void receiver(int fd)
+{
+	static char buf[1 << 16];
+
+	while (recv(fd, buf, sizeof(buf), 0) > 0)
+		;
+	_exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long sent = 0;
+	double start, elapsed, cpu;
+	char *buf;
+	int tx, rx, c;
+	pid_t pid;
+
+	while ((c = getopt(argc, argv, "v:w:d:")) != -1) {
+		switch (c) {
+		case 'v':
+			version = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			write_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if ((version != 2 && version != 3) || !write_size || !duration)
+		goto usage;
+
+	buf = malloc(write_size);
+	if (!buf)
+		error("malloc");
+	memset(buf, 0x5a, write_size);
+
+	connect_pair(&tx, &rx);
+	setup_tls(tx, TLS_TX);
+	setup_tls(rx, TLS_RX);
+
+	pid = fork();
+	if (pid < 0)
+		error("fork");
+	if (!pid) {
+		close(tx);
+		receiver(rx);
+	}
+	close(rx);
+
+	start = now();
+	cpu = cpu_time();
+	do {
+		ssize_t ret;
+
+		ret = send(tx, buf, write_size, 0);
+		if (ret < 0)
+			error("send");
+		sent += ret;
+	} while (now() - start < duration);
+	elapsed = now() - start;
+	cpu = cpu_time() - cpu;
+
+	close(tx);
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	printf("TLS 1.%d, %u byte writes: %lu bytes in %.2fs, %.2f Gbit/s, %.3f ns CPU/byte\n",
+	       version, write_size, sent, elapsed, sent * 8 / elapsed / 1e9,
+	       cpu * 1e9 / sent);
+
+	free(buf);
+	return 0;
+
+usage:
+	fprintf(stderr, "Usage: %s [-v 2|3] [-w write_size] [-d seconds]\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Measure kTLS software Tx throughput and CPU cost per byte over loopback,
+# for TLS 1.2 and 1.3, with large writes spanning many records and with
+# single record writes.
+
+readonly ksft_skip=4
+readonly NS="tls-tx-bench-$(mktemp -u XXXXXX)"
+
+cleanup() {
+	ip netns del "${NS}" 2>/dev/null
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+ip netns add "${NS}" || exit $ksft_skip
+ip -netns "${NS}" link set lo up
+
+for version in 2 3; do
+	for write in 1048576 16384; do
+		ip netns exec "${NS}" ./tls_tx_bench -v ${version} \
+			-w ${write} -d 5 "$@"
+		ret=$?
+		[ ${ret} -eq 0 ] || exit ${ret}
+	done
+done
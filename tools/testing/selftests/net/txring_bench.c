@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * PF_PACKET Tx ring benchmark, TPACKET_V2 frames against TPACKET_V3 blocks.
+ *
+ * Sends fixed size frames on an interface for a given time, either
+ * through a V2 Tx ring, kicking the kernel every batch frames, or through
+ * a V3 Tx ring in block mode (TP_FT_REQ_TX_BLOCK), packing batch frames
+ * per block and kicking the kernel once per block. Reports the rate of
+ * completed frames. Meant to be run on a veth pair, with or without
+ * PACKET_QDISC_BYPASS.
+ *
+ * Usage: txring_bench -i ifname [-v 2|3] [-s frame_size] [-d seconds]
+ *                     [-b batch] [-q]
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef TP_FT_REQ_TX_BLOCK
+#define TP_FT_REQ_TX_BLOCK	0x2
+#endif
+
+#define BLOCK_SIZE	(1 << 16)
+#define BLOCK_NR	64
+#define V2_FRAME_SIZE	2048
+#define V3_ALIGNMENT	8
+#define ALIGN(x, a)	(((x) + (a) - 1) & ~((a) - 1))
+#define BLK_HDR_LEN	ALIGN(sizeof(struct tpacket_block_desc), V3_ALIGNMENT)
+
+static const char *ifname;
+static int version = TPACKET_V3;
+static unsigned int frame_len = 64;
+static unsigned int duration = 10;
+static unsigned int batch = 64;
+static bool bypass;
+
+static void *ring;
+static unsigned int ring_nr, frame_size;
+static unsigned int prod, cons;
+static unsigned int *blk_pkts;
+
+static void error(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_frame(unsigned char *data, unsigned int seq)
+{
+	struct ethhdr *eth = (struct ethhdr *)data;
+
+	memset(eth->h_dest, 0xff, ETH_ALEN);
+	memset(eth->h_source, 0x02, ETH_ALEN);
+	eth->h_proto = htons(ETH_P_IP);
+	memset(data + sizeof(*eth), seq, frame_len - sizeof(*eth));
+}
+
+static int setup_socket(void)
+{
+	struct tpacket_req3 req = {};
+	struct sockaddr_ll sll = {};
+	int fd, val;
+
+	fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (fd < 0)
+		error("socket");
+
+	val = version;
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &val, sizeof(val)))
+		error("PACKET_VERSION");
+
+	val = bypass;
+	if (setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &val, sizeof(val)))
+		error("PACKET_QDISC_BYPASS");
+
+	req.tp_block_size = BLOCK_SIZE;
+	req.tp_block_nr = BLOCK_NR;
+	if (version == TPACKET_V3) {
+		/* Each block is a single frame from the ring's point of view */
+		req.tp_frame_size = BLOCK_SIZE;
+		req.tp_frame_nr = BLOCK_NR;
+		req.tp_feature_req_word = TP_FT_REQ_TX_BLOCK;
+	} else {
+		req.tp_frame_size = V2_FRAME_SIZE;
+		req.tp_frame_nr = BLOCK_SIZE / V2_FRAME_SIZE * BLOCK_NR;
+	}
+	if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)))
+		error("PACKET_TX_RING");
+
+	ring_nr = req.tp_frame_nr;
+	frame_size = req.tp_frame_size;
+	ring = mmap(NULL, (size_t)BLOCK_SIZE * BLOCK_NR, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (ring == MAP_FAILED)
+		error("mmap");
+
+	sll.sll_family = AF_PACKET;
+	sll.sll_ifindex = if_nametoindex(ifname);
+	if (!sll.sll_ifindex)
+		error("if_nametoindex");
+	if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)))
+		error("bind");
+
+	return fd;
+}
+
+static void kick(int fd)
+{
+	if (sendto(fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+	    errno != EAGAIN && errno != ENOBUFS)
+		error("sendto");
+}
+
+static unsigned long v2_complete(void)
+{
+	unsigned long n = 0;
+
+	while (cons != prod) {
+		struct tpacket2_hdr *hdr = ring + (cons % ring_nr) * frame_size;
+		__u32 status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+
+		if (status & TP_STATUS_WRONG_FORMAT) {
+			fprintf(stderr, "frame %u: wrong format\n", cons);
+			exit(1);
+		}
+		if (status != TP_STATUS_AVAILABLE)
+			break;
+		cons++;
+		n++;
+	}
+	return n;
+}
+
+static void v2_send(int fd)
+{
+	unsigned int hdroff = TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+	unsigned int i;
+
+	for (i = 0; i < batch && prod - cons < ring_nr; i++, prod++) {
+		struct tpacket2_hdr *hdr = ring + (prod % ring_nr) * frame_size;
+
+		fill_frame((unsigned char *)hdr + hdroff, prod);
+		hdr->tp_len = frame_len;
+		__atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST,
+				 __ATOMIC_RELEASE);
+	}
+	kick(fd);
+}
+
+static unsigned long v3_complete(void)
+{
+	unsigned long n = 0;
+
+	while (cons != prod) {
+		struct tpacket_block_desc *pbd;
+		__u32 status;
+
+		pbd = ring + (cons % ring_nr) * frame_size;
+		status = __atomic_load_n(&pbd->hdr.bh1.block_status,
+					 __ATOMIC_ACQUIRE);
+		if (status & TP_STATUS_WRONG_FORMAT) {
+			fprintf(stderr, "block %u: wrong format\n", cons);
+			exit(1);
+		}
+		if (status != TP_STATUS_AVAILABLE)
+			break;
+		n += blk_pkts[cons % ring_nr];
+		cons++;
+	}
+	return n;
+}
+
+static void v3_send(int fd)
+{
+	unsigned int hdroff = TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+	unsigned int stride = ALIGN(hdroff + frame_len, TPACKET_ALIGNMENT);
+	struct tpacket3_hdr *hdr = NULL;
+	struct tpacket_block_desc *pbd;
+	unsigned int off, i;
+
+	if (prod - cons == ring_nr) {
+		kick(fd);
+		return;
+	}
+
+	pbd = ring + (prod % ring_nr) * frame_size;
+	off = BLK_HDR_LEN;
+	for (i = 0; i < batch && off + stride <= frame_size; i++) {
+		hdr = (void *)pbd + off;
+		fill_frame((unsigned char *)hdr + hdroff, prod * batch + i);
+		hdr->tp_len = frame_len;
+		hdr->tp_next_offset = stride;
+		off += stride;
+	}
+	hdr->tp_next_offset = 0;
+
+	pbd->hdr.bh1.num_pkts = i;
+	pbd->hdr.bh1.offset_to_first_pkt = BLK_HDR_LEN;
+	pbd->hdr.bh1.blk_len = off;
+	blk_pkts[prod % ring_nr] = i;
+	__atomic_store_n(&pbd->hdr.bh1.block_status, TP_STATUS_SEND_REQUEST,
+			 __ATOMIC_RELEASE);
+	prod++;
+
+	kick(fd);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long completed = 0;
+	double start, elapsed;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "i:v:s:d:b:q")) != -1) {
+		switch (c) {
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'v':
+			version = strtoul(optarg, NULL, 0) == 2 ? TPACKET_V2 :
+								  TPACKET_V3;
+			break;
+		case 's':
+			frame_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			bypass = true;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (!ifname || frame_len < ETH_HLEN || !batch || !duration ||
+	    frame_len > V2_FRAME_SIZE - TPACKET2_HDRLEN)
+		goto usage;
+
+	fd = setup_socket();
+	blk_pkts = calloc(ring_nr, sizeof(*blk_pkts));
+	if (!blk_pkts)
+		error("calloc");
+
+	start = now();
+	do {
+		if (version == TPACKET_V3) {
+			v3_send(fd);
+			completed += v3_complete();
+		} else {
+			v2_send(fd);
+			completed += v2_complete();
+		}
+	} while (now() - start < duration);
+	elapsed = now() - start;
+
+	printf("TPACKET_V%d%s, %u byte frames, batch %u: %lu frames in %.2fs, %.0f pps\n",
+	       version + 1, bypass ? " qdisc bypass" : "", frame_len, batch,
+	       completed, elapsed, completed / elapsed);
+
+	close(fd);
+	free(blk_pkts);
+	return 0;
+
+usage:
+	fprintf(stderr,
+		"Usage: %s -i ifname [-v 2|3] [-s frame_size] [-d seconds] [-b batch] [-q]\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,34 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare the PF_PACKET Tx rings over a veth pair: TPACKET_V2 frames against
+# TPACKET_V3 blocks, through the qdisc layer and bypassing it.
+
+readonly ksft_skip=4
+readonly NS="txring-bench-$(mktemp -u XXXXXX)"
+
+cleanup() {
+	ip netns del "${NS}" 2>/dev/null
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+ip netns add "${NS}" || exit $ksft_skip
+ip -netns "${NS}" link add veth0 type veth peer name veth1 || exit $ksft_skip
+ip -netns "${NS}" link set veth0 up
+ip -netns "${NS}" link set veth1 up
+
+for bypass in "" "-q"; do
+	for size in 64 512 1500; do
+		for version in 2 3; do
+			ip netns exec "${NS}" ./txring_bench -i veth0 \
+				-v ${version} -s ${size} -d 5 ${bypass} "$@" ||
+				exit 1
+		done
+	done
+done
@@ -0,0 +1,94 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# XFRM policy lookup benchmark: send ESP protected pings between two
+# namespaces with a subnet based (inexact) policy, behind a number of
+# subnet based policies for the same addresses which the traffic does not
+# match, so that every lookup has to evaluate all of them. Reports the
+# ping flood time and the policy lookup cache counters of
+# /proc/net/xfrm_stat for each number of policies.
+#
+# Usage: xfrm_policy_bench.sh [nr_pings]
+
+readonly ksft_skip=4
+readonly nr_pings=${1:-100000}
+readonly rnd="$(mktemp -u XXXXXX)"
+readonly ns1="xfrm-bench1-${rnd}"
+readonly ns2="xfrm-bench2-${rnd}"
+readonly key=0x0123456789abcdef0123456789abcdef01234567
+
+cleanup() {
+	ip netns del "${ns1}" 2>/dev/null
+	ip netns del "${ns2}" 2>/dev/null
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+if ! ip -Version > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+ip netns add "${ns1}" || exit $ksft_skip
+ip netns add "${ns2}" || exit $ksft_skip
+ip link add veth0 netns "${ns1}" type veth peer name veth0 netns "${ns2}"
+ip -netns "${ns1}" addr add 10.0.0.1/24 dev veth0
+ip -netns "${ns2}" addr add 10.0.0.2/24 dev veth0
+for ns in "${ns1}" "${ns2}"; do
+	ip -netns "${ns}" link set lo up
+	ip -netns "${ns}" link set veth0 up
+
+	ip -netns "${ns}" xfrm state add src 10.0.0.1 dst 10.0.0.2 \
+		proto esp spi 0x1000 mode transport \
+		aead 'rfc4106(gcm(aes))' ${key} 128 || exit $ksft_skip
+	ip -netns "${ns}" xfrm state add src 10.0.0.2 dst 10.0.0.1 \
+		proto esp spi 0x1001 mode transport \
+		aead 'rfc4106(gcm(aes))' ${key} 128 || exit $ksft_skip
+done
+
+# Prefixes shorter than the hash thresholds make the policies inexact
+ip -netns "${ns1}" xfrm policy add src 10.0.0.0/24 dst 10.0.0.0/24 \
+	dir out priority 1000 \
+	tmpl src 10.0.0.1 dst 10.0.0.2 proto esp mode transport || exit 1
+ip -netns "${ns2}" xfrm policy add src 10.0.0.0/24 dst 10.0.0.0/24 \
+	dir out priority 1000 \
+	tmpl src 10.0.0.2 dst 10.0.0.1 proto esp mode transport || exit 1
+
+filler=0
+add_policies() {
+	local nr=$1
+
+	{
+		while [ ${filler} -lt ${nr} ]; do
+			filler=$((filler + 1))
+			echo "policy add src 10.0.0.0/24 dst 10.0.0.0/24 proto tcp dport ${filler} dir out priority 100"
+		done
+	} | ip -netns "${ns1}" -batch - || exit 1
+}
+
+xfrm_stat() {
+	ip netns exec "${ns1}" awk -v f="$1" '$1 == f { print $2 }' \
+		/proc/net/xfrm_stat
+}
+
+ip netns exec "${ns1}" ping -q -c 1 -W 1 10.0.0.2 > /dev/null || exit 1
+
+printf "%10s %10s %12s %12s\n" "policies" "time ms" "cache hits" "cache misses"
+for nr in 0 100 1000 10000; do
+	add_policies ${nr}
+
+	hit=$(xfrm_stat XfrmPolCacheHit)
+	miss=$(xfrm_stat XfrmPolCacheMiss)
+	start=$(date +%s%N)
+	ip netns exec "${ns1}" ping -q -f -c ${nr_pings} 10.0.0.2 > /dev/null
+	end=$(date +%s%N)
+
+	printf "%10d %10d %12d %12d\n" ${nr} $(( (end - start) / 1000000 )) \
+		$(( $(xfrm_stat XfrmPolCacheHit) - hit )) \
+		$(( $(xfrm_stat XfrmPolCacheMiss) - miss ))
+done
@@ -0,0 +1,474 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * AF_XDP multi-buffer test.
+ *
+ * Sends frames larger than a UMEM chunk from an AF_XDP socket bound with
+ * XDP_USE_SG to one end of a veth pair, as several descriptors chained
+ * with XDP_PKT_CONTD, and receives them on a second XDP_USE_SG socket at
+ * the other end, to which a generic XDP program redirects all traffic.
+ * Checks that each frame arrives intact and spread over the expected
+ * number of descriptors.
+ *
+ * Usage: xsk_mb -t tx_ifname -r rx_ifname [-s frame_size] [-n frames]
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+#define NUM_FRAMES	256
+#define FRAME_SIZE	4096
+#define RING_SIZE	256
+/* The kernel keeps XDP_PACKET_HEADROOM free in front of received frames */
+#define RX_FRAME_SIZE	(FRAME_SIZE - XDP_PACKET_HEADROOM)
+#define ETH_P_TEST	0x88b5	/* local experimental */
+
+struct ring {
+	__u32 *producer;
+	__u32 *consumer;
+	void *desc;
+	__u32 cached_prod;
+	__u32 cached_cons;
+};
+
+struct xsk {
+	int fd;
+	void *umem;
+	struct ring rx, tx, fq, cq;
+};
+
+static const char *tx_ifname, *rx_ifname;
+static unsigned int frame_len = 9000;
+static unsigned int nr_frames = 16;
+
+static void error(const char *msg)
+{
+	ksft_exit_fail_msg("%s: %s\n", msg, strerror(errno));
+}
+
+static void map_ring(int fd, struct ring *r, const struct xdp_ring_offset *off,
+		     size_t desc_size, off_t pgoff)
+{
+	void *map;
+
+	map = mmap(NULL, off->desc + RING_SIZE * desc_size,
+		   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (map == MAP_FAILED)
+		error("mmap ring");
+
+	r->producer = map + off->producer;
+	r->consumer = map + off->consumer;
+	r->desc = map + off->desc;
+}
+
+static void xsk_setup(struct xsk *xsk, const char *ifname, bool rx)
+{
+	struct xdp_umem_reg mr = {};
+	struct xdp_mmap_offsets off;
+	struct sockaddr_xdp sxdp = {};
+	socklen_t optlen;
+	int size = RING_SIZE;
+
+	xsk->fd = socket(AF_XDP, SOCK_RAW, 0);
+	if (xsk->fd < 0) {
+		if (errno == EAFNOSUPPORT)
+			ksft_exit_skip("AF_XDP is not supported\n");
+		error("socket");
+	}
+
+	xsk->umem = mmap(NULL, NUM_FRAMES * FRAME_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (xsk->umem == MAP_FAILED)
+		error("mmap umem");
+
+	mr.addr = (unsigned long)xsk->umem;
+	mr.len = NUM_FRAMES * FRAME_SIZE;
+	mr.chunk_size = FRAME_SIZE;
+	if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)))
+		error("XDP_UMEM_REG");
+
+	if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_FILL_RING, &size,
+		       sizeof(size)) ||
+	    setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size,
+		       sizeof(size)) ||
+	    setsockopt(xsk->fd, SOL_XDP, rx ? XDP_RX_RING : XDP_TX_RING, &size,
+		       sizeof(size)))
+		error("ring setup");
+
+	optlen = sizeof(off);
+	if (getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen))
+		error("XDP_MMAP_OFFSETS");
+
+	map_ring(xsk->fd, &xsk->fq, &off.fr, sizeof(__u64),
+		 XDP_UMEM_PGOFF_FILL_RING);
+	map_ring(xsk->fd, &xsk->cq, &off.cr, sizeof(__u64),
+		 XDP_UMEM_PGOFF_COMPLETION_RING);
+	if (rx)
+		map_ring(xsk->fd, &xsk->rx, &off.rx, sizeof(struct xdp_desc),
+			 XDP_PGOFF_RX_RING);
+	else
+		map_ring(xsk->fd, &xsk->tx, &off.tx, sizeof(struct xdp_desc),
+			 XDP_PGOFF_TX_RING);
+
+	if (rx) {
+		__u64 *addrs = xsk->fq.desc;
+		unsigned int i;
+
+		for (i = 0; i < RING_SIZE; i++)
+			addrs[i] = (__u64)i * FRAME_SIZE;
+		xsk->fq.cached_prod = RING_SIZE;
+		__atomic_store_n(xsk->fq.producer, RING_SIZE, __ATOMIC_RELEASE);
+	}
+
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = if_nametoindex(ifname);
+	sxdp.sxdp_flags = XDP_COPY | XDP_USE_SG;
+	if (!sxdp.sxdp_ifindex)
+		error("if_nametoindex");
+	if (bind(xsk->fd, (struct sockaddr *)&sxdp, sizeof(sxdp))) {
+		if (errno == EINVAL)
+			ksft_exit_skip("XDP_USE_SG is not supported\n");
+		error("bind");
+	}
+}
+
+static int bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/* Redirect everything received to the socket of the same queue */
+static int load_redirect_prog(int xsk_fd)
+{
+	struct bpf_insn insns[] = {
+		{ .code = BPF_LDX | BPF_MEM | BPF_W, .dst_reg = BPF_REG_2,
+		  .src_reg = BPF_REG_1,
+		  .off = offsetof(struct xdp_md, rx_queue_index) },
+		{ .code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1,
+		  .src_reg = BPF_PSEUDO_MAP_FD },
+		{ 0 },
+		{ .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3,
+		  .imm = XDP_PASS },
+		{ .code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map },
+		{ .code = BPF_JMP | BPF_EXIT },
+	};
+	union bpf_attr attr;
+	__u32 key = 0;
+	int map_fd, prog_fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(__u32);
+	attr.value_size = sizeof(__u32);
+	attr.max_entries = 1;
+	map_fd = bpf(BPF_MAP_CREATE, &attr);
+	if (map_fd < 0)
+		error("BPF_MAP_CREATE");
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = map_fd;
+	attr.key = (unsigned long)&key;
+	attr.value = (unsigned long)&xsk_fd;
+	if (bpf(BPF_MAP_UPDATE_ELEM, &attr))
+		error("BPF_MAP_UPDATE_ELEM");
+
+	insns[1].imm = map_fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (unsigned long)insns;
+	attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+	attr.license = (unsigned long)"GPL";
+	prog_fd = bpf(BPF_PROG_LOAD, &attr);
+	if (prog_fd < 0)
+		error("BPF_PROG_LOAD");
+
+	return prog_fd;
+}
+
+static void attach_prog(const char *ifname, int prog_fd)
+{
+	struct {
+		struct nlmsghdr nh;
+		struct ifinfomsg ifi;
+		char attrbuf[64];
+	} req = {};
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	struct rtattr *xdp, *rta;
+	struct nlmsgerr *nerr;
+	char buf[512];
+	__u32 flags = XDP_FLAGS_SKB_MODE;
+	int fd, len;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0)
+		error("netlink socket");
+
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+	req.nh.nlmsg_type = RTM_SETLINK;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	req.ifi.ifi_family = AF_UNSPEC;
+	req.ifi.ifi_index = if_nametoindex(ifname);
+
+	xdp = (struct rtattr *)((char *)&req + NLMSG_ALIGN(req.nh.nlmsg_len));
+	xdp->rta_type = NLA_F_NESTED | IFLA_XDP;
+	xdp->rta_len = RTA_LENGTH(0);
+
+	rta = (struct rtattr *)((char *)xdp + xdp->rta_len);
+	rta->rta_type = IFLA_XDP_FD;
+	rta->rta_len = RTA_LENGTH(sizeof(int));
+	memcpy(RTA_DATA(rta), &prog_fd, sizeof(int));
+	xdp->rta_len += RTA_ALIGN(rta->rta_len);
+
+	rta = (struct rtattr *)((char *)xdp + xdp->rta_len);
+	rta->rta_type = IFLA_XDP_FLAGS;
+	rta->rta_len = RTA_LENGTH(sizeof(flags));
+	memcpy(RTA_DATA(rta), &flags, sizeof(flags));
+	xdp->rta_len += RTA_ALIGN(rta->rta_len);
+
+	req.nh.nlmsg_len = NLMSG_ALIGN(req.nh.nlmsg_len) + xdp->rta_len;
+
+	if (sendto(fd, &req, req.nh.nlmsg_len, 0, (struct sockaddr *)&sa,
+		   sizeof(sa)) < 0)
+		error("netlink send");
+
+	len = recv(fd, buf, sizeof(buf), 0);
+	if (len < (int)NLMSG_LENGTH(sizeof(*nerr)))
+		error("netlink recv");
+	nerr = NLMSG_DATA((struct nlmsghdr *)buf);
+	if (nerr->error) {
+		errno = -nerr->error;
+		error("attach XDP program");
+	}
+
+	close(fd);
+}
+
+static void fill_frame(unsigned char *buf, unsigned int seq)
+{
+	struct ethhdr *eth = (struct ethhdr *)buf;
+	unsigned int i;
+
+	memset(eth->h_dest, 0xff, ETH_ALEN);
+	memset(eth->h_source, 0x02, ETH_ALEN);
+	eth->h_proto = htons(ETH_P_TEST);
+	for (i = sizeof(*eth); i < frame_len; i++)
+		buf[i] = (i + seq) & 0xff;
+}
+
+/* Post one frame as a chain of chunk sized descriptors */
+static unsigned int send_frame(struct xsk *xsk, unsigned int seq)
+{
+	struct xdp_desc *descs = xsk->tx.desc;
+	unsigned char frame[frame_len];
+	unsigned int off, n = 0;
+
+	fill_frame(frame, seq);
+
+	for (off = 0; off < frame_len; off += FRAME_SIZE, n++) {
+		struct xdp_desc *d = &descs[xsk->tx.cached_prod++ % RING_SIZE];
+		__u64 addr = (__u64)((seq * 4 + n) % NUM_FRAMES) * FRAME_SIZE;
+		unsigned int len = frame_len - off;
+
+		if (len > FRAME_SIZE)
+			len = FRAME_SIZE;
+
+		memcpy(xsk->umem + addr, frame + off, len);
+		d->addr = addr;
+		d->len = len;
+		d->options = off + len < frame_len ? XDP_PKT_CONTD : 0;
+	}
+
+	__atomic_store_n(xsk->tx.producer, xsk->tx.cached_prod,
+			 __ATOMIC_RELEASE);
+	if (sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+	    errno != EAGAIN && errno != EBUSY)
+		error("sendto");
+
+	return n;
+}
+
+/* Wait for the completions of @n descriptors */
+static void wait_completions(struct xsk *xsk, unsigned int n)
+{
+	unsigned int tries;
+
+	for (tries = 0; tries < 1000; tries++) {
+		__u32 prod = __atomic_load_n(xsk->cq.producer, __ATOMIC_ACQUIRE);
+
+		if (prod - xsk->cq.cached_cons >= n) {
+			xsk->cq.cached_cons += n;
+			__atomic_store_n(xsk->cq.consumer, xsk->cq.cached_cons,
+					 __ATOMIC_RELEASE);
+			return;
+		}
+		sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+		usleep(1000);
+	}
+
+	ksft_exit_fail_msg("missing Tx completions\n");
+}
+
+/* Receive one frame, possibly spread over several descriptors */
+static int recv_frame(struct xsk *xsk, unsigned int seq, unsigned int *nr)
+{
+	struct xdp_desc *descs = xsk->rx.desc;
+	unsigned char expected[frame_len];
+	__u64 *fq = xsk->fq.desc;
+	unsigned int off = 0;
+	struct pollfd pfd = { .fd = xsk->fd, .events = POLLIN };
+	bool skip = false;
+
+	fill_frame(expected, seq);
+	*nr = 0;
+
+	for (;;) {
+		struct xdp_desc *d;
+
+		if (__atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE) ==
+		    xsk->rx.cached_cons) {
+			if (poll(&pfd, 1, 1000) <= 0) {
+				ksft_print_msg("frame %u: timeout after %u bytes\n",
+					       seq, off);
+				return -1;
+			}
+			continue;
+		}
+
+		d = &descs[xsk->rx.cached_cons++ % RING_SIZE];
+		(*nr)++;
+
+		/* Ignore whatever else the stack sends on the link */
+		if (!off && !skip && memcmp(xsk->umem + d->addr + 2 * ETH_ALEN,
+					    expected + 2 * ETH_ALEN, 2))
+			skip = true;
+
+		if (skip) {
+			fq[xsk->fq.cached_prod++ % RING_SIZE] =
+				d->addr & ~(FRAME_SIZE - 1ULL);
+			if (!(d->options & XDP_PKT_CONTD)) {
+				skip = false;
+				*nr = 0;
+			}
+			continue;
+		}
+
+		if (off + d->len > frame_len ||
+		    memcmp(xsk->umem + d->addr, expected + off, d->len)) {
+			ksft_print_msg("frame %u: bad data at offset %u\n",
+				       seq, off);
+			return -1;
+		}
+		off += d->len;
+
+		/* Give the buffer back */
+		fq[xsk->fq.cached_prod++ % RING_SIZE] = d->addr & ~(FRAME_SIZE - 1ULL);
+
+		if (!(d->options & XDP_PKT_CONTD))
+			break;
+	}
+
+	__atomic_store_n(xsk->rx.consumer, xsk->rx.cached_cons,
+			 __ATOMIC_RELEASE);
+	__atomic_store_n(xsk->fq.producer, xsk->fq.cached_prod,
+			 __ATOMIC_RELEASE);
+
+	if (off != frame_len) {
+		ksft_print_msg("frame %u: got %u bytes, expected %u\n",
+			       seq, off, frame_len);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct xsk tx = {}, rx = {};
+	unsigned int seq, nr_tx, nr_rx;
+	int c, prog_fd;
+
+	while ((c = getopt(argc, argv, "t:r:s:n:")) != -1) {
+		switch (c) {
+		case 't':
+			tx_ifname = optarg;
+			break;
+		case 'r':
+			rx_ifname = optarg;
+			break;
+		case 's':
+			frame_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_frames = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (!tx_ifname || !rx_ifname || frame_len < ETH_HLEN ||
+	    frame_len > 4 * FRAME_SIZE)
+		goto usage;
+
+	ksft_print_header();
+	ksft_set_plan(nr_frames);
+
+	xsk_setup(&rx, rx_ifname, true);
+	xsk_setup(&tx, tx_ifname, false);
+	prog_fd = load_redirect_prog(rx.fd);
+	attach_prog(rx_ifname, prog_fd);
+
+	for (seq = 0; seq < nr_frames; seq++) {
+		nr_tx = send_frame(&tx, seq);
+		wait_completions(&tx, nr_tx);
+
+		if (recv_frame(&rx, seq, &nr_rx)) {
+			ksft_test_result_fail("frame %u of %u bytes\n",
+					      seq, frame_len);
+			continue;
+		}
+
+		ksft_test_result(nr_rx == (frame_len + RX_FRAME_SIZE - 1) / RX_FRAME_SIZE,
+				 "frame %u of %u bytes in %u/%u descriptors\n",
+				 seq, frame_len, nr_tx, nr_rx);
+	}
+
+	attach_prog(rx_ifname, -1);
+
+	if (ksft_get_fail_cnt())
+		ksft_exit_fail();
+	ksft_exit_pass();
+
+usage:
+	fprintf(stderr,
+		"Usage: %s -t tx_ifname -r rx_ifname [-s frame_size] [-n frames]\n",
+		argv[0]);
+	return KSFT_FAIL;
+}
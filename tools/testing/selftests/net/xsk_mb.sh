@@ -0,0 +1,30 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# AF_XDP multi-buffer test over a veth pair with a jumbo MTU.
+
+readonly ksft_skip=4
+readonly NS="xsk-mb-$(mktemp -u XXXXXX)"
+
+cleanup() {
+	ip netns del "${NS}" 2>/dev/null
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+ip netns add "${NS}" || exit $ksft_skip
+ip -netns "${NS}" link add veth0 mtu 9000 type veth peer name veth1 mtu 9000 ||
+	exit $ksft_skip
+ip -netns "${NS}" link set veth0 up
+ip -netns "${NS}" link set veth1 up
+
+ret=0
+for size in 1000 4096 9000; do
+	ip netns exec "${NS}" ./xsk_mb -t veth0 -r veth1 -s ${size} || ret=1
+done
+exit $ret
@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * AF_XDP Tx benchmark, in the spirit of xdpsock -t.
+ *
+ * Binds an AF_XDP socket to a queue of an interface, without any XDP
+ * program since only the Tx ring is used, and sends fixed size frames
+ * as fast as possible for a given time, reporting the rate of completed
+ * frames. Meant to be run on a veth pair in copy mode to measure the
+ * generic Tx path.
+ *
+ * Usage: xsk_tx_bench -i ifname [-q queue] [-s frame_size] [-d seconds]
+ *                     [-b batch] [-z]
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+#define NUM_FRAMES	4096
+#define FRAME_SIZE	4096
+#define RING_SIZE	2048
+
+struct ring {
+	__u32 *producer;
+	__u32 *consumer;
+	void *desc;
+	__u32 mask;
+	__u32 cached_prod;
+	__u32 cached_cons;
+	void *map;
+	size_t map_len;
+};
+
+static const char *ifname;
+static unsigned int queue;
+static unsigned int frame_len = 64;
+static unsigned int duration = 10;
+static unsigned int batch = 64;
+static bool zerocopy;
+
+static void *umem_area;
+static struct ring tx, cq;
+static __u32 outstanding;
+
+static void error(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void map_ring(int fd, struct ring *r, const struct xdp_ring_offset *off,
+		     size_t desc_size, off_t pgoff)
+{
+	r->map_len = off->desc + RING_SIZE * desc_size;
+	r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (r->map == MAP_FAILED)
+		error("mmap ring");
+
+	r->producer = r->map + off->producer;
+	r->consumer = r->map + off->consumer;
+	r->desc = r->map + off->desc;
+	r->mask = RING_SIZE - 1;
+}
+
+static int setup_socket(void)
+{
+	struct xdp_umem_reg mr = {};
+	struct xdp_mmap_offsets off;
+	struct sockaddr_xdp sxdp = {};
+	socklen_t optlen;
+	int fd, size = RING_SIZE;
+
+	fd = socket(AF_XDP, SOCK_RAW, 0);
+	if (fd < 0)
+		error("socket");
+
+	umem_area = mmap(NULL, NUM_FRAMES * FRAME_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (umem_area == MAP_FAILED)
+		error("mmap umem");
+
+	mr.addr = (unsigned long)umem_area;
+	mr.len = NUM_FRAMES * FRAME_SIZE;
+	mr.chunk_size = FRAME_SIZE;
+	if (setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)))
+		error("XDP_UMEM_REG");
+
+	/* A fill ring is mandatory even if nothing is received */
+	if (setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) ||
+	    setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size,
+		       sizeof(size)) ||
+	    setsockopt(fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)))
+		error("ring setup");
+
+	optlen = sizeof(off);
+	if (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen))
+		error("XDP_MMAP_OFFSETS");
+
+	map_ring(fd, &tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING);
+	map_ring(fd, &cq, &off.cr, sizeof(__u64),
+		 XDP_UMEM_PGOFF_COMPLETION_RING);
+
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = if_nametoindex(ifname);
+	sxdp.sxdp_queue_id = queue;
+	sxdp.sxdp_flags = zerocopy ? XDP_ZEROCOPY : XDP_COPY;
+	if (!sxdp.sxdp_ifindex)
+		error("if_nametoindex");
+	if (bind(fd, (struct sockaddr *)&sxdp, sizeof(sxdp)))
+		error("bind");
+
+	return fd;
+}
+
+static void init_frames(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_FRAMES; i++) {
+		unsigned char *frame = umem_area + i * FRAME_SIZE;
+		struct ethhdr *eth = (struct ethhdr *)frame;
+
+		memset(eth->h_dest, 0xff, ETH_ALEN);
+		memset(eth->h_source, 0x02, ETH_ALEN);
+		eth->h_proto = htons(ETH_P_IP);
+		memset(frame + sizeof(*eth), i, frame_len - sizeof(*eth));
+	}
+}
+
+static unsigned long complete_tx(void)
+{
+	__u32 prod = __atomic_load_n(cq.producer, __ATOMIC_ACQUIRE);
+	__u32 n = prod - cq.cached_cons;
+
+	if (n) {
+		cq.cached_cons = prod;
+		__atomic_store_n(cq.consumer, prod, __ATOMIC_RELEASE);
+		outstanding -= n;
+	}
+	return n;
+}
+
+static void send_batch(int fd, __u32 *frame)
+{
+	struct xdp_desc *descs = tx.desc;
+	__u32 i, n = batch;
+
+	if (n > RING_SIZE - outstanding)
+		n = RING_SIZE - outstanding;
+	if (n > NUM_FRAMES - outstanding)
+		n = NUM_FRAMES - outstanding;
+
+	for (i = 0; i < n; i++) {
+		struct xdp_desc *d = &descs[(tx.cached_prod + i) & tx.mask];
+
+		d->addr = (__u64)((*frame)++ % NUM_FRAMES) * FRAME_SIZE;
+		d->len = frame_len;
+		d->options = 0;
+	}
+	tx.cached_prod += n;
+	outstanding += n;
+	__atomic_store_n(tx.producer, tx.cached_prod, __ATOMIC_RELEASE);
+
+	if (sendto(fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+	    errno != EAGAIN && errno != EBUSY && errno != ENOBUFS &&
+	    errno != ENETDOWN)
+		error("sendto");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long completed = 0;
+	double start, elapsed;
+	__u32 frame = 0;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "i:q:s:d:b:z")) != -1) {
+		switch (c) {
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'q':
+			queue = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			frame_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'z':
+			zerocopy = true;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (!ifname || frame_len < ETH_HLEN || frame_len > FRAME_SIZE ||
+	    !batch || !duration)
+		goto usage;
+
+	fd = setup_socket();
+	init_frames();
+
+	start = now();
+	do {
+		send_batch(fd, &frame);
+		completed += complete_tx();
+	} while (now() - start < duration);
+	elapsed = now() - start;
+
+	printf("%s mode, %u byte frames: %lu frames in %.2fs, %.0f pps\n",
+	       zerocopy ? "zero-copy" : "copy", frame_len, completed, elapsed,
+	       completed / elapsed);
+
+	close(fd);
+	return 0;
+
+usage:
+	fprintf(stderr,
+		"Usage: %s -i ifname [-q queue] [-s frame_size] [-d seconds] [-b batch] [-z]\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,29 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run the AF_XDP Tx benchmark in copy mode over a veth pair, for a few
+# frame sizes.
+
+readonly ksft_skip=4
+readonly NS="xsk-bench-$(mktemp -u XXXXXX)"
+
+cleanup() {
+	ip netns del "${NS}" 2>/dev/null
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+ip netns add "${NS}" || exit $ksft_skip
+ip -netns "${NS}" link add veth0 type veth peer name veth1 || exit $ksft_skip
+ip -netns "${NS}" link set veth0 up
+ip -netns "${NS}" link set veth1 up
+
+for size in 64 512 1500; do
+	ip netns exec "${NS}" ./xsk_tx_bench -i veth0 -s ${size} -d 5 "$@" ||
+		exit 1
+done
@@ -0,0 +1,65 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# ipset hash:net lookup benchmark: fill a set with networks of many
+# different prefix lengths, so that testing a single address has to probe
+# a bucket for every prefix length, then time "ipset test" in a loop with
+# addresses which are and which are not in the set.
+#
+# Usage: ipset_hash_bench.sh [nr_entries] [nr_tests]
+
+readonly ksft_skip=4
+readonly nr_entries=${1:-65536}
+readonly nr_tests=${2:-10000}
+readonly ns="ipset-bench-$(mktemp -u XXXXXX)"
+readonly set=bench
+
+cleanup() {
+	ip netns del "${ns}" 2>/dev/null
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+if ! ipset -v > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without ipset"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+ip netns add "${ns}" || exit $ksft_skip
+
+# Networks of 10.0.0.0/8 with prefix lengths from /9 to /32, the host part
+# of every entry is left random as ipset masks it on add.
+{
+	echo "create ${set} hash:net family inet hashsize 1024 maxelem $((nr_entries * 2))"
+	for i in $(seq 1 ${nr_entries}); do
+		echo "add ${set} 10.$((RANDOM % 256)).$((RANDOM % 256)).$((RANDOM % 256))/$((9 + i % 24)) -exist"
+	done
+} | ip netns exec "${ns}" ipset restore || exit 1
+
+ip netns exec "${ns}" ipset list -terse ${set} | grep -E "Size|entries"
+
+run() {
+	local desc=$1 prefix=$2
+	local start end i
+
+	start=$(date +%s%N)
+	for i in $(seq 1 ${nr_tests}); do
+		ip netns exec "${ns}" ipset -q test ${set} \
+			${prefix}.$((RANDOM % 256)).$((RANDOM % 256))
+	done
+	end=$(date +%s%N)
+
+	printf "%-8s %8d tests in %6d ms, %6d us/test\n" "${desc}" ${nr_tests} \
+		$(( (end - start) / 1000000 )) \
+		$(( (end - start) / 1000 / nr_tests ))
+}
+
+# Nearly every address of 10.0.0.0/8 hits one of the short prefixes,
+# 11.0.0.0/8 probes all the prefix lengths and misses.
+run "hit" "10.$((RANDOM % 256))"
+run "miss" "11.$((RANDOM % 256))"
@@ -0,0 +1,120 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# IPVS connection table benchmark: flood a UDP virtual service in DR mode
+# with packets from random client addresses and ports, so that nearly every
+# packet creates a new connection, and sample every second the number of
+# connections, the size of the connection hash table and the forwarding
+# rate while the table fills up.
+#
+# Topology: client (pktgen) -> director (ipvs) -> real server
+#
+# Usage: ipvs_conn_flood.sh [nr_conns]
+
+readonly ksft_skip=4
+readonly nr_conns=${1:-1000000}
+readonly vip=207.175.44.110
+readonly port=8080
+readonly rnd="$(mktemp -u XXXXXX)"
+readonly cl="cl-${rnd}"
+readonly lb="lb-${rnd}"
+readonly rs="rs-${rnd}"
+readonly pgdev=/proc/net/pktgen
+
+cleanup() {
+	ip netns exec "${cl}" sh -c "echo reset > ${pgdev}/pgctrl" 2>/dev/null
+	for ns in "${cl}" "${lb}" "${rs}"; do
+		ip netns del "${ns}" 2>/dev/null
+	done
+}
+
+pgset() {
+	ip netns exec "${cl}" sh -c "echo '$2' > ${pgdev}/$1" || exit 1
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+if ! ipvsadm -v > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without ipvsadm"
+	exit $ksft_skip
+fi
+
+if ! modprobe -q ip_vs || ! modprobe -q pktgen; then
+	echo "SKIP: Could not run test without ipvs and pktgen modules"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+for ns in "${cl}" "${lb}" "${rs}"; do
+	ip netns add "${ns}" || exit $ksft_skip
+	ip -netns "${ns}" link set lo up
+done
+
+ip link add veth0 netns "${cl}" type veth peer name veth1 netns "${lb}"
+ip link add veth2 netns "${lb}" type veth peer name veth3 netns "${rs}"
+
+ip -netns "${cl}" addr add 10.0.0.2/24 dev veth0
+ip -netns "${cl}" link set veth0 up
+ip -netns "${lb}" addr add 10.0.0.1/24 dev veth1
+ip -netns "${lb}" addr add 172.16.0.1/24 dev veth2
+ip -netns "${lb}" addr add ${vip}/32 dev lo
+ip -netns "${lb}" link set veth1 up
+ip -netns "${lb}" link set veth2 up
+ip -netns "${rs}" addr add 172.16.0.2/24 dev veth3
+ip -netns "${rs}" addr add ${vip}/32 dev lo
+ip -netns "${rs}" link set veth3 up
+
+ip netns exec "${lb}" sysctl -qw net.ipv4.conf.all.rp_filter=0
+ip netns exec "${lb}" sysctl -qw net.ipv4.conf.veth1.rp_filter=0
+ip netns exec "${rs}" sysctl -qw net.ipv4.conf.all.arp_ignore=1
+ip netns exec "${rs}" sysctl -qw net.ipv4.conf.all.arp_announce=2
+
+ip netns exec "${lb}" ipvsadm -A -u ${vip}:${port} -s rr || exit 1
+ip netns exec "${lb}" ipvsadm -a -g -u ${vip}:${port} -r 172.16.0.2:${port}
+# keep every connection for the whole run
+ip netns exec "${lb}" ipvsadm --set 0 0 3600
+
+# make sure the director resolved the real server before the flood
+ip netns exec "${lb}" ping -q -c 1 172.16.0.2 > /dev/null
+
+ip netns exec "${cl}" sh -c "echo reset > ${pgdev}/pgctrl"
+pgset kpktgend_0 "rem_device_all"
+pgset kpktgend_0 "add_device veth0"
+pgset veth0 "count ${nr_conns}"
+pgset veth0 "pkt_size 64"
+pgset veth0 "dst ${vip}"
+pgset veth0 "dst_mac $(ip -netns "${lb}" -br link show veth1 | awk '{print $3}')"
+pgset veth0 "udp_dst_min ${port}"
+pgset veth0 "udp_dst_max ${port}"
+pgset veth0 "src_min 10.1.0.0"
+pgset veth0 "src_max 10.1.255.255"
+pgset veth0 "udp_src_min 1024"
+pgset veth0 "udp_src_max 65535"
+pgset veth0 "flag IPSRC_RND"
+pgset veth0 "flag UDPSRC_RND"
+pgset veth0 "flag NO_TIMESTAMP"
+
+ip netns exec "${cl}" sh -c "echo start > ${pgdev}/pgctrl" &
+pgpid=$!
+
+rx_stat() {
+	ip netns exec "${rs}" cat /sys/class/net/veth3/statistics/rx_packets
+}
+
+printf "%6s %12s %10s %12s\n" "time" "conns" "tab size" "fwd pps"
+t=0
+rx_prev=$(rx_stat)
+while kill -0 ${pgpid} 2>/dev/null; do
+	sleep 1
+	t=$((t + 1))
+	rx=$(rx_stat)
+	conns=$(ip netns exec "${lb}" ipvsadm -Ln | awk '$1 == "->" && $2 != "RemoteAddress:Port" { n += $5 + $6 } END { print n + 0 }')
+	size=$(ip netns exec "${lb}" head -1 /proc/net/ip_vs | sed -e 's/.*size=\([0-9]*\).*/\1/')
+	printf "%6d %12d %10d %12d\n" ${t} ${conns} ${size} $((rx - rx_prev))
+	rx_prev=${rx}
+done
+wait ${pgpid}
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Test for perf_event_attr::wakeup_interval: a sampling event that asks
+ * for a wakeup on every sample must still wake up poll() and deliver
+ * SIGIO, but at most about once per interval.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest_harness.h"
+
+#define INTERVAL_US	50000
+#define DURATION_MS	1000
+#define DATA_PAGES	16
+
+/* Data shared between test body, poll thread, and signal handler. */
+static struct {
+	int fd;
+	struct perf_event_mmap_page *page;
+	volatile bool stop;
+	int poll_wakeups;
+	int sigio_count;
+} ctx;
+
+static void sigio_handler(int signum, siginfo_t *info, void *ucontext)
+{
+	__atomic_fetch_add(&ctx.sigio_count, 1, __ATOMIC_RELAXED);
+}
+
+/* Count the poll() wakeups, and consume the data so that sampling goes on. */
+static void *poll_thread(void *arg)
+{
+	struct pollfd pfd = { .fd = ctx.fd, .events = POLLIN };
+
+	while (!ctx.stop) {
+		if (poll(&pfd, 1, 100) > 0 && (pfd.revents & POLLIN))
+			ctx.poll_wakeups++;
+		__atomic_store_n(&ctx.page->data_tail,
+				 __atomic_load_n(&ctx.page->data_head,
+						 __ATOMIC_ACQUIRE),
+				 __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+TEST(poll_and_sigio)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_SOFTWARE,
+		.size		= sizeof(attr),
+		.config		= PERF_COUNT_SW_TASK_CLOCK,
+		.sample_period	= 10000, /* a sample every 10us */
+		.sample_type	= PERF_SAMPLE_IP,
+		.disabled	= 1,
+		.wakeup_events	= 1,
+		.wakeup_interval = INTERVAL_US,
+	};
+	size_t size = (DATA_PAGES + 1) * sysconf(_SC_PAGESIZE);
+	/* one wakeup per interval, with slack for the timer */
+	int max_wakeups = 2 * DURATION_MS * 1000 / INTERVAL_US + 4;
+	struct sigaction action = {};
+	pthread_t thread;
+	uint64_t end;
+
+	ctx.fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (ctx.fd < 0) {
+		if (errno == EINVAL || errno == E2BIG || errno == EACCES)
+			SKIP(return, "wakeup_interval not supported");
+		ASSERT_GE(ctx.fd, 0);
+	}
+
+	ctx.page = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			ctx.fd, 0);
+	ASSERT_NE(ctx.page, MAP_FAILED);
+
+	action.sa_flags = SA_SIGINFO;
+	action.sa_sigaction = sigio_handler;
+	sigemptyset(&action.sa_mask);
+	ASSERT_EQ(sigaction(SIGIO, &action, NULL), 0);
+	ASSERT_EQ(fcntl(ctx.fd, F_SETOWN, getpid()), 0);
+	ASSERT_EQ(fcntl(ctx.fd, F_SETSIG, SIGIO), 0);
+	ASSERT_EQ(fcntl(ctx.fd, F_SETFL, fcntl(ctx.fd, F_GETFL) | O_ASYNC), 0);
+
+	ASSERT_EQ(pthread_create(&thread, NULL, poll_thread, NULL), 0);
+
+	/* Burn task clock, which generates the samples */
+	ASSERT_EQ(ioctl(ctx.fd, PERF_EVENT_IOC_ENABLE, 0), 0);
+	for (end = now_ms() + DURATION_MS; now_ms() < end; )
+		;
+	ASSERT_EQ(ioctl(ctx.fd, PERF_EVENT_IOC_DISABLE, 0), 0);
+
+	/* Let the last deferred wakeup come in */
+	usleep(2 * INTERVAL_US);
+	ctx.stop = true;
+	ASSERT_EQ(pthread_join(thread, NULL), 0);
+
+	signal(SIGIO, SIG_IGN);
+	munmap(ctx.page, size);
+	close(ctx.fd);
+
+	TH_LOG("%d poll wakeups, %d SIGIO", ctx.poll_wakeups, ctx.sigio_count);
+	EXPECT_GE(ctx.poll_wakeups, 2);
+	EXPECT_LE(ctx.poll_wakeups, max_wakeups);
+	EXPECT_GE(ctx.sigio_count, 2);
+	EXPECT_LE(ctx.sigio_count, max_wakeups);
+}
+
+TEST_HARNESS_MAIN
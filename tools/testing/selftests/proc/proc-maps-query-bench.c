@@ -0,0 +1,353 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Cost of finding the VMA that covers an address with the PROCMAP_QUERY
+ * ioctl on /proc/self/maps against reading and parsing the text of maps,
+ * the way symbolizers and profilers do it, for a process with many VMAs.
+ * Also compares walking all VMAs with PROCMAP_QUERY_COVERING_OR_NEXT_VMA
+ * against reading the whole file, and checks that both agree on every VMA.
+ *
+ * Usage: proc-maps-query-bench [-v vmas] [-n lookups]
+ *
+ * The number of VMAs is limited by vm.max_map_count, 65530 by default.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+
+#include "../kselftest.h"
+
+#define MAPS_BUF_SIZE	(64 * 1024)
+
+struct vma {
+	uint64_t start, end, offset, inode;
+	unsigned int dev_major, dev_minor;
+	uint64_t flags;
+};
+
+static int maps_fd;
+static char maps_buf[MAPS_BUF_SIZE];
+static long page_size;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int parse_line(const char *line, struct vma *v)
+{
+	char perm[5];
+
+	if (sscanf(line, "%" SCNx64 "-%" SCNx64 " %4s %" SCNx64 " %x:%x %" SCNu64,
+		   &v->start, &v->end, perm, &v->offset, &v->dev_major,
+		   &v->dev_minor, &v->inode) != 7)
+		return -1;
+
+	v->flags = 0;
+	if (perm[0] == 'r')
+		v->flags |= PROCMAP_QUERY_VMA_READABLE;
+	if (perm[1] == 'w')
+		v->flags |= PROCMAP_QUERY_VMA_WRITABLE;
+	if (perm[2] == 'x')
+		v->flags |= PROCMAP_QUERY_VMA_EXECUTABLE;
+	if (perm[3] == 's')
+		v->flags |= PROCMAP_QUERY_VMA_SHARED;
+	return 0;
+}
+
+/*
+ * Reads maps from the start and calls fn for every line until it returns
+ * nonzero, returns that or 0 at the end of the file.
+ */
+static int for_each_maps_line(int (*fn)(const char *line, void *arg),
+			      void *arg)
+{
+	size_t fill = 0;
+	char *line, *nl;
+	ssize_t n;
+	int ret;
+
+	if (lseek(maps_fd, 0, SEEK_SET))
+		ksft_exit_fail_msg("lseek maps: %s\n", strerror(errno));
+
+	for (;;) {
+		n = read(maps_fd, maps_buf + fill, sizeof(maps_buf) - fill - 1);
+		if (n < 0)
+			ksft_exit_fail_msg("read maps: %s\n", strerror(errno));
+		if (!n)
+			return 0;
+		fill += n;
+		maps_buf[fill] = '\0';
+
+		line = maps_buf;
+		while ((nl = strchr(line, '\n'))) {
+			*nl = '\0';
+			ret = fn(line, arg);
+			if (ret)
+				return ret;
+			line = nl + 1;
+		}
+		fill = maps_buf + fill - line;
+		memmove(maps_buf, line, fill);
+	}
+}
+
+struct text_lookup {
+	uint64_t addr;
+	struct vma vma;
+};
+
+static int text_lookup_line(const char *line, void *arg)
+{
+	struct text_lookup *tl = arg;
+
+	if (parse_line(line, &tl->vma))
+		return -1;
+	if (tl->addr >= tl->vma.end)
+		return 0;
+	return tl->addr >= tl->vma.start ? 1 : -1;
+}
+
+static int text_lookup(uint64_t addr, struct vma *v)
+{
+	struct text_lookup tl = { .addr = addr };
+
+	if (for_each_maps_line(text_lookup_line, &tl) != 1)
+		return -1;
+	*v = tl.vma;
+	return 0;
+}
+
+static int query(uint64_t addr, uint64_t flags, struct vma *v)
+{
+	struct procmap_query q = {
+		.size		= sizeof(q),
+		.query_flags	= flags,
+		.query_addr	= addr,
+	};
+
+	if (ioctl(maps_fd, PROCMAP_QUERY, &q))
+		return -errno;
+
+	v->start = q.vma_start;
+	v->end = q.vma_end;
+	v->offset = q.vma_offset;
+	v->inode = q.inode;
+	v->dev_major = q.dev_major;
+	v->dev_minor = q.dev_minor;
+	v->flags = q.vma_flags;
+	return 0;
+}
+
+static int same_vma(const struct vma *a, const struct vma *b)
+{
+	return a->start == b->start && a->end == b->end &&
+	       a->offset == b->offset && a->inode == b->inode &&
+	       a->dev_major == b->dev_major && a->dev_minor == b->dev_minor &&
+	       a->flags == b->flags;
+}
+
+struct text_walk {
+	uint64_t next_addr;
+	long count;
+	int bad;
+};
+
+/* Every line of maps must be what the ioctl walk returns next */
+static int text_walk_line(const char *line, void *arg)
+{
+	struct text_walk *tw = arg;
+	struct vma text, ioc;
+
+	if (parse_line(line, &text))
+		return -1;
+	tw->count++;
+
+	/* The gate VMA of x86-64 is in maps but not an mm VMA */
+	if (query(tw->next_addr, PROCMAP_QUERY_COVERING_OR_NEXT_VMA, &ioc)) {
+		if (text.start < tw->next_addr)
+			tw->bad = 1;
+		return 0;
+	}
+	if (!same_vma(&text, &ioc)) {
+		ksft_print_msg("maps %" PRIx64 "-%" PRIx64 " ioctl %" PRIx64 "-%" PRIx64 "\n",
+			       text.start, text.end, ioc.start, ioc.end);
+		tw->bad = 1;
+		return 1;
+	}
+	tw->next_addr = ioc.end;
+	return 0;
+}
+
+static int count_line(const char *line, void *arg)
+{
+	(*(long *)arg)++;
+	return 0;
+}
+
+static char *create_vmas(long nr)
+{
+	char *p;
+	long i;
+
+	/* Every other page writable, so that none of the VMAs get merged */
+	p = mmap(NULL, nr * page_size, PROT_READ,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		ksft_exit_fail_msg("mmap: %s\n", strerror(errno));
+	for (i = 0; i < nr; i += 2)
+		if (mprotect(p + i * page_size, page_size,
+			     PROT_READ | PROT_WRITE))
+			ksft_exit_skip("mprotect: %s, vm.max_map_count too low?\n",
+				       strerror(errno));
+	return p;
+}
+
+static void check_filters(char *region)
+{
+	struct vma v;
+	int ret;
+
+	/* The first page of the region is writable, the second one is not */
+	ret = query((uintptr_t)region + page_size, PROCMAP_QUERY_VMA_WRITABLE, &v);
+	if (ret != -ENOENT)
+		ksft_exit_fail_msg("writable filter matched a read-only VMA\n");
+	ret = query((uintptr_t)region + page_size,
+		    PROCMAP_QUERY_VMA_WRITABLE | PROCMAP_QUERY_COVERING_OR_NEXT_VMA,
+		    &v);
+	if (ret || v.start != (uintptr_t)region + 2 * page_size)
+		ksft_exit_fail_msg("next writable VMA not found\n");
+	ret = query((uintptr_t)region, PROCMAP_QUERY_FILE_BACKED_VMA, &v);
+	if (ret != -ENOENT)
+		ksft_exit_fail_msg("file backed filter matched an anonymous VMA\n");
+	ret = query((uintptr_t)region, 1ULL << 63, &v);
+	if (ret != -EINVAL)
+		ksft_exit_fail_msg("unknown query flag accepted\n");
+}
+
+static void check_name(void)
+{
+	char name[4096], build_id[64];
+	struct procmap_query q = {
+		.size		= sizeof(q),
+		.query_addr	= (uintptr_t)check_name,
+		.vma_name_size	= sizeof(name),
+		.vma_name_addr	= (uintptr_t)name,
+		.build_id_size	= sizeof(build_id),
+		.build_id_addr	= (uintptr_t)build_id,
+	};
+	char exe[4096];
+	ssize_t len;
+
+	if (ioctl(maps_fd, PROCMAP_QUERY, &q))
+		ksft_exit_fail_msg("query text VMA: %s\n", strerror(errno));
+
+	len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (len < 0)
+		ksft_exit_fail_msg("readlink: %s\n", strerror(errno));
+	exe[len] = '\0';
+
+	if (q.vma_name_size != len + 1 || strcmp(name, exe))
+		ksft_exit_fail_msg("VMA name %s, expected %s\n", name, exe);
+	if (!(q.vma_flags & PROCMAP_QUERY_VMA_EXECUTABLE))
+		ksft_exit_fail_msg("text VMA not executable\n");
+	ksft_print_msg("text VMA %s, build ID of %u bytes\n", name,
+		       q.build_id_size);
+}
+
+int main(int argc, char **argv)
+{
+	long nr_vmas = 50000, lookups = 2000, maps_lines = 0, i;
+	uint64_t start, ioctl_ns, text_ns;
+	struct text_walk tw = { 0 };
+	struct vma a, b;
+	uint64_t addr;
+	char *region;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "v:n:")) != -1) {
+		switch (opt) {
+		case 'v':
+			nr_vmas = atol(optarg);
+			break;
+		case 'n':
+			lookups = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-v vmas] [-n lookups]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (nr_vmas < 2 || lookups <= 0)
+		ksft_exit_fail_msg("bad number of VMAs or lookups\n");
+
+	page_size = sysconf(_SC_PAGESIZE);
+	maps_fd = open("/proc/self/maps", O_RDONLY);
+	if (maps_fd < 0)
+		ksft_exit_fail_msg("open maps: %s\n", strerror(errno));
+	if (query(0, PROCMAP_QUERY_COVERING_OR_NEXT_VMA, &a) == -ENOTTY)
+		ksft_exit_skip("PROCMAP_QUERY not supported\n");
+
+	region = create_vmas(nr_vmas);
+	check_filters(region);
+	check_name();
+	srandom(1);
+
+	/* Lookups of random addresses in the region, checked against the text */
+	ioctl_ns = text_ns = 0;
+	for (i = 0; i < lookups; i++) {
+		addr = (uintptr_t)region + random() % (nr_vmas * page_size);
+
+		start = now_ns();
+		if (query(addr, 0, &a))
+			ksft_exit_fail_msg("no VMA at %" PRIx64 "\n", addr);
+		ioctl_ns += now_ns() - start;
+
+		start = now_ns();
+		if (text_lookup(addr, &b))
+			ksft_exit_fail_msg("no VMA at %" PRIx64 " in maps\n", addr);
+		text_ns += now_ns() - start;
+
+		if (!same_vma(&a, &b))
+			ksft_exit_fail_msg("ioctl and maps disagree at %" PRIx64 "\n",
+					   addr);
+	}
+	printf("lookup of %ld addresses, %ld VMAs: ioctl %8.2f us  maps text %10.2f us per lookup\n",
+	       lookups, nr_vmas, ioctl_ns / 1000.0 / lookups,
+	       text_ns / 1000.0 / lookups);
+
+	/* Full walks, then a pass that checks the ioctl walk line by line */
+	start = now_ns();
+	for (addr = 0, i = 0; !query(addr, PROCMAP_QUERY_COVERING_OR_NEXT_VMA, &a); i++)
+		addr = a.end;
+	ioctl_ns = now_ns() - start;
+
+	start = now_ns();
+	for_each_maps_line(count_line, &maps_lines);
+	text_ns = now_ns() - start;
+
+	printf("walk of %ld VMAs: ioctl %8.2f ms  maps text %8.2f ms (%ld lines)\n",
+	       i, ioctl_ns / 1e6, text_ns / 1e6, maps_lines);
+
+	for_each_maps_line(text_walk_line, &tw);
+	if (tw.bad || tw.count != maps_lines)
+		ksft_exit_fail_msg("ioctl walk doesn't match maps\n");
+
+	munmap(region, nr_vmas * page_size);
+	close(maps_fd);
+	return KSFT_PASS;
+}
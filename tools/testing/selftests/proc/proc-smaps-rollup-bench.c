@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Read latency of /proc/self/smaps_rollup for a process with a lot of
+ * resident memory, in the default "full" mode that walks all page tables,
+ * in "rss" mode that only reads the RSS counters and in "cached" mode that
+ * reuses the stats of unchanged VMAs from the previous read.  While reading,
+ * another thread maps and unmaps a page in a loop, to show how much the
+ * reads hold up mmap_lock writers.  Every read is checked to report at
+ * least the memory touched.
+ *
+ * Usage: proc-smaps-rollup-bench [-g size_gb] [-n reads]
+ *
+ * The default size is 64 GiB of anonymous memory, all of it is touched, so
+ * pick a size that fits in the RAM of the machine.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../kselftest.h"
+
+#define CHUNK		(64UL << 20)
+
+static long page_size;
+static volatile int stop;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 64 MiB chunks, each followed by a PROT_NONE page so they aren't merged */
+static void create_memory(unsigned long size)
+{
+	unsigned long i, nr = size / CHUNK;
+	char *p;
+
+	for (i = 0; i < nr; i++) {
+		p = mmap(NULL, CHUNK + page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+			ksft_exit_skip("mmap: %s\n", strerror(errno));
+		if (mprotect(p + CHUNK, page_size, PROT_NONE))
+			ksft_exit_fail_msg("mprotect: %s\n", strerror(errno));
+		memset(p, 1, CHUNK);
+	}
+}
+
+static void *contender(void *arg)
+{
+	unsigned long *ops = arg;
+	void *p;
+
+	while (!stop) {
+		p = mmap(NULL, page_size, PROT_READ,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED)
+			munmap(p, page_size);
+		(*ops)++;
+	}
+	return NULL;
+}
+
+static unsigned long read_rss_kb(int fd)
+{
+	static char buf[4096];
+	ssize_t n;
+	char *rss;
+
+	n = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (n <= 0)
+		ksft_exit_fail_msg("read smaps_rollup: %s\n", strerror(errno));
+	buf[n] = '\0';
+
+	rss = strstr(buf, "\nRss:");
+	if (!rss)
+		ksft_exit_fail_msg("no Rss in smaps_rollup:\n%s", buf);
+	return strtoul(rss + strlen("\nRss:"), NULL, 10);
+}
+
+static int bench(const char *mode, unsigned long size, int reads)
+{
+	uint64_t start, t, min = UINT64_MAX, max = 0, total = 0;
+	unsigned long ops = 0, rss_kb;
+	pthread_t tid;
+	int fd, i, ret = 0;
+
+	fd = open("/proc/self/smaps_rollup", O_RDWR);
+	if (fd < 0)
+		ksft_exit_skip("open smaps_rollup for write: %s\n",
+			       strerror(errno));
+	if (write(fd, mode, strlen(mode)) != strlen(mode))
+		ksft_exit_skip("smaps_rollup mode \"%s\": %s\n", mode,
+			       strerror(errno));
+
+	stop = 0;
+	if (pthread_create(&tid, NULL, contender, &ops))
+		ksft_exit_fail_msg("pthread_create failed\n");
+
+	for (i = 0; i < reads; i++) {
+		start = now_ns();
+		rss_kb = read_rss_kb(fd);
+		t = now_ns() - start;
+
+		if (rss_kb < size >> 10) {
+			ksft_print_msg("%s: Rss %lu kB, touched %lu kB\n",
+				       mode, rss_kb, size >> 10);
+			ret = -1;
+		}
+		if (t < min)
+			min = t;
+		if (t > max)
+			max = t;
+		total += t;
+	}
+
+	stop = 1;
+	pthread_join(tid, NULL);
+	close(fd);
+
+	printf("%-12s read: min %10.1f us  avg %10.1f us  max %10.1f us  mmap+munmap: %8.0f/s\n",
+	       mode, min / 1e3, total / 1e3 / reads, max / 1e3,
+	       ops * 1e9 / total);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long size_gb = 64;
+	int reads = 20, opt, ret;
+
+	while ((opt = getopt(argc, argv, "g:n:")) != -1) {
+		switch (opt) {
+		case 'g':
+			size_gb = atol(optarg);
+			break;
+		case 'n':
+			reads = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-g size_gb] [-n reads]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (!size_gb || reads <= 0)
+		ksft_exit_fail_msg("bad size or number of reads\n");
+
+	page_size = sysconf(_SC_PAGESIZE);
+	create_memory(size_gb << 30);
+
+	ret = bench("full", size_gb << 30, reads);
+	ret |= bench("rss", size_gb << 30, reads);
+	ret |= bench("cached 1000", size_gb << 30, reads);
+
+	return ret ? KSFT_FAIL : KSFT_PASS;
+}
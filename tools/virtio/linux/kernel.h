@@ -8,6 +8,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <limits.h>
 
 #include <linux/compiler.h>
 #include <linux/types.h>
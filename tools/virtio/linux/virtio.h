@@ -34,6 +34,18 @@ int virtqueue_add_sgs(struct virtqueue *vq,
 		      void *data,
 		      gfp_t gfp);
 
+struct virtqueue_buf {
+	struct scatterlist **sgs;
+	unsigned int out_sgs;
+	unsigned int in_sgs;
+	void *data;
+};
+
+int virtqueue_add_sgs_batch(struct virtqueue *vq,
+			    struct virtqueue_buf *bufs,
+			    unsigned int num,
+			    gfp_t gfp);
+
 int virtqueue_add_outbuf(struct virtqueue *vq,
 			 struct scatterlist sg[], unsigned int num,
 			 void *data,
@@ -48,6 +60,9 @@ bool virtqueue_kick(struct virtqueue *vq);
 
 void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len);
 
+unsigned int virtqueue_get_bufs(struct virtqueue *vq, void **bufs,
+				unsigned int *lens, unsigned int num);
+
 void virtqueue_disable_cb(struct virtqueue *vq);
 
 bool virtqueue_enable_cb(struct virtqueue *vq);
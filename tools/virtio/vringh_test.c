@@ -15,6 +15,7 @@
 #include <sys/mman.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <time.h>
 
 #define USER_MEM (1024*1024)
 void *__user_addr_min, *__user_addr_max;
@@ -86,6 +87,13 @@ static bool no_notify_host(struct virtqueue *vq)
 }
 
 #define NUM_XFERS (10000000)
+#define MAX_BATCH 64
+
+/*
+ * With VIRTIO_F_IN_ORDER, the host writes a single used entry for up to
+ * this many buffers.
+ */
+#define HOST_IN_ORDER_BATCH 16
 
 /* We aim for two "distant" cpus. */
 static void find_cpus(unsigned int *first, unsigned int *last)
@@ -133,10 +141,53 @@ static inline int vringh_get_head(struct vringh *vrh, u16 *head)
 	return 1;
 }
 
+/* Build the sg list of transfer @xfer, as seen by the host. */
+static unsigned int xfer_sg(struct scatterlist *sg, int *dbuf,
+			    unsigned long xfer)
+{
+	unsigned int num_sg;
+
+	switch ((xfer / sizeof(*dbuf)) % 4) {
+	case 0:
+		/* Nasty three-element sg list. */
+		sg_init_table(sg, num_sg = 3);
+		sg_set_buf(&sg[0], (void *)dbuf, 1);
+		sg_set_buf(&sg[1], (void *)dbuf + 1, 2);
+		sg_set_buf(&sg[2], (void *)dbuf + 3, 1);
+		break;
+	case 1:
+		sg_init_table(sg, num_sg = 2);
+		sg_set_buf(&sg[0], (void *)dbuf, 1);
+		sg_set_buf(&sg[1], (void *)dbuf + 1, 3);
+		break;
+	case 2:
+		sg_init_table(sg, num_sg = 1);
+		sg_set_buf(&sg[0], (void *)dbuf, 4);
+		break;
+	default:
+		sg_init_table(sg, num_sg = 4);
+		sg_set_buf(&sg[0], (void *)dbuf, 1);
+		sg_set_buf(&sg[1], (void *)dbuf + 1, 1);
+		sg_set_buf(&sg[2], (void *)dbuf + 2, 1);
+		sg_set_buf(&sg[3], (void *)dbuf + 3, 1);
+		break;
+	}
+	return num_sg;
+}
+
+static unsigned long elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000000UL
+		+ now.tv_nsec - start->tv_nsec;
+}
+
 static int parallel_test(u64 features,
 			 bool (*getrange)(struct vringh *vrh,
 					  u64 addr, struct vringh_range *r),
-			 bool fast_vringh)
+			 bool fast_vringh, unsigned int batch)
 {
 	void *host_map, *guest_map;
 	int fd, mapsize, to_guest[2], to_host[2];
@@ -173,6 +224,15 @@ static int parallel_test(u64 features,
 		struct vringh vrh;
 		int status, err, rlen = 0;
 		char rbuf[5];
+		/*
+		 * The fast path doesn't write the data, so the guest can't
+		 * be told the buffers before the last of a batch are full.
+		 */
+		bool in_order = !fast_vringh &&
+				(features & (1ULL << VIRTIO_F_IN_ORDER));
+		unsigned int pending = 0;
+		u16 last_head = 0;
+		u32 last_written = 0;
 
 		/* We are the host: never access guest addresses! */
 		munmap(guest_map, mapsize);
@@ -227,6 +287,15 @@ static int parallel_test(u64 features,
 							  getrange, &head);
 			}
 			if (err == 0) {
+				/* Publish the batch before waiting for more. */
+				if (pending) {
+					err = vringh_complete_user(&vrh,
+							last_head, last_written);
+					if (err != 0)
+						errx(1, "vringh_complete_user: %i",
+						     err);
+					pending = 0;
+				}
 				err = vringh_need_notify_user(&vrh);
 				if (err < 0)
 					errx(1, "vringh_need_notify_user: %i",
@@ -270,6 +339,16 @@ static int parallel_test(u64 features,
 		complete:
 			xfers++;
 
+			/* One used entry, for the last buffer, per batch. */
+			if (in_order) {
+				last_head = head;
+				last_written = written;
+				if (++pending < HOST_IN_ORDER_BATCH &&
+				    xfers < NUM_XFERS)
+					continue;
+				pending = 0;
+			}
+
 			err = vringh_complete_user(&vrh, head, written);
 			if (err != 0)
 				errx(1, "vringh_complete_user: %i", err);
@@ -295,6 +374,8 @@ static int parallel_test(u64 features,
 		unsigned int *data;
 		struct vring_desc *indirects;
 		unsigned int finished = 0;
+		struct timespec start;
+		unsigned long ns;
 
 		/* We pass sg[]s pointing into here, but we need RINGSIZE+1 */
 		data = guest_map + vring_size(RINGSIZE, ALIGN);
@@ -325,7 +406,62 @@ static int parallel_test(u64 features,
 		__kfree_ignore_start = indirects;
 		__kfree_ignore_end = indirects + RINGSIZE * 6;
 
-		while (xfers < NUM_XFERS) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		while (batch && xfers < NUM_XFERS) {
+			struct scatterlist sg[MAX_BATCH][4], *sgs[MAX_BATCH];
+			struct virtqueue_buf bufs[MAX_BATCH];
+			unsigned int lens[MAX_BATCH];
+			int *dbufs[MAX_BATCH];
+			unsigned int i, n;
+			int err;
+
+			/* Consume bufs, a batch at a time. */
+			while ((n = virtqueue_get_bufs(vq, (void **)dbufs, lens,
+						       batch)) != 0) {
+				for (i = 0; i < n; i++) {
+					if (lens[i] == 4)
+						assert(*dbufs[i] == finished - 1);
+					else if (!fast_vringh)
+						assert(*dbufs[i] == finished);
+					finished++;
+				}
+			}
+
+			/* Produce a batch of buffers, kick once. */
+			for (i = 0; i < batch && xfers + i < NUM_XFERS; i++) {
+				bool output = !((xfers + i) % 2);
+				int *dbuf = data + ((xfers + i) % (RINGSIZE + 1));
+
+				*dbuf = output ? xfers + i : -1;
+				xfer_sg(sg[i], dbuf, xfers + i);
+				sgs[i] = sg[i];
+				bufs[i].sgs = &sgs[i];
+				bufs[i].out_sgs = output;
+				bufs[i].in_sgs = !output;
+				bufs[i].data = dbuf;
+			}
+
+			err = virtqueue_add_sgs_batch(vq, bufs, i, GFP_KERNEL);
+			if (err == -ENOSPC) {
+				if (!virtqueue_enable_cb_delayed(vq))
+					continue;
+				/* Swallow all notifies at once. */
+				if (read(to_guest[0], buf, sizeof(buf)) < 1)
+					break;
+
+				receives++;
+				virtqueue_disable_cb(vq);
+				continue;
+			}
+
+			if (err < 0)
+				errx(1, "virtqueue_add_sgs_batch: %i", err);
+
+			xfers += err;
+			virtqueue_kick(vq);
+		}
+
+		while (!batch && xfers < NUM_XFERS) {
 			struct scatterlist sg[4];
 			unsigned int num_sg, len;
 			int *dbuf, err;
@@ -348,31 +484,7 @@ static int parallel_test(u64 features,
 			else
 				*dbuf = -1;
 
-			switch ((xfers / sizeof(*dbuf)) % 4) {
-			case 0:
-				/* Nasty three-element sg list. */
-				sg_init_table(sg, num_sg = 3);
-				sg_set_buf(&sg[0], (void *)dbuf, 1);
-				sg_set_buf(&sg[1], (void *)dbuf + 1, 2);
-				sg_set_buf(&sg[2], (void *)dbuf + 3, 1);
-				break;
-			case 1:
-				sg_init_table(sg, num_sg = 2);
-				sg_set_buf(&sg[0], (void *)dbuf, 1);
-				sg_set_buf(&sg[1], (void *)dbuf + 1, 3);
-				break;
-			case 2:
-				sg_init_table(sg, num_sg = 1);
-				sg_set_buf(&sg[0], (void *)dbuf, 4);
-				break;
-			case 3:
-				sg_init_table(sg, num_sg = 4);
-				sg_set_buf(&sg[0], (void *)dbuf, 1);
-				sg_set_buf(&sg[1], (void *)dbuf + 1, 1);
-				sg_set_buf(&sg[2], (void *)dbuf + 2, 1);
-				sg_set_buf(&sg[3], (void *)dbuf + 3, 1);
-				break;
-			}
+			num_sg = xfer_sg(sg, dbuf, xfers);
 
 			/* May allocate an indirect, so force it to allocate
 			 * user addr */
@@ -428,8 +540,12 @@ static int parallel_test(u64 features,
 			virtqueue_disable_cb(vq);
 		}
 
+		ns = elapsed_ns(&start);
 		printf("Guest: notified %lu, pinged %lu\n",
 		       gvdev.notifies, receives);
+		printf("Guest: %lu xfers in %lu.%03lu s, %lu ns per xfer\n",
+		       xfers, ns / 1000000000UL, ns / 1000000UL % 1000,
+		       ns / xfers);
 		vring_del_virtqueue(vq);
 		return 0;
 	}
@@ -451,6 +567,7 @@ int main(int argc, char *argv[])
 	void *ret;
 	bool (*getrange)(struct vringh *vrh, u64 addr, struct vringh_range *r);
 	bool fast_vringh = false, parallel = false;
+	unsigned int batch = 0;
 
 	getrange = getrange_iov;
 	vdev.features = 0;
@@ -463,19 +580,30 @@ int main(int argc, char *argv[])
 			__virtio_set_bit(&vdev, VIRTIO_RING_F_EVENT_IDX);
 		else if (strcmp(argv[1], "--virtio-1") == 0)
 			__virtio_set_bit(&vdev, VIRTIO_F_VERSION_1);
+		else if (strcmp(argv[1], "--in-order") == 0)
+			__virtio_set_bit(&vdev, VIRTIO_F_IN_ORDER);
 		else if (strcmp(argv[1], "--slow-range") == 0)
 			getrange = getrange_slow;
 		else if (strcmp(argv[1], "--fast-vringh") == 0)
 			fast_vringh = true;
 		else if (strcmp(argv[1], "--parallel") == 0)
 			parallel = true;
+		else if (strncmp(argv[1], "--batch=", 8) == 0)
+			batch = atoi(argv[1] + 8);
 		else
 			errx(1, "Unknown arg %s", argv[1]);
 		argv++;
 	}
 
+	/* Every indirect of a batch would get the same __kmalloc_fake. */
+	if (batch && virtio_has_feature(&vdev, VIRTIO_RING_F_INDIRECT_DESC))
+		errx(1, "--batch can't be used with --indirect");
+	if (batch > MAX_BATCH)
+		errx(1, "--batch can't be more than %u", MAX_BATCH);
+
 	if (parallel)
-		return parallel_test(vdev.features, getrange, fast_vringh);
+		return parallel_test(vdev.features, getrange, fast_vringh,
+				     batch);
 
 	if (posix_memalign(&__user_addr_min, PAGE_SIZE, USER_MEM) != 0)
 		abort();